@@ -55,6 +55,38 @@ ApplicationWindow {
             ToolTip.text: "Open a 3D model into the canvas"
         }
 
+        ComboBox {
+            id: pickingModeCombobox
+            width: 200
+            model: ["ID buffer picking", "Exact picking", "Cell picker"]
+            currentIndex: 0
+            anchors.right: parent.right
+            anchors.bottom: openFileButton.top
+            anchors.rightMargin: 50
+            anchors.bottomMargin: 20
+
+            onActivated: canvasHandler.setPickingMode(currentIndex);
+
+            ToolTip.visible: hovered
+            ToolTip.delay: 1000
+            ToolTip.text: "How the clicks select the models"
+        }
+
+        Button {
+            id: duplicateModelButton
+            text: "Duplicate"
+            visible: canvasHandler.isModelSelected
+            anchors.right: openFileButton.left
+            anchors.bottom: parent.bottom
+            anchors.bottomMargin: 50
+            anchors.rightMargin: 20
+            onClicked: canvasHandler.duplicateSelectedModel();
+
+            ToolTip.visible: hovered
+            ToolTip.delay: 1000
+            ToolTip.text: "Add a copy of the selected model, sharing its geometry"
+        }
+
         ComboBox {
             id: representationCombobox
             visible: canvasHandler.isModelSelected
@@ -136,6 +168,94 @@ ApplicationWindow {
             anchors.topMargin: 25
         }
 
+        Button {
+            id: colorModelButton
+            text: "Apply color"
+            visible: canvasHandler.isModelSelected
+            anchors.left: parent.left
+            anchors.top: modelColorB.bottom
+            anchors.leftMargin: 40
+            anchors.topMargin: 25
+            onClicked: canvasHandler.colorSelectedModel(modelColorR.value, modelColorG.value, modelColorB.value);
+
+            ToolTip.visible: hovered
+            ToolTip.delay: 1000
+            ToolTip.text: "Give the selected model this color, shown once it is not selected anymore"
+        }
+
+        Column {
+            id: modelsLoadingPanel
+            visible: canvasHandler.isLoadingModels
+            spacing: 8
+            anchors.horizontalCenter: parent.horizontalCenter
+            anchors.bottom: parent.bottom
+            anchors.bottomMargin: 50
+
+            Label {
+                text: canvasHandler.modelsLoadingStatus
+                font.pixelSize: 12
+                anchors.horizontalCenter: parent.horizontalCenter
+            }
+
+            ProgressBar {
+                width: 300
+                from: 0
+                to: 1
+                value: canvasHandler.modelsLoadingProgress
+            }
+        }
+
+        Column {
+            id: memoryUsagePanel
+            visible: canvasHandler.modelsCount > 0
+            spacing: 4
+            anchors.right: parent.right
+            anchors.top: parent.top
+            anchors.rightMargin: 40
+            anchors.topMargin: 30
+
+            function formatBytes(bytes) {
+                return (bytes / (1024 * 1024)).toFixed(1) + " MB";
+            }
+
+            Label {
+                text: "Models: " + canvasHandler.modelsCount + " - " + memoryUsagePanel.formatBytes(canvasHandler.memoryModelsBytes)
+                font.pixelSize: 12
+                anchors.right: parent.right
+            }
+
+            Label {
+                text: "Points " + memoryUsagePanel.formatBytes(canvasHandler.memoryPointsBytes)
+                      + ", connectivity " + memoryUsagePanel.formatBytes(canvasHandler.memoryConnectivityBytes)
+                      + ", normals " + memoryUsagePanel.formatBytes(canvasHandler.memoryNormalsBytes)
+                      + ", intermediates " + memoryUsagePanel.formatBytes(canvasHandler.memoryIntermediatesBytes)
+                font.pixelSize: 11
+                anchors.right: parent.right
+            }
+
+            Label {
+                text: "GPU (estimated) " + memoryUsagePanel.formatBytes(canvasHandler.memoryGpuBytes)
+                font.pixelSize: 11
+                anchors.right: parent.right
+            }
+
+            Label {
+                text: "Process " + memoryUsagePanel.formatBytes(canvasHandler.memoryProcessBytes)
+                      + " / budget " + memoryUsagePanel.formatBytes(canvasHandler.memoryBudgetBytes)
+                font.pixelSize: 12
+                font.bold: canvasHandler.memoryOverBudget
+                color: canvasHandler.memoryOverBudget ? Material.color(Material.Red) : Material.foreground
+                anchors.right: parent.right
+            }
+
+            Label {
+                text: "Frames rendered " + canvasHandler.framesRendered + ", skipped " + canvasHandler.framesSkipped
+                      + ", requests collapsed " + canvasHandler.frameRequestsCollapsed
+                font.pixelSize: 11
+                anchors.right: parent.right
+            }
+        }
+
         Label {
             id: positionLabelX
             visible: canvasHandler.isModelSelected
@@ -157,16 +277,36 @@ ApplicationWindow {
         }
     }
 
+    Shortcut {
+        sequence: "Ctrl+Shift+T"
+        onActivated: canvasHandler.writeFrameTrace()
+    }
+
+    MessageDialog {
+        id: modelLoadingErrorDialog
+        title: "Unable to open the model"
+        icon: StandardIcon.Warning
+    }
+
+    Connections {
+        target: canvasHandler
+        onModelLoadingFailed: {
+            modelLoadingErrorDialog.text = error;
+            modelLoadingErrorDialog.open();
+        }
+    }
+
     FileDialog {
         id: openModelsFileDialog
         visible: canvasHandler.showFileDialog
-        title: "Import model"
+        title: "Import models"
         folder: shortcuts.documents
+        selectMultiple: true
         nameFilters: ["Model files" + "(*.stl *.STL *.obj *.OBJ)", "All files" + "(*)"]
 
         onAccepted: {
             canvasHandler.showFileDialog = false;
-            canvasHandler.openModel(fileUrl);
+            canvasHandler.addModelsFromFiles(fileUrls);
         }
         onRejected: {
             canvasHandler.showFileDialog = false;
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstring>
+
+#include <QDebug>
+#include <QFile>
+
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkFloatArray.h>
+#include <vtkPoints.h>
+
+#include "BinarySTLReader.h"
+
+
+static const qint64 STL_HEADER_SIZE = 80;
+static const qint64 STL_TRIANGLES_OFFSET = STL_HEADER_SIZE + sizeof(uint32_t);
+static const qint64 STL_TRIANGLE_SIZE = 12 * sizeof(float) + sizeof(uint16_t);
+
+// Triangles between two progress reports, about 64MB of file
+static const vtkIdType STL_PROGRESS_TRIANGLES = (64 << 20) / STL_TRIANGLE_SIZE;
+
+
+vtkSmartPointer<vtkPolyData> BinarySTLReader::read(const QString &filePath, const ReadProgress_t &readProgress)
+{
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << "BinarySTLReader::read(): unable to open" << filePath;
+		return nullptr;
+	}
+
+	const qint64 fileSize = file.size();
+	const uchar *data = fileSize >= STL_TRIANGLES_OFFSET ? file.map(0, fileSize) : nullptr;
+
+	uint32_t trianglesCount = 0;
+
+	if (!data || !isBinarySTL(data, fileSize, trianglesCount))
+	{
+		return nullptr;
+	}
+
+	// Pre-sized output arrays: three points per triangle (the file is a triangle soup) and the face normals
+	vtkSmartPointer<vtkFloatArray> pointsData = vtkSmartPointer<vtkFloatArray>::New();
+	pointsData->SetNumberOfComponents(3);
+	pointsData->SetNumberOfTuples(3 * static_cast<vtkIdType>(trianglesCount));
+	float *pointsPointer = pointsData->GetPointer(0);
+
+	vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+	normals->SetName("Normals");
+	normals->SetNumberOfComponents(3);
+	normals->SetNumberOfTuples(trianglesCount);
+	float *normalsPointer = normals->GetPointer(0);
+
+	vtkSmartPointer<vtkCellArray> triangles = vtkSmartPointer<vtkCellArray>::New();
+	vtkIdType *trianglesPointer = triangles->WritePointer(trianglesCount, 4 * static_cast<vtkIdType>(trianglesCount));
+
+	const uchar *triangle = data + STL_TRIANGLES_OFFSET;
+
+	for (vtkIdType i = 0; i < trianglesCount; ++i)
+	{
+		// Normal followed by the three vertices, the records are not aligned
+		std::memcpy(normalsPointer + 3 * i, triangle, 3 * sizeof(float));
+		std::memcpy(pointsPointer + 9 * i, triangle + 3 * sizeof(float), 9 * sizeof(float));
+
+		trianglesPointer[4 * i] = 3;
+		trianglesPointer[4 * i + 1] = 3 * i;
+		trianglesPointer[4 * i + 2] = 3 * i + 1;
+		trianglesPointer[4 * i + 3] = 3 * i + 2;
+
+		triangle += STL_TRIANGLE_SIZE;
+
+		if (readProgress && (i + 1) % STL_PROGRESS_TRIANGLES == 0)
+		{
+			readProgress(triangle - data);
+		}
+	}
+
+	file.unmap(const_cast<uchar*>(data));
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetData(pointsData);
+
+	vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+	polyData->SetPoints(points);
+	polyData->SetPolys(triangles);
+	polyData->GetCellData()->SetNormals(normals);
+
+	qDebug() << "BinarySTLReader::read():" << trianglesCount << "triangles read from" << filePath;
+
+	return polyData;
+}
+
+vtkSmartPointer<vtkPolyData> BinarySTLReader::readSample(const QString &filePath, const uint32_t maximumTriangles)
+{
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return nullptr;
+	}
+
+	const qint64 fileSize = file.size();
+	const uchar *data = fileSize >= STL_TRIANGLES_OFFSET ? file.map(0, fileSize) : nullptr;
+
+	uint32_t trianglesCount = 0;
+
+	if (!data || !isBinarySTL(data, fileSize, trianglesCount) || trianglesCount == 0 || maximumTriangles == 0)
+	{
+		return nullptr;
+	}
+
+	const uint32_t stride = std::max<uint32_t>(trianglesCount / maximumTriangles, 1);
+	const vtkIdType sampledTrianglesCount = (trianglesCount + stride - 1) / stride;
+
+	vtkSmartPointer<vtkFloatArray> pointsData = vtkSmartPointer<vtkFloatArray>::New();
+	pointsData->SetNumberOfComponents(3);
+	pointsData->SetNumberOfTuples(3 * sampledTrianglesCount);
+	float *pointsPointer = pointsData->GetPointer(0);
+
+	vtkSmartPointer<vtkCellArray> vertices = vtkSmartPointer<vtkCellArray>::New();
+	vtkIdType *verticesPointer = vertices->WritePointer(3 * sampledTrianglesCount, 6 * sampledTrianglesCount);
+
+	for (vtkIdType i = 0; i < sampledTrianglesCount; ++i)
+	{
+		const uchar *triangle = data + STL_TRIANGLES_OFFSET + STL_TRIANGLE_SIZE * static_cast<qint64>(i) * stride;
+		std::memcpy(pointsPointer + 9 * i, triangle + 3 * sizeof(float), 9 * sizeof(float));
+
+		for (vtkIdType corner = 0; corner < 3; ++corner)
+		{
+			verticesPointer[6 * i + 2 * corner] = 1;
+			verticesPointer[6 * i + 2 * corner + 1] = 3 * i + corner;
+		}
+	}
+
+	file.unmap(const_cast<uchar*>(data));
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetData(pointsData);
+
+	vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+	polyData->SetPoints(points);
+	polyData->SetVerts(vertices);
+
+	return polyData;
+}
+
+bool BinarySTLReader::isBinarySTL(const uchar *data, const qint64 size, uint32_t &trianglesCount)
+{
+	std::memcpy(&trianglesCount, data + STL_HEADER_SIZE, sizeof(uint32_t));
+
+	const qint64 expectedSize = STL_TRIANGLES_OFFSET + STL_TRIANGLE_SIZE * static_cast<qint64>(trianglesCount);
+
+	if (size == expectedSize)
+	{
+		return true;
+	}
+
+	// ASCII files start with "solid", some binary exporters also write it in the header but then the size matches
+	if (std::strncmp(reinterpret_cast<const char*>(data), "solid", 5) == 0)
+	{
+		return false;
+	}
+
+	// Some exporters append data after the triangles
+	return (trianglesCount > 0 && size > expectedSize);
+}
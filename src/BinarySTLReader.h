@@ -0,0 +1,33 @@
+#ifndef BINARYSTLREADER_H
+#define BINARYSTLREADER_H
+
+#include <cstdint>
+#include <functional>
+
+#include <QString>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+
+// Fast path for binary STL files.
+// The file is memory mapped and the points, triangles and face normals are written in one pass
+// into pre-sized arrays, without the intermediate structures and point merging of vtkSTLReader.
+// Returns nullptr if the file is not a binary STL, so the caller can fall back to vtkSTLReader.
+class BinarySTLReader
+{
+public:
+	// Called during the read with the number of bytes processed so far
+	typedef std::function<void(const qint64 bytesRead)> ReadProgress_t;
+
+	static vtkSmartPointer<vtkPolyData> read(const QString &filePath, const ReadProgress_t &readProgress = nullptr);
+
+	// Vertices of at most maximumTriangles triangles evenly sampled from the file, as a points cloud.
+	// Only touches the sampled records, used to preview huge files before they are read.
+	static vtkSmartPointer<vtkPolyData> readSample(const QString &filePath, const uint32_t maximumTriangles);
+
+private:
+	static bool isBinarySTL(const uchar *data, const qint64 size, uint32_t &trianglesCount);
+};
+
+#endif // BINARYSTLREADER_H
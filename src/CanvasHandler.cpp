@@ -1,10 +1,17 @@
+#include <algorithm>
+
 #include <QApplication>
+#include <QColor>
 #include <QDebug>
+#include <QDir>
 #include <QIcon>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 #include <QQuickStyle>
+#include <QTimer>
 
+#include "CommandModelAdd.h"
+#include "FrameProfiler.h"
 #include "Model.h"
 #include "ProcessingEngine.h"
 #include "QVTKFramebufferObjectItem.h"
@@ -12,6 +19,8 @@
 #include "CanvasHandler.h"
 
 
+static const int MEMORY_USAGE_REFRESH_INTERVAL = 1000;
+
 CanvasHandler::CanvasHandler(int argc, char **argv)
 {
 	QApplication app(argc, argv);
@@ -52,6 +61,10 @@ CanvasHandler::CanvasHandler(int argc, char **argv)
 		connect(m_vtkFboItem, &QVTKFramebufferObjectItem::isModelSelectedChanged, this, &CanvasHandler::isModelSelectedChanged);
 		connect(m_vtkFboItem, &QVTKFramebufferObjectItem::selectedModelPositionXChanged, this, &CanvasHandler::selectedModelPositionXChanged);
 		connect(m_vtkFboItem, &QVTKFramebufferObjectItem::selectedModelPositionYChanged, this, &CanvasHandler::selectedModelPositionYChanged);
+		connect(m_vtkFboItem, &QVTKFramebufferObjectItem::addModelFromFileProgress, this, &CanvasHandler::setModelLoadingProgress);
+		connect(m_vtkFboItem, &QVTKFramebufferObjectItem::addModelFromFilePreprocessingProgress, this, &CanvasHandler::setModelLoadingPreprocessingProgress);
+		connect(m_vtkFboItem, &QVTKFramebufferObjectItem::addModelFromFileStageChanged, this, &CanvasHandler::setModelLoadingStage);
+		connect(m_vtkFboItem, &QVTKFramebufferObjectItem::addModelFromFileError, this, &CanvasHandler::modelLoadingFailed);
 	}
 	else
 	{
@@ -59,9 +72,20 @@ CanvasHandler::CanvasHandler(int argc, char **argv)
 		return;
 	}
 
+	// Polled: the models memory changes on loads, duplicates, levels of detail and interpolation changes.
+	// The residency manager enforces the memory budget from the same report.
+	QTimer memoryUsageTimer;
+	connect(&memoryUsageTimer, &QTimer::timeout, this, &CanvasHandler::updateMemoryUsage);
+	connect(&memoryUsageTimer, &QTimer::timeout, this, &CanvasHandler::updateFrameStats);
+	memoryUsageTimer.start(MEMORY_USAGE_REFRESH_INTERVAL);
+
 	int rc = app.exec();
 
 	qDebug() << "CanvasHandler::CanvasHandler: Execution finished with return code:" << rc;
+
+#ifdef QTVTK_FRAME_PROFILER
+	this->writeFrameTrace();
+#endif
 }
 
 
@@ -77,21 +101,274 @@ void CanvasHandler::openModel(const QUrl &path) const
 {
 	qDebug() << "CanvasHandler::openModel():" << path;
 
-	QUrl localFilePath;
+	m_vtkFboItem->addModelFromFile(this->getLocalFilePath(path));
+}
+
+void CanvasHandler::addModelsFromFiles(const QList<QUrl> &paths) const
+{
+	qDebug() << "CanvasHandler::addModelsFromFiles():" << paths.size() << "files";
+
+	QList<QUrl> localFilePaths;
+
+	for (const QUrl &path : paths)
+	{
+		QUrl localFilePath = this->getLocalFilePath(path);
+
+		if (!this->isModelExtensionValid(localFilePath))
+		{
+			qWarning() << "CanvasHandler::addModelsFromFiles(): skipping unsupported file" << localFilePath;
+			continue;
+		}
+
+		localFilePaths.append(localFilePath);
+	}
+
+	if (!localFilePaths.isEmpty())
+	{
+		m_vtkFboItem->addModelsFromFiles(localFilePaths);
+	}
+}
+
+void CanvasHandler::duplicateSelectedModel() const
+{
+	qDebug() << "CanvasHandler::duplicateSelectedModel()";
+
+	m_vtkFboItem->duplicateSelectedModel();
+}
+
+void CanvasHandler::colorSelectedModel(const int colorR, const int colorG, const int colorB) const
+{
+	qDebug() << "CanvasHandler::colorSelectedModel()";
+
+	m_vtkFboItem->colorSelectedModel(QColor(colorR, colorG, colorB));
+}
+
+bool CanvasHandler::writeFrameTrace() const
+{
+#ifdef QTVTK_FRAME_PROFILER
+	return FRAME_PROFILER_WRITE_TRACE(this->getFrameTraceFilePath());
+#else
+	qDebug() << "CanvasHandler::writeFrameTrace(): frame profiler not built, enable QTVTK_FRAME_PROFILER";
+	return false;
+#endif
+}
 
+QString CanvasHandler::getFrameTraceFilePath() const
+{
+	// Overridden by the environment, e.g. to collect the traces of automated runs
+	const QString frameTraceFilePath = QString::fromLocal8Bit(qgetenv("QTVTK_FRAME_TRACE"));
+
+	return frameTraceFilePath.isEmpty() ? QDir::temp().filePath("qtvtk_frame_trace.json") : frameTraceFilePath;
+}
+
+QUrl CanvasHandler::getLocalFilePath(const QUrl &path) const
+{
 	if (path.isLocalFile())
 	{
 		// Remove the "file:///" if present
-		localFilePath = path.toLocalFile();
+		return path.toLocalFile();
+	}
+
+	return path;
+}
+
+void CanvasHandler::setModelLoadingProgress(const quint64 loadId, const qint64 bytesRead, const qint64 bytesTotal)
+{
+	ModelLoading_t &modelLoading = m_modelsLoading[loadId];
+
+	// The parsing threads may report out of order
+	modelLoading.bytesRead = std::max(modelLoading.bytesRead, bytesRead);
+	modelLoading.bytesTotal = bytesTotal;
+
+	emit modelsLoadingChanged();
+}
+
+void CanvasHandler::setModelLoadingPreprocessingProgress(const quint64 loadId, const double progress)
+{
+	m_modelsLoading[loadId].preprocessingProgress = progress;
+
+	emit modelsLoadingChanged();
+}
+
+void CanvasHandler::setModelLoadingStage(const quint64 loadId, const int stage)
+{
+	if (stage == CommandModelAdd::LoadStage_t::Done)
+	{
+		m_modelsLoading.remove(loadId);
 	}
 	else
 	{
-		localFilePath = path;
+		m_modelsLoading[loadId].stage = stage;
+	}
+
+	emit modelsLoadingChanged();
+}
+
+bool CanvasHandler::getIsLoadingModels() const
+{
+	return !m_modelsLoading.isEmpty();
+}
+
+double CanvasHandler::getModelsLoadingProgress() const
+{
+	// Reading is most of the loading time, the preprocessing accounts for the last fifth
+	qint64 bytesTotal = 0;
+	double bytesDone = 0.0;
+
+	for (const ModelLoading_t &modelLoading : m_modelsLoading)
+	{
+		const double readProgress = modelLoading.bytesTotal > 0 ? static_cast<double>(modelLoading.bytesRead) / modelLoading.bytesTotal : 0.0;
+
+		bytesTotal += modelLoading.bytesTotal;
+		bytesDone += modelLoading.bytesTotal * (0.8 * std::min(readProgress, 1.0) + 0.2 * modelLoading.preprocessingProgress);
+	}
+
+	return bytesTotal > 0 ? bytesDone / bytesTotal : 0.0;
+}
+
+QString CanvasHandler::getModelsLoadingStatus() const
+{
+	if (m_modelsLoading.isEmpty())
+	{
+		return QString();
+	}
+
+	// Least advanced model
+	int stage = CommandModelAdd::LoadStage_t::Done;
+	for (const ModelLoading_t &modelLoading : m_modelsLoading)
+	{
+		stage = std::min(stage, modelLoading.stage);
+	}
+
+	QString stageName;
+	switch (stage)
+	{
+		case CommandModelAdd::LoadStage_t::Reading:
+			stageName = "reading";
+			break;
+		case CommandModelAdd::LoadStage_t::PointsPreview:
+		case CommandModelAdd::LoadStage_t::DecimatedPreview:
+			stageName = "previewing";
+			break;
+		default:
+			stageName = "preprocessing";
+			break;
 	}
 
-	m_vtkFboItem->addModelFromFile(localFilePath);
+	return QString("Loading %1 model(s): %2").arg(m_modelsLoading.size()).arg(stageName);
 }
 
+
+int CanvasHandler::getModelsCount() const
+{
+	return static_cast<int>(m_memoryReport.modelsCount);
+}
+
+double CanvasHandler::getMemoryPointsBytes() const
+{
+	return m_memoryReport.models.pointsBytes;
+}
+
+double CanvasHandler::getMemoryConnectivityBytes() const
+{
+	return m_memoryReport.models.connectivityBytes;
+}
+
+double CanvasHandler::getMemoryNormalsBytes() const
+{
+	return m_memoryReport.models.normalsBytes;
+}
+
+double CanvasHandler::getMemoryIntermediatesBytes() const
+{
+	return m_memoryReport.models.intermediatesBytes;
+}
+
+double CanvasHandler::getMemoryModelsBytes() const
+{
+	return m_memoryReport.models.totalBytes;
+}
+
+double CanvasHandler::getMemoryGpuBytes() const
+{
+	return m_memoryReport.models.gpuBytes;
+}
+
+double CanvasHandler::getMemoryProcessBytes() const
+{
+	return m_memoryReport.processBytes;
+}
+
+double CanvasHandler::getMemoryBudgetBytes() const
+{
+	return m_processingEngine->getMemoryBudget();
+}
+
+void CanvasHandler::setMemoryBudgetBytes(const double memoryBudgetBytes)
+{
+	m_processingEngine->setMemoryBudget(static_cast<int64_t>(memoryBudgetBytes));
+
+	this->updateMemoryUsage();
+}
+
+bool CanvasHandler::getMemoryOverBudget() const
+{
+	return m_memoryReport.overBudget;
+}
+
+double CanvasHandler::getFramesRendered() const
+{
+	return static_cast<double>(m_frameStats.renderedFramesCount);
+}
+
+double CanvasHandler::getFramesSkipped() const
+{
+	return static_cast<double>(m_frameStats.skippedFramesCount);
+}
+
+double CanvasHandler::getFrameRequestsCollapsed() const
+{
+	return static_cast<double>(m_frameStats.collapsedRequestsCount);
+}
+
+void CanvasHandler::updateMemoryUsage()
+{
+	const bool wasOverBudget = m_memoryReport.overBudget;
+
+	m_memoryReport = m_processingEngine->getMemoryReport();
+
+	// The same report, the geometries are only walked once per poll
+	if (ResidencyManager *residencyManager = m_vtkFboItem->getResidencyManager())
+	{
+		residencyManager->enforceBudget(m_memoryReport);
+	}
+
+	if (m_memoryReport.overBudget && !wasOverBudget)
+	{
+		qWarning() << "CanvasHandler::updateMemoryUsage(): memory budget exceeded," << m_memoryReport.processBytes << "process bytes,"
+				   << m_memoryReport.models.totalBytes << "models bytes, budget" << m_memoryReport.budgetBytes << "bytes";
+	}
+
+	emit memoryUsageChanged();
+}
+
+void CanvasHandler::updateFrameStats()
+{
+	const FrameScheduler::Stats_t frameStats = m_vtkFboItem->getFrameScheduler().getStats();
+
+	// Idle scene: nothing to refresh in the overlay either
+	if (frameStats.requestsCount == m_frameStats.requestsCount && frameStats.renderedFramesCount == m_frameStats.renderedFramesCount
+		&& frameStats.skippedFramesCount == m_frameStats.skippedFramesCount)
+	{
+		return;
+	}
+
+	m_frameStats = frameStats;
+
+	emit frameStatsChanged();
+}
+
+
 bool CanvasHandler::isModelExtensionValid(const QUrl &modelPath) const
 {
 	if (modelPath.toString().toLower().endsWith(".stl") || modelPath.toString().toLower().endsWith(".obj"))
@@ -220,3 +497,13 @@ void CanvasHandler::setModelColorB(const int colorB)
 {
 	m_vtkFboItem->setModelColorB(colorB);
 }
+
+void CanvasHandler::setLodTrianglesBudget(const int trianglesBudget)
+{
+	m_vtkFboItem->setLodTrianglesBudget(trianglesBudget);
+}
+
+void CanvasHandler::setPickingMode(const int pickingMode)
+{
+	m_vtkFboItem->setPickingMode(pickingMode);
+}
@@ -3,11 +3,16 @@
 
 #include <memory>
 
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QString>
 #include <QUrl>
 
+#include "FrameScheduler.h"
+#include "ProcessingEngine.h"
+
 
-class ProcessingEngine;
 class QVTKFramebufferObjectItem;
 
 class CanvasHandler : public QObject
@@ -18,11 +23,34 @@ class CanvasHandler : public QObject
 	Q_PROPERTY(bool isModelSelected READ getIsModelSelected NOTIFY isModelSelectedChanged)
 	Q_PROPERTY(double modelPositionX READ getSelectedModelPositionX NOTIFY selectedModelPositionXChanged)
 	Q_PROPERTY(double modelPositionY READ getSelectedModelPositionY NOTIFY selectedModelPositionYChanged)
+	Q_PROPERTY(bool isLoadingModels READ getIsLoadingModels NOTIFY modelsLoadingChanged)
+	Q_PROPERTY(double modelsLoadingProgress READ getModelsLoadingProgress NOTIFY modelsLoadingChanged)
+	Q_PROPERTY(QString modelsLoadingStatus READ getModelsLoadingStatus NOTIFY modelsLoadingChanged)
+	Q_PROPERTY(int modelsCount READ getModelsCount NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryPointsBytes READ getMemoryPointsBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryConnectivityBytes READ getMemoryConnectivityBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryNormalsBytes READ getMemoryNormalsBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryIntermediatesBytes READ getMemoryIntermediatesBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryModelsBytes READ getMemoryModelsBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryGpuBytes READ getMemoryGpuBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryProcessBytes READ getMemoryProcessBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double memoryBudgetBytes READ getMemoryBudgetBytes WRITE setMemoryBudgetBytes NOTIFY memoryUsageChanged)
+	Q_PROPERTY(bool memoryOverBudget READ getMemoryOverBudget NOTIFY memoryUsageChanged)
+	Q_PROPERTY(double framesRendered READ getFramesRendered NOTIFY frameStatsChanged)
+	Q_PROPERTY(double framesSkipped READ getFramesSkipped NOTIFY frameStatsChanged)
+	Q_PROPERTY(double frameRequestsCollapsed READ getFrameRequestsCollapsed NOTIFY frameStatsChanged)
 
 public:
 	CanvasHandler(int argc, char **argv);
 
 	Q_INVOKABLE void openModel(const QUrl &path) const;
+	Q_INVOKABLE void addModelsFromFiles(const QList<QUrl> &paths) const;
+	Q_INVOKABLE void duplicateSelectedModel() const;
+	// Color of the selected instance once it is not selected anymore
+	Q_INVOKABLE void colorSelectedModel(const int colorR, const int colorG, const int colorB) const;
+
+	// Chrome trace of the frames and loader phases, only recorded by the builds with QTVTK_FRAME_PROFILER
+	Q_INVOKABLE bool writeFrameTrace() const;
 
 	Q_INVOKABLE void mousePressEvent(const int button, const int mouseX, const int mouseY) const;
 	Q_INVOKABLE void mouseMoveEvent(const int button, const int mouseX, const int mouseY);
@@ -32,12 +60,37 @@ public:
 	double getSelectedModelPositionX() const;
 	double getSelectedModelPositionY() const;
 
+	bool getIsLoadingModels() const;
+	double getModelsLoadingProgress() const;
+	QString getModelsLoadingStatus() const;
+
+	// Models memory, every shared geometry counted once, refreshed every second
+	int getModelsCount() const;
+	double getMemoryPointsBytes() const;
+	double getMemoryConnectivityBytes() const;
+	double getMemoryNormalsBytes() const;
+	double getMemoryIntermediatesBytes() const;
+	double getMemoryModelsBytes() const;
+	double getMemoryGpuBytes() const;
+	double getMemoryProcessBytes() const;
+	double getMemoryBudgetBytes() const;
+	void setMemoryBudgetBytes(const double memoryBudgetBytes);
+	bool getMemoryOverBudget() const;
+
+	// Frames rendered, skipped as identical, and redraw requests merged into another frame, refreshed every second
+	double getFramesRendered() const;
+	double getFramesSkipped() const;
+	double getFrameRequestsCollapsed() const;
+
 	Q_INVOKABLE void setModelsRepresentation(const int representationOption);
 	Q_INVOKABLE void setModelsOpacity(const double opacity);
 	Q_INVOKABLE void setGouraudInterpolation(const bool gouraudInterpolation);
 	Q_INVOKABLE void setModelColorR(const int colorR);
 	Q_INVOKABLE void setModelColorG(const int colorG);
 	Q_INVOKABLE void setModelColorB(const int colorB);
+	Q_INVOKABLE void setLodTrianglesBudget(const int trianglesBudget);
+	// Order of QVTKFramebufferObjectRenderer::PickingMode_t
+	Q_INVOKABLE void setPickingMode(const int pickingMode);
 
 public slots:
 	void startApplication() const;
@@ -49,8 +102,31 @@ signals:
 	void selectedModelPositionXChanged();
 	void selectedModelPositionYChanged();
 
+	void modelsLoadingChanged();
+	void modelLoadingFailed(QString error);
+
+	void memoryUsageChanged();
+	void frameStatsChanged();
+
 private:
+	typedef struct
+	{
+		qint64 bytesRead{0};
+		qint64 bytesTotal{0};
+		double preprocessingProgress{0.0};
+		int stage{0};
+	} ModelLoading_t;
+
+	void setModelLoadingProgress(const quint64 loadId, const qint64 bytesRead, const qint64 bytesTotal);
+	void setModelLoadingPreprocessingProgress(const quint64 loadId, const double progress);
+	void setModelLoadingStage(const quint64 loadId, const int stage);
+
+	void updateMemoryUsage();
+	void updateFrameStats();
+
 	bool isModelExtensionValid(const QUrl &modelPath) const;
+	QUrl getLocalFilePath(const QUrl &path) const;
+	QString getFrameTraceFilePath() const;
 
 	std::shared_ptr<ProcessingEngine> m_processingEngine;
 	QVTKFramebufferObjectItem *m_vtkFboItem = nullptr;
@@ -59,6 +135,12 @@ private:
 	double m_previousWorldY = 0;
 	bool m_draggingMouse = false;
 	bool m_showFileDialog = false;
+
+	// Models being loaded, by load ID: the same file can be loading twice
+	QHash<quint64, ModelLoading_t> m_modelsLoading;
+
+	ProcessingEngine::MemoryReport_t m_memoryReport;
+	FrameScheduler::Stats_t m_frameStats{};
 };
 
 #endif // CANVASHANDLER_H
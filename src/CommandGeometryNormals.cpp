@@ -0,0 +1,89 @@
+#include <QDebug>
+
+#include "CommandGeometryNormals.h"
+#include "FrameProfiler.h"
+#include "ModelGeometry.h"
+#include "ProcessingEngine.h"
+
+
+CommandGeometryNormals::CommandGeometryNormals(std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<ModelGeometry> geometry, const Operation_t operation)
+	: m_processingEngine{processingEngine}
+	, m_geometry{geometry}
+	, m_operation{operation}
+{
+	m_modelsRenderer = nullptr;
+
+	// Not deleted by the pool: the commands queue owns the command once it is prepared, the renderer then hands it back
+	// to the GUI thread it belongs to with deleteLater()
+	this->setAutoDelete(false);
+}
+
+
+void CommandGeometryNormals::run()
+{
+	FRAME_PROFILER_THREAD_NAME("Loader");
+	FRAME_PROFILER_SCOPE("CommandGeometryNormals::run");
+
+	m_data = m_geometry->getData();
+
+	if (m_operation == Operation_t::Compute)
+	{
+		m_normals = m_geometry->preparePointNormals(m_data);
+		m_lodsNormals = m_geometry->prepareLodsPointNormals();
+	}
+	else
+	{
+		m_octahedralNormals = m_geometry->prepareReleasedPointNormals(m_data);
+	}
+
+	m_ready = true;
+
+	// Must be the last access: the ready() slot hands the command over to the commands queue
+	emit ready();
+}
+
+bool CommandGeometryNormals::isPrepared() const
+{
+	return m_operation == Operation_t::Compute ? m_normals != nullptr || !m_lodsNormals.empty() : m_octahedralNormals != nullptr;
+}
+
+const std::shared_ptr<ModelGeometry> &CommandGeometryNormals::getGeometry() const
+{
+	return m_geometry;
+}
+
+CommandGeometryNormals::Operation_t CommandGeometryNormals::getOperation() const
+{
+	return m_operation;
+}
+
+
+bool CommandGeometryNormals::isReady() const
+{
+	return m_ready;
+}
+
+void CommandGeometryNormals::execute()
+{
+	// The interpolation changed again meanwhile, the command started for it does the opposite
+	if (m_processingEngine->getPointNormalsRequired() != (m_operation == Operation_t::Compute))
+	{
+		qDebug() << "CommandGeometryNormals::execute(): dropped for" << m_geometry->getFilePath() << "- interpolation changed meanwhile";
+		return;
+	}
+
+	if (m_operation == Operation_t::Compute)
+	{
+		if (m_normals)
+		{
+			m_geometry->setPointNormals(m_data, m_normals);
+		}
+
+		m_geometry->setLodsPointNormals(m_lodsNormals);
+	}
+	else
+	{
+		m_geometry->releasePointNormals(m_data, m_octahedralNormals);
+		m_geometry->releaseLodsPointNormals();
+	}
+}
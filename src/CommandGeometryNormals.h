@@ -0,0 +1,66 @@
+#ifndef COMMANDGEOMETRYNORMALS_H
+#define COMMANDGEOMETRYNORMALS_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <QObject>
+#include <QRunnable>
+
+#include <vtkDataArray.h>
+#include <vtkPolyData.h>
+#include <vtkShortArray.h>
+#include <vtkSmartPointer.h>
+
+#include "CommandModel.h"
+#include "ModelGeometry.h"
+
+class ProcessingEngine;
+
+// Adds the point normals of a geometry for the Gouraud interpolation, or releases them to the octahedral
+// encoding. The normals are computed, decoded or encoded in a loader thread (run), then swapped for all the
+// instances in the renderer thread (execute). The coarser levels of detail follow, without an encoded copy.
+// Nothing is swapped if the interpolation changed again in between.
+class CommandGeometryNormals : public QObject, public QRunnable, public CommandModel
+{
+	Q_OBJECT
+
+public:
+	enum Operation_t
+	{
+		Compute = 0,
+		Release
+	};
+
+	CommandGeometryNormals(std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<ModelGeometry> geometry, const Operation_t operation);
+
+	void run() Q_DECL_OVERRIDE;
+
+	// False if there was nothing to prepare, the normals were already in the requested state
+	bool isPrepared() const;
+
+	const std::shared_ptr<ModelGeometry> &getGeometry() const;
+	Operation_t getOperation() const;
+
+	bool isReady() const override;
+	void execute() override;
+
+signals:
+	void ready();
+
+private:
+	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	std::shared_ptr<ModelGeometry> m_geometry;
+	Operation_t m_operation;
+
+	// Mesh the normals were prepared for, nothing is swapped if the residency replaced it meanwhile
+	vtkSmartPointer<vtkPolyData> m_data;
+	vtkSmartPointer<vtkDataArray> m_normals;
+	vtkSmartPointer<vtkShortArray> m_octahedralNormals;
+	std::vector<ModelGeometry::LodNormals_t> m_lodsNormals;
+
+	std::atomic<bool> m_ready{false};
+};
+
+#endif // COMMANDGEOMETRYNORMALS_H
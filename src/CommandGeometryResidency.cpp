@@ -0,0 +1,106 @@
+#include <QDebug>
+#include <QThreadPool>
+
+#include "CommandGeometryResidency.h"
+#include "FrameProfiler.h"
+#include "ModelBVHBuilder.h"
+#include "ModelGeometry.h"
+#include "ModelLodGenerator.h"
+#include "ProcessingEngine.h"
+
+
+CommandGeometryResidency::CommandGeometryResidency(std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<ModelGeometry> geometry, const Operation_t operation, QThreadPool *loaderPool)
+	: m_processingEngine{processingEngine}
+	, m_geometry{geometry}
+	, m_operation{operation}
+	, m_loaderPool{loaderPool}
+	, m_lastAccessTime{geometry->getLastAccessTime()}
+{
+	m_modelsRenderer = nullptr;
+
+	// Not deleted by the pool: the commands queue owns the command once it is prepared, the renderer then hands it back
+	// to the GUI thread it belongs to with deleteLater()
+	this->setAutoDelete(false);
+}
+
+
+void CommandGeometryResidency::run()
+{
+	FRAME_PROFILER_THREAD_NAME("Residency");
+	FRAME_PROFILER_SCOPE("CommandGeometryResidency::run");
+
+	if (m_operation == Operation_t::Evict)
+	{
+		m_data = m_processingEngine->prepareGeometryEviction(m_geometry);
+
+		if (!m_data)
+		{
+			qWarning() << "CommandGeometryResidency::run(): unable to evict" << m_geometry->getFilePath();
+			m_geometry->changeResidency(ModelGeometry::Residency_t::Evicting, ModelGeometry::Residency_t::Resident);
+		}
+	}
+	else
+	{
+		m_data = m_processingEngine->loadEvictedGeometry(m_geometry);
+
+		if (!m_data)
+		{
+			qWarning() << "CommandGeometryResidency::run(): unable to restore" << m_geometry->getFilePath();
+			m_geometry->changeResidency(ModelGeometry::Residency_t::Restoring, ModelGeometry::Residency_t::Evicted);
+		}
+	}
+
+	m_ready = true;
+
+	// Must be the last access: the ready() slot hands the command over to the commands queue
+	emit ready();
+}
+
+bool CommandGeometryResidency::isPrepared() const
+{
+	return m_data != nullptr;
+}
+
+
+bool CommandGeometryResidency::isReady() const
+{
+	return m_ready;
+}
+
+void CommandGeometryResidency::execute()
+{
+	if (m_operation == Operation_t::Evict)
+	{
+		// Needed again since the eviction was decided
+		if (m_geometry->getLastAccessTime() != m_lastAccessTime)
+		{
+			qDebug() << "CommandGeometryResidency::execute(): eviction canceled," << m_geometry->getFilePath() << "was used meanwhile";
+
+			m_geometry->changeResidency(ModelGeometry::Residency_t::Evicting, ModelGeometry::Residency_t::Resident);
+			return;
+		}
+
+		qDebug() << "CommandGeometryResidency::execute(): evicted" << m_geometry->getFilePath() << "- proxy of" << m_data->GetNumberOfPolys() << "polygons";
+
+		if (m_processingEngine->setGeometryData(m_geometry, m_data, false))
+		{
+			emit normalsOutdated();
+		}
+	}
+	else
+	{
+		qDebug() << "CommandGeometryResidency::execute(): restored" << m_geometry->getFilePath();
+
+		if (m_processingEngine->setGeometryData(m_geometry, m_data, true))
+		{
+			emit normalsOutdated();
+		}
+
+		// Skipped while the geometry was evicted, the levels are not generated again if they already exist
+		if (m_loaderPool)
+		{
+			m_loaderPool->start(new ModelBVHBuilder(m_geometry), -1);
+			m_loaderPool->start(new ModelLodGenerator(m_processingEngine, m_geometry), -1);
+		}
+	}
+}
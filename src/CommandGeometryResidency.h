@@ -0,0 +1,62 @@
+#ifndef COMMANDGEOMETRYRESIDENCY_H
+#define COMMANDGEOMETRYRESIDENCY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <QObject>
+#include <QRunnable>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include "CommandModel.h"
+
+
+class ModelGeometry;
+class ProcessingEngine;
+class QThreadPool;
+
+// Evicts the full mesh of a geometry to the mesh cache, or restores it. The mesh is prepared in a
+// residency thread (run), then swapped for all the instances in the renderer thread (execute).
+// An eviction is dropped if an instance was selected or moved in between.
+class CommandGeometryResidency : public QObject, public QRunnable, public CommandModel
+{
+	Q_OBJECT
+
+public:
+	enum Operation_t
+	{
+		Evict = 0,
+		Restore
+	};
+
+	CommandGeometryResidency(std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<ModelGeometry> geometry, const Operation_t operation, QThreadPool *loaderPool);
+
+	void run() Q_DECL_OVERRIDE;
+
+	// False if the mesh could not be prepared, the geometry is then back in its previous state
+	bool isPrepared() const;
+
+	bool isReady() const override;
+	void execute() override;
+
+signals:
+	void ready();
+	// Renderer thread: the swapped mesh needs a CommandGeometryNormals, the interpolation changed while it was prepared
+	void normalsOutdated();
+
+private:
+	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	std::shared_ptr<ModelGeometry> m_geometry;
+	Operation_t m_operation;
+	QThreadPool *m_loaderPool;
+
+	int64_t m_lastAccessTime;
+	vtkSmartPointer<vtkPolyData> m_data;
+
+	std::atomic<bool> m_ready{false};
+};
+
+#endif // COMMANDGEOMETRYRESIDENCY_H
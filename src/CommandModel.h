@@ -2,7 +2,7 @@
 #define COMMANDMODEL_H
 
 
-class QVTKFramebufferObjectRenderer;
+class ModelsRenderer;
 
 class CommandModel
 {
@@ -13,8 +13,11 @@ public:
 	virtual bool isReady() const = 0;
 	virtual void execute() = 0;
 
+	// True if executing the next command makes executing this one pointless
+	virtual bool isSupersededBy(const CommandModel &) const { return false; }
+
 protected:
-	QVTKFramebufferObjectRenderer *m_vtkFboRenderer;
+	ModelsRenderer *m_modelsRenderer;
 };
 
 #endif // COMMANDMODEL_H
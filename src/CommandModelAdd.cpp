@@ -1,14 +1,41 @@
+#include <QDebug>
+#include <QFileInfo>
+
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+
+#include "BinarySTLReader.h"
 #include "CommandModelAdd.h"
+#include "CommandModelPreview.h"
+#include "CommandQueue.h"
+#include "FrameProfiler.h"
 #include "Model.h"
+#include "ModelGeometry.h"
+#include "OBJParallelReader.h"
 #include "ProcessingEngine.h"
-#include "QVTKFramebufferObjectRenderer.h"
+#include "ModelsRenderer.h"
+
+
+// Smaller files load fast enough to skip the previews
+static const qint64 PREVIEW_MINIMUM_FILE_SIZE = 32 << 20;
+
+static const uint32_t PREVIEW_POINTS_COUNT = 100000;
+static const int PREVIEW_CLUSTERING_DIVISIONS = 96;
+
+static std::atomic<uint64_t> loadsCount{0};
 
 
-CommandModelAdd::CommandModelAdd(QVTKFramebufferObjectRenderer *vtkFboRenderer, std::shared_ptr<ProcessingEngine> processingEngine, QUrl modelPath)
+CommandModelAdd::CommandModelAdd(ModelsRenderer *modelsRenderer, std::shared_ptr<ProcessingEngine> processingEngine, CommandQueue *commandsQueue, QUrl modelPath)
 	: m_processingEngine{processingEngine}
+	, m_commandsQueue{commandsQueue}
 	, m_modelPath{modelPath}
+	, m_loadId{++loadsCount}
 {
-	m_vtkFboRenderer = vtkFboRenderer;
+	m_modelsRenderer = modelsRenderer;
+
+	// Not deleted by the pool: the commands queue owns the command once it is loaded, the renderer then hands it back
+	// to the GUI thread it belongs to with deleteLater()
+	this->setAutoDelete(false);
 }
 
 
@@ -16,14 +43,126 @@ void CommandModelAdd::run()
 {
 	qDebug() << "CommandModelAdd::run()";
 
-	m_model = m_processingEngine->addModel(m_modelPath);
+	FRAME_PROFILER_THREAD_NAME("Loader");
+	FRAME_PROFILER_SCOPE("CommandModelAdd::run");
+
+	const qint64 bytesTotal = QFileInfo(m_modelPath.toString()).size();
+	const bool previewModel = bytesTotal >= PREVIEW_MINIMUM_FILE_SIZE;
+
+	emit stageChanged(LoadStage_t::Reading);
+	emit progress(0, bytesTotal);
+
+	// Files opened before are already preprocessed in the mesh cache, no previews needed
+	QString modelKey;
+	m_model = m_processingEngine->addCachedModel(m_modelPath, &modelKey);
+
+	if (m_model)
+	{
+		emit progress(bytesTotal, bytesTotal);
+	}
+	else
+	{
+		// Sampled before being read: the records of binary STL files, the vertex lines of OBJ and ASCII STL files
+		if (previewModel)
+		{
+			vtkSmartPointer<vtkPolyData> sampleData;
+
+			if (QFileInfo(m_modelPath.toString()).suffix().toLower() == "obj")
+			{
+				sampleData = OBJParallelReader::readSample(m_modelPath.toString(), PREVIEW_POINTS_COUNT);
+			}
+			else
+			{
+				sampleData = BinarySTLReader::readSample(m_modelPath.toString(), PREVIEW_POINTS_COUNT / 3);
+
+				if (!sampleData)
+				{
+					sampleData = OBJParallelReader::readSample(m_modelPath.toString(), PREVIEW_POINTS_COUNT, "vertex");
+				}
+			}
+
+			if (sampleData)
+			{
+				this->publishPreview(sampleData, LoadStage_t::PointsPreview);
+			}
+		}
+
+		vtkSmartPointer<vtkPolyData> modelData = m_processingEngine->readModelData(m_modelPath, [this, bytesTotal](const qint64 bytesRead)
+		{
+			emit progress(bytesRead, bytesTotal);
+		});
+
+		// Unreadable or without triangles: no model, the renderer removes the preview and reports the error
+		if (!modelData || modelData->GetNumberOfPolys() == 0)
+		{
+			qWarning() << "CommandModelAdd::run(): no triangles read from" << m_modelPath;
+
+			m_error = QString("No triangles could be read from %1").arg(m_modelPath.toString());
+			m_ready = true;
+
+			// Must be the last access: the ready() slot hands the command over to the commands queue
+			emit ready();
+			return;
+		}
+
+		if (previewModel)
+		{
+			FRAME_PROFILER_SCOPE("CommandModelAdd::run::previews");
+
+			if (!m_previewPublished)
+			{
+				this->publishPreview(ProcessingEngine::createPointsProxy(modelData, PREVIEW_POINTS_COUNT), LoadStage_t::PointsPreview);
+			}
+
+			this->publishPreview(ProcessingEngine::createDecimatedProxy(modelData, PREVIEW_CLUSTERING_DIVISIONS), LoadStage_t::DecimatedPreview);
+		}
+
+		emit stageChanged(LoadStage_t::Preprocessing);
+
+		m_model = m_processingEngine->createModel(modelData, m_modelPath, modelKey, [this](const double preprocessProgress)
+		{
+			emit preprocessingProgress(preprocessProgress);
+		});
+	}
 
 	m_processingEngine->placeModel(*m_model);
 
 	m_ready = true;
+
+	// Must be the last access: the ready() slot hands the command over to the commands queue
 	emit ready();
 }
 
+void CommandModelAdd::publishPreview(const vtkSmartPointer<vtkPolyData> previewData, const LoadStage_t stage)
+{
+	if (!previewData || previewData->GetNumberOfPoints() == 0)
+	{
+		return;
+	}
+
+	vtkSmartPointer<vtkPolyDataMapper> previewMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+	previewMapper->SetInputData(previewData);
+	previewMapper->ScalarVisibilityOff();
+
+	vtkSmartPointer<vtkActor> previewActor = vtkSmartPointer<vtkActor>::New();
+	previewActor->SetMapper(previewMapper);
+	previewActor->PickableOff();
+	previewActor->GetProperty()->SetColor(0.6, 0.7, 0.8);
+	previewActor->GetProperty()->SetPointSize(2.0);
+
+	// Same placement as the loaded model: centered on the plate and lying on it
+	double previewBounds[6];
+	previewData->GetBounds(previewBounds);
+	previewActor->SetPosition(-(previewBounds[0] + previewBounds[1]) / 2.0, -(previewBounds[2] + previewBounds[3]) / 2.0, -previewBounds[4]);
+
+	// The queue accepts producers from any thread, previews are pushed before the model command itself
+	m_commandsQueue->push(new CommandModelPreview(m_modelsRenderer, m_loadId, previewActor));
+	m_previewPublished = true;
+
+	emit stageChanged(stage);
+	emit previewReady();
+}
+
 
 bool CommandModelAdd::isReady() const
 {
@@ -34,7 +173,40 @@ void CommandModelAdd::execute()
 {
 	qDebug() << "CommandModelAdd::execute()";
 
-	m_vtkFboRenderer->addModelActor(m_model);
+	if (m_previewPublished)
+	{
+		m_modelsRenderer->removePreviewActor(m_loadId);
+	}
 
+	if (!m_model)
+	{
+		emit failed(m_error);
+		emit stageChanged(LoadStage_t::Done);
+		return;
+	}
+
+	m_modelsRenderer->addModelActor(m_model);
+
+	// Only now visible to the registry readers: placed, and drawn from this frame on
+	m_processingEngine->insertModel(m_model);
+
+	// The interpolation may have switched since the loader computed the point normals,
+	// the commands started for the registry did not include this model
+	if (m_processingEngine->isPointNormalsOutdated(m_model->getGeometry()))
+	{
+		emit normalsOutdated();
+	}
+
+	emit stageChanged(LoadStage_t::Done);
 	emit done();
 }
+
+const std::shared_ptr<Model> &CommandModelAdd::getModel() const
+{
+	return m_model;
+}
+
+uint64_t CommandModelAdd::getLoadId() const
+{
+	return m_loadId;
+}
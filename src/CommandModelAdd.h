@@ -1,42 +1,81 @@
 #ifndef COMMANDMODELADD_H
 #define COMMANDMODELADD_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 
+#include <QObject>
+#include <QRunnable>
+#include <QString>
 #include <QUrl>
-#include <QThread>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
 
 #include "CommandModel.h"
 
 
+class CommandQueue;
 class Model;
 class ProcessingEngine;
-class QVTKFramebufferObjectRenderer;
+class ModelsRenderer;
 
-class CommandModelAdd : public QThread, public CommandModel
+// Loads the model in one of the loader pool threads (run), then adds it to the scene in the renderer thread (execute).
+// Large files are previewed while loading: the previews go through the commands queue as soon as each stage is done.
+// A file without any triangle creates no model, execute() then only reports the error.
+class CommandModelAdd : public QObject, public QRunnable, public CommandModel
 {
 	Q_OBJECT
 
 public:
-	CommandModelAdd(QVTKFramebufferObjectRenderer *vtkFboRenderer, std::shared_ptr<ProcessingEngine> processingEngine, QUrl modelPath);
+	enum LoadStage_t
+	{
+		Reading = 0,
+		PointsPreview,
+		DecimatedPreview,
+		Preprocessing,
+		Done
+	};
+
+	CommandModelAdd(ModelsRenderer *modelsRenderer, std::shared_ptr<ProcessingEngine> processingEngine, CommandQueue *commandsQueue, QUrl modelPath);
 
 	void run() Q_DECL_OVERRIDE;
 
 	bool isReady() const override;
 	void execute() override;
 
+	const std::shared_ptr<Model> &getModel() const;
+
+	// Unique per load, even for the same file loaded twice. Also identifies the preview of the load.
+	uint64_t getLoadId() const;
+
 signals:
+	void progress(const qint64 bytesRead, const qint64 bytesTotal);
+	void preprocessingProgress(const double progress);
+	void stageChanged(const int stage);
+	void previewReady();
 	void ready();
 	void done();
+	void failed(const QString &error);
+	// Emitted by execute(): a CommandGeometryNormals is needed for the model geometry
+	void normalsOutdated();
 
 private:
+	void publishPreview(const vtkSmartPointer<vtkPolyData> previewData, const LoadStage_t stage);
+
 	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	CommandQueue *m_commandsQueue;
 	std::shared_ptr<Model> m_model = nullptr;
 	QUrl m_modelPath;
 	double m_positionX;
 	double m_positionY;
 
-	bool m_ready = false;
+	uint64_t m_loadId;
+	bool m_previewPublished = false;
+	QString m_error;
+
+	std::atomic<bool> m_ready{false};
 };
 
 #endif // COMMANDMODELADD_H
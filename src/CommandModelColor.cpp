@@ -0,0 +1,38 @@
+#include <QDebug>
+
+#include "CommandModelColor.h"
+#include "Model.h"
+#include "ProcessingEngine.h"
+
+
+CommandModelColor::CommandModelColor(std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<Model> model, const QColor &modelColor)
+	: m_processingEngine{processingEngine}
+	, m_model{model}
+	, m_modelColor{modelColor}
+{
+	m_modelsRenderer = nullptr;
+}
+
+bool CommandModelColor::isReady() const
+{
+	return true;
+}
+
+void CommandModelColor::execute()
+{
+	qDebug() << "CommandModelColor::execute():" << m_modelColor.name();
+
+	m_processingEngine->setModelColor(m_model, m_modelColor);
+}
+
+bool CommandModelColor::isSupersededBy(const CommandModel &nextCommand) const
+{
+	const CommandModelColor *nextColorCommand = dynamic_cast<const CommandModelColor*>(&nextCommand);
+
+	return nextColorCommand && nextColorCommand->getModel() == m_model;
+}
+
+const std::shared_ptr<Model> &CommandModelColor::getModel() const
+{
+	return m_model;
+}
@@ -0,0 +1,35 @@
+#ifndef COMMANDMODELCOLOR_H
+#define COMMANDMODELCOLOR_H
+
+#include <memory>
+
+#include <QColor>
+
+#include "CommandModel.h"
+
+
+class Model;
+class ProcessingEngine;
+
+// Gives a model its own color, through the property shared by the models of that color. Executed in the
+// renderer thread, the only one reading and creating the models properties.
+class CommandModelColor : public CommandModel
+{
+public:
+	CommandModelColor(std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<Model> model, const QColor &modelColor);
+
+	bool isReady() const override;
+	void execute() override;
+
+	// Only the last color of consecutive changes on the same model is seen
+	bool isSupersededBy(const CommandModel &nextCommand) const override;
+
+	const std::shared_ptr<Model> &getModel() const;
+
+private:
+	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	std::shared_ptr<Model> m_model;
+	QColor m_modelColor;
+};
+
+#endif // COMMANDMODELCOLOR_H
@@ -0,0 +1,33 @@
+#include <QDebug>
+
+#include "CommandModelDuplicate.h"
+#include "Model.h"
+#include "ModelGeometry.h"
+#include "ModelsRenderer.h"
+#include "ProcessingEngine.h"
+
+
+CommandModelDuplicate::CommandModelDuplicate(ModelsRenderer *modelsRenderer, std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<Model> model)
+	: m_processingEngine{processingEngine}
+	, m_model{model}
+{
+	m_modelsRenderer = modelsRenderer;
+}
+
+bool CommandModelDuplicate::isReady() const
+{
+	return true;
+}
+
+void CommandModelDuplicate::execute()
+{
+	qDebug() << "CommandModelDuplicate::execute()";
+
+	// Used again: not evicted before the idle time, like a selected or moved model
+	m_model->getGeometry()->touch();
+
+	std::shared_ptr<Model> duplicatedModel = m_processingEngine->duplicateModel(m_model);
+
+	m_modelsRenderer->addModelActor(duplicatedModel);
+	m_processingEngine->insertModel(duplicatedModel);
+}
@@ -0,0 +1,28 @@
+#ifndef COMMANDMODELDUPLICATE_H
+#define COMMANDMODELDUPLICATE_H
+
+#include <memory>
+
+#include "CommandModel.h"
+
+
+class Model;
+class ModelsRenderer;
+class ProcessingEngine;
+
+// Adds a new instance of a model next to it. The instance shares the geometry and the mappers of the
+// model, only its actor and matrix are new: nothing is read, copied nor uploaded again.
+class CommandModelDuplicate : public CommandModel
+{
+public:
+	CommandModelDuplicate(ModelsRenderer *modelsRenderer, std::shared_ptr<ProcessingEngine> processingEngine, std::shared_ptr<Model> model);
+
+	bool isReady() const override;
+	void execute() override;
+
+private:
+	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	std::shared_ptr<Model> m_model;
+};
+
+#endif // COMMANDMODELDUPLICATE_H
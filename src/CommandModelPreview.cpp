@@ -0,0 +1,33 @@
+#include "CommandModelPreview.h"
+#include "ModelsRenderer.h"
+
+
+CommandModelPreview::CommandModelPreview(ModelsRenderer *modelsRenderer, const uint64_t previewId, const vtkSmartPointer<vtkActor> previewActor)
+	: m_previewId{previewId}
+	, m_previewActor{previewActor}
+{
+	m_modelsRenderer = modelsRenderer;
+}
+
+bool CommandModelPreview::isReady() const
+{
+	return true;
+}
+
+void CommandModelPreview::execute()
+{
+	m_modelsRenderer->setPreviewActor(m_previewId, m_previewActor);
+}
+
+bool CommandModelPreview::isSupersededBy(const CommandModel &nextCommand) const
+{
+	// A finer preview of the same model replaces this one anyway
+	const CommandModelPreview *nextPreviewCommand = dynamic_cast<const CommandModelPreview*>(&nextCommand);
+
+	return (nextPreviewCommand && nextPreviewCommand->getPreviewId() == m_previewId);
+}
+
+uint64_t CommandModelPreview::getPreviewId() const
+{
+	return m_previewId;
+}
@@ -0,0 +1,31 @@
+#ifndef COMMANDMODELPREVIEW_H
+#define COMMANDMODELPREVIEW_H
+
+#include <cstdint>
+
+#include <vtkActor.h>
+#include <vtkSmartPointer.h>
+
+#include "CommandModel.h"
+
+
+class ModelsRenderer;
+
+// Shows or replaces the preview of a model that is still loading
+class CommandModelPreview : public CommandModel
+{
+public:
+	CommandModelPreview(ModelsRenderer *modelsRenderer, const uint64_t previewId, const vtkSmartPointer<vtkActor> previewActor);
+
+	bool isReady() const override;
+	void execute() override;
+	bool isSupersededBy(const CommandModel &nextCommand) const override;
+
+	uint64_t getPreviewId() const;
+
+private:
+	uint64_t m_previewId;
+	vtkSmartPointer<vtkActor> m_previewActor;
+};
+
+#endif // COMMANDMODELPREVIEW_H
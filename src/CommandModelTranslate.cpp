@@ -1,15 +1,23 @@
 #include <array>
 
 #include "CommandModelTranslate.h"
+#include "FixedBlockPool.h"
 #include "Model.h"
-#include "QVTKFramebufferObjectRenderer.h"
+#include "ModelsRenderer.h"
 
 
-CommandModelTranslate::CommandModelTranslate(QVTKFramebufferObjectRenderer *vtkFboRenderer, const TranslateParams_t & translateData, bool inTransition)
+static FixedBlockPool<sizeof(CommandModelTranslate), 1024> &getTranslateCommandsPool()
+{
+	static FixedBlockPool<sizeof(CommandModelTranslate), 1024> translateCommandsPool;
+	return translateCommandsPool;
+}
+
+
+CommandModelTranslate::CommandModelTranslate(ModelsRenderer *modelsRenderer, const TranslateParams_t & translateData, bool inTransition)
 	: m_translateParams{translateData}
 	, m_inTransition{inTransition}
 {
-	m_vtkFboRenderer = vtkFboRenderer;
+	m_modelsRenderer = modelsRenderer;
 }
 
 bool CommandModelTranslate::isReady() const
@@ -17,11 +25,46 @@ bool CommandModelTranslate::isReady() const
 	return true;
 }
 
+bool CommandModelTranslate::isInTransition() const
+{
+	return m_inTransition;
+}
+
+const std::shared_ptr<Model> &CommandModelTranslate::getModel() const
+{
+	return m_translateParams.model;
+}
+
+bool CommandModelTranslate::isSupersededBy(const CommandModel &nextCommand) const
+{
+	// Only consecutive in-transition translations of the same model, nobody will ever see the
+	// intermediate positions. Release translations are never skipped.
+	const CommandModelTranslate *nextTranslateCommand = dynamic_cast<const CommandModelTranslate*>(&nextCommand);
+
+	return (m_inTransition && nextTranslateCommand && nextTranslateCommand->isInTransition() && nextTranslateCommand->getModel() == m_translateParams.model);
+}
+
+void *CommandModelTranslate::operator new(std::size_t size)
+{
+	if (size != sizeof(CommandModelTranslate))
+	{
+		return ::operator new(size);
+	}
+
+	return getTranslateCommandsPool().allocate();
+}
+
+void CommandModelTranslate::operator delete(void *pointer)
+{
+	// Blocks not owned by the pool are handed back to the global heap
+	getTranslateCommandsPool().release(pointer);
+}
+
 void CommandModelTranslate::transformCoordinates()
 {
 	std::array<double, 3> worldCoordinates;
 
-	if (m_vtkFboRenderer->screenToWorld(m_translateParams.screenX, m_translateParams.screenY, worldCoordinates.data()))
+	if (m_modelsRenderer->screenToWorld(m_translateParams.screenX, m_translateParams.screenY, worldCoordinates.data()))
 	{
 		m_translateParams.targetPositionX = worldCoordinates[0] - m_translateParams.model->getMouseDeltaX();
 		m_translateParams.targetPositionY = worldCoordinates[1] - m_translateParams.model->getMouseDeltaY();
@@ -1,13 +1,14 @@
 #ifndef COMMANDMODELTRANSLATE_H
 #define COMMANDMODELTRANSLATE_H
 
+#include <cstddef>
 #include <memory>
 
 #include "CommandModel.h"
 
 
 class Model;
-class QVTKFramebufferObjectRenderer;
+class ModelsRenderer;
 
 class CommandModelTranslate : public CommandModel
 {
@@ -23,10 +24,18 @@ public:
 		double targetPositionY{0};
 	} TranslateParams_t;
 
-	CommandModelTranslate(QVTKFramebufferObjectRenderer *vtkFboRenderer, const TranslateParams_t & translateVector, bool inTransition);
+	CommandModelTranslate(ModelsRenderer *modelsRenderer, const TranslateParams_t & translateVector, bool inTransition);
 
 	bool isReady() const override;
 	void execute() override;
+	bool isSupersededBy(const CommandModel &nextCommand) const override;
+
+	bool isInTransition() const;
+	const std::shared_ptr<Model>& getModel() const;
+
+	// Translations are created on every mouse move, they are taken from a preallocated pool
+	static void *operator new(std::size_t size);
+	static void operator delete(void *pointer);
 
 private:
 	void transformCoordinates();
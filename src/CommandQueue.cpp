@@ -0,0 +1,259 @@
+#include <algorithm>
+
+#include "CommandModel.h"
+#include "CommandQueue.h"
+
+
+static uint64_t roundUpToPowerOfTwo(const uint32_t value)
+{
+	uint64_t powerOfTwo = 2;
+
+	while (powerOfTwo < value)
+	{
+		powerOfTwo <<= 1;
+	}
+
+	return powerOfTwo;
+}
+
+
+CommandQueue::CommandQueue(const uint32_t capacity)
+	: m_mask{roundUpToPowerOfTwo(capacity) - 1}
+	, m_cells{new Cell_t[m_mask + 1]}
+{
+	for (uint64_t i = 0; i <= m_mask; ++i)
+	{
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		m_cells[i].command = nullptr;
+	}
+}
+
+CommandQueue::~CommandQueue()
+{
+	// Delete the commands that were never executed
+	while (this->peek())
+	{
+		this->pop();
+	}
+}
+
+
+void CommandQueue::push(CommandModel *command)
+{
+	const Clock::time_point enqueueTime = Clock::now();
+
+	++m_pushedCount;
+
+	if (!m_hasOverflow.load(std::memory_order_acquire) && this->tryPush(command, enqueueTime))
+	{
+		this->updateMaxDepth();
+		return;
+	}
+
+	m_overflowMutex.lock();
+
+	if (m_overflow.empty() && this->tryPush(command, enqueueTime))
+	{
+		m_overflowMutex.unlock();
+		this->updateMaxDepth();
+		return;
+	}
+
+	// Ring full: keep the order by queueing behind the commands already waiting for room
+	m_overflow.emplace_back(command, enqueueTime);
+	m_overflowSize.store(static_cast<uint32_t>(m_overflow.size()), std::memory_order_relaxed);
+	m_hasOverflow.store(true, std::memory_order_release);
+	++m_overflowedCount;
+
+	m_overflowMutex.unlock();
+
+	this->updateMaxDepth();
+}
+
+bool CommandQueue::tryPush(CommandModel *command, const Clock::time_point enqueueTime)
+{
+	uint64_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+	Cell_t *cell;
+
+	for (;;)
+	{
+		cell = &m_cells[position & m_mask];
+
+		const uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+		const int64_t difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+
+		if (difference == 0)
+		{
+			if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (difference < 0)
+		{
+			// Full
+			return false;
+		}
+		else
+		{
+			position = m_enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->command = command;
+	cell->enqueueTime = enqueueTime;
+	cell->sequence.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+
+std::unique_ptr<CommandModel> CommandQueue::popReady()
+{
+	CommandModel *command = this->peek();
+
+	if (!command || !command->isReady())
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<CommandModel> readyCommand = this->pop();
+
+	// Skip the commands whose result would be overwritten by the next one before anybody sees it
+	for (;;)
+	{
+		CommandModel *nextCommand = this->peek();
+
+		if (!nextCommand || !nextCommand->isReady() || !readyCommand->isSupersededBy(*nextCommand))
+		{
+			break;
+		}
+
+		readyCommand = this->pop();
+
+		++m_mergedCount;
+		++m_mergedSinceLastTake;
+	}
+
+	++m_executedCount;
+
+	return readyCommand;
+}
+
+bool CommandQueue::isEmpty() const
+{
+	return (this->peekNoFlush() == nullptr && !m_hasOverflow.load(std::memory_order_acquire));
+}
+
+uint32_t CommandQueue::takeMergedCount()
+{
+	return m_mergedSinceLastTake.exchange(0);
+}
+
+CommandModel *CommandQueue::peekNoFlush() const
+{
+	const uint64_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+	const Cell_t &cell = m_cells[position & m_mask];
+
+	if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+	{
+		return nullptr;
+	}
+
+	return cell.command;
+}
+
+CommandModel *CommandQueue::peek()
+{
+	CommandModel *command = this->peekNoFlush();
+
+	if (!command && m_hasOverflow.load(std::memory_order_acquire))
+	{
+		this->flushOverflow();
+		command = this->peekNoFlush();
+	}
+
+	return command;
+}
+
+std::unique_ptr<CommandModel> CommandQueue::pop()
+{
+	const uint64_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+	Cell_t &cell = m_cells[position & m_mask];
+
+	std::unique_ptr<CommandModel> command(cell.command);
+
+	const uint64_t waitNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - cell.enqueueTime).count());
+
+	cell.command = nullptr;
+	cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+	m_dequeuePosition.store(position + 1, std::memory_order_relaxed);
+
+	m_totalWaitNs += waitNs;
+
+	uint64_t maxWaitNs = m_maxWaitNs.load(std::memory_order_relaxed);
+	while (waitNs > maxWaitNs && !m_maxWaitNs.compare_exchange_weak(maxWaitNs, waitNs, std::memory_order_relaxed))
+	{
+	}
+
+	// A slot was freed, move the commands waiting in the overflow list into the ring
+	if (m_hasOverflow.load(std::memory_order_acquire))
+	{
+		this->flushOverflow();
+	}
+
+	return command;
+}
+
+void CommandQueue::flushOverflow()
+{
+	std::lock_guard<std::mutex> lock(m_overflowMutex);
+
+	while (!m_overflow.empty() && this->tryPush(m_overflow.front().first, m_overflow.front().second))
+	{
+		m_overflow.pop_front();
+	}
+
+	m_overflowSize.store(static_cast<uint32_t>(m_overflow.size()), std::memory_order_relaxed);
+
+	if (m_overflow.empty())
+	{
+		m_hasOverflow.store(false, std::memory_order_release);
+	}
+}
+
+void CommandQueue::updateMaxDepth()
+{
+	const uint32_t depth = this->getStats().depth;
+
+	uint32_t maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+	while (depth > maxDepth && !m_maxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed))
+	{
+	}
+}
+
+
+CommandQueue::Stats_t CommandQueue::getStats() const
+{
+	Stats_t stats;
+
+	const uint64_t enqueuePosition = m_enqueuePosition.load(std::memory_order_relaxed);
+	const uint64_t dequeuePosition = m_dequeuePosition.load(std::memory_order_relaxed);
+
+	stats.pushed = m_pushedCount.load(std::memory_order_relaxed);
+	stats.executed = m_executedCount.load(std::memory_order_relaxed);
+	stats.merged = m_mergedCount.load(std::memory_order_relaxed);
+	stats.overflowed = m_overflowedCount.load(std::memory_order_relaxed);
+	stats.depth = static_cast<uint32_t>(enqueuePosition > dequeuePosition ? enqueuePosition - dequeuePosition : 0) + m_overflowSize.load(std::memory_order_relaxed);
+	stats.maxDepth = std::max(m_maxDepth.load(std::memory_order_relaxed), stats.depth);
+
+	const uint64_t dequeuedCount = stats.executed + stats.merged;
+
+	if (dequeuedCount > 0)
+	{
+		stats.averageWaitMs = m_totalWaitNs.load(std::memory_order_relaxed) / 1.0e6 / dequeuedCount;
+	}
+	stats.maxWaitMs = m_maxWaitNs.load(std::memory_order_relaxed) / 1.0e6;
+
+	return stats;
+}
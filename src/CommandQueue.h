@@ -0,0 +1,89 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+
+class CommandModel;
+
+// Bounded multi-producer single-consumer queue of commands between the GUI and the render thread.
+// The queue owns the commands: the consumer receives them as unique pointers and any command left
+// in the queue is deleted with it. Pushing never blocks; if the ring is full the commands are kept
+// in an overflow list (the only locked path) until the consumer makes room.
+class CommandQueue
+{
+public:
+	typedef struct
+	{
+		uint64_t pushed{0};
+		uint64_t executed{0};
+		uint64_t merged{0};
+		uint64_t overflowed{0};
+		uint32_t depth{0};
+		uint32_t maxDepth{0};
+		double averageWaitMs{0.0};
+		double maxWaitMs{0.0};
+	} Stats_t;
+
+	CommandQueue(const uint32_t capacity = 1024);
+	~CommandQueue();
+
+	CommandQueue(const CommandQueue&) = delete;
+	CommandQueue& operator=(const CommandQueue&) = delete;
+
+	// Producers
+	void push(CommandModel *command);
+
+	// Consumer
+	std::unique_ptr<CommandModel> popReady();
+	bool isEmpty() const;
+	uint32_t takeMergedCount();
+
+	Stats_t getStats() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	typedef struct
+	{
+		std::atomic<uint64_t> sequence;
+		CommandModel *command;
+		Clock::time_point enqueueTime;
+	} Cell_t;
+
+	bool tryPush(CommandModel *command, const Clock::time_point enqueueTime);
+	CommandModel *peekNoFlush() const;
+	CommandModel *peek();
+	std::unique_ptr<CommandModel> pop();
+	void flushOverflow();
+	void updateMaxDepth();
+
+	const uint64_t m_mask;
+	std::unique_ptr<Cell_t[]> m_cells;
+
+	std::atomic<uint64_t> m_enqueuePosition{0};
+	std::atomic<uint64_t> m_dequeuePosition{0};
+
+	std::mutex m_overflowMutex;
+	std::deque<std::pair<CommandModel*, Clock::time_point>> m_overflow;
+	std::atomic<bool> m_hasOverflow{false};
+	std::atomic<uint32_t> m_overflowSize{0};
+
+	// Counters
+	std::atomic<uint64_t> m_pushedCount{0};
+	std::atomic<uint64_t> m_executedCount{0};
+	std::atomic<uint64_t> m_mergedCount{0};
+	std::atomic<uint64_t> m_overflowedCount{0};
+	std::atomic<uint32_t> m_mergedSinceLastTake{0};
+	std::atomic<uint32_t> m_maxDepth{0};
+	std::atomic<uint64_t> m_totalWaitNs{0};
+	std::atomic<uint64_t> m_maxWaitNs{0};
+};
+
+#endif // COMMANDQUEUE_H
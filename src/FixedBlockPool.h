@@ -0,0 +1,87 @@
+#ifndef FIXEDBLOCKPOOL_H
+#define FIXEDBLOCKPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+
+// Lock-free pool of fixed size blocks. The free list head packs a block index with a tag
+// that is bumped on every update, so concurrent allocate/release calls are safe from ABA.
+// When the pool is exhausted the allocation falls back to the global heap.
+template <std::size_t BlockSize, uint32_t Capacity>
+class FixedBlockPool
+{
+public:
+	FixedBlockPool()
+	{
+		for (uint32_t i = 0; i < Capacity; ++i)
+		{
+			m_next[i].store(i + 1, std::memory_order_relaxed);
+		}
+
+		m_head.store(0);
+	}
+
+	void *allocate()
+	{
+		uint64_t head = m_head.load(std::memory_order_acquire);
+
+		for (;;)
+		{
+			const uint32_t index = static_cast<uint32_t>(head);
+
+			if (index >= Capacity)
+			{
+				// Pool exhausted
+				return ::operator new(BlockSize);
+			}
+
+			const uint64_t newHead = ((head >> 32) + 1) << 32 | m_next[index].load(std::memory_order_relaxed);
+
+			if (m_head.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				return &m_storage[index * BlockStride];
+			}
+		}
+	}
+
+	void release(void *block)
+	{
+		if (!this->owns(block))
+		{
+			::operator delete(block);
+			return;
+		}
+
+		const uint32_t index = static_cast<uint32_t>((static_cast<unsigned char*>(block) - m_storage) / BlockStride);
+
+		uint64_t head = m_head.load(std::memory_order_acquire);
+		uint64_t newHead;
+
+		do
+		{
+			m_next[index].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+			newHead = ((head >> 32) + 1) << 32 | index;
+		}
+		while (!m_head.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire));
+	}
+
+	bool owns(const void *block) const
+	{
+		const unsigned char *pointer = static_cast<const unsigned char*>(block);
+
+		return (pointer >= m_storage && pointer < m_storage + sizeof(m_storage));
+	}
+
+private:
+	static const std::size_t BlockAlignment = alignof(std::max_align_t);
+	static const std::size_t BlockStride = (BlockSize + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+
+	alignas(std::max_align_t) unsigned char m_storage[BlockStride * Capacity];
+	std::atomic<uint32_t> m_next[Capacity];
+	std::atomic<uint64_t> m_head;
+};
+
+#endif // FIXEDBLOCKPOOL_H
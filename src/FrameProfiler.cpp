@@ -0,0 +1,144 @@
+#include "FrameProfiler.h"
+
+#ifdef QTVTK_FRAME_PROFILER
+
+#include <algorithm>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+
+FrameProfiler &FrameProfiler::getInstance()
+{
+	static FrameProfiler frameProfiler;
+	return frameProfiler;
+}
+
+FrameProfiler::FrameProfiler()
+	: m_origin{std::chrono::steady_clock::now()}
+	, m_slots{new Slot_t[SLOTS_COUNT]}
+{
+	for (size_t i = 0; i < SLOTS_COUNT; ++i)
+	{
+		m_slots[i].sequence.store(0, std::memory_order_relaxed);
+	}
+
+	for (size_t i = 0; i < THREADS_MAXIMUM_COUNT; ++i)
+	{
+		m_threadNames[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+
+void FrameProfiler::record(const char *name, const int64_t startNs, const int64_t durationNs)
+{
+	const uint64_t writeIndex = m_writeIndex.fetch_add(1, std::memory_order_relaxed);
+	Slot_t &slot = m_slots[writeIndex & (SLOTS_COUNT - 1)];
+
+	// Sequence lock: the reader drops the slots being written
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.startNs.store(startNs, std::memory_order_relaxed);
+	slot.durationNs.store(durationNs, std::memory_order_relaxed);
+	slot.threadIndex.store(this->getThreadIndex(), std::memory_order_relaxed);
+
+	slot.sequence.store(writeIndex + 1, std::memory_order_release);
+}
+
+void FrameProfiler::setThreadName(const char *name)
+{
+	const uint32_t threadIndex = this->getThreadIndex();
+
+	if (threadIndex < THREADS_MAXIMUM_COUNT)
+	{
+		m_threadNames[threadIndex].store(name, std::memory_order_relaxed);
+	}
+}
+
+uint32_t FrameProfiler::getThreadIndex()
+{
+	// Small and stable ids, the trace viewer shows one row per thread
+	static thread_local const uint32_t threadIndex = FrameProfiler::getInstance().m_threadsCount.fetch_add(1, std::memory_order_relaxed);
+	return threadIndex;
+}
+
+
+bool FrameProfiler::writeChromeTrace(const QString &filePath) const
+{
+	const uint64_t writeIndex = m_writeIndex.load(std::memory_order_acquire);
+	const uint64_t firstIndex = writeIndex > SLOTS_COUNT ? writeIndex - SLOTS_COUNT : 0;
+	const qint64 processId = QCoreApplication::applicationPid();
+
+	QJsonArray traceEvents;
+
+	for (uint64_t index = firstIndex; index < writeIndex; ++index)
+	{
+		const Slot_t &slot = m_slots[index & (SLOTS_COUNT - 1)];
+
+		const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		const char *name = slot.name.load(std::memory_order_relaxed);
+		const int64_t startNs = slot.startNs.load(std::memory_order_relaxed);
+		const int64_t durationNs = slot.durationNs.load(std::memory_order_relaxed);
+		const uint32_t threadIndex = slot.threadIndex.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// Being written, or already overwritten by a newer event
+		if (sequence != index + 1 || slot.sequence.load(std::memory_order_relaxed) != sequence)
+		{
+			continue;
+		}
+
+		QJsonObject traceEvent;
+		traceEvent["name"] = QString::fromLatin1(name);
+		traceEvent["ph"] = "X";
+		traceEvent["ts"] = startNs / 1000.0;
+		traceEvent["dur"] = durationNs / 1000.0;
+		traceEvent["pid"] = processId;
+		traceEvent["tid"] = static_cast<int>(threadIndex);
+		traceEvents.append(traceEvent);
+	}
+
+	const uint32_t threadsCount = std::min<uint32_t>(m_threadsCount.load(std::memory_order_relaxed), THREADS_MAXIMUM_COUNT);
+
+	for (uint32_t threadIndex = 0; threadIndex < threadsCount; ++threadIndex)
+	{
+		const char *threadName = m_threadNames[threadIndex].load(std::memory_order_relaxed);
+
+		if (!threadName)
+		{
+			continue;
+		}
+
+		QJsonObject traceEvent;
+		traceEvent["name"] = "thread_name";
+		traceEvent["ph"] = "M";
+		traceEvent["pid"] = processId;
+		traceEvent["tid"] = static_cast<int>(threadIndex);
+		traceEvent["args"] = QJsonObject{{"name", QString::fromLatin1(threadName)}};
+		traceEvents.append(traceEvent);
+	}
+
+	QJsonObject trace;
+	trace["traceEvents"] = traceEvents;
+	trace["displayTimeUnit"] = "ms";
+
+	QSaveFile traceFile(filePath);
+
+	if (!traceFile.open(QIODevice::WriteOnly) || traceFile.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) < 0 || !traceFile.commit())
+	{
+		qWarning() << "FrameProfiler::writeChromeTrace(): unable to write" << filePath;
+		return false;
+	}
+
+	qDebug() << "FrameProfiler::writeChromeTrace():" << traceEvents.size() << "events written to" << filePath;
+
+	return true;
+}
+
+#endif // QTVTK_FRAME_PROFILER
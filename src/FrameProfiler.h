@@ -0,0 +1,104 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+// Scoped timers of the frame phases and the loader stages, exported as a Chrome trace (chrome://tracing).
+// Only built with the QTVTK_FRAME_PROFILER CMake option: otherwise the macros expand to nothing.
+//
+//	FRAME_PROFILER_SCOPE("render::commands");	// times the rest of the enclosing block
+//	FRAME_PROFILER_THREAD_NAME("Render");		// labels the calling thread in the trace
+//	FRAME_PROFILER_WRITE_TRACE(filePath);		// true if written
+
+#ifdef QTVTK_FRAME_PROFILER
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include <QString>
+
+
+class FrameProfiler
+{
+public:
+	// Records from construction to destruction. The name must outlive the profiler (a string literal).
+	class Scope
+	{
+	public:
+		explicit Scope(const char *name)
+			: m_name{name}
+			, m_startNs{FrameProfiler::getInstance().getTimeNs()}
+		{
+		}
+
+		~Scope()
+		{
+			FrameProfiler &frameProfiler = FrameProfiler::getInstance();
+			frameProfiler.record(m_name, m_startNs, frameProfiler.getTimeNs() - m_startNs);
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+	private:
+		const char *m_name;
+		const int64_t m_startNs;
+	};
+
+	static FrameProfiler &getInstance();
+
+	int64_t getTimeNs() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin).count();
+	}
+
+	// Lock-free, callable from any thread. The oldest events are overwritten once the buffer is full.
+	void record(const char *name, const int64_t startNs, const int64_t durationNs);
+	void setThreadName(const char *name);
+
+	// Events still in the buffer, as Chrome trace JSON
+	bool writeChromeTrace(const QString &filePath) const;
+
+private:
+	typedef struct
+	{
+		// 0 while being written, else the write index + 1
+		std::atomic<uint64_t> sequence;
+		std::atomic<const char*> name;
+		std::atomic<int64_t> startNs;
+		std::atomic<int64_t> durationNs;
+		std::atomic<uint32_t> threadIndex;
+	} Slot_t;
+
+	static const size_t SLOTS_COUNT = 1 << 16;
+	static const size_t THREADS_MAXIMUM_COUNT = 64;
+
+	FrameProfiler();
+
+	uint32_t getThreadIndex();
+
+	const std::chrono::steady_clock::time_point m_origin;
+
+	std::unique_ptr<Slot_t[]> m_slots;
+	std::atomic<uint64_t> m_writeIndex{0};
+
+	std::atomic<uint32_t> m_threadsCount{0};
+	std::atomic<const char*> m_threadNames[THREADS_MAXIMUM_COUNT];
+};
+
+#define FRAME_PROFILER_CONCATENATE_(a, b) a##b
+#define FRAME_PROFILER_CONCATENATE(a, b) FRAME_PROFILER_CONCATENATE_(a, b)
+
+#define FRAME_PROFILER_SCOPE(name) FrameProfiler::Scope FRAME_PROFILER_CONCATENATE(frameProfilerScope, __LINE__)(name)
+#define FRAME_PROFILER_THREAD_NAME(name) FrameProfiler::getInstance().setThreadName(name)
+#define FRAME_PROFILER_WRITE_TRACE(filePath) FrameProfiler::getInstance().writeChromeTrace(filePath)
+
+#else
+
+#define FRAME_PROFILER_SCOPE(name) do {} while (false)
+#define FRAME_PROFILER_THREAD_NAME(name) do {} while (false)
+#define FRAME_PROFILER_WRITE_TRACE(filePath) false
+
+#endif // QTVTK_FRAME_PROFILER
+
+#endif // FRAMEPROFILER_H
@@ -0,0 +1,118 @@
+#include "FrameScheduler.h"
+
+
+FrameScheduler::FrameScheduler()
+{
+	m_throttleTimer.setSingleShot(true);
+	connect(&m_throttleTimer, &QTimer::timeout, this, [this]()
+	{
+		// Already synchronized meanwhile, for another reason
+		if (m_updatePending)
+		{
+			this->emitUpdate();
+		}
+	});
+}
+
+
+void FrameScheduler::requestFrame(const uint32_t dirtyReasons)
+{
+	++m_requestsCount;
+
+	m_dirtyReasons |= dirtyReasons;
+
+	// The next frame renders every reason requested so far
+	if (m_updatePending)
+	{
+		++m_collapsedRequestsCount;
+		return;
+	}
+
+	m_updatePending = true;
+
+	const qint64 frameInterval = m_maximumFrameRate > 0 ? 1000 / m_maximumFrameRate : 0;
+	const qint64 elapsedTime = m_lastUpdateTimer.isValid() ? m_lastUpdateTimer.elapsed() : frameInterval;
+
+	if (elapsedTime < frameInterval)
+	{
+		++m_throttledRequestsCount;
+		m_throttleTimer.start(static_cast<int>(frameInterval - elapsedTime));
+		return;
+	}
+
+	this->emitUpdate();
+}
+
+void FrameScheduler::setMaximumFrameRate(const int maximumFrameRate)
+{
+	m_maximumFrameRate = maximumFrameRate;
+}
+
+int FrameScheduler::getMaximumFrameRate() const
+{
+	return m_maximumFrameRate;
+}
+
+
+uint32_t FrameScheduler::takeDirtyReasons()
+{
+	const uint32_t dirtyReasons = m_dirtyReasons;
+
+	m_dirtyReasons = None;
+	m_updatePending = false;
+
+	return dirtyReasons;
+}
+
+void FrameScheduler::addFrameChanges(const uint32_t changedReasons)
+{
+	m_frameChanges |= changedReasons;
+}
+
+void FrameScheduler::checkCameraChange(const uint64_t cameraMTime)
+{
+	if (cameraMTime != m_renderedCameraMTime)
+	{
+		m_frameChanges |= Camera;
+	}
+}
+
+uint32_t FrameScheduler::getFrameChanges() const
+{
+	return m_frameChanges;
+}
+
+void FrameScheduler::frameDone(const bool rendered, const uint64_t renderedCameraMTime)
+{
+	if (rendered)
+	{
+		m_frameChanges = None;
+		m_renderedCameraMTime = renderedCameraMTime;
+
+		++m_renderedFramesCount;
+	}
+	else
+	{
+		++m_skippedFramesCount;
+	}
+}
+
+FrameScheduler::Stats_t FrameScheduler::getStats() const
+{
+	Stats_t stats;
+	stats.requestsCount = m_requestsCount;
+	stats.collapsedRequestsCount = m_collapsedRequestsCount;
+	stats.throttledRequestsCount = m_throttledRequestsCount;
+	stats.renderedFramesCount = m_renderedFramesCount;
+	stats.skippedFramesCount = m_skippedFramesCount;
+
+	return stats;
+}
+
+
+void FrameScheduler::emitUpdate()
+{
+	m_lastUpdateTimer.start();
+
+	emit updateRequested();
+}
@@ -0,0 +1,92 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <atomic>
+#include <cstdint>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+
+// Renders on demand: the item requests a frame with the reasons it may have changed, the requests are merged
+// into one update() per frame and spaced by the maximum frame rate. The requested reasons are only hints: the
+// renderer reports the changes it observes while preparing the frame (camera moved, commands executed, selection,
+// levels of detail, render state, viewport), and only renders when there is one. An idle update or a press
+// without drag leaves the framebuffer as it is.
+class FrameScheduler : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum DirtyReason_t : uint32_t
+	{
+		None = 0,
+		Camera = 1 << 0,
+		Scene = 1 << 1,
+		Selection = 1 << 2,
+		Style = 1 << 3,
+		Viewport = 1 << 4,
+		All = Camera | Scene | Selection | Style | Viewport
+	};
+
+	typedef struct
+	{
+		uint64_t requestsCount;
+		uint64_t collapsedRequestsCount;
+		uint64_t throttledRequestsCount;
+		uint64_t renderedFramesCount;
+		uint64_t skippedFramesCount;
+	} Stats_t;
+
+	FrameScheduler();
+
+	// GUI thread
+	void requestFrame(const uint32_t dirtyReasons);
+
+	// Frames per second, 0 for no cap
+	void setMaximumFrameRate(const int maximumFrameRate);
+	int getMaximumFrameRate() const;
+
+	// Renderer synchronize(), the GUI thread is blocked: the reasons requested since the previous frame, as hints
+	uint32_t takeDirtyReasons();
+
+	// Renderer thread: the changes observed since the last rendered frame
+	void addFrameChanges(const uint32_t changedReasons);
+	// A camera change if the modification time differs from the one of the last rendered frame
+	void checkCameraChange(const uint64_t cameraMTime);
+	// None if the framebuffer already holds the frame
+	uint32_t getFrameChanges() const;
+
+	// Renderer thread, once per render(). The camera modification time after rendering, the clipping range
+	// is reset while rendering.
+	void frameDone(const bool rendered, const uint64_t renderedCameraMTime);
+
+	Stats_t getStats() const;
+
+signals:
+	// Connected to the update() of the item
+	void updateRequested();
+
+private:
+	void emitUpdate();
+
+	uint32_t m_dirtyReasons = None;
+	bool m_updatePending = false;
+
+	// Renderer thread
+	uint32_t m_frameChanges = None;
+	uint64_t m_renderedCameraMTime = 0;
+
+	int m_maximumFrameRate = 60;
+	QElapsedTimer m_lastUpdateTimer;
+	QTimer m_throttleTimer;
+
+	std::atomic<uint64_t> m_requestsCount{0};
+	std::atomic<uint64_t> m_collapsedRequestsCount{0};
+	std::atomic<uint64_t> m_throttledRequestsCount{0};
+	std::atomic<uint64_t> m_renderedFramesCount{0};
+	std::atomic<uint64_t> m_skippedFramesCount{0};
+};
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cmath>
+
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDoubleArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkVersion.h>
+
+#include "GeometryCompactor.h"
+#include "Parallel.h"
+
+
+static const float OCTAHEDRAL_SCALE = 32767.0f;
+
+// Out of the [-32767, 32767] range of the encoded directions, (0, 0) itself is the +Z direction
+static const short ZERO_NORMAL_CODE = -32768;
+
+
+static inline float signNotZero(const float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+static inline void encodeOctahedral(const float normal[3], short octahedral[2])
+{
+	const float l1Norm = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+
+	// Zero normals of degenerate faces stay zero, and so do the non-finite ones
+	if (!std::isfinite(l1Norm) || l1Norm <= 0.0f)
+	{
+		octahedral[0] = ZERO_NORMAL_CODE;
+		octahedral[1] = ZERO_NORMAL_CODE;
+		return;
+	}
+
+	// Project on the octahedron, then fold its lower half over the upper one
+	float x = normal[0] / l1Norm;
+	float y = normal[1] / l1Norm;
+
+	if (normal[2] < 0.0f)
+	{
+		const float foldedX = (1.0f - std::abs(y)) * signNotZero(x);
+		const float foldedY = (1.0f - std::abs(x)) * signNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	octahedral[0] = static_cast<short>(std::round(std::max(-1.0f, std::min(x, 1.0f)) * OCTAHEDRAL_SCALE));
+	octahedral[1] = static_cast<short>(std::round(std::max(-1.0f, std::min(y, 1.0f)) * OCTAHEDRAL_SCALE));
+}
+
+static inline void decodeOctahedral(const short octahedral[2], float normal[3])
+{
+	if (octahedral[0] == ZERO_NORMAL_CODE && octahedral[1] == ZERO_NORMAL_CODE)
+	{
+		normal[0] = 0.0f;
+		normal[1] = 0.0f;
+		normal[2] = 0.0f;
+		return;
+	}
+
+	float x = octahedral[0] / OCTAHEDRAL_SCALE;
+	float y = octahedral[1] / OCTAHEDRAL_SCALE;
+	const float z = 1.0f - std::abs(x) - std::abs(y);
+
+	if (z < 0.0f)
+	{
+		const float unfoldedX = (1.0f - std::abs(y)) * signNotZero(x);
+		const float unfoldedY = (1.0f - std::abs(x)) * signNotZero(y);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	const float inverseLength = 1.0f / std::sqrt(x * x + y * y + z * z);
+
+	normal[0] = x * inverseLength;
+	normal[1] = y * inverseLength;
+	normal[2] = z * inverseLength;
+}
+
+
+GeometryCompactor::GeometryBytes_t GeometryCompactor::compact(const vtkSmartPointer<vtkPolyData> polyData)
+{
+	vtkPoints *points = polyData->GetPoints();
+
+	// Float32 points: the readers already produce them, other sources are converted
+	if (points && points->GetDataType() != VTK_FLOAT)
+	{
+		const vtkIdType pointsCount = points->GetNumberOfPoints();
+
+		vtkSmartPointer<vtkFloatArray> floatPointsData = vtkSmartPointer<vtkFloatArray>::New();
+		floatPointsData->SetNumberOfComponents(3);
+		floatPointsData->SetNumberOfTuples(pointsCount);
+		float *floatCoordinates = floatPointsData->GetPointer(0);
+
+		Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+		{
+			if (points->GetDataType() == VTK_DOUBLE)
+			{
+				const double *coordinates = static_cast<vtkDoubleArray*>(points->GetData())->GetPointer(0);
+				std::transform(coordinates + 3 * rangeBegin, coordinates + 3 * rangeEnd, floatCoordinates + 3 * rangeBegin, [](const double coordinate)
+				{
+					return static_cast<float>(coordinate);
+				});
+			}
+			else
+			{
+				for (size_t i = rangeBegin; i < rangeEnd; ++i)
+				{
+					double point[3];
+					points->GetPoint(i, point);
+					floatCoordinates[3 * i] = static_cast<float>(point[0]);
+					floatCoordinates[3 * i + 1] = static_cast<float>(point[1]);
+					floatCoordinates[3 * i + 2] = static_cast<float>(point[2]);
+				}
+			}
+		});
+
+		points->SetData(floatPointsData);
+	}
+
+	// Face normals of the file: the flat interpolation gets the same result from the positions
+	polyData->GetCellData()->Initialize();
+
+	// Cell types and point to cells links are rebuilt if a filter ever needs them
+	polyData->DeleteCells();
+	polyData->DeleteLinks();
+
+#if VTK_MAJOR_VERSION >= 9
+	if (polyData->GetPolys()->CanConvertTo32BitStorage())
+	{
+		polyData->GetPolys()->ConvertTo32BitStorage();
+	}
+#else
+	// Legacy cell arrays keep their vtkIdType ids, see getConnectivityIdBytes()
+#endif
+
+	polyData->Squeeze();
+
+	return GeometryCompactor::getGeometryBytes(polyData);
+}
+
+GeometryCompactor::GeometryBytes_t GeometryCompactor::getGeometryBytes(const vtkSmartPointer<vtkPolyData> polyData)
+{
+	GeometryBytes_t geometryBytes;
+
+	if (!polyData)
+	{
+		return geometryBytes;
+	}
+
+	geometryBytes.pointsBytes = polyData->GetPoints() ? GeometryCompactor::getArrayBytes(polyData->GetPoints()->GetData()) : 0;
+	geometryBytes.polysBytes = polyData->GetPolys() ? 1024 * static_cast<int64_t>(polyData->GetPolys()->GetActualMemorySize()) : 0;
+	geometryBytes.pointNormalsBytes = GeometryCompactor::getArrayBytes(polyData->GetPointData()->GetNormals());
+	geometryBytes.cellDataBytes = 1024 * static_cast<int64_t>(polyData->GetCellData()->GetActualMemorySize());
+	geometryBytes.totalBytes = geometryBytes.pointsBytes + geometryBytes.polysBytes + geometryBytes.pointNormalsBytes + geometryBytes.cellDataBytes;
+
+	return geometryBytes;
+}
+
+int64_t GeometryCompactor::getArrayBytes(vtkDataArray *dataArray)
+{
+	// Allocated size, spare capacity included
+	return dataArray ? static_cast<int64_t>(dataArray->GetSize()) * dataArray->GetDataTypeSize() : 0;
+}
+
+int GeometryCompactor::getConnectivityIdBytes(const vtkSmartPointer<vtkPolyData> polyData)
+{
+#if VTK_MAJOR_VERSION >= 9
+	return polyData->GetPolys()->IsStorage64Bit() ? 8 : 4;
+#else
+	(void)polyData;
+	return sizeof(vtkIdType);
+#endif
+}
+
+
+vtkSmartPointer<vtkShortArray> GeometryCompactor::encodeNormals(vtkDataArray *normals)
+{
+	const vtkIdType normalsCount = normals->GetNumberOfTuples();
+
+	vtkSmartPointer<vtkShortArray> octNormals = vtkSmartPointer<vtkShortArray>::New();
+	octNormals->SetName("OctahedralNormals");
+	octNormals->SetNumberOfComponents(2);
+	octNormals->SetNumberOfTuples(normalsCount);
+	short *octNormalsPointer = octNormals->GetPointer(0);
+
+	Parallel::forEachRange(normalsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		const float *floatNormals = normals->GetDataType() == VTK_FLOAT ? static_cast<vtkFloatArray*>(normals)->GetPointer(0) : nullptr;
+
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			float normal[3];
+
+			if (floatNormals)
+			{
+				std::copy(floatNormals + 3 * i, floatNormals + 3 * i + 3, normal);
+			}
+			else
+			{
+				double doubleNormal[3];
+				normals->GetTuple(i, doubleNormal);
+				std::copy(doubleNormal, doubleNormal + 3, normal);
+			}
+
+			encodeOctahedral(normal, octNormalsPointer + 2 * i);
+		}
+	});
+
+	return octNormals;
+}
+
+vtkSmartPointer<vtkFloatArray> GeometryCompactor::decodeNormals(vtkShortArray *octNormals)
+{
+	const vtkIdType normalsCount = octNormals->GetNumberOfTuples();
+	const short *octNormalsPointer = octNormals->GetPointer(0);
+
+	vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+	normals->SetName("Normals");
+	normals->SetNumberOfComponents(3);
+	normals->SetNumberOfTuples(normalsCount);
+	float *normalsPointer = normals->GetPointer(0);
+
+	Parallel::forEachRange(normalsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			decodeOctahedral(octNormalsPointer + 2 * i, normalsPointer + 3 * i);
+		}
+	});
+
+	return normals;
+}
+
+vtkSmartPointer<vtkShortArray> GeometryCompactor::quantizeNormals(vtkDataArray *normals)
+{
+	const vtkIdType normalsCount = normals->GetNumberOfTuples();
+
+	vtkSmartPointer<vtkShortArray> quantizedNormals = vtkSmartPointer<vtkShortArray>::New();
+	quantizedNormals->SetName("Normals");
+	quantizedNormals->SetNumberOfComponents(3);
+	quantizedNormals->SetNumberOfTuples(normalsCount);
+	short *quantizedNormalsPointer = quantizedNormals->GetPointer(0);
+
+	Parallel::forEachRange(normalsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		const float *floatNormals = normals->GetDataType() == VTK_FLOAT ? static_cast<vtkFloatArray*>(normals)->GetPointer(0) : nullptr;
+
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			float normal[3];
+
+			if (floatNormals)
+			{
+				std::copy(floatNormals + 3 * i, floatNormals + 3 * i + 3, normal);
+			}
+			else
+			{
+				double doubleNormal[3];
+				normals->GetTuple(i, doubleNormal);
+				std::copy(doubleNormal, doubleNormal + 3, normal);
+			}
+
+			const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			const float scale = (std::isfinite(length) && length > 0.0f) ? OCTAHEDRAL_SCALE / length : 0.0f;
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				quantizedNormalsPointer[3 * i + axis] = static_cast<short>(std::round(normal[axis] * scale));
+			}
+		}
+	});
+
+	return quantizedNormals;
+}
+
+void GeometryCompactor::quantizePointNormals(vtkPolyData *polyData)
+{
+	vtkDataArray *normals = polyData->GetPointData()->GetNormals();
+
+	if (normals && normals->GetDataType() != VTK_SHORT)
+	{
+		polyData->GetPointData()->SetNormals(GeometryCompactor::quantizeNormals(normals));
+	}
+}
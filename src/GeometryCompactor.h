@@ -0,0 +1,47 @@
+#ifndef GEOMETRYCOMPACTOR_H
+#define GEOMETRYCOMPACTOR_H
+
+#include <cstdint>
+
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPolyData.h>
+#include <vtkShortArray.h>
+#include <vtkSmartPointer.h>
+
+
+// Compact resident storage of the models geometry.
+// compact() modifies the polydata in place: float32 points, 32-bit connectivity when the ids fit, no cell
+// data nor cached cells and links, no spare capacity. Point normals are kept as two 16-bit octahedral
+// coordinates while nothing draws them (4 bytes per point instead of 12). The drawn ones are three 16-bit
+// components (6 bytes per point): the mapper converts them to floats when it uploads them, and the shaders
+// normalize them.
+// VTK 8 cell arrays can only store vtkIdType: their ids are 32-bit only with a VTK built with
+// VTK_USE_64BIT_IDS off, compact() cannot narrow them. The saving on the normals does not depend on the VTK version.
+class GeometryCompactor
+{
+public:
+	typedef struct
+	{
+		int64_t pointsBytes{0};
+		int64_t polysBytes{0};
+		int64_t pointNormalsBytes{0};
+		int64_t cellDataBytes{0};
+		int64_t totalBytes{0};
+	} GeometryBytes_t;
+
+	static GeometryBytes_t compact(const vtkSmartPointer<vtkPolyData> polyData);
+
+	static GeometryBytes_t getGeometryBytes(const vtkSmartPointer<vtkPolyData> polyData);
+	static int64_t getArrayBytes(vtkDataArray *dataArray);
+	static int getConnectivityIdBytes(const vtkSmartPointer<vtkPolyData> polyData);
+
+	static vtkSmartPointer<vtkShortArray> encodeNormals(vtkDataArray *normals);
+	static vtkSmartPointer<vtkFloatArray> decodeNormals(vtkShortArray *octNormals);
+	// Drawn normals, unit length is 32767. Zero and non-finite normals are zero.
+	static vtkSmartPointer<vtkShortArray> quantizeNormals(vtkDataArray *normals);
+	// Quantizes the float point normals of the polydata in place, if any
+	static void quantizePointNormals(vtkPolyData *polyData);
+};
+
+#endif // GEOMETRYCOMPACTOR_H
@@ -0,0 +1,130 @@
+#include "InputEventRing.h"
+
+
+static uint64_t roundUpToPowerOfTwo(const uint32_t value)
+{
+	uint64_t powerOfTwo = 2;
+
+	while (powerOfTwo < value)
+	{
+		powerOfTwo <<= 1;
+	}
+
+	return powerOfTwo;
+}
+
+
+InputEventRing::InputEventRing(const uint32_t capacity)
+	: m_mask{roundUpToPowerOfTwo(capacity) - 1}
+	, m_events{new InputEvent_t[m_mask + 1]}
+{
+	m_deferredEvents.reserve(m_mask + 1);
+}
+
+
+void InputEventRing::push(const InputEvent_t &inputEvent)
+{
+	++m_pushedCount;
+
+	// Nothing overtakes the events waiting for room
+	if (this->flushDeferred() && this->tryPush(inputEvent))
+	{
+		return;
+	}
+
+	++m_deferredCount;
+
+	if (!m_deferredEvents.empty())
+	{
+		InputEvent_t &lastEvent = m_deferredEvents.back();
+
+		// The interactor only uses the latest position of a drag, and the renderer sums the wheel ticks anyway
+		if (lastEvent.type == inputEvent.type && inputEvent.type == Type_t::MouseMove)
+		{
+			lastEvent = inputEvent;
+			++m_mergedCount;
+			return;
+		}
+
+		if (lastEvent.type == inputEvent.type && inputEvent.type == Type_t::Wheel)
+		{
+			lastEvent.delta += inputEvent.delta;
+			lastEvent.timestamp = inputEvent.timestamp;
+			++m_mergedCount;
+			return;
+		}
+	}
+
+	// Only the presses, releases and selections accumulate here, at the user pace
+	m_deferredEvents.push_back(inputEvent);
+	m_hasDeferredEvents = true;
+}
+
+bool InputEventRing::flushDeferred()
+{
+	if (m_deferredEvents.empty())
+	{
+		return true;
+	}
+
+	size_t flushedCount = 0;
+
+	while (flushedCount < m_deferredEvents.size() && this->tryPush(m_deferredEvents[flushedCount]))
+	{
+		++flushedCount;
+	}
+
+	m_deferredEvents.erase(m_deferredEvents.begin(), m_deferredEvents.begin() + flushedCount);
+	m_hasDeferredEvents = !m_deferredEvents.empty();
+
+	return m_deferredEvents.empty();
+}
+
+bool InputEventRing::pop(InputEvent_t &inputEvent)
+{
+	const uint64_t readPosition = m_readPosition.load(std::memory_order_relaxed);
+
+	if (readPosition == m_writePosition.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	inputEvent = m_events[readPosition & m_mask];
+	m_readPosition.store(readPosition + 1, std::memory_order_release);
+
+	++m_poppedCount;
+
+	return true;
+}
+
+bool InputEventRing::hasDeferredEvents() const
+{
+	return m_hasDeferredEvents;
+}
+
+InputEventRing::Stats_t InputEventRing::getStats() const
+{
+	Stats_t stats;
+	stats.pushed = m_pushedCount;
+	stats.popped = m_poppedCount;
+	stats.merged = m_mergedCount;
+	stats.deferred = m_deferredCount;
+
+	return stats;
+}
+
+
+bool InputEventRing::tryPush(const InputEvent_t &inputEvent)
+{
+	const uint64_t writePosition = m_writePosition.load(std::memory_order_relaxed);
+
+	if (writePosition - m_readPosition.load(std::memory_order_acquire) > m_mask)
+	{
+		return false;
+	}
+
+	m_events[writePosition & m_mask] = inputEvent;
+	m_writePosition.store(writePosition + 1, std::memory_order_release);
+
+	return true;
+}
@@ -0,0 +1,86 @@
+#ifndef INPUTEVENTRING_H
+#define INPUTEVENTRING_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// Bounded single-producer single-consumer ring of the input events, from the GUI thread to the render
+// thread. The events are small plain records copied in place: nothing is allocated per event. If the
+// ring is full, the producer defers the events in order until there is room again: the consecutive moves
+// and wheel ticks are merged, the presses, releases and selections are never dropped.
+class InputEventRing
+{
+public:
+	enum class Type_t : uint8_t
+	{
+		MousePress,
+		MouseRelease,
+		MouseMove,
+		Wheel,
+		Select
+	};
+
+	typedef struct
+	{
+		Type_t type;
+		int32_t x;
+		int32_t y;
+		uint32_t buttons;
+		uint32_t modifiers;
+		// Wheel angle, in eighths of a degree
+		int32_t delta;
+		uint64_t timestamp;
+	} InputEvent_t;
+
+	typedef struct
+	{
+		uint64_t pushed{0};
+		uint64_t popped{0};
+		uint64_t merged{0};
+		uint64_t deferred{0};
+	} Stats_t;
+
+	InputEventRing(const uint32_t capacity = 256);
+
+	InputEventRing(const InputEventRing&) = delete;
+	InputEventRing& operator=(const InputEventRing&) = delete;
+
+	// Producer
+	void push(const InputEvent_t &inputEvent);
+
+	// Producer, or while it is blocked (renderer synchronize()): moves the deferred events to the ring, false if some are left
+	bool flushDeferred();
+
+	// Consumer, false once empty
+	bool pop(InputEvent_t &inputEvent);
+
+	// Any thread: some events wait for room in the ring, the consumer must run again once it is drained
+	bool hasDeferredEvents() const;
+
+	Stats_t getStats() const;
+
+private:
+	bool tryPush(const InputEvent_t &inputEvent);
+
+	const uint64_t m_mask;
+	std::unique_ptr<InputEvent_t[]> m_events;
+
+	// Written by the producer and by the consumer respectively
+	std::atomic<uint64_t> m_writePosition{0};
+	std::atomic<uint64_t> m_readPosition{0};
+
+	// Producer only: what did not fit in the ring, in order. Reserved with the ring capacity.
+	std::vector<InputEvent_t> m_deferredEvents;
+	std::atomic<bool> m_hasDeferredEvents{false};
+
+	// Counters
+	std::atomic<uint64_t> m_pushedCount{0};
+	std::atomic<uint64_t> m_poppedCount{0};
+	std::atomic<uint64_t> m_mergedCount{0};
+	std::atomic<uint64_t> m_deferredCount{0};
+};
+
+#endif // INPUTEVENTRING_H
@@ -0,0 +1,81 @@
+#include <atomic>
+
+#include "LegacyCells.h"
+#include "Parallel.h"
+
+
+LegacyCells::LegacyCells(vtkCellArray *cells)
+	: m_cells{cells}
+{
+#if VTK_MAJOR_VERSION >= 9
+	m_exportedCells = vtkSmartPointer<vtkIdTypeArray>::New();
+	m_cells->ExportLegacyFormat(m_exportedCells);
+#endif
+}
+
+vtkIdType *LegacyCells::getData() const
+{
+#if VTK_MAJOR_VERSION >= 9
+	return m_exportedCells->GetPointer(0);
+#else
+	return m_cells->GetPointer();
+#endif
+}
+
+int64_t LegacyCells::getSize() const
+{
+#if VTK_MAJOR_VERSION >= 9
+	return m_exportedCells->GetNumberOfValues();
+#else
+	return m_cells->GetNumberOfConnectivityEntries();
+#endif
+}
+
+int64_t LegacyCells::getCellsCount() const
+{
+	return m_cells->GetNumberOfCells();
+}
+
+bool LegacyCells::isTrianglesOnly() const
+{
+	const vtkIdType *cells = this->getData();
+	const int64_t cellsCount = this->getCellsCount();
+
+	std::atomic<bool> trianglesOnly{this->getSize() == 4 * cellsCount};
+
+	if (trianglesOnly)
+	{
+		Parallel::forEachRange(cellsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+		{
+			for (size_t i = rangeBegin; i < rangeEnd && trianglesOnly.load(std::memory_order_relaxed); ++i)
+			{
+				if (cells[4 * i] != 3)
+				{
+					trianglesOnly = false;
+				}
+			}
+		});
+	}
+
+	return trianglesOnly;
+}
+
+void LegacyCells::commit()
+{
+#if VTK_MAJOR_VERSION >= 9
+	m_cells->ImportLegacyFormat(m_exportedCells);
+#endif
+
+	m_cells->Modified();
+}
+
+void LegacyCells::setCells(vtkCellArray *cells, const int64_t cellsCount, vtkIdTypeArray *legacyCells)
+{
+#if VTK_MAJOR_VERSION >= 9
+	// The cells count follows from the sizes in the array
+	(void)cellsCount;
+	cells->ImportLegacyFormat(legacyCells);
+#else
+	cells->SetCells(cellsCount, legacyCells);
+#endif
+}
@@ -0,0 +1,41 @@
+#ifndef LEGACYCELLS_H
+#define LEGACYCELLS_H
+
+#include <cstdint>
+
+#include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkSmartPointer.h>
+#include <vtkVersion.h>
+
+
+// Cells of a cell array in the VTK 8 layout, every cell stored as [n, id_0, ..., id_n-1].
+// VTK 8 cell arrays are stored this way and are read and edited in place. VTK 9 ones store the offsets
+// and the 32 or 64-bit ids apart: their cells are exported to a copy owned by the view, and edits are
+// only stored back by commit().
+class LegacyCells
+{
+public:
+	explicit LegacyCells(vtkCellArray *cells);
+
+	vtkIdType *getData() const;
+	int64_t getSize() const;
+	int64_t getCellsCount() const;
+
+	// Triangles only: cell i then starts at 4 * i
+	bool isTrianglesOnly() const;
+
+	void commit();
+
+	// Replaces the cells of an array by cellsCount cells in the VTK 8 layout
+	static void setCells(vtkCellArray *cells, const int64_t cellsCount, vtkIdTypeArray *legacyCells);
+
+private:
+	vtkCellArray *m_cells;
+
+#if VTK_MAJOR_VERSION >= 9
+	vtkSmartPointer<vtkIdTypeArray> m_exportedCells;
+#endif
+};
+
+#endif // LEGACYCELLS_H
@@ -0,0 +1,610 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <vtkCellArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+#include "LegacyCells.h"
+
+
+// Bumped whenever the layout below changes, older entries are then ignored
+static const uint32_t FORMAT_VERSION = 1;
+static const char FORMAT_MAGIC[8] = {'Q', 'T', 'V', 'T', 'K', 'M', 'S', 'H'};
+
+// Arrays start on this boundary, so the mapped file can be read in place
+static const qint64 ARRAYS_ALIGNMENT = 64;
+
+// Read size of the key hashing
+static const qint64 HASH_BLOCK_SIZE = 1 << 20;
+
+static const char *INDEX_FILE_NAME = "index.json";
+
+// The accesses of the cache hits are saved at most this often, the other changes right away
+static const qint64 INDEX_ACCESSES_SAVE_INTERVAL = 30000;
+static const char *ENTRY_FILE_SUFFIX = ".mesh";
+
+typedef struct
+{
+	char magic[8];
+	uint32_t formatVersion;
+	uint32_t pointsType;
+	uint64_t pointsCount;
+	uint64_t polysCount;
+	uint64_t connectivityCount;
+	uint64_t normalsCount;
+	uint64_t pointsOffset;
+	uint64_t connectivityOffset;
+	uint64_t normalsOffset;
+	uint64_t fileSize;
+} FileHeader_t;
+
+static_assert(sizeof(FileHeader_t) == 80, "The mesh cache header must not be padded");
+
+
+// Without overflow: the header values are read from the file
+static bool isArrayInFile(const uint64_t offset, const uint64_t count, const uint64_t itemSize, const uint64_t fileSize)
+{
+	return offset <= fileSize && count <= (fileSize - offset) / itemSize;
+}
+
+// Every polygon in the [n, ids...] layout fits in the array and only references existing points
+static bool isValidConnectivity(const int64_t *connectivity, const uint64_t connectivityCount, const uint64_t polysCount, const uint64_t pointsCount)
+{
+	uint64_t position = 0;
+
+	for (uint64_t poly = 0; poly < polysCount; ++poly)
+	{
+		if (position >= connectivityCount)
+		{
+			return false;
+		}
+
+		const int64_t polySize = connectivity[position++];
+
+		if (polySize < 1 || static_cast<uint64_t>(polySize) > connectivityCount - position)
+		{
+			return false;
+		}
+
+		for (int64_t corner = 0; corner < polySize; ++corner)
+		{
+			const int64_t pointId = connectivity[position++];
+
+			if (pointId < 0 || static_cast<uint64_t>(pointId) >= pointsCount)
+			{
+				return false;
+			}
+		}
+	}
+
+	return position == connectivityCount;
+}
+
+static qint64 alignOffset(const qint64 offset)
+{
+	return (offset + ARRAYS_ALIGNMENT - 1) / ARRAYS_ALIGNMENT * ARRAYS_ALIGNMENT;
+}
+
+static bool writePadding(QSaveFile &file, const qint64 offset)
+{
+	static const char zeros[ARRAYS_ALIGNMENT] = {};
+
+	return file.pos() <= offset && file.write(zeros, offset - file.pos()) == offset - file.pos();
+}
+
+// A short write is a failure, the entry would be truncated
+static bool writeData(QSaveFile &file, const void *data, const qint64 size)
+{
+	return file.write(static_cast<const char *>(data), size) == size;
+}
+
+
+MeshCache::MeshCache()
+{
+	this->setDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/meshes");
+}
+
+MeshCache::~MeshCache()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_indexChanged)
+	{
+		this->saveIndexNoLock();
+	}
+}
+
+
+void MeshCache::setDirectory(const QString &directory)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// The pending accesses belong to the previous directory
+	if (m_indexChanged)
+	{
+		this->saveIndexNoLock();
+	}
+
+	m_directory = directory;
+
+	this->loadIndexNoLock();
+}
+
+QString MeshCache::getDirectory() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_directory;
+}
+
+void MeshCache::setMaximumSize(const qint64 maximumSize)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_maximumSize = maximumSize;
+
+	this->evictNoLock(0);
+	this->saveIndexNoLock();
+}
+
+qint64 MeshCache::getMaximumSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_maximumSize;
+}
+
+qint64 MeshCache::getSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_size;
+}
+
+void MeshCache::setEnabled(const bool enabled)
+{
+	m_enabled = enabled;
+}
+
+bool MeshCache::isEnabled() const
+{
+	return m_enabled;
+}
+
+
+QString MeshCache::computeKey(const QString &filePath, const QString &pipelineTag) const
+{
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return QString();
+	}
+
+	const QFileInfo fileInfo(filePath);
+	const qint64 fileSize = file.size();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(QByteArray::number(fileSize));
+	hash.addData(QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch()));
+	hash.addData(pipelineTag.toUtf8());
+	hash.addData(QByteArray::number(FORMAT_VERSION));
+
+	// Every byte: the key also identifies the geometry shared by the models loaded from equal files.
+	// Read in blocks, the whole file is never held in memory.
+	qint64 hashedBytes = 0;
+
+	while (hashedBytes < fileSize)
+	{
+		const QByteArray block = file.read(HASH_BLOCK_SIZE);
+
+		if (block.isEmpty())
+		{
+			return QString();
+		}
+
+		hash.addData(block);
+		hashedBytes += block.size();
+	}
+
+	return QString::fromLatin1(hash.result().toHex());
+}
+
+
+bool MeshCache::contains(const QString &key) const
+{
+	if (!m_enabled || key.isEmpty())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_entries.contains(key) && QFile::exists(this->getEntryPath(key));
+}
+
+vtkSmartPointer<vtkPolyData> MeshCache::load(const QString &key)
+{
+	if (!m_enabled || key.isEmpty())
+	{
+		return nullptr;
+	}
+
+	QString entryPath;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_entries.contains(key))
+		{
+			return nullptr;
+		}
+
+		entryPath = this->getEntryPath(key);
+	}
+
+	QFile file(entryPath);
+
+	if (!file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(FileHeader_t)))
+	{
+		return nullptr;
+	}
+
+	const uchar *mappedFile = file.map(0, file.size());
+
+	if (!mappedFile)
+	{
+		return nullptr;
+	}
+
+	FileHeader_t header;
+	std::memcpy(&header, mappedFile, sizeof(FileHeader_t));
+
+	const size_t pointSize = header.pointsType == VTK_FLOAT ? sizeof(float) : sizeof(double);
+	const bool validHeader = std::memcmp(header.magic, FORMAT_MAGIC, sizeof(FORMAT_MAGIC)) == 0
+							 && header.formatVersion == FORMAT_VERSION
+							 && (header.pointsType == VTK_FLOAT || header.pointsType == VTK_DOUBLE)
+							 && header.fileSize == static_cast<uint64_t>(file.size())
+							 && isArrayInFile(header.pointsOffset, header.pointsCount, 3 * pointSize, header.fileSize)
+							 && isArrayInFile(header.connectivityOffset, header.connectivityCount, sizeof(int64_t), header.fileSize)
+							 && isArrayInFile(header.normalsOffset, header.normalsCount, 3 * sizeof(float), header.fileSize)
+							 && header.connectivityOffset % sizeof(int64_t) == 0
+							 && (header.normalsCount == 0 || header.normalsCount == header.pointsCount);
+
+	// A corrupted entry must not index past the points when drawn or picked
+	const bool validEntry = validHeader && isValidConnectivity(reinterpret_cast<const int64_t *>(mappedFile + header.connectivityOffset),
+															   header.connectivityCount, header.polysCount, header.pointsCount);
+
+	if (!validEntry)
+	{
+		qDebug() << "MeshCache::load(): invalid entry" << key;
+
+		file.unmap(const_cast<uchar *>(mappedFile));
+		return nullptr;
+	}
+
+	// Points
+	vtkSmartPointer<vtkDataArray> pointsData;
+
+	if (header.pointsType == VTK_FLOAT)
+	{
+		pointsData = vtkSmartPointer<vtkFloatArray>::New();
+	}
+	else
+	{
+		pointsData = vtkSmartPointer<vtkDoubleArray>::New();
+	}
+
+	pointsData->SetNumberOfComponents(3);
+	pointsData->SetNumberOfTuples(header.pointsCount);
+	std::memcpy(pointsData->GetVoidPointer(0), mappedFile + header.pointsOffset, 3 * pointSize * header.pointsCount);
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetData(pointsData);
+
+	// Polygons, in the [n, ids...] layout of the cell array
+	vtkSmartPointer<vtkIdTypeArray> connectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+	connectivity->SetNumberOfValues(header.connectivityCount);
+
+	if (sizeof(vtkIdType) == sizeof(int64_t))
+	{
+		std::memcpy(connectivity->GetPointer(0), mappedFile + header.connectivityOffset, sizeof(int64_t) * header.connectivityCount);
+	}
+	else
+	{
+		const int64_t *storedConnectivity = reinterpret_cast<const int64_t *>(mappedFile + header.connectivityOffset);
+		std::copy(storedConnectivity, storedConnectivity + header.connectivityCount, connectivity->GetPointer(0));
+	}
+
+	vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+	LegacyCells::setCells(polys, header.polysCount, connectivity);
+
+	vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+	polyData->SetPoints(points);
+	polyData->SetPolys(polys);
+
+	// Point normals
+	if (header.normalsCount > 0)
+	{
+		vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+		normals->SetName("Normals");
+		normals->SetNumberOfComponents(3);
+		normals->SetNumberOfTuples(header.normalsCount);
+		std::memcpy(normals->GetPointer(0), mappedFile + header.normalsOffset, 3 * sizeof(float) * header.normalsCount);
+
+		polyData->GetPointData()->SetNormals(normals);
+	}
+
+	file.unmap(const_cast<uchar *>(mappedFile));
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_entries.contains(key))
+		{
+			const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+			m_entries[key].lastAccess = now;
+			m_indexChanged = true;
+
+			// Batched: losing the latest accesses only makes the eviction order slightly less accurate
+			if (now - m_indexSaveTime >= INDEX_ACCESSES_SAVE_INTERVAL)
+			{
+				this->saveIndexNoLock();
+			}
+		}
+	}
+
+	return polyData;
+}
+
+bool MeshCache::store(const QString &key, const vtkSmartPointer<vtkPolyData> polyData)
+{
+	if (!m_enabled || key.isEmpty() || !polyData || !polyData->GetPoints())
+	{
+		return false;
+	}
+
+	// Only the output of the preprocessing is cached: points, polygons and optional float point normals
+	if (polyData->GetNumberOfVerts() > 0 || polyData->GetNumberOfLines() > 0 || polyData->GetNumberOfStrips() > 0)
+	{
+		return false;
+	}
+
+	vtkDataArray *pointsData = polyData->GetPoints()->GetData();
+	vtkDataArray *normals = polyData->GetPointData()->GetNormals();
+	const LegacyCells connectivity(polyData->GetPolys());
+
+	if ((pointsData->GetDataType() != VTK_FLOAT && pointsData->GetDataType() != VTK_DOUBLE) || pointsData->GetNumberOfComponents() != 3)
+	{
+		return false;
+	}
+
+	if (normals && (normals->GetDataType() != VTK_FLOAT || normals->GetNumberOfComponents() != 3))
+	{
+		normals = nullptr;
+	}
+
+	FileHeader_t header;
+	std::memcpy(header.magic, FORMAT_MAGIC, sizeof(FORMAT_MAGIC));
+	header.formatVersion = FORMAT_VERSION;
+	header.pointsType = pointsData->GetDataType();
+	header.pointsCount = pointsData->GetNumberOfTuples();
+	header.polysCount = polyData->GetNumberOfPolys();
+	header.connectivityCount = connectivity.getSize();
+	header.normalsCount = normals ? normals->GetNumberOfTuples() : 0;
+	header.pointsOffset = alignOffset(sizeof(FileHeader_t));
+	header.connectivityOffset = alignOffset(header.pointsOffset + 3 * pointsData->GetDataTypeSize() * header.pointsCount);
+	header.normalsOffset = alignOffset(header.connectivityOffset + sizeof(int64_t) * header.connectivityCount);
+	header.fileSize = header.normalsOffset + 3 * sizeof(float) * header.normalsCount;
+
+	if (static_cast<qint64>(header.fileSize) > this->getMaximumSize())
+	{
+		return false;
+	}
+
+	QString entryPath;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!QDir().mkpath(m_directory))
+		{
+			qDebug() << "MeshCache::store(): could not create" << m_directory;
+			return false;
+		}
+
+		// Make room before writing, so the directory never grows past the limit
+		this->evictNoLock(header.fileSize);
+
+		entryPath = this->getEntryPath(key);
+	}
+
+	// Written to a temporary file and renamed when complete, concurrent readers never see a partial entry
+	QSaveFile file(entryPath);
+
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	bool written = writeData(file, &header, sizeof(FileHeader_t));
+
+	written = written && writePadding(file, header.pointsOffset);
+	written = written && writeData(file, pointsData->GetVoidPointer(0), 3 * pointsData->GetDataTypeSize() * header.pointsCount);
+
+	written = written && writePadding(file, header.connectivityOffset);
+
+	if (sizeof(vtkIdType) == sizeof(int64_t))
+	{
+		written = written && writeData(file, connectivity.getData(), sizeof(int64_t) * header.connectivityCount);
+	}
+	else
+	{
+		const std::vector<int64_t> storedConnectivity(connectivity.getData(), connectivity.getData() + header.connectivityCount);
+		written = written && writeData(file, storedConnectivity.data(), sizeof(int64_t) * header.connectivityCount);
+	}
+
+	if (normals)
+	{
+		written = written && writePadding(file, header.normalsOffset);
+		written = written && writeData(file, normals->GetVoidPointer(0), 3 * sizeof(float) * header.normalsCount);
+	}
+
+	if (!written || !file.commit())
+	{
+		qDebug() << "MeshCache::store(): could not write" << key;
+
+		file.cancelWriting();
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Entry_t &entry = m_entries[key];
+	m_size += static_cast<qint64>(header.fileSize) - entry.bytes;
+	entry.bytes = header.fileSize;
+	entry.lastAccess = QDateTime::currentMSecsSinceEpoch();
+
+	this->saveIndexNoLock();
+
+	qDebug() << "MeshCache::store():" << key << header.fileSize << "bytes, cache size" << m_size;
+
+	return true;
+}
+
+void MeshCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it)
+	{
+		QFile::remove(this->getEntryPath(it.key()));
+	}
+
+	m_entries.clear();
+	m_size = 0;
+
+	this->saveIndexNoLock();
+}
+
+
+void MeshCache::loadIndexNoLock()
+{
+	m_entries.clear();
+	m_size = 0;
+
+	QFile indexFile(QDir(m_directory).filePath(INDEX_FILE_NAME));
+
+	if (indexFile.open(QIODevice::ReadOnly))
+	{
+		const QJsonObject entries = QJsonDocument::fromJson(indexFile.readAll()).object();
+
+		for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+		{
+			const QJsonObject entryObject = it.value().toObject();
+
+			Entry_t entry;
+			entry.bytes = static_cast<qint64>(entryObject["bytes"].toDouble());
+			entry.lastAccess = static_cast<qint64>(entryObject["lastAccess"].toDouble());
+
+			m_entries.insert(it.key(), entry);
+		}
+	}
+
+	// The files are the reference: entries lost by a crash are picked up, deleted files dropped
+	const QFileInfoList entriesFiles = QDir(m_directory).entryInfoList(QStringList() << QString("*") + ENTRY_FILE_SUFFIX, QDir::Files);
+	QHash<QString, Entry_t> existingEntries;
+
+	for (const QFileInfo &entryFile : entriesFiles)
+	{
+		const QString key = entryFile.completeBaseName();
+
+		Entry_t entry = m_entries.value(key);
+		entry.bytes = entryFile.size();
+
+		if (entry.lastAccess == 0)
+		{
+			entry.lastAccess = entryFile.lastModified().toMSecsSinceEpoch();
+		}
+
+		existingEntries.insert(key, entry);
+		m_size += entry.bytes;
+	}
+
+	m_entries.swap(existingEntries);
+
+	qDebug() << "MeshCache::loadIndex():" << m_entries.size() << "entries," << m_size << "bytes in" << m_directory;
+}
+
+void MeshCache::saveIndexNoLock()
+{
+	QJsonObject entries;
+
+	for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it)
+	{
+		QJsonObject entryObject;
+		entryObject["bytes"] = static_cast<double>(it.value().bytes);
+		entryObject["lastAccess"] = static_cast<double>(it.value().lastAccess);
+
+		entries[it.key()] = entryObject;
+	}
+
+	QSaveFile indexFile(QDir(m_directory).filePath(INDEX_FILE_NAME));
+
+	if (indexFile.open(QIODevice::WriteOnly))
+	{
+		indexFile.write(QJsonDocument(entries).toJson(QJsonDocument::Compact));
+		indexFile.commit();
+	}
+
+	m_indexChanged = false;
+	m_indexSaveTime = QDateTime::currentMSecsSinceEpoch();
+}
+
+void MeshCache::evictNoLock(const qint64 incomingBytes)
+{
+	while (!m_entries.isEmpty() && m_size + incomingBytes > m_maximumSize)
+	{
+		auto leastRecentlyUsed = m_entries.begin();
+
+		for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+		{
+			if (it.value().lastAccess < leastRecentlyUsed.value().lastAccess)
+			{
+				leastRecentlyUsed = it;
+			}
+		}
+
+		qDebug() << "MeshCache::evict():" << leastRecentlyUsed.key() << leastRecentlyUsed.value().bytes << "bytes";
+
+		// Readers map the whole file, removing it while one is loading does not affect it on POSIX systems
+		QFile::remove(this->getEntryPath(leastRecentlyUsed.key()));
+
+		m_size -= leastRecentlyUsed.value().bytes;
+		m_entries.erase(leastRecentlyUsed);
+	}
+}
+
+QString MeshCache::getEntryPath(const QString &key) const
+{
+	return QDir(m_directory).filePath(key + ENTRY_FILE_SUFFIX);
+}
@@ -0,0 +1,72 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <QHash>
+#include <QString>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+
+// On-disk cache of preprocessed meshes: the welded points and polygons, point normals only if given.
+// Entries are keyed by a hash of the whole file contents, the file size and modification time and the
+// pipeline settings. The mesh arrays are stored raw after a fixed header, so a hit is a mapping and a
+// few copies, without parsing. Corrupted entries (arrays out of the file, point ids out of range) are rejected.
+// The cache is bounded in size, the least recently used entries go first.
+// The accesses of the cache hits are written to the index in batches.
+// Thread-safe: the loader threads look up and store concurrently.
+class MeshCache
+{
+public:
+	MeshCache();
+	~MeshCache();
+
+	void setDirectory(const QString &directory);
+	QString getDirectory() const;
+
+	void setMaximumSize(const qint64 maximumSize);
+	qint64 getMaximumSize() const;
+	qint64 getSize() const;
+
+	void setEnabled(const bool enabled);
+	bool isEnabled() const;
+
+	// Empty if the file can not be read
+	QString computeKey(const QString &filePath, const QString &pipelineTag) const;
+
+	bool contains(const QString &key) const;
+	vtkSmartPointer<vtkPolyData> load(const QString &key);
+	bool store(const QString &key, const vtkSmartPointer<vtkPolyData> polyData);
+	void clear();
+
+private:
+	typedef struct
+	{
+		qint64 bytes{0};
+		qint64 lastAccess{0};
+	} Entry_t;
+
+	void loadIndexNoLock();
+	void saveIndexNoLock();
+	void evictNoLock(const qint64 incomingBytes);
+	QString getEntryPath(const QString &key) const;
+
+	mutable std::mutex m_mutex;
+
+	QString m_directory;
+	qint64 m_maximumSize = 4LL << 30;
+	qint64 m_size = 0;
+	QHash<QString, Entry_t> m_entries;
+
+	// Accesses not saved yet, see load()
+	bool m_indexChanged = false;
+	qint64 m_indexSaveTime = 0;
+
+	std::atomic<bool> m_enabled{true};
+};
+
+#endif // MESHCACHE_H
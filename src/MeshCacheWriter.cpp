@@ -0,0 +1,24 @@
+#include "FrameProfiler.h"
+#include "MeshCacheWriter.h"
+#include "ModelGeometry.h"
+#include "ProcessingEngine.h"
+
+
+MeshCacheWriter::MeshCacheWriter(const std::shared_ptr<ProcessingEngine> processingEngine, const std::shared_ptr<ModelGeometry> geometry)
+	: m_processingEngine{processingEngine}
+	, m_geometry{geometry}
+{
+}
+
+void MeshCacheWriter::run()
+{
+	FRAME_PROFILER_THREAD_NAME("Loader");
+
+	// Evicted meanwhile: the eviction stored the full mesh first, the proxy is not cached
+	if (!m_geometry->isResident())
+	{
+		return;
+	}
+
+	m_processingEngine->storeGeometryInCache(m_geometry);
+}
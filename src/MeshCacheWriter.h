@@ -0,0 +1,26 @@
+#ifndef MESHCACHEWRITER_H
+#define MESHCACHEWRITER_H
+
+#include <memory>
+
+#include <QRunnable>
+
+
+class ModelGeometry;
+class ProcessingEngine;
+
+// Writes the preprocessed mesh of a newly displayed model to the mesh cache, in one of the loader pool threads,
+// so the write does not delay the model. The next time the same file is opened it is neither parsed nor preprocessed.
+class MeshCacheWriter : public QRunnable
+{
+public:
+	MeshCacheWriter(const std::shared_ptr<ProcessingEngine> processingEngine, const std::shared_ptr<ModelGeometry> geometry);
+
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	std::shared_ptr<ModelGeometry> m_geometry;
+};
+
+#endif // MESHCACHEWRITER_H
@@ -1,47 +1,45 @@
+#include <algorithm>
+
 #include <QDebug>
 
 #include <vtkAlgorithmOutput.h>
+#include <vtkPointData.h>
 #include <vtkPolyData.h>
 #include <vtkProperty.h>
 #include <vtkTransform.h>
 
+#include "GeometryCompactor.h"
 #include "Model.h"
 
 
-QColor Model::m_defaultModelColor = QColor{"#0277bd"};
-QColor Model::m_selectedModelColor = QColor{"#03a9f4"};
-
-
-Model::Model(vtkSmartPointer<vtkPolyData> modelData)
-	: m_modelData{modelData}
+Model::Model(std::shared_ptr<ModelGeometry> geometry, vtkSmartPointer<vtkProperty> defaultProperty, vtkSmartPointer<vtkProperty> selectedProperty)
+	: m_geometry{geometry}
+	, m_defaultProperty{defaultProperty}
+	, m_selectedProperty{selectedProperty}
 {
-	// Place model with lower Z bound at zero
-	m_positionZ = -m_modelData->GetBounds()[4];
+	// Center the model on its bounds and place its lower Z bound at zero, through the matrix only
+	double bounds[6];
+	m_geometry->getBounds(bounds);
 
-	vtkSmartPointer<vtkTransform> translation = vtkSmartPointer<vtkTransform>::New();
-	translation->Translate(m_positionX, m_positionY, m_positionZ);
+	m_baseOffset[0] = -(bounds[0] + bounds[1]) / 2.0;
+	m_baseOffset[1] = -(bounds[2] + bounds[3]) / 2.0;
+	m_baseOffset[2] = -bounds[4];
 
-	m_modelFilterTranslate = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-	m_modelFilterTranslate->SetInputData(m_modelData);
-	m_modelFilterTranslate->SetTransform(translation);
-	m_modelFilterTranslate->Update();
+	m_modelMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+	this->updateModelMatrix();
 
-	// Model Mapper
-	m_modelMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-	m_modelMapper->SetInputConnection(m_modelFilterTranslate->GetOutputPort());
-	m_modelMapper->ScalarVisibilityOff();
-
-	// Model Actor
+	// Model Actor, drawn by the mapper of the shared geometry
 	m_modelActor = vtkSmartPointer<vtkActor>::New();
-	m_modelActor->SetMapper(m_modelMapper);
-	m_modelActor->GetProperty()->SetInterpolationToFlat();
-
-	m_modelActor->GetProperty()->SetAmbient(0.1);
-	m_modelActor->GetProperty()->SetDiffuse(0.7);
-	m_modelActor->GetProperty()->SetSpecular(0.3);
-	this->setColor(m_defaultModelColor);
+	m_modelActor->SetMapper(m_geometry->getLodMapper(0));
+	m_modelActor->SetProperty(m_defaultProperty);
 
 	m_modelActor->SetPosition(0.0, 0.0, 0.0);
+	m_modelActor->SetUserMatrix(m_modelMatrix);
+}
+
+Model::Model(vtkSmartPointer<vtkPolyData> modelData, vtkSmartPointer<vtkProperty> defaultProperty, vtkSmartPointer<vtkProperty> selectedProperty)
+	: Model(std::make_shared<ModelGeometry>(modelData), defaultProperty, selectedProperty)
+{
 }
 
 
@@ -50,6 +48,16 @@ const vtkSmartPointer<vtkActor> &Model::getModelActor() const
 	return m_modelActor;
 }
 
+vtkSmartPointer<vtkPolyData> Model::getModelData() const
+{
+	return m_geometry->getData();
+}
+
+const std::shared_ptr<ModelGeometry> &Model::getGeometry() const
+{
+	return m_geometry;
+}
+
 
 double Model::getPositionX()
 {
@@ -98,15 +106,93 @@ void Model::translateToPosition(const double x, const double y)
 	this->setPositionY(y);
 	m_propertiesMutex.unlock();
 
-	vtkSmartPointer<vtkTransform> translation = vtkSmartPointer<vtkTransform>::New();
-	translation->Translate(m_positionX, m_positionY, m_positionZ);
-	m_modelFilterTranslate->SetTransform(translation);
-	m_modelFilterTranslate->Update();
+	this->updateModelMatrix();
+	m_geometry->touch();
 
 	emit positionXChanged(m_positionX);
 	emit positionYChanged(m_positionY);
 }
 
+void Model::updateModelMatrix()
+{
+	// Only the translation column changes, the mesh points are left untouched
+	m_modelMatrix->SetElement(0, 3, m_positionX + m_baseOffset[0]);
+	m_modelMatrix->SetElement(1, 3, m_positionY + m_baseOffset[1]);
+	m_modelMatrix->SetElement(2, 3, m_baseOffset[2]);
+}
+
+const vtkSmartPointer<vtkPolyData> &Model::getTransformedModelData()
+{
+	// Bake the model matrix into the points only when world-space geometry is really needed
+	if (!m_transformedModelData || m_transformedModelDataTime < m_modelMatrix->GetMTime())
+	{
+		if (!m_modelFilterTranslate)
+		{
+			m_modelFilterTranslate = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+			m_modelFilterTranslate->SetInputData(m_geometry->getData());
+		}
+
+		vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+		transform->SetMatrix(m_modelMatrix);
+		m_modelFilterTranslate->SetTransform(transform);
+		m_modelFilterTranslate->Update();
+
+		m_transformedModelData = m_modelFilterTranslate->GetOutput();
+		m_transformedModelDataTime = m_modelMatrix->GetMTime();
+
+		// The filter transforms the points and the normals, the polygons are shared with the geometry
+		m_transformedModelDataBytes = GeometryCompactor::getArrayBytes(m_transformedModelData->GetPoints()->GetData())
+									  + GeometryCompactor::getArrayBytes(m_transformedModelData->GetPointData()->GetNormals());
+	}
+
+	return m_transformedModelData;
+}
+
+int64_t Model::getTransformedModelDataBytes() const
+{
+	return m_transformedModelDataBytes;
+}
+
+void Model::releaseTransformedModelData()
+{
+	m_modelFilterTranslate = nullptr;
+	m_transformedModelData = nullptr;
+	m_transformedModelDataTime = 0;
+	m_transformedModelDataBytes = 0;
+}
+
+
+bool Model::intersectRay(const double origin[3], const double direction[3], double &t, double hitPosition[3])
+{
+	// Inverse of the full actor matrix, the BVH is in model space
+	double worldToModel[16];
+	vtkMatrix4x4::Invert(*m_modelActor->GetMatrix()->Element, worldToModel);
+
+	const double worldOrigin[4] = {origin[0], origin[1], origin[2], 1.0};
+	const double worldDirection[4] = {direction[0], direction[1], direction[2], 0.0};
+
+	double modelOrigin[4];
+	double modelDirection[4];
+	vtkMatrix4x4::MultiplyPoint(worldToModel, worldOrigin, modelOrigin);
+	vtkMatrix4x4::MultiplyPoint(worldToModel, worldDirection, modelDirection);
+
+	const std::shared_ptr<const ModelBVH> bvh = m_geometry->getBVH();
+	ModelBVH::RayHit_t hit;
+
+	// The direction is not normalized, t is the same in both spaces
+	if (!bvh || !bvh->intersectRay(modelOrigin, modelDirection, hit))
+	{
+		return false;
+	}
+
+	t = hit.t;
+	hitPosition[0] = origin[0] + t * direction[0];
+	hitPosition[1] = origin[1] + t * direction[1];
+	hitPosition[2] = origin[2] + t * direction[2];
+
+	return true;
+}
+
 
 void Model::setSelected(const bool selected)
 {
@@ -114,30 +200,55 @@ void Model::setSelected(const bool selected)
 	{
 		m_selected = selected;
 
-		this->updateModelColor();
+		m_modelActor->SetProperty(m_selected ? m_selectedProperty : m_defaultProperty);
 	}
-}
 
-void Model::setSelectedModelColor(const QColor &selectedModelColor)
-{
-	m_selectedModelColor = selectedModelColor;
+	if (m_selected)
+	{
+		m_geometry->touch();
+	}
 }
 
-void Model::updateModelColor()
+void Model::setDefaultProperty(const vtkSmartPointer<vtkProperty> defaultProperty)
 {
-	if (m_selected)
+	m_defaultProperty = defaultProperty;
+
+	if (!m_selected)
 	{
-		this->setColor(m_selectedModelColor);
+		m_modelActor->SetProperty(m_defaultProperty);
 	}
-	else
+}
+
+const vtkSmartPointer<vtkProperty> &Model::getDefaultProperty() const
+{
+	return m_defaultProperty;
+}
+
+
+size_t Model::getLodsCount()
+{
+	return m_geometry->getLodsCount();
+}
+
+vtkIdType Model::getLodTrianglesCount(const size_t level)
+{
+	return m_geometry->getLodTrianglesCount(level);
+}
+
+void Model::setLodLevel(const size_t level)
+{
+	const size_t lodLevel = std::min(level, m_geometry->getLodsCount() - 1);
+
+	if (m_lodLevel != lodLevel)
 	{
-		this->setColor(m_defaultModelColor);
+		m_lodLevel = lodLevel;
+		m_modelActor->SetMapper(m_geometry->getLodMapper(m_lodLevel));
 	}
 }
 
-void Model::setColor(const QColor &color)
+size_t Model::getLodLevel()
 {
-	m_modelActor->GetProperty()->SetColor(color.redF(), color.greenF(), color.blueF());
+	return m_lodLevel;
 }
 
 
@@ -156,3 +267,14 @@ void Model::setMouseDeltaXY(const double deltaX, const double deltaY)
 	m_mouseDeltaX = deltaX;
 	m_mouseDeltaY = deltaY;
 }
+
+
+const ModelRegistry::Handle_t &Model::getRegistryHandle() const
+{
+	return m_registryHandle;
+}
+
+void Model::setRegistryHandle(const ModelRegistry::Handle_t &handle)
+{
+	m_registryHandle = handle;
+}
@@ -1,40 +1,73 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include <QObject>
-#include <QColor>
 
 #include <vtkActor.h>
+#include <vtkMatrix4x4.h>
 #include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
 #include <vtkSmartPointer.h>
 #include <vtkTransformPolyDataFilter.h>
 
+#include "ModelGeometry.h"
+#include "ModelRegistry.h"
+
 
 class Model : public QObject
 {
 	Q_OBJECT
 
 public:
-	Model(vtkSmartPointer<vtkPolyData> modelData);
+	// Instance of a shared geometry: the geometry is drawn by the same mappers for every instance
+	Model(std::shared_ptr<ModelGeometry> geometry, vtkSmartPointer<vtkProperty> defaultProperty, vtkSmartPointer<vtkProperty> selectedProperty);
+	Model(vtkSmartPointer<vtkPolyData> modelData, vtkSmartPointer<vtkProperty> defaultProperty, vtkSmartPointer<vtkProperty> selectedProperty);
 
 	const vtkSmartPointer<vtkActor>& getModelActor() const;
+	vtkSmartPointer<vtkPolyData> getModelData() const;
+	const std::shared_ptr<ModelGeometry>& getGeometry() const;
 
 	double getPositionX();
 	double getPositionY();
 
 	void translateToPosition(const double x, const double y);
 
+	const vtkSmartPointer<vtkPolyData>& getTransformedModelData();
+
+	// Arrays of the world-space copy held by the translate filter, zero until it is first baked
+	int64_t getTransformedModelDataBytes() const;
+
+	// Drops the world-space copy, baked again on demand. Renderer thread, when the geometry mesh is swapped.
+	void releaseTransformedModelData();
+
+	// Closest hit of the world space ray origin + t * direction, the ray is moved into model space.
+	// False until the BVH of the geometry is built.
+	bool intersectRay(const double origin[3], const double direction[3], double &t, double hitPosition[3]);
+
 	void setSelected(const bool selected);
-	static void setSelectedModelColor(const QColor &selectedModelColor);
+
+	// Property of the not selected instance, shared by the instances of the same color
+	void setDefaultProperty(const vtkSmartPointer<vtkProperty> defaultProperty);
+	const vtkSmartPointer<vtkProperty>& getDefaultProperty() const;
+
+	// Levels of detail of the geometry, the renderer picks the level to draw for every instance
+	size_t getLodsCount();
+	vtkIdType getLodTrianglesCount(const size_t level);
+	void setLodLevel(const size_t level);
+	size_t getLodLevel();
 
 	const double getMouseDeltaX() const;
 	const double getMouseDeltaY() const;
 	void setMouseDeltaXY(const double deltaX, const double deltaY);
 
-	void updateModelColor();
+	const ModelRegistry::Handle_t &getRegistryHandle() const;
+	void setRegistryHandle(const ModelRegistry::Handle_t &handle);
 
 signals:
 	void positionXChanged(const double positionX);
@@ -44,25 +77,39 @@ private:
 	void setPositionX(const double positionX);
 	void setPositionY(const double positionY);
 
-	void setColor(const QColor &color);
+	void updateModelMatrix();
 
-	static QColor m_defaultModelColor;
-	static QColor m_selectedModelColor;
-
-	vtkSmartPointer<vtkPolyData> m_modelData;
-	vtkSmartPointer<vtkPolyDataMapper> m_modelMapper;
+	std::shared_ptr<ModelGeometry> m_geometry;
 	vtkSmartPointer<vtkActor> m_modelActor;
 
+	// Shared by the models of the same color, swapped on selection instead of modifying per-model properties
+	vtkSmartPointer<vtkProperty> m_defaultProperty;
+	vtkSmartPointer<vtkProperty> m_selectedProperty;
+
+	// Position lives in the actor user matrix, the mesh is never transformed during interaction
+	vtkSmartPointer<vtkMatrix4x4> m_modelMatrix;
+
+	// Only used to bake the world-space geometry on demand (export, collision checks)
 	vtkSmartPointer<vtkTransformPolyDataFilter> m_modelFilterTranslate;
+	vtkSmartPointer<vtkPolyData> m_transformedModelData;
+	vtkMTimeType m_transformedModelDataTime = 0;
+	std::atomic<int64_t> m_transformedModelDataBytes{0};
+
+	// Renderer thread only
+	size_t m_lodLevel = 0;
 
 	std::mutex m_propertiesMutex;
 
 	double m_positionX {0.0};
 	double m_positionY {0.0};
-	double m_positionZ {0.0};
+
+	// Moves the mesh centered and onto the plate: folded into the model matrix, the points are not shifted
+	double m_baseOffset[3];
 
 	bool m_selected = false;
 
+	ModelRegistry::Handle_t m_registryHandle;
+
 	double m_mouseDeltaX = 0.0;
 	double m_mouseDeltaY = 0.0;
 };
@@ -0,0 +1,568 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <vtkCellArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPoints.h>
+
+#include "LegacyCells.h"
+#include "ModelBVH.h"
+#include "Parallel.h"
+
+
+static const uint32_t LEAF_TRIANGLES_COUNT = 4;
+static const uint32_t PARALLEL_SUBTREE_TRIANGLES_COUNT = 16384;
+static const uint32_t TRAVERSAL_STACK_SIZE = 64;
+
+// Point ids and triangle corners are indexed with 32 bits, larger meshes are not indexed
+static const uint64_t MAXIMUM_POINTS_COUNT = UINT32_MAX;
+static const uint64_t MAXIMUM_TRIANGLES_COUNT = UINT32_MAX / 3;
+
+template <typename T>
+static inline void readPoint(const T *coordinates, const uint32_t pointId, double point[3])
+{
+	point[0] = coordinates[3 * pointId];
+	point[1] = coordinates[3 * pointId + 1];
+	point[2] = coordinates[3 * pointId + 2];
+}
+
+static inline bool intersectRayBox(const float boundsMin[3], const float boundsMax[3], const double origin[3], const double inverseDirection[3], const double tMax, double &tEntry)
+{
+	double tNear = 0.0;
+	double tFar = tMax;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		double t0 = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+		double t1 = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+
+		if (t0 > t1)
+		{
+			std::swap(t0, t1);
+		}
+
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+
+		if (tNear > tFar)
+		{
+			return false;
+		}
+	}
+
+	tEntry = tNear;
+	return true;
+}
+
+// Möller-Trumbore, both faces
+static inline bool intersectRayTriangle(const double a[3], const double b[3], const double c[3], const double origin[3], const double direction[3], double &t)
+{
+	const double edge1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+	const double edge2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+
+	const double p[3] = {direction[1] * edge2[2] - direction[2] * edge2[1],
+						 direction[2] * edge2[0] - direction[0] * edge2[2],
+						 direction[0] * edge2[1] - direction[1] * edge2[0]};
+
+	const double determinant = edge1[0] * p[0] + edge1[1] * p[1] + edge1[2] * p[2];
+
+	if (std::abs(determinant) < 1.0e-300)
+	{
+		return false;
+	}
+
+	const double inverseDeterminant = 1.0 / determinant;
+	const double s[3] = {origin[0] - a[0], origin[1] - a[1], origin[2] - a[2]};
+
+	const double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDeterminant;
+
+	if (u < 0.0 || u > 1.0)
+	{
+		return false;
+	}
+
+	const double q[3] = {s[1] * edge1[2] - s[2] * edge1[1],
+						 s[2] * edge1[0] - s[0] * edge1[2],
+						 s[0] * edge1[1] - s[1] * edge1[0]};
+
+	const double v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverseDeterminant;
+
+	if (v < 0.0 || u + v > 1.0)
+	{
+		return false;
+	}
+
+	t = (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]) * inverseDeterminant;
+
+	return t >= 0.0;
+}
+
+
+ModelBVH::ModelBVH(const vtkSmartPointer<vtkPolyData> polyData)
+	: m_polyData{polyData}
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	this->build();
+
+	qDebug() << "ModelBVH::ModelBVH():" << this->getTrianglesCount() << "triangles," << this->getNodesCount() << "nodes in" << timer.elapsed() << "ms";
+}
+
+void ModelBVH::build()
+{
+	vtkPoints *points = m_polyData->GetPoints();
+	vtkCellArray *polys = m_polyData->GetPolys();
+
+	if (!points || !polys || polys->GetNumberOfCells() == 0)
+	{
+		return;
+	}
+
+	if (points->GetDataType() == VTK_FLOAT)
+	{
+		m_floatCoordinates = static_cast<vtkFloatArray*>(points->GetData())->GetPointer(0);
+	}
+	else if (points->GetDataType() == VTK_DOUBLE)
+	{
+		m_doubleCoordinates = static_cast<vtkDoubleArray*>(points->GetData())->GetPointer(0);
+	}
+	else
+	{
+		return;
+	}
+
+	// Triangulate the polygons as fans
+	const LegacyCells legacyPolys(polys);
+	const vtkIdType *cellsBegin = legacyPolys.getData();
+	const vtkIdType *cellsEnd = cellsBegin + legacyPolys.getSize();
+
+	size_t trianglesCount = 0;
+	for (const vtkIdType *cell = cellsBegin; cell < cellsEnd; cell += cell[0] + 1)
+	{
+		trianglesCount += std::max<vtkIdType>(cell[0] - 2, 0);
+	}
+
+	// Left empty, the model is then picked by the cell picker
+	if (static_cast<uint64_t>(points->GetNumberOfPoints()) > MAXIMUM_POINTS_COUNT || trianglesCount > MAXIMUM_TRIANGLES_COUNT)
+	{
+		qWarning() << "ModelBVH::build(): too large to index," << points->GetNumberOfPoints() << "points," << trianglesCount << "triangles";
+		m_floatCoordinates = nullptr;
+		m_doubleCoordinates = nullptr;
+		return;
+	}
+
+	m_triangles.reserve(3 * trianglesCount);
+
+	for (const vtkIdType *cell = cellsBegin; cell < cellsEnd; cell += cell[0] + 1)
+	{
+		for (vtkIdType corner = 2; corner < cell[0]; ++corner)
+		{
+			m_triangles.push_back(static_cast<uint32_t>(cell[1]));
+			m_triangles.push_back(static_cast<uint32_t>(cell[corner]));
+			m_triangles.push_back(static_cast<uint32_t>(cell[corner + 1]));
+		}
+	}
+
+	// Centroids, used for the splits only
+	std::vector<float> centroids(3 * trianglesCount);
+
+	Parallel::forEachRange(trianglesCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		double a[3], b[3], c[3];
+
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			if (m_floatCoordinates)
+			{
+				readPoint(m_floatCoordinates, m_triangles[3 * i], a);
+				readPoint(m_floatCoordinates, m_triangles[3 * i + 1], b);
+				readPoint(m_floatCoordinates, m_triangles[3 * i + 2], c);
+			}
+			else
+			{
+				readPoint(m_doubleCoordinates, m_triangles[3 * i], a);
+				readPoint(m_doubleCoordinates, m_triangles[3 * i + 1], b);
+				readPoint(m_doubleCoordinates, m_triangles[3 * i + 2], c);
+			}
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				centroids[3 * i + axis] = static_cast<float>((a[axis] + b[axis] + c[axis]) / 3.0);
+			}
+		}
+	});
+
+	m_order.resize(trianglesCount);
+	std::iota(m_order.begin(), m_order.end(), 0);
+
+	// Split the top of the tree on the calling thread until there is enough independent subtrees
+	typedef struct
+	{
+		uint32_t node;
+		uint32_t begin;
+		uint32_t end;
+	} PendingNode_t;
+
+	std::vector<PendingNode_t> pendingNodes;
+
+	m_nodes.push_back(Node_t());
+	pendingNodes.push_back({0, 0, static_cast<uint32_t>(trianglesCount)});
+
+	const size_t subtreesCount = 4 * Parallel::getThreadsCount();
+	std::vector<PendingNode_t> subtrees;
+
+	while (!pendingNodes.empty() && pendingNodes.size() + subtrees.size() < subtreesCount)
+	{
+		// Largest pending range first
+		std::vector<PendingNode_t>::iterator largest = std::max_element(pendingNodes.begin(), pendingNodes.end(), [](const PendingNode_t &a, const PendingNode_t &b)
+		{
+			return a.end - a.begin < b.end - b.begin;
+		});
+
+		const PendingNode_t pendingNode = *largest;
+		pendingNodes.erase(largest);
+
+		if (pendingNode.end - pendingNode.begin < PARALLEL_SUBTREE_TRIANGLES_COUNT)
+		{
+			subtrees.push_back(pendingNode);
+			continue;
+		}
+
+		this->computeNodeBounds(m_nodes[pendingNode.node], pendingNode.begin, pendingNode.end);
+
+		uint32_t middle;
+		if (!this->splitRange(pendingNode.begin, pendingNode.end, middle, centroids))
+		{
+			subtrees.push_back(pendingNode);
+			continue;
+		}
+
+		const uint32_t left = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.push_back(Node_t());
+		m_nodes.push_back(Node_t());
+
+		m_nodes[pendingNode.node].first = 0;
+		m_nodes[pendingNode.node].count = 0;
+		m_nodes[pendingNode.node].left = left;
+		m_nodes[pendingNode.node].right = left + 1;
+
+		pendingNodes.push_back({left, pendingNode.begin, middle});
+		pendingNodes.push_back({left + 1, middle, pendingNode.end});
+	}
+
+	subtrees.insert(subtrees.end(), pendingNodes.begin(), pendingNodes.end());
+
+	// Build the subtrees in parallel, each one in its own nodes array, then append them
+	std::vector<std::vector<Node_t>> subtreesNodes(subtrees.size());
+
+	Parallel::forEachChunk(subtrees.size(), [&](const size_t subtreeIndex)
+	{
+		this->buildSubtree(subtrees[subtreeIndex].begin, subtrees[subtreeIndex].end, subtreesNodes[subtreeIndex], centroids);
+	});
+
+	for (size_t subtreeIndex = 0; subtreeIndex < subtrees.size(); ++subtreeIndex)
+	{
+		const std::vector<Node_t> &subtreeNodes = subtreesNodes[subtreeIndex];
+
+		// Local index i > 0 goes to offset + i - 1, the local root replaces the pending node
+		const uint32_t offset = static_cast<uint32_t>(m_nodes.size());
+
+		for (size_t i = 0; i < subtreeNodes.size(); ++i)
+		{
+			Node_t node = subtreeNodes[i];
+
+			if (node.count == 0)
+			{
+				node.left += offset - 1;
+				node.right += offset - 1;
+			}
+
+			if (i == 0)
+			{
+				m_nodes[subtrees[subtreeIndex].node] = node;
+			}
+			else
+			{
+				m_nodes.push_back(node);
+			}
+		}
+	}
+
+	// Store the triangles in leaf order
+	std::vector<uint32_t> orderedTriangles(m_triangles.size());
+
+	Parallel::forEachRange(trianglesCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			std::copy(&m_triangles[3 * m_order[i]], &m_triangles[3 * m_order[i]] + 3, &orderedTriangles[3 * i]);
+		}
+	});
+
+	m_triangles.swap(orderedTriangles);
+}
+
+void ModelBVH::buildSubtree(const uint32_t begin, const uint32_t end, std::vector<Node_t> &nodes, const std::vector<float> &centroids)
+{
+	typedef struct
+	{
+		uint32_t node;
+		uint32_t begin;
+		uint32_t end;
+	} PendingNode_t;
+
+	std::vector<PendingNode_t> stack;
+
+	nodes.push_back(Node_t());
+	stack.push_back({0, begin, end});
+
+	while (!stack.empty())
+	{
+		const PendingNode_t pendingNode = stack.back();
+		stack.pop_back();
+
+		this->computeNodeBounds(nodes[pendingNode.node], pendingNode.begin, pendingNode.end);
+
+		uint32_t middle;
+		if (pendingNode.end - pendingNode.begin <= LEAF_TRIANGLES_COUNT || !this->splitRange(pendingNode.begin, pendingNode.end, middle, centroids))
+		{
+			nodes[pendingNode.node].first = pendingNode.begin;
+			nodes[pendingNode.node].count = pendingNode.end - pendingNode.begin;
+			nodes[pendingNode.node].left = 0;
+			nodes[pendingNode.node].right = 0;
+			continue;
+		}
+
+		const uint32_t left = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(Node_t());
+		nodes.push_back(Node_t());
+
+		nodes[pendingNode.node].first = 0;
+		nodes[pendingNode.node].count = 0;
+		nodes[pendingNode.node].left = left;
+		nodes[pendingNode.node].right = left + 1;
+
+		stack.push_back({left, pendingNode.begin, middle});
+		stack.push_back({left + 1, middle, pendingNode.end});
+	}
+}
+
+bool ModelBVH::splitRange(const uint32_t begin, const uint32_t end, uint32_t &middle, const std::vector<float> &centroids)
+{
+	float centroidsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float centroidsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const float *centroid = &centroids[3 * m_order[i]];
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			centroidsMin[axis] = std::min(centroidsMin[axis], centroid[axis]);
+			centroidsMax[axis] = std::max(centroidsMax[axis], centroid[axis]);
+		}
+	}
+
+	int splitAxis = 0;
+	for (int axis = 1; axis < 3; ++axis)
+	{
+		if (centroidsMax[axis] - centroidsMin[axis] > centroidsMax[splitAxis] - centroidsMin[splitAxis])
+		{
+			splitAxis = axis;
+		}
+	}
+
+	// All the centroids coincide, nothing to split
+	if (centroidsMax[splitAxis] <= centroidsMin[splitAxis])
+	{
+		return false;
+	}
+
+	middle = begin + (end - begin) / 2;
+
+	std::nth_element(m_order.begin() + begin, m_order.begin() + middle, m_order.begin() + end, [&](const uint32_t a, const uint32_t b)
+	{
+		return centroids[3 * a + splitAxis] < centroids[3 * b + splitAxis];
+	});
+
+	return true;
+}
+
+void ModelBVH::computeNodeBounds(Node_t &node, const uint32_t begin, const uint32_t end) const
+{
+	double boundsMin[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+	double boundsMax[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+
+	double point[3];
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			const uint32_t pointId = m_triangles[3 * m_order[i] + corner];
+
+			if (m_floatCoordinates)
+			{
+				readPoint(m_floatCoordinates, pointId, point);
+			}
+			else
+			{
+				readPoint(m_doubleCoordinates, pointId, point);
+			}
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				boundsMin[axis] = std::min(boundsMin[axis], point[axis]);
+				boundsMax[axis] = std::max(boundsMax[axis], point[axis]);
+			}
+		}
+	}
+
+	// Rounded outwards, the float boxes always contain the triangles
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		node.boundsMin[axis] = std::nextafter(static_cast<float>(boundsMin[axis]), -FLT_MAX);
+		node.boundsMax[axis] = std::nextafter(static_cast<float>(boundsMax[axis]), FLT_MAX);
+	}
+}
+
+bool ModelBVH::intersectRay(const double origin[3], const double direction[3], RayHit_t &hit) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	if (m_floatCoordinates)
+	{
+		return this->intersectRayTriangles(m_floatCoordinates, origin, direction, hit);
+	}
+
+	return this->intersectRayTriangles(m_doubleCoordinates, origin, direction, hit);
+}
+
+template <typename T>
+bool ModelBVH::intersectRayTriangles(const T *coordinates, const double origin[3], const double direction[3], RayHit_t &hit) const
+{
+	const double inverseDirection[3] = {1.0 / direction[0], 1.0 / direction[1], 1.0 / direction[2]};
+
+	double closestT = DBL_MAX;
+	int64_t closestTriangle = -1;
+
+	uint32_t stack[TRAVERSAL_STACK_SIZE];
+	uint32_t stackSize = 0;
+	double tEntry;
+
+	if (!intersectRayBox(m_nodes[0].boundsMin, m_nodes[0].boundsMax, origin, inverseDirection, closestT, tEntry))
+	{
+		return false;
+	}
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node_t &node = m_nodes[stack[--stackSize]];
+
+		// The box may be farther than a hit found since it was pushed
+		if (!intersectRayBox(node.boundsMin, node.boundsMax, origin, inverseDirection, closestT, tEntry))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			double a[3], b[3], c[3], t;
+
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				readPoint(coordinates, m_triangles[3 * i], a);
+				readPoint(coordinates, m_triangles[3 * i + 1], b);
+				readPoint(coordinates, m_triangles[3 * i + 2], c);
+
+				if (intersectRayTriangle(a, b, c, origin, direction, t) && t < closestT)
+				{
+					closestT = t;
+					closestTriangle = m_order[i];
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearest child first
+		double tLeft, tRight;
+		const bool hitLeft = intersectRayBox(m_nodes[node.left].boundsMin, m_nodes[node.left].boundsMax, origin, inverseDirection, closestT, tLeft);
+		const bool hitRight = intersectRayBox(m_nodes[node.right].boundsMin, m_nodes[node.right].boundsMax, origin, inverseDirection, closestT, tRight);
+
+		if (stackSize + 2 > TRAVERSAL_STACK_SIZE)
+		{
+			qDebug() << "ModelBVH::intersectRay(): traversal stack overflow";
+			break;
+		}
+
+		if (hitLeft && hitRight)
+		{
+			stack[stackSize++] = tLeft < tRight ? node.right : node.left;
+			stack[stackSize++] = tLeft < tRight ? node.left : node.right;
+		}
+		else if (hitLeft)
+		{
+			stack[stackSize++] = node.left;
+		}
+		else if (hitRight)
+		{
+			stack[stackSize++] = node.right;
+		}
+	}
+
+	if (closestTriangle < 0)
+	{
+		return false;
+	}
+
+	hit.t = closestT;
+	hit.triangleIndex = closestTriangle;
+	hit.position[0] = origin[0] + closestT * direction[0];
+	hit.position[1] = origin[1] + closestT * direction[1];
+	hit.position[2] = origin[2] + closestT * direction[2];
+
+	return true;
+}
+
+void ModelBVH::getBounds(double bounds[6]) const
+{
+	if (m_nodes.empty())
+	{
+		std::fill(bounds, bounds + 6, 0.0);
+		return;
+	}
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		bounds[2 * axis] = m_nodes[0].boundsMin[axis];
+		bounds[2 * axis + 1] = m_nodes[0].boundsMax[axis];
+	}
+}
+
+size_t ModelBVH::getTrianglesCount() const
+{
+	return m_order.size();
+}
+
+size_t ModelBVH::getNodesCount() const
+{
+	return m_nodes.size();
+}
+
+size_t ModelBVH::getMemorySize() const
+{
+	return m_nodes.capacity() * sizeof(Node_t) + m_triangles.capacity() * sizeof(uint32_t) + m_order.capacity() * sizeof(uint32_t);
+}
@@ -0,0 +1,68 @@
+#ifndef MODELBVH_H
+#define MODELBVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+
+// Bounding volume hierarchy over the triangles of a model, in model space.
+// Built once per geometry (in parallel, median splits on the longest centroid axis) and queried with
+// rays already transformed by the inverse model matrix, so moving the model never rebuilds it.
+// Polygons are indexed as triangle fans, the triangle index of a triangle mesh is its cell id.
+// The ids are 32 bits: meshes over 2^32 points or 2^32 / 3 triangles are left empty, never hit.
+class ModelBVH
+{
+public:
+	typedef struct
+	{
+		double t{0.0};
+		int64_t triangleIndex{-1};
+		double position[3];
+	} RayHit_t;
+
+	explicit ModelBVH(const vtkSmartPointer<vtkPolyData> polyData);
+
+	// Closest hit at t >= 0 of origin + t * direction, both in model space
+	bool intersectRay(const double origin[3], const double direction[3], RayHit_t &hit) const;
+
+	void getBounds(double bounds[6]) const;
+	size_t getTrianglesCount() const;
+	size_t getNodesCount() const;
+	size_t getMemorySize() const;
+
+private:
+	typedef struct
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t first;
+		uint32_t count;
+		uint32_t left;
+		uint32_t right;
+	} Node_t;
+
+	void build();
+	void buildSubtree(const uint32_t begin, const uint32_t end, std::vector<Node_t> &nodes, const std::vector<float> &centroids);
+	bool splitRange(const uint32_t begin, const uint32_t end, uint32_t &middle, const std::vector<float> &centroids);
+	void computeNodeBounds(Node_t &node, const uint32_t begin, const uint32_t end) const;
+
+	template <typename T>
+	bool intersectRayTriangles(const T *coordinates, const double origin[3], const double direction[3], RayHit_t &hit) const;
+
+	vtkSmartPointer<vtkPolyData> m_polyData;
+
+	// Points of the polydata, only one of them is set
+	const float *m_floatCoordinates = nullptr;
+	const double *m_doubleCoordinates = nullptr;
+
+	std::vector<Node_t> m_nodes;
+
+	// Vertex ids of every triangle, in leaf order, and the original index of every leaf triangle
+	std::vector<uint32_t> m_triangles;
+	std::vector<uint32_t> m_order;
+};
+
+#endif // MODELBVH_H
@@ -0,0 +1,19 @@
+#include "ModelBVHBuilder.h"
+#include "ModelGeometry.h"
+
+
+ModelBVHBuilder::ModelBVHBuilder(const std::shared_ptr<ModelGeometry> geometry)
+	: m_geometry{geometry}
+{
+}
+
+void ModelBVHBuilder::run()
+{
+	// The proxy of an evicted geometry is picked by the cell picker, its index is built once it is restored
+	if (!m_geometry->isResident())
+	{
+		return;
+	}
+
+	m_geometry->buildBVH();
+}
@@ -0,0 +1,24 @@
+#ifndef MODELBVHBUILDER_H
+#define MODELBVHBUILDER_H
+
+#include <memory>
+
+#include <QRunnable>
+
+
+class ModelGeometry;
+
+// Builds the picking BVH of a loaded or restored model, in one of the loader pool threads.
+// Until it is ready the clicks on the model go through the cell picker.
+class ModelBVHBuilder : public QRunnable
+{
+public:
+	explicit ModelBVHBuilder(const std::shared_ptr<ModelGeometry> geometry);
+
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	std::shared_ptr<ModelGeometry> m_geometry;
+};
+
+#endif // MODELBVHBUILDER_H
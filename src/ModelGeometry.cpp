@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <chrono>
+
+#include <vtkCellArray.h>
+#include <vtkPointData.h>
+
+#include "FrameProfiler.h"
+#include "ModelGeometry.h"
+#include "NormalsGenerator.h"
+
+
+static int64_t getSteadyTimeMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+ModelGeometry::ModelGeometry(const vtkSmartPointer<vtkPolyData> data, const QString &key, const QUrl &filePath)
+	: m_data{data}
+	, m_key{key}
+	, m_filePath{filePath}
+{
+	m_data->GetBounds(m_bounds);
+	this->touch();
+
+	vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+	mapper->SetInputData(m_data);
+	mapper->ScalarVisibilityOff();
+
+	m_lods.push_back({m_data, mapper, m_data->GetNumberOfPolys()});
+}
+
+
+vtkSmartPointer<vtkPolyData> ModelGeometry::getData() const
+{
+	std::lock_guard<std::mutex> lock(m_dataMutex);
+	return m_data;
+}
+
+const QString &ModelGeometry::getKey() const
+{
+	return m_key;
+}
+
+const QUrl &ModelGeometry::getFilePath() const
+{
+	return m_filePath;
+}
+
+void ModelGeometry::getBounds(double bounds[6]) const
+{
+	std::copy(m_bounds, m_bounds + 6, bounds);
+}
+
+
+ModelGeometry::Residency_t ModelGeometry::getResidency() const
+{
+	return static_cast<Residency_t>(m_residency.load());
+}
+
+bool ModelGeometry::isResident() const
+{
+	return this->getResidency() == Residency_t::Resident;
+}
+
+bool ModelGeometry::changeResidency(const Residency_t expectedResidency, const Residency_t residency)
+{
+	int expected = static_cast<int>(expectedResidency);
+	return m_residency.compare_exchange_strong(expected, static_cast<int>(residency));
+}
+
+void ModelGeometry::setData(const vtkSmartPointer<vtkPolyData> data, const Residency_t residency)
+{
+	{
+		std::lock_guard<std::mutex> normalsLock(m_normalsMutex);
+		std::lock_guard<std::mutex> dataLock(m_dataMutex);
+
+		m_data = data;
+
+		// Encoded from the previous mesh points
+		m_octahedralNormals = nullptr;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_lodsMutex);
+
+		// The coarser levels are kept, they are small and drawn while interacting
+		m_lods[0].data = data;
+		m_lods[0].mapper->SetInputData(data);
+		m_lods[0].trianglesCount = data->GetNumberOfPolys();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_bvhMutex);
+		m_bvh.reset();
+	}
+
+	m_residency = static_cast<int>(residency);
+}
+
+void ModelGeometry::touch()
+{
+	m_lastAccessTime = getSteadyTimeMs();
+}
+
+int64_t ModelGeometry::getLastAccessTime() const
+{
+	return m_lastAccessTime;
+}
+
+
+bool ModelGeometry::hasPointNormals()
+{
+	std::lock_guard<std::mutex> lock(m_normalsMutex);
+
+	return m_data->GetPointData()->GetNormals() != nullptr;
+}
+
+void ModelGeometry::computePointNormals()
+{
+	// The mesh is only swapped with this lock held too
+	std::lock_guard<std::mutex> lock(m_normalsMutex);
+
+	if (m_data->GetPointData()->GetNormals())
+	{
+		return;
+	}
+
+	if (m_octahedralNormals)
+	{
+		m_data->GetPointData()->SetNormals(GeometryCompactor::quantizeNormals(GeometryCompactor::decodeNormals(m_octahedralNormals)));
+
+		// Encoded again from the drawn normals when released
+		m_octahedralNormals = nullptr;
+	}
+	else
+	{
+		FRAME_PROFILER_SCOPE("ModelGeometry::computePointNormals");
+		NormalsGenerator::computePointNormals(m_data);
+	}
+
+	// No float copy stays resident next to the uploaded buffers, see GeometryCompactor
+	GeometryCompactor::quantizePointNormals(m_data);
+}
+
+vtkSmartPointer<vtkDataArray> ModelGeometry::preparePointNormals(const vtkSmartPointer<vtkPolyData> data)
+{
+	vtkSmartPointer<vtkShortArray> octahedralNormals;
+
+	{
+		std::lock_guard<std::mutex> lock(m_normalsMutex);
+
+		if (data != m_data || m_data->GetPointData()->GetNormals())
+		{
+			return nullptr;
+		}
+
+		octahedralNormals = m_octahedralNormals;
+	}
+
+	if (octahedralNormals)
+	{
+		return GeometryCompactor::quantizeNormals(GeometryCompactor::decodeNormals(octahedralNormals));
+	}
+
+	FRAME_PROFILER_SCOPE("ModelGeometry::preparePointNormals");
+
+	// Computed on a copy of the geometry, the renderer thread draws the mesh meanwhile
+	vtkSmartPointer<vtkPolyData> normalsData = vtkSmartPointer<vtkPolyData>::New();
+	normalsData->SetPoints(data->GetPoints());
+	normalsData->SetPolys(data->GetPolys());
+
+	if (!NormalsGenerator::computePointNormals(normalsData))
+	{
+		return nullptr;
+	}
+
+	return GeometryCompactor::quantizeNormals(normalsData->GetPointData()->GetNormals());
+}
+
+bool ModelGeometry::setPointNormals(const vtkSmartPointer<vtkPolyData> data, const vtkSmartPointer<vtkDataArray> normals)
+{
+	std::lock_guard<std::mutex> lock(m_normalsMutex);
+
+	if (data != m_data || m_data->GetPointData()->GetNormals())
+	{
+		return false;
+	}
+
+	m_data->GetPointData()->SetNormals(normals);
+	m_octahedralNormals = nullptr;
+
+	return true;
+}
+
+vtkSmartPointer<vtkShortArray> ModelGeometry::prepareReleasedPointNormals(const vtkSmartPointer<vtkPolyData> data)
+{
+	vtkSmartPointer<vtkDataArray> normals;
+
+	{
+		std::lock_guard<std::mutex> lock(m_normalsMutex);
+
+		if (data != m_data)
+		{
+			return nullptr;
+		}
+
+		normals = m_data->GetPointData()->GetNormals();
+	}
+
+	// Only read, by the renderer thread too
+	return normals ? GeometryCompactor::encodeNormals(normals) : nullptr;
+}
+
+bool ModelGeometry::releasePointNormals(const vtkSmartPointer<vtkPolyData> data, const vtkSmartPointer<vtkShortArray> octahedralNormals)
+{
+	// The proxy of an evicted geometry can be its coarsest level of detail, which keeps its normals
+	if (this->getResidency() == Residency_t::Evicted || this->getResidency() == Residency_t::Restoring)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_normalsMutex);
+
+	if (data != m_data || !m_data->GetPointData()->GetNormals())
+	{
+		return false;
+	}
+
+	m_octahedralNormals = octahedralNormals;
+
+	// Removes the array from the point data
+	m_data->GetPointData()->SetNormals(nullptr);
+
+	return true;
+}
+
+
+std::shared_ptr<const ModelBVH> ModelGeometry::getBVH()
+{
+	const vtkSmartPointer<vtkPolyData> data = this->getData();
+
+	// Only the geometry matters, adding the normals does not outdate the index
+	const vtkMTimeType geometryTime = std::max(data->GetPoints()->GetMTime(), data->GetPolys()->GetMTime());
+
+	std::lock_guard<std::mutex> lock(m_bvhMutex);
+
+	if (!m_bvh || m_bvhDataTime < geometryTime)
+	{
+		return nullptr;
+	}
+
+	return m_bvh;
+}
+
+void ModelGeometry::buildBVH()
+{
+	const vtkSmartPointer<vtkPolyData> data = this->getData();
+	const vtkMTimeType geometryTime = std::max(data->GetPoints()->GetMTime(), data->GetPolys()->GetMTime());
+
+	{
+		std::lock_guard<std::mutex> lock(m_bvhMutex);
+
+		if (m_bvh && m_bvhDataTime >= geometryTime)
+		{
+			return;
+		}
+	}
+
+	// Outside of the lock, the renderer keeps picking through the cell picker meanwhile
+	std::shared_ptr<const ModelBVH> bvh = std::make_shared<ModelBVH>(data);
+
+	std::lock_guard<std::mutex> lock(m_bvhMutex);
+
+	// The data may have been swapped during the build, the index of the new data is built by its own builder
+	if (!m_bvh || m_bvhDataTime < geometryTime)
+	{
+		m_bvh = bvh;
+		m_bvhDataTime = geometryTime;
+	}
+}
+
+
+bool ModelGeometry::startLodGeneration()
+{
+	return !m_lodGenerationStarted.exchange(true);
+}
+
+void ModelGeometry::addLod(const vtkSmartPointer<vtkPolyData> lodData)
+{
+	vtkSmartPointer<vtkPolyDataMapper> lodMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+	lodMapper->SetInputData(lodData);
+	lodMapper->ScalarVisibilityOff();
+
+	std::lock_guard<std::mutex> lock(m_lodsMutex);
+	m_lods.push_back({lodData, lodMapper, lodData->GetNumberOfPolys()});
+}
+
+size_t ModelGeometry::getLodsCount()
+{
+	std::lock_guard<std::mutex> lock(m_lodsMutex);
+	return m_lods.size();
+}
+
+vtkIdType ModelGeometry::getLodTrianglesCount(const size_t level)
+{
+	std::lock_guard<std::mutex> lock(m_lodsMutex);
+	return m_lods[std::min(level, m_lods.size() - 1)].trianglesCount;
+}
+
+vtkSmartPointer<vtkPolyDataMapper> ModelGeometry::getLodMapper(const size_t level)
+{
+	std::lock_guard<std::mutex> lock(m_lodsMutex);
+	return m_lods[std::min(level, m_lods.size() - 1)].mapper;
+}
+
+vtkSmartPointer<vtkPolyData> ModelGeometry::getLodData(const size_t level)
+{
+	std::lock_guard<std::mutex> lock(m_lodsMutex);
+	return m_lods[std::min(level, m_lods.size() - 1)].data;
+}
+
+std::vector<ModelGeometry::LodNormals_t> ModelGeometry::prepareLodsPointNormals()
+{
+	std::vector<LodNormals_t> lodsNormals;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lodsMutex);
+
+		// Level 0 is the full mesh, see preparePointNormals()
+		for (size_t level = 1; level < m_lods.size(); ++level)
+		{
+			if (!m_lods[level].data->GetPointData()->GetNormals())
+			{
+				lodsNormals.push_back({m_lods[level].data, nullptr});
+			}
+		}
+	}
+
+	for (LodNormals_t &lodNormals : lodsNormals)
+	{
+		// On a copy, the level may be drawn meanwhile
+		vtkSmartPointer<vtkPolyData> normalsData = vtkSmartPointer<vtkPolyData>::New();
+		normalsData->SetPoints(lodNormals.data->GetPoints());
+		normalsData->SetPolys(lodNormals.data->GetPolys());
+
+		if (NormalsGenerator::computePointNormals(normalsData))
+		{
+			lodNormals.normals = normalsData->GetPointData()->GetNormals();
+		}
+	}
+
+	return lodsNormals;
+}
+
+void ModelGeometry::setLodsPointNormals(const std::vector<LodNormals_t> &lodsNormals)
+{
+	std::lock_guard<std::mutex> lock(m_lodsMutex);
+
+	for (const LodNormals_t &lodNormals : lodsNormals)
+	{
+		if (lodNormals.normals && !lodNormals.data->GetPointData()->GetNormals())
+		{
+			lodNormals.data->GetPointData()->SetNormals(lodNormals.normals);
+		}
+	}
+}
+
+void ModelGeometry::releaseLodsPointNormals()
+{
+	// The coarsest level can be the proxy of an evicted geometry, see releasePointNormals()
+	if (this->getResidency() == Residency_t::Evicted || this->getResidency() == Residency_t::Restoring)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_lodsMutex);
+
+	for (size_t level = 1; level < m_lods.size(); ++level)
+	{
+		m_lods[level].data->GetPointData()->SetNormals(nullptr);
+	}
+}
+
+
+ModelGeometry::MemoryReport_t ModelGeometry::getMemoryReport()
+{
+	MemoryReport_t memoryReport;
+
+	{
+		std::lock_guard<std::mutex> lock(m_normalsMutex);
+
+		memoryReport.geometry = GeometryCompactor::getGeometryBytes(m_data);
+		memoryReport.octahedralNormalsBytes = GeometryCompactor::getArrayBytes(m_octahedralNormals);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_lodsMutex);
+
+		// Level 0 is the model data itself
+		for (size_t level = 1; level < m_lods.size(); ++level)
+		{
+			memoryReport.lodsBytes += GeometryCompactor::getGeometryBytes(m_lods[level].data).totalBytes;
+		}
+
+		// Float positions, float normals when present and 32-bit triangle indices.
+		// The normals of level 0 come and go with the interpolation, they were read under their lock above.
+		for (size_t level = 0; level < m_lods.size(); ++level)
+		{
+			const bool hasNormals = level == 0 ? memoryReport.geometry.pointNormalsBytes > 0 : m_lods[level].data->GetPointData()->GetNormals() != nullptr;
+			const int64_t vertexBytes = (hasNormals ? 6 : 3) * sizeof(float);
+
+			memoryReport.gpuBytes += vertexBytes * m_lods[level].data->GetNumberOfPoints() + 3 * sizeof(uint32_t) * static_cast<int64_t>(m_lods[level].trianglesCount);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_bvhMutex);
+
+		memoryReport.bvhBytes = m_bvh ? m_bvh->getMemorySize() : 0;
+	}
+
+	memoryReport.totalBytes = memoryReport.geometry.totalBytes + memoryReport.octahedralNormalsBytes + memoryReport.lodsBytes + memoryReport.bvhBytes;
+
+	return memoryReport;
+}
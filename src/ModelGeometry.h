@@ -0,0 +1,145 @@
+#ifndef MODELGEOMETRY_H
+#define MODELGEOMETRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QString>
+#include <QUrl>
+
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkShortArray.h>
+#include <vtkSmartPointer.h>
+
+#include "GeometryCompactor.h"
+#include "ModelBVH.h"
+
+
+// Mesh of a model, shared by all the instances of the same part: the polydata, one mapper per level of
+// detail (so the GPU buffers are uploaded once), the picking index and the point normals.
+// The geometry is immutable once built, only the normals and the levels of detail are added later.
+// Under memory pressure the full mesh is evicted to the mesh cache, and a coarse proxy is drawn until
+// it is restored (see ResidencyManager). The instances (Model) own their actor, matrix and render state.
+class ModelGeometry
+{
+public:
+	enum class Residency_t
+	{
+		Resident = 0,
+		Evicting,
+		Evicted,
+		Restoring
+	};
+
+	// Point normals of a coarser level of detail, prepared in a loader thread
+	typedef struct
+	{
+		vtkSmartPointer<vtkPolyData> data;
+		vtkSmartPointer<vtkDataArray> normals;
+	} LodNormals_t;
+
+	typedef struct
+	{
+		GeometryCompactor::GeometryBytes_t geometry;
+		int64_t octahedralNormalsBytes{0};
+		int64_t lodsBytes{0};
+		int64_t bvhBytes{0};
+		int64_t totalBytes{0};
+
+		// Vertex and index buffers of the mappers, estimated: uploaded once a level is drawn, not in totalBytes
+		int64_t gpuBytes{0};
+	} MemoryReport_t;
+
+	// The key identifies the file contents the geometry was loaded from, empty if unknown
+	explicit ModelGeometry(const vtkSmartPointer<vtkPolyData> data, const QString &key = QString(), const QUrl &filePath = QUrl());
+
+	// The proxy while evicted
+	vtkSmartPointer<vtkPolyData> getData() const;
+	const QString &getKey() const;
+	const QUrl &getFilePath() const;
+
+	// Bounds of the full mesh, also while evicted
+	void getBounds(double bounds[6]) const;
+
+	// Transitions are claimed by the thread that performs them, false if the geometry is not in the expected state
+	Residency_t getResidency() const;
+	bool isResident() const;
+	bool changeResidency(const Residency_t expectedResidency, const Residency_t residency);
+
+	// Swaps the drawn mesh (level 0): the full mesh when restored, a proxy when evicted. Renderer thread.
+	void setData(const vtkSmartPointer<vtkPolyData> data, const Residency_t residency);
+
+	// Steady clock milliseconds of the last selection, move or duplication of an instance
+	void touch();
+	int64_t getLastAccessTime() const;
+
+	// Point normals, only needed by the Gouraud interpolation. Released normals are kept in octahedral
+	// encoding and decoded when needed again: only one of the two representations is resident.
+	bool hasPointNormals();
+	// In place, only while the geometry is not drawn yet (loader threads)
+	void computePointNormals();
+	// Once drawn, see CommandGeometryNormals: the normals of the given mesh are prepared in a loader thread,
+	// without modifying it, then swapped in the renderer thread. Both do nothing if the mesh was swapped meanwhile.
+	vtkSmartPointer<vtkDataArray> preparePointNormals(const vtkSmartPointer<vtkPolyData> data);
+	bool setPointNormals(const vtkSmartPointer<vtkPolyData> data, const vtkSmartPointer<vtkDataArray> normals);
+	vtkSmartPointer<vtkShortArray> prepareReleasedPointNormals(const vtkSmartPointer<vtkPolyData> data);
+	bool releasePointNormals(const vtkSmartPointer<vtkPolyData> data, const vtkSmartPointer<vtkShortArray> octahedralNormals);
+
+	// Triangles index of the current data, null until buildBVH() is done with it
+	std::shared_ptr<const ModelBVH> getBVH();
+	// Loader pool once the geometry is loaded or restored, does nothing if the index is up to date
+	void buildBVH();
+
+	// Levels of detail, level 0 is the full mesh and the next ones are coarser.
+	// Only the first call returns true, the levels are generated once for all the instances.
+	bool startLodGeneration();
+	void addLod(const vtkSmartPointer<vtkPolyData> lodData);
+	size_t getLodsCount();
+	vtkIdType getLodTrianglesCount(const size_t level);
+	vtkSmartPointer<vtkPolyDataMapper> getLodMapper(const size_t level);
+	vtkSmartPointer<vtkPolyData> getLodData(const size_t level);
+
+	// The coarser levels follow the Gouraud interpolation as the full mesh: their normals are computed in a
+	// loader thread, then set or dropped in the renderer thread along with the ones of the full mesh
+	std::vector<LodNormals_t> prepareLodsPointNormals();
+	void setLodsPointNormals(const std::vector<LodNormals_t> &lodsNormals);
+	void releaseLodsPointNormals();
+
+	// Resident bytes of the geometry: mesh, levels of detail and picking index
+	MemoryReport_t getMemoryReport();
+
+private:
+	typedef struct
+	{
+		vtkSmartPointer<vtkPolyData> data;
+		vtkSmartPointer<vtkPolyDataMapper> mapper;
+		vtkIdType trianglesCount;
+	} Lod_t;
+
+	vtkSmartPointer<vtkPolyData> m_data;
+	mutable std::mutex m_dataMutex;
+
+	QString m_key;
+	QUrl m_filePath;
+	double m_bounds[6];
+
+	std::atomic<int> m_residency{static_cast<int>(Residency_t::Resident)};
+	std::atomic<int64_t> m_lastAccessTime{0};
+
+	vtkSmartPointer<vtkShortArray> m_octahedralNormals;
+	std::mutex m_normalsMutex;
+
+	std::vector<Lod_t> m_lods;
+	std::atomic<bool> m_lodGenerationStarted{false};
+	std::mutex m_lodsMutex;
+
+	std::shared_ptr<const ModelBVH> m_bvh;
+	vtkMTimeType m_bvhDataTime = 0;
+	std::mutex m_bvhMutex;
+};
+
+#endif // MODELGEOMETRY_H
@@ -0,0 +1,91 @@
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <vtkPolyData.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkSmartPointer.h>
+#include <vtkTriangleFilter.h>
+
+#include "ModelGeometry.h"
+#include "ModelLodGenerator.h"
+#include "NormalsGenerator.h"
+#include "ProcessingEngine.h"
+
+
+// Fraction of the full mesh triangles kept by every level
+static const double LOD_RATIOS[] = {0.5, 0.1, 0.01};
+
+// Smaller meshes are cheap enough to always render at full resolution
+static const vtkIdType LOD_MINIMUM_MODEL_TRIANGLES = 50000;
+
+// Levels below this size are not worth a mapper
+static const vtkIdType LOD_MINIMUM_LEVEL_TRIANGLES = 500;
+
+
+ModelLodGenerator::ModelLodGenerator(const std::shared_ptr<ProcessingEngine> processingEngine, const std::shared_ptr<ModelGeometry> geometry)
+	: m_processingEngine{processingEngine}
+	, m_geometry{geometry}
+{
+}
+
+void ModelLodGenerator::run()
+{
+	vtkSmartPointer<vtkPolyData> modelData = m_geometry->getData();
+	const vtkIdType trianglesCount = modelData->GetNumberOfPolys();
+
+	// An evicted geometry draws a proxy, its levels are generated once it is restored
+	if (trianglesCount < LOD_MINIMUM_MODEL_TRIANGLES || !m_geometry->isResident() || !m_geometry->startLodGeneration())
+	{
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Geometry only: the renderer thread adds and releases the model point normals meanwhile
+	vtkSmartPointer<vtkPolyData> previousLevelData = vtkSmartPointer<vtkPolyData>::New();
+	previousLevelData->SetPoints(modelData->GetPoints());
+	previousLevelData->SetPolys(modelData->GetPolys());
+
+	// The decimation needs triangles only
+	if (modelData->GetPolys()->GetNumberOfConnectivityEntries() != 4 * trianglesCount)
+	{
+		vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+		triangleFilter->SetInputData(previousLevelData);
+		triangleFilter->Update();
+		previousLevelData = triangleFilter->GetOutput();
+	}
+
+	double previousRatio = 1.0;
+
+	for (const double ratio : LOD_RATIOS)
+	{
+		if (trianglesCount * ratio < LOD_MINIMUM_LEVEL_TRIANGLES)
+		{
+			break;
+		}
+
+		// Cascaded: each level is decimated from the previous, much smaller, one
+		vtkSmartPointer<vtkQuadricDecimation> decimation = vtkSmartPointer<vtkQuadricDecimation>::New();
+		decimation->SetInputData(previousLevelData);
+		decimation->SetTargetReduction(1.0 - ratio / previousRatio);
+		decimation->Update();
+
+		// Detached from the filter, so the decimation working copy of the mesh is released
+		vtkSmartPointer<vtkPolyData> levelData = vtkSmartPointer<vtkPolyData>::New();
+		levelData->ShallowCopy(decimation->GetOutput());
+
+		// Normals - Only for the Gouraud interpolation, cheap enough on the decimated levels to compute them here
+		if (m_processingEngine->getPointNormalsRequired())
+		{
+			NormalsGenerator::computePointNormals(levelData);
+		}
+
+		m_geometry->addLod(levelData);
+
+		previousLevelData = levelData;
+		previousRatio = ratio;
+	}
+
+	qDebug() << "ModelLodGenerator::run():" << m_geometry->getLodsCount() - 1 << "levels of" << trianglesCount << "triangles in" << timer.elapsed() << "ms";
+}
@@ -0,0 +1,29 @@
+#ifndef MODELLODGENERATOR_H
+#define MODELLODGENERATOR_H
+
+#include <memory>
+
+#include <QRunnable>
+
+
+class ModelGeometry;
+class ProcessingEngine;
+
+// Builds the decimated levels of detail of a loaded model, in one of the loader pool threads.
+// Each level is decimated from the previous one (50%, 10% and 1% of the triangles) and handed to the
+// geometry as soon as it is ready, the renderer uses them while the user interacts with the scene.
+// The instances share the levels of their geometry, they are only generated for the first one.
+// The levels get point normals only while the Gouraud interpolation is on, see CommandGeometryNormals.
+class ModelLodGenerator : public QRunnable
+{
+public:
+	ModelLodGenerator(const std::shared_ptr<ProcessingEngine> processingEngine, const std::shared_ptr<ModelGeometry> geometry);
+
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	std::shared_ptr<ModelGeometry> m_geometry;
+};
+
+#endif // MODELLODGENERATOR_H
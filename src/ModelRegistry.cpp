@@ -0,0 +1,128 @@
+#include <vtkActor.h>
+
+#include "Model.h"
+#include "ModelRegistry.h"
+
+
+ModelRegistry::ModelRegistry()
+	: m_snapshot{std::make_shared<Snapshot_t>()}
+{
+}
+
+
+ModelRegistry::Handle_t ModelRegistry::insert(const std::shared_ptr<Model> &model)
+{
+	QWriteLocker locker(&m_lock);
+
+	Handle_t handle;
+
+	if (!m_freeSlots.empty())
+	{
+		handle.index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		handle.index = static_cast<uint32_t>(m_slots.size());
+		m_slots.emplace_back();
+	}
+
+	Slot_t &slot = m_slots[handle.index];
+	slot.model = model;
+	handle.generation = slot.generation;
+
+	m_actorIndex[model->getModelActor().GetPointer()] = handle;
+
+	m_snapshotStale.store(true, std::memory_order_release);
+
+	return handle;
+}
+
+bool ModelRegistry::remove(const Handle_t &handle)
+{
+	QWriteLocker locker(&m_lock);
+
+	if (handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation || !m_slots[handle.index].model)
+	{
+		return false;
+	}
+
+	Slot_t &slot = m_slots[handle.index];
+
+	m_actorIndex.erase(slot.model->getModelActor().GetPointer());
+
+	// Invalidate every handle to this slot
+	slot.model = nullptr;
+	++slot.generation;
+	m_freeSlots.push_back(handle.index);
+
+	m_snapshotStale.store(true, std::memory_order_release);
+
+	return true;
+}
+
+
+std::shared_ptr<Model> ModelRegistry::get(const Handle_t &handle) const
+{
+	QReadLocker locker(&m_lock);
+
+	if (handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation)
+	{
+		return nullptr;
+	}
+
+	return m_slots[handle.index].model;
+}
+
+std::shared_ptr<Model> ModelRegistry::getFromActor(const vtkActor *actor) const
+{
+	QReadLocker locker(&m_lock);
+
+	std::unordered_map<const vtkActor*, Handle_t>::const_iterator it = m_actorIndex.find(actor);
+
+	if (it == m_actorIndex.end())
+	{
+		return nullptr;
+	}
+
+	return m_slots[it->second.index].model;
+}
+
+std::shared_ptr<const ModelRegistry::Snapshot_t> ModelRegistry::getSnapshot() const
+{
+	if (m_snapshotStale.load(std::memory_order_acquire))
+	{
+		QWriteLocker locker(&m_lock);
+
+		// Another reader may have rebuilt it while this one was waiting for the lock
+		if (m_snapshotStale.load(std::memory_order_relaxed))
+		{
+			this->rebuildSnapshotNoLock();
+			m_snapshotStale.store(false, std::memory_order_release);
+		}
+	}
+
+	return std::atomic_load(&m_snapshot);
+}
+
+size_t ModelRegistry::size() const
+{
+	return this->getSnapshot()->size();
+}
+
+
+void ModelRegistry::rebuildSnapshotNoLock() const
+{
+	std::shared_ptr<Snapshot_t> snapshot = std::make_shared<Snapshot_t>();
+	snapshot->reserve(m_slots.size() - m_freeSlots.size());
+
+	for (const Slot_t &slot : m_slots)
+	{
+		if (slot.model)
+		{
+			snapshot->push_back(slot.model);
+		}
+	}
+
+	std::atomic_store(&m_snapshot, std::shared_ptr<const Snapshot_t>(snapshot));
+}
@@ -0,0 +1,62 @@
+#ifndef MODELREGISTRY_H
+#define MODELREGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <QReadWriteLock>
+
+
+class Model;
+class vtkActor;
+
+// Thread-safe slot map of the loaded models.
+// Handles carry the slot generation, so a handle to a removed model never resolves to the model
+// that reuses its slot. Actor lookups go through a hash index, and readers that need to walk
+// every model (the render thread) take an immutable snapshot. Inserts and removes only mark it stale,
+// it is rebuilt once by the next reader, so a batch of N loads or duplications costs O(N).
+class ModelRegistry
+{
+public:
+	typedef struct
+	{
+		uint32_t index{UINT32_MAX};
+		uint32_t generation{0};
+	} Handle_t;
+
+	typedef std::vector<std::shared_ptr<Model>> Snapshot_t;
+
+	ModelRegistry();
+
+	Handle_t insert(const std::shared_ptr<Model> &model);
+	bool remove(const Handle_t &handle);
+
+	std::shared_ptr<Model> get(const Handle_t &handle) const;
+	std::shared_ptr<Model> getFromActor(const vtkActor *actor) const;
+	std::shared_ptr<const Snapshot_t> getSnapshot() const;
+	size_t size() const;
+
+private:
+	typedef struct
+	{
+		std::shared_ptr<Model> model;
+		uint32_t generation{0};
+	} Slot_t;
+
+	void rebuildSnapshotNoLock() const;
+
+	mutable QReadWriteLock m_lock;
+
+	std::vector<Slot_t> m_slots;
+	std::vector<uint32_t> m_freeSlots;
+	std::unordered_map<const vtkActor*, Handle_t> m_actorIndex;
+
+	// Read and replaced atomically, never modified in place
+	mutable std::shared_ptr<const Snapshot_t> m_snapshot;
+	mutable std::atomic<bool> m_snapshotStale{false};
+};
+
+#endif // MODELREGISTRY_H
@@ -0,0 +1,28 @@
+#ifndef MODELSRENDERER_H
+#define MODELSRENDERER_H
+
+#include <cstdint>
+#include <memory>
+
+#include <vtkActor.h>
+#include <vtkSmartPointer.h>
+
+
+class Model;
+
+// What the model commands need from the renderer.
+// Implemented by QVTKFramebufferObjectRenderer, keeps the commands free of the Qt Quick rendering code.
+class ModelsRenderer
+{
+public:
+	virtual ~ModelsRenderer(){}
+
+	virtual void addModelActor(const std::shared_ptr<Model> model) = 0;
+	virtual const bool screenToWorld(const int16_t screenX, const int16_t screenY, double worldPos[]) = 0;
+
+	// Placeholder actors of the models still loading, replaced stage by stage until the model is added
+	virtual void setPreviewActor(const uint64_t previewId, const vtkSmartPointer<vtkActor> previewActor) = 0;
+	virtual void removePreviewActor(const uint64_t previewId) = 0;
+};
+
+#endif // MODELSRENDERER_H
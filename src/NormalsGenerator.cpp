@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <vtkCellArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+#include "LegacyCells.h"
+#include "NormalsGenerator.h"
+#include "Parallel.h"
+
+
+// Upper bound of the memory used by the per-thread partial sums, fewer threads scatter on large meshes
+static const size_t PARTIAL_NORMALS_MAXIMUM_BYTES = 256 << 20;
+
+
+static inline int64_t getCellOffset(const int64_t *cellsOffsets, const int64_t cellIndex)
+{
+	// Triangle meshes have no offsets table: every cell takes 4 entries, [3, id0, id1, id2]
+	return cellsOffsets ? cellsOffsets[cellIndex] : 4 * cellIndex;
+}
+
+
+bool NormalsGenerator::computePointNormals(const vtkSmartPointer<vtkPolyData> polyData)
+{
+	vtkPoints *points = polyData->GetPoints();
+	vtkCellArray *polys = polyData->GetPolys();
+
+	if (!points || !polys || polys->GetNumberOfCells() == 0)
+	{
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	const int64_t pointsCount = points->GetNumberOfPoints();
+	const int64_t cellsCount = polys->GetNumberOfCells();
+	const LegacyCells legacyPolys(polys);
+	const vtkIdType *cells = legacyPolys.getData();
+
+	// Cells of mixed sizes are located through their offsets, only computed when needed
+	std::vector<int64_t> cellsOffsets;
+
+	if (legacyPolys.getSize() != 4 * cellsCount)
+	{
+		cellsOffsets.resize(cellsCount);
+
+		int64_t cellOffset = 0;
+
+		for (int64_t i = 0; i < cellsCount; ++i)
+		{
+			cellsOffsets[i] = cellOffset;
+			cellOffset += cells[cellOffset] + 1;
+		}
+	}
+
+	const int64_t *cellsOffsetsPointer = cellsOffsets.empty() ? nullptr : cellsOffsets.data();
+
+	// Face normals, not normalized: their length is twice the face area
+	std::vector<float> faceNormals(3 * cellsCount);
+
+	Parallel::forEachRange(cellsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		if (points->GetDataType() == VTK_FLOAT)
+		{
+			const float *coordinates = static_cast<vtkFloatArray*>(points->GetData())->GetPointer(0);
+			NormalsGenerator::computeFaceNormals(coordinates, cells, cellsOffsetsPointer, rangeBegin, rangeEnd, faceNormals.data());
+		}
+		else if (points->GetDataType() == VTK_DOUBLE)
+		{
+			const double *coordinates = static_cast<vtkDoubleArray*>(points->GetData())->GetPointer(0);
+			NormalsGenerator::computeFaceNormals(coordinates, cells, cellsOffsetsPointer, rangeBegin, rangeEnd, faceNormals.data());
+		}
+		else
+		{
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+			{
+				const vtkIdType *cell = cells + getCellOffset(cellsOffsetsPointer, i);
+				double normal[3] = {0.0, 0.0, 0.0};
+
+				// Newell's method, exact for planar polygons and robust for the others
+				for (vtkIdType j = 0; j < cell[0]; ++j)
+				{
+					double currentPoint[3];
+					double nextPoint[3];
+					points->GetPoint(cell[1 + j], currentPoint);
+					points->GetPoint(cell[1 + (j + 1) % cell[0]], nextPoint);
+
+					normal[0] += (currentPoint[1] - nextPoint[1]) * (currentPoint[2] + nextPoint[2]);
+					normal[1] += (currentPoint[2] - nextPoint[2]) * (currentPoint[0] + nextPoint[0]);
+					normal[2] += (currentPoint[0] - nextPoint[0]) * (currentPoint[1] + nextPoint[1]);
+				}
+
+				faceNormals[3 * i] = static_cast<float>(normal[0]);
+				faceNormals[3 * i + 1] = static_cast<float>(normal[1]);
+				faceNormals[3 * i + 2] = static_cast<float>(normal[2]);
+			}
+		}
+	}, 16384);
+
+	// Scatter: every range of faces accumulates into its own partial sums, the first one into the output array
+	vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+	normals->SetName("Normals");
+	normals->SetNumberOfComponents(3);
+	normals->SetNumberOfTuples(pointsCount);
+	float *normalsPointer = normals->GetPointer(0);
+
+	const size_t partialBytes = std::max<size_t>(3 * sizeof(float) * pointsCount, 1);
+	const size_t partialsCount = std::max<size_t>(std::min<size_t>(Parallel::getRangesCount(cellsCount, 65536), PARTIAL_NORMALS_MAXIMUM_BYTES / partialBytes + 1), 1);
+
+	std::vector<std::unique_ptr<float[]>> partialNormals(partialsCount);
+
+	Parallel::forEachChunk(partialsCount, [&](const size_t partialIndex)
+	{
+		float *partial = normalsPointer;
+
+		if (partialIndex > 0)
+		{
+			partialNormals[partialIndex].reset(new float[3 * pointsCount]);
+			partial = partialNormals[partialIndex].get();
+		}
+
+		// Zeroed by the thread that fills it
+		std::fill(partial, partial + 3 * pointsCount, 0.0f);
+
+		const int64_t cellsBegin = cellsCount * partialIndex / partialsCount;
+		const int64_t cellsEnd = cellsCount * (partialIndex + 1) / partialsCount;
+
+		NormalsGenerator::scatterFaceNormals(cells, cellsOffsetsPointer, cellsBegin, cellsEnd, faceNormals.data(), partial);
+	});
+
+	// Reduce the partial sums and normalize, per range of points
+	Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t partialIndex = 1; partialIndex < partialsCount; ++partialIndex)
+		{
+			const float *partial = partialNormals[partialIndex].get();
+
+			for (size_t i = 3 * rangeBegin; i < 3 * rangeEnd; ++i)
+			{
+				normalsPointer[i] += partial[i];
+			}
+		}
+
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			float *normal = normalsPointer + 3 * i;
+			const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+			// Points used by no face, or only by degenerated ones, keep a null normal
+			const float inverseLength = length > 0.0f ? 1.0f / length : 0.0f;
+
+			normal[0] *= inverseLength;
+			normal[1] *= inverseLength;
+			normal[2] *= inverseLength;
+		}
+	}, 16384);
+
+	polyData->GetPointData()->SetNormals(normals);
+
+	qDebug() << "NormalsGenerator::computePointNormals():" << pointsCount << "points," << cellsCount << "faces," << partialsCount << "partials in" << timer.elapsed() << "ms";
+
+	return true;
+}
+
+
+template <typename T>
+void NormalsGenerator::computeFaceNormals(const T *coordinates, const vtkIdType *cells, const int64_t *cellsOffsets, const int64_t cellsBegin, const int64_t cellsEnd, float *faceNormals)
+{
+	if (!cellsOffsets)
+	{
+		// Triangles: a straight cross product per face, with no branch in the loop
+		for (int64_t i = cellsBegin; i < cellsEnd; ++i)
+		{
+			const T *a = coordinates + 3 * cells[4 * i + 1];
+			const T *b = coordinates + 3 * cells[4 * i + 2];
+			const T *c = coordinates + 3 * cells[4 * i + 3];
+
+			const T ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			const T ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+
+			faceNormals[3 * i] = static_cast<float>(ab[1] * ac[2] - ab[2] * ac[1]);
+			faceNormals[3 * i + 1] = static_cast<float>(ab[2] * ac[0] - ab[0] * ac[2]);
+			faceNormals[3 * i + 2] = static_cast<float>(ab[0] * ac[1] - ab[1] * ac[0]);
+		}
+		return;
+	}
+
+	for (int64_t i = cellsBegin; i < cellsEnd; ++i)
+	{
+		const vtkIdType *cell = cells + cellsOffsets[i];
+		T normal[3] = {0, 0, 0};
+
+		// Newell's method, exact for planar polygons and robust for the others
+		for (vtkIdType j = 0; j < cell[0]; ++j)
+		{
+			const T *currentPoint = coordinates + 3 * cell[1 + j];
+			const T *nextPoint = coordinates + 3 * cell[1 + (j + 1) % cell[0]];
+
+			normal[0] += (currentPoint[1] - nextPoint[1]) * (currentPoint[2] + nextPoint[2]);
+			normal[1] += (currentPoint[2] - nextPoint[2]) * (currentPoint[0] + nextPoint[0]);
+			normal[2] += (currentPoint[0] - nextPoint[0]) * (currentPoint[1] + nextPoint[1]);
+		}
+
+		faceNormals[3 * i] = static_cast<float>(normal[0]);
+		faceNormals[3 * i + 1] = static_cast<float>(normal[1]);
+		faceNormals[3 * i + 2] = static_cast<float>(normal[2]);
+	}
+}
+
+void NormalsGenerator::scatterFaceNormals(const vtkIdType *cells, const int64_t *cellsOffsets, const int64_t cellsBegin, const int64_t cellsEnd, const float *faceNormals, float *pointNormals)
+{
+	for (int64_t i = cellsBegin; i < cellsEnd; ++i)
+	{
+		const vtkIdType *cell = cells + getCellOffset(cellsOffsets, i);
+		const float *faceNormal = faceNormals + 3 * i;
+
+		for (vtkIdType j = 1; j <= cell[0]; ++j)
+		{
+			float *pointNormal = pointNormals + 3 * cell[j];
+
+			pointNormal[0] += faceNormal[0];
+			pointNormal[1] += faceNormal[1];
+			pointNormal[2] += faceNormal[2];
+		}
+	}
+}
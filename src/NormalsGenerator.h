@@ -0,0 +1,28 @@
+#ifndef NORMALSGENERATOR_H
+#define NORMALSGENERATOR_H
+
+#include <cstdint>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+
+// Smooth point normals of polygonal meshes, replacing vtkPolyDataNormals where no orientation fixes
+// nor feature edges splitting are needed.
+// The face normals are computed in parallel, then scattered into per-thread partial sums that are
+// reduced and normalized per point, so no atomics are needed. The faces are weighted by their area.
+// The polydata is modified in place: only the "Normals" point data array is added.
+class NormalsGenerator
+{
+public:
+	// Returns false if the polydata has no polygon
+	static bool computePointNormals(const vtkSmartPointer<vtkPolyData> polyData);
+
+private:
+	template <typename T>
+	static void computeFaceNormals(const T *coordinates, const vtkIdType *cells, const int64_t *cellsOffsets, const int64_t cellsBegin, const int64_t cellsEnd, float *faceNormals);
+
+	static void scatterFaceNormals(const vtkIdType *cells, const int64_t *cellsOffsets, const int64_t cellsBegin, const int64_t cellsEnd, const float *faceNormals, float *pointNormals);
+};
+
+#endif // NORMALSGENERATOR_H
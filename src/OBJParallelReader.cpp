@@ -0,0 +1,550 @@
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#include <QDebug>
+#include <QFile>
+
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+#include "OBJParallelReader.h"
+#include "Parallel.h"
+
+
+static const qint64 CHUNK_MINIMUM_SIZE = 4 * 1024 * 1024;
+
+// Lines searched for a vertex after every sample offset, the faces and normals are interleaved with the vertices
+static const int SAMPLE_SEARCH_LINES = 16;
+
+
+static inline bool isBlank(const char c)
+{
+	return (c == ' ' || c == '\t');
+}
+
+static inline const char *skipBlanks(const char *p, const char *end)
+{
+	while (p < end && isBlank(*p))
+	{
+		++p;
+	}
+	return p;
+}
+
+static inline const char *skipLine(const char *p, const char *end)
+{
+	while (p < end && *p != '\n')
+	{
+		++p;
+	}
+	return (p < end) ? p + 1 : end;
+}
+
+// Locale independent float parser, much faster than strtod
+static inline const char *parseFloat(const char *p, const char *end, float &value)
+{
+	static const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+										 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	p = skipBlanks(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+			++digits;
+		}
+		else
+		{
+			++exponent;
+		}
+		++p;
+	}
+
+	if (p < end && *p == '.')
+	{
+		++p;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				++digits;
+				--exponent;
+			}
+			++p;
+		}
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negativeExponent = (*p == '-');
+			++p;
+		}
+
+		int explicitExponent = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (explicitExponent < 10000)
+			{
+				explicitExponent = explicitExponent * 10 + (*p - '0');
+			}
+			++p;
+		}
+
+		exponent += negativeExponent ? -explicitExponent : explicitExponent;
+	}
+
+	double result = static_cast<double>(mantissa);
+
+	if (exponent < 0)
+	{
+		result = (exponent >= -22) ? result / powersOfTen[-exponent] : result * std::pow(10.0, exponent);
+	}
+	else if (exponent > 0)
+	{
+		result = (exponent <= 22) ? result * powersOfTen[exponent] : result * std::pow(10.0, exponent);
+	}
+
+	value = static_cast<float>(negative ? -result : result);
+
+	return p;
+}
+
+static inline const char *parseInteger(const char *p, const char *end, int64_t &value, bool &valid)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		++p;
+	}
+
+	valid = (p < end && *p >= '0' && *p <= '9');
+
+	value = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		value = value * 10 + (*p - '0');
+		++p;
+	}
+
+	if (negative)
+	{
+		value = -value;
+	}
+
+	return p;
+}
+
+
+vtkSmartPointer<vtkPolyData> OBJParallelReader::read(const QString &filePath, const ReadProgress_t &readProgress)
+{
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+	{
+		qWarning() << "OBJParallelReader::read(): unable to open" << filePath;
+		return nullptr;
+	}
+
+	const qint64 fileSize = file.size();
+	const char *data = reinterpret_cast<const char*>(file.map(0, fileSize));
+
+	if (!data)
+	{
+		return nullptr;
+	}
+
+	// Split the file on line boundaries, a few chunks per thread to balance uneven sections (vertices vs faces)
+	const qint64 chunksCount = std::max<qint64>(1, std::min<qint64>(4 * Parallel::getThreadsCount(), fileSize / CHUNK_MINIMUM_SIZE));
+
+	std::vector<Chunk_t> chunks(static_cast<size_t>(chunksCount));
+	const char *fileEnd = data + fileSize;
+
+	for (qint64 i = 0; i < chunksCount; ++i)
+	{
+		chunks[i].begin = (i == 0) ? data : chunks[i - 1].end;
+		chunks[i].end = (i == chunksCount - 1) ? fileEnd : std::max(chunks[i].begin, skipLine(data + fileSize * (i + 1) / chunksCount, fileEnd));
+	}
+
+	// Parse, the progress is the size of the chunks parsed so far
+	std::mutex readProgressMutex;
+	qint64 bytesRead = 0;
+
+	Parallel::forEachChunk(chunks.size(), [&](const size_t chunkIndex)
+	{
+		parseChunk(chunks[chunkIndex]);
+
+		if (readProgress)
+		{
+			std::lock_guard<std::mutex> lock(readProgressMutex);
+
+			bytesRead += chunks[chunkIndex].end - chunks[chunkIndex].begin;
+			readProgress(bytesRead);
+		}
+	});
+
+	// Prefix sum of the per-chunk counts
+	int64_t verticesCount = 0;
+	int64_t normalsCount = 0;
+	int64_t facesCount = 0;
+	int64_t connectivitySize = 0;
+	bool normalsMatchVertices = true;
+
+	for (Chunk_t &chunk : chunks)
+	{
+		chunk.verticesOffset = verticesCount;
+		chunk.normalsOffset = normalsCount;
+		chunk.facesOffset = facesCount;
+		chunk.connectivityOffset = connectivitySize;
+
+		verticesCount += chunk.vertices.size() / 3;
+		normalsCount += chunk.normals.size() / 3;
+		facesCount += chunk.faceSizes.size();
+		connectivitySize += chunk.faceSizes.size() + chunk.faceCorners.size();
+		normalsMatchVertices = normalsMatchVertices && chunk.normalsMatchVertices && (!chunk.hasRelativeNormals || chunk.verticesOffset - chunk.normalsOffset == -chunk.relativeNormalsShift);
+	}
+
+	if (verticesCount == 0 || facesCount == 0)
+	{
+		qWarning() << "OBJParallelReader::read(): no geometry found in" << filePath;
+		return nullptr;
+	}
+
+	// Output arrays
+	vtkSmartPointer<vtkFloatArray> pointsData = vtkSmartPointer<vtkFloatArray>::New();
+	pointsData->SetNumberOfComponents(3);
+	pointsData->SetNumberOfTuples(verticesCount);
+	float *pointsPointer = pointsData->GetPointer(0);
+
+	const bool withNormals = normalsMatchVertices && normalsCount == verticesCount;
+
+	vtkSmartPointer<vtkFloatArray> normals;
+	float *normalsPointer = nullptr;
+
+	if (withNormals)
+	{
+		normals = vtkSmartPointer<vtkFloatArray>::New();
+		normals->SetName("Normals");
+		normals->SetNumberOfComponents(3);
+		normals->SetNumberOfTuples(normalsCount);
+		normalsPointer = normals->GetPointer(0);
+	}
+
+	vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+	vtkIdType *polysPointer = polys->WritePointer(facesCount, connectivitySize);
+
+	// Stitch the chunks into the output, fixing up the relative indices with the chunk offsets
+	std::atomic<bool> indicesValid{true};
+
+	Parallel::forEachChunk(chunks.size(), [&](const size_t chunkIndex)
+	{
+		Chunk_t &chunk = chunks[chunkIndex];
+
+		std::copy(chunk.vertices.begin(), chunk.vertices.end(), pointsPointer + 3 * chunk.verticesOffset);
+
+		if (normalsPointer)
+		{
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normalsPointer + 3 * chunk.normalsOffset);
+		}
+
+		for (const size_t relativeCorner : chunk.relativeCorners)
+		{
+			chunk.faceCorners[relativeCorner] += chunk.verticesOffset;
+		}
+
+		vtkIdType *polyPointer = polysPointer + chunk.connectivityOffset;
+		std::vector<int64_t>::const_iterator corner = chunk.faceCorners.begin();
+
+		for (const uint32_t faceSize : chunk.faceSizes)
+		{
+			*polyPointer++ = faceSize;
+
+			for (uint32_t i = 0; i < faceSize; ++i, ++corner)
+			{
+				if (*corner < 0 || *corner >= verticesCount)
+				{
+					indicesValid = false;
+				}
+				*polyPointer++ = *corner;
+			}
+		}
+
+		// Release the chunk memory as soon as possible
+		std::vector<float>().swap(chunk.vertices);
+		std::vector<float>().swap(chunk.normals);
+		std::vector<int64_t>().swap(chunk.faceCorners);
+	});
+
+	file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+
+	if (!indicesValid)
+	{
+		qWarning() << "OBJParallelReader::read(): face indices out of range in" << filePath;
+		return nullptr;
+	}
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetData(pointsData);
+
+	vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+	polyData->SetPoints(points);
+	polyData->SetPolys(polys);
+
+	if (normals)
+	{
+		polyData->GetPointData()->SetNormals(normals);
+	}
+
+	qDebug() << "OBJParallelReader::read():" << verticesCount << "vertices and" << facesCount << "faces read from" << filePath << "in" << chunks.size() << "chunks";
+
+	return polyData;
+}
+
+vtkSmartPointer<vtkPolyData> OBJParallelReader::readSample(const QString &filePath, const uint32_t maximumPoints, const char *vertexKeyword)
+{
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly) || maximumPoints == 0)
+	{
+		return nullptr;
+	}
+
+	const qint64 fileSize = file.size();
+	const uchar *data = fileSize > 0 ? file.map(0, fileSize) : nullptr;
+
+	if (!data)
+	{
+		return nullptr;
+	}
+
+	const char *begin = reinterpret_cast<const char*>(data);
+	const char *end = begin + fileSize;
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetDataTypeToFloat();
+	vtkSmartPointer<vtkCellArray> vertices = vtkSmartPointer<vtkCellArray>::New();
+
+	// Offsets closer than a line apart find the same vertex
+	const char *lastVertexLine = nullptr;
+
+	for (uint32_t i = 0; i < maximumPoints; ++i)
+	{
+		const char *p = begin + static_cast<qint64>(static_cast<double>(fileSize) * i / maximumPoints);
+
+		// From the start of the next line, unless at the start of the file
+		if (p != begin)
+		{
+			p = skipLine(p, end);
+		}
+
+		for (int searchedLines = 0; searchedLines < SAMPLE_SEARCH_LINES && p < end; ++searchedLines)
+		{
+			float point[3];
+
+			if (parseSampleVertex(p, end, vertexKeyword, point))
+			{
+				if (p != lastVertexLine)
+				{
+					const vtkIdType pointId = points->InsertNextPoint(point);
+					vertices->InsertNextCell(1, &pointId);
+					lastVertexLine = p;
+				}
+				break;
+			}
+
+			p = skipLine(p, end);
+		}
+	}
+
+	file.unmap(const_cast<uchar*>(data));
+
+	if (points->GetNumberOfPoints() == 0)
+	{
+		return nullptr;
+	}
+
+	vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+	polyData->SetPoints(points);
+	polyData->SetVerts(vertices);
+
+	return polyData;
+}
+
+bool OBJParallelReader::parseSampleVertex(const char *p, const char *end, const char *vertexKeyword, float point[3])
+{
+	p = skipBlanks(p, end);
+
+	const size_t keywordLength = std::strlen(vertexKeyword);
+
+	if (static_cast<size_t>(end - p) <= keywordLength || std::strncmp(p, vertexKeyword, keywordLength) != 0 || !isBlank(p[keywordLength]))
+	{
+		return false;
+	}
+
+	p += keywordLength;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		// The three coordinates are on the vertex line
+		const char *coordinate = skipBlanks(p, end);
+
+		if (coordinate == end || *coordinate == '\r' || *coordinate == '\n')
+		{
+			return false;
+		}
+
+		p = parseFloat(coordinate, end, point[axis]);
+
+		if (p == coordinate)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void OBJParallelReader::parseChunk(Chunk_t &chunk)
+{
+	// Rough reservation, a vertex line is around 30 bytes long
+	chunk.vertices.reserve(static_cast<size_t>(chunk.end - chunk.begin) / 30 * 3);
+
+	const char *p = chunk.begin;
+	const char *end = chunk.end;
+
+	while (p < end)
+	{
+		p = skipBlanks(p, end);
+
+		if (p + 1 < end && p[0] == 'v' && isBlank(p[1]))
+		{
+			float coordinates[3];
+			p = parseFloat(p + 1, end, coordinates[0]);
+			p = parseFloat(p, end, coordinates[1]);
+			p = parseFloat(p, end, coordinates[2]);
+			chunk.vertices.insert(chunk.vertices.end(), coordinates, coordinates + 3);
+		}
+		else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isBlank(p[2]))
+		{
+			float coordinates[3];
+			p = parseFloat(p + 2, end, coordinates[0]);
+			p = parseFloat(p, end, coordinates[1]);
+			p = parseFloat(p, end, coordinates[2]);
+			chunk.normals.insert(chunk.normals.end(), coordinates, coordinates + 3);
+		}
+		else if (p + 1 < end && p[0] == 'f' && isBlank(p[1]))
+		{
+			p = parseFace(p + 1, end, chunk);
+		}
+
+		// Comments, texture coordinates, groups, materials, etc. are ignored
+		p = skipLine(p, end);
+	}
+}
+
+const char *OBJParallelReader::parseFace(const char *p, const char *end, Chunk_t &chunk)
+{
+	const int64_t chunkVerticesCount = static_cast<int64_t>(chunk.vertices.size() / 3);
+	const int64_t chunkNormalsCount = static_cast<int64_t>(chunk.normals.size() / 3);
+	uint32_t faceSize = 0;
+
+	for (;;)
+	{
+		p = skipBlanks(p, end);
+
+		// Corner format: v, v/vt, v//vn or v/vt/vn
+		int64_t vertexIndex;
+		bool valid;
+		p = parseInteger(p, end, vertexIndex, valid);
+
+		if (!valid || vertexIndex == 0)
+		{
+			break;
+		}
+
+		int64_t normalIndex = 0;
+		if (p < end && *p == '/')
+		{
+			++p;
+			int64_t textureIndex;
+			p = parseInteger(p, end, textureIndex, valid);
+
+			if (p < end && *p == '/')
+			{
+				++p;
+				p = parseInteger(p, end, normalIndex, valid);
+			}
+		}
+
+		if (vertexIndex > 0)
+		{
+			chunk.faceCorners.push_back(vertexIndex - 1);
+		}
+		else
+		{
+			// Relative to the last vertex read so far, completed with the chunk offset when stitching
+			chunk.relativeCorners.push_back(chunk.faceCorners.size());
+			chunk.faceCorners.push_back(chunkVerticesCount + vertexIndex);
+		}
+
+		// Per vertex normals are only kept when they can be used as point data as they are
+		if (vertexIndex > 0 && normalIndex != vertexIndex)
+		{
+			chunk.normalsMatchVertices = false;
+		}
+		else if (vertexIndex < 0)
+		{
+			// Both relative: they match if the local vertex and normal indices differ by the same amount
+			// as the chunk offsets, which is only known after the prefix sum
+			const int64_t relativeNormalsShift = (chunkVerticesCount + vertexIndex) - (chunkNormalsCount + normalIndex);
+
+			if (normalIndex >= 0 || (chunk.hasRelativeNormals && relativeNormalsShift != chunk.relativeNormalsShift))
+			{
+				chunk.normalsMatchVertices = false;
+			}
+
+			chunk.hasRelativeNormals = true;
+			chunk.relativeNormalsShift = relativeNormalsShift;
+		}
+
+		++faceSize;
+	}
+
+	if (faceSize >= 3)
+	{
+		chunk.faceSizes.push_back(faceSize);
+	}
+	else
+	{
+		// Degenerate face, drop its corners
+		chunk.relativeCorners.erase(std::remove_if(chunk.relativeCorners.begin(), chunk.relativeCorners.end(), [&chunk, faceSize](const size_t corner)
+		{
+			return corner >= chunk.faceCorners.size() - faceSize;
+		}), chunk.relativeCorners.end());
+		chunk.faceCorners.resize(chunk.faceCorners.size() - faceSize);
+	}
+
+	return p;
+}
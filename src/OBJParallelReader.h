@@ -0,0 +1,64 @@
+#ifndef OBJPARALLELREADER_H
+#define OBJPARALLELREADER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <QString>
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+
+// Multi-threaded OBJ reader.
+// The memory mapped file is split in chunks on line boundaries and each chunk is parsed concurrently
+// (vertices, normals and faces). A prefix sum over the per-chunk counts then gives every chunk its
+// offsets in the output arrays, which are filled in parallel as well.
+// Returns nullptr if the file cannot be read, so the caller can fall back to vtkOBJReader.
+class OBJParallelReader
+{
+public:
+	// Called during the parsing with the number of bytes parsed so far, from the parsing threads one at a time
+	typedef std::function<void(const qint64 bytesRead)> ReadProgress_t;
+
+	static vtkSmartPointer<vtkPolyData> read(const QString &filePath, const ReadProgress_t &readProgress = nullptr);
+
+	// At most maximumPoints vertices probed at evenly spaced offsets of the file, as a points cloud, to preview
+	// huge files before they are parsed. The vertex lines start with the keyword: "v" for OBJ, also usable with
+	// "vertex" for ASCII STL. Returns nullptr if no vertex was found.
+	static vtkSmartPointer<vtkPolyData> readSample(const QString &filePath, const uint32_t maximumPoints, const char *vertexKeyword = "v");
+
+private:
+	typedef struct
+	{
+		const char *begin{nullptr};
+		const char *end{nullptr};
+
+		std::vector<float> vertices;
+		std::vector<float> normals;
+
+		// Vertex indices of every face corner, resolved to zero based global indices, except the
+		// negative (relative) ones which are stored relative to the chunk and listed in relativeCorners
+		std::vector<int64_t> faceCorners;
+		std::vector<uint32_t> faceSizes;
+		std::vector<size_t> relativeCorners;
+
+		// True while every face corner uses the normal with the same index as its vertex
+		bool normalsMatchVertices{true};
+		bool hasRelativeNormals{false};
+		int64_t relativeNormalsShift{0};
+
+		// Offsets in the output, from the prefix sum
+		int64_t verticesOffset{0};
+		int64_t normalsOffset{0};
+		int64_t facesOffset{0};
+		int64_t connectivityOffset{0};
+	} Chunk_t;
+
+	static bool parseSampleVertex(const char *p, const char *end, const char *vertexKeyword, float point[3]);
+	static void parseChunk(Chunk_t &chunk);
+	static const char *parseFace(const char *p, const char *end, Chunk_t &chunk);
+};
+
+#endif // OBJPARALLELREADER_H
@@ -0,0 +1,155 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Parallel.h"
+
+
+namespace
+{
+	typedef struct
+	{
+		const std::function<void(const size_t)> *function;
+		size_t chunksCount;
+
+		std::atomic<size_t> nextChunk;
+		std::atomic<size_t> chunksDone;
+
+		std::mutex doneMutex;
+		std::condition_variable doneCondition;
+	} Job_t;
+
+	class WorkerPool
+	{
+	public:
+		WorkerPool()
+		{
+			const unsigned int workersCount = Parallel::getThreadsCount() - 1;
+
+			m_workers.reserve(workersCount);
+
+			for (unsigned int i = 0; i < workersCount; ++i)
+			{
+				m_workers.emplace_back(&WorkerPool::work, this);
+			}
+		}
+
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+
+			m_jobAvailable.notify_all();
+
+			for (std::thread &worker : m_workers)
+			{
+				worker.join();
+			}
+		}
+
+		void run(const std::shared_ptr<Job_t> &job)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_jobs.push_back(job);
+			}
+
+			m_jobAvailable.notify_all();
+
+			// Whatever the workers are busy with, the calling thread alone completes the job
+			WorkerPool::runJob(*job);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				for (std::deque<std::shared_ptr<Job_t>>::iterator it = m_jobs.begin(); it != m_jobs.end(); ++it)
+				{
+					if (*it == job)
+					{
+						m_jobs.erase(it);
+						break;
+					}
+				}
+			}
+
+			// Chunks still running in the workers
+			std::unique_lock<std::mutex> doneLock(job->doneMutex);
+			job->doneCondition.wait(doneLock, [&job]() { return job->chunksDone.load() == job->chunksCount; });
+		}
+
+	private:
+		static void runJob(Job_t &job)
+		{
+			size_t chunkIndex;
+
+			while ((chunkIndex = job.nextChunk.fetch_add(1)) < job.chunksCount)
+			{
+				(*job.function)(chunkIndex);
+
+				if (job.chunksDone.fetch_add(1) + 1 == job.chunksCount)
+				{
+					std::lock_guard<std::mutex> doneLock(job.doneMutex);
+					job.doneCondition.notify_all();
+				}
+			}
+		}
+
+		void work()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			for (;;)
+			{
+				m_jobAvailable.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+
+				if (m_stopping)
+				{
+					return;
+				}
+
+				// Kept alive by the shared pointer: the caller may return as soon as the last chunk is done
+				std::shared_ptr<Job_t> job = m_jobs.front();
+
+				if (job->nextChunk.load() >= job->chunksCount)
+				{
+					m_jobs.pop_front();
+					continue;
+				}
+
+				lock.unlock();
+				WorkerPool::runJob(*job);
+				lock.lock();
+			}
+		}
+
+		std::mutex m_mutex;
+		std::condition_variable m_jobAvailable;
+		std::deque<std::shared_ptr<Job_t>> m_jobs;
+		std::vector<std::thread> m_workers;
+		bool m_stopping = false;
+	};
+
+	WorkerPool &getWorkerPool()
+	{
+		static WorkerPool workerPool;
+
+		return workerPool;
+	}
+}
+
+
+void Parallel::runChunks(const size_t chunksCount, const std::function<void(const size_t)> &function)
+{
+	std::shared_ptr<Job_t> job = std::make_shared<Job_t>();
+	job->function = &function;
+	job->chunksCount = chunksCount;
+	job->nextChunk = 0;
+	job->chunksDone = 0;
+
+	getWorkerPool().run(job);
+}
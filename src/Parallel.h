@@ -0,0 +1,67 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+
+// Minimal data-parallel helpers for the mesh processing stages.
+// The work is split in contiguous ranges, one per hardware thread, run by a shared pool of workers and the calling thread.
+class Parallel
+{
+public:
+	static unsigned int getThreadsCount()
+	{
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	// Calls function(rangeBegin, rangeEnd, rangeIndex) for each range, with at least minimumRangeSize items per range
+	template <typename Function>
+	static void forEachRange(const size_t count, Function function, const size_t minimumRangeSize = 4096)
+	{
+		const size_t rangesCount = Parallel::getRangesCount(count, minimumRangeSize);
+
+		Parallel::forEachChunk(rangesCount, [&](const size_t rangeIndex)
+		{
+			const size_t rangeBegin = count * rangeIndex / rangesCount;
+			const size_t rangeEnd = count * (rangeIndex + 1) / rangesCount;
+
+			function(rangeBegin, rangeEnd, rangeIndex);
+		});
+	}
+
+	// Number of ranges forEachRange() will use, to size per-range partial results
+	static size_t getRangesCount(const size_t count, const size_t minimumRangeSize = 4096)
+	{
+		const size_t maximumRangesCount = std::max<size_t>(count / std::max<size_t>(minimumRangeSize, 1), 1);
+
+		return std::min<size_t>(Parallel::getThreadsCount(), maximumRangesCount);
+	}
+
+	// Calls function(chunkIndex) for every chunk, the chunks are shared out between the calling thread and the workers
+	template <typename Function>
+	static void forEachChunk(const size_t chunksCount, Function function)
+	{
+		if (chunksCount <= 1 || Parallel::getThreadsCount() <= 1)
+		{
+			for (size_t chunkIndex = 0; chunkIndex < chunksCount; ++chunkIndex)
+			{
+				function(chunkIndex);
+			}
+			return;
+		}
+
+		Parallel::runChunks(chunksCount, std::function<void(const size_t)>(std::ref(function)));
+	}
+
+private:
+	// Every call goes through one process-wide pool of getThreadsCount() - 1 workers.
+	// The calling thread runs chunks too, so the calls nested in the loader threads, or in other chunks,
+	// share the same workers instead of starting their own threads, and never wait for a chunk nobody runs.
+	static void runChunks(const size_t chunksCount, const std::function<void(const size_t)> &function);
+};
+
+#endif // PARALLEL_H
@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <memory>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <vtkActor.h>
+#include <vtkCamera.h>
+#include <vtkCellArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkMapper.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+#include "LegacyCells.h"
+#include "Model.h"
+#include "Parallel.h"
+#include "PickingBuffer.h"
+
+
+typedef struct
+{
+	// Window x, window y and device z of every point, z is NaN for the points behind the camera
+	std::vector<float> vertices;
+	std::unique_ptr<LegacyCells> polys;
+	uint32_t id{0};
+} ProjectedModel_t;
+
+template <typename T>
+static void projectPoints(const T *coordinates, const vtkIdType pointsCount, const double matrix[16], const int width, const int height, float *vertices)
+{
+	Parallel::forEachRange(static_cast<size_t>(pointsCount), [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			const T *point = coordinates + 3 * i;
+			float *vertex = vertices + 3 * i;
+
+			const double x = matrix[0] * point[0] + matrix[1] * point[1] + matrix[2] * point[2] + matrix[3];
+			const double y = matrix[4] * point[0] + matrix[5] * point[1] + matrix[6] * point[2] + matrix[7];
+			const double z = matrix[8] * point[0] + matrix[9] * point[1] + matrix[10] * point[2] + matrix[11];
+			const double w = matrix[12] * point[0] + matrix[13] * point[1] + matrix[14] * point[2] + matrix[15];
+
+			if (w <= DBL_EPSILON)
+			{
+				vertex[0] = 0.0f;
+				vertex[1] = 0.0f;
+				vertex[2] = NAN;
+				continue;
+			}
+
+			vertex[0] = static_cast<float>((x / w + 1.0) * 0.5 * width);
+			vertex[1] = static_cast<float>((y / w + 1.0) * 0.5 * height);
+			vertex[2] = static_cast<float>(z / w);
+		}
+	});
+}
+
+static inline float edgeFunction(const float *u, const float *v, const float px, const float py)
+{
+	return (v[0] - u[0]) * (py - u[1]) - (v[1] - u[1]) * (px - u[0]);
+}
+
+// Rows covered by a triangle in a viewport of the given size, false if it covers none
+static bool computeTriangleRows(const float *a, const float *b, const float *c, const int width, const int height, int &minY, int &maxY)
+{
+	if (std::isnan(a[2]) || std::isnan(b[2]) || std::isnan(c[2]))
+	{
+		return false;
+	}
+
+	// Pixel centers at +0.5
+	const int minX = std::max(0, static_cast<int>(std::ceil(std::min({a[0], b[0], c[0]}) - 0.5f)));
+	const int maxX = std::min(width - 1, static_cast<int>(std::floor(std::max({a[0], b[0], c[0]}) - 0.5f)));
+
+	minY = std::max(0, static_cast<int>(std::ceil(std::min({a[1], b[1], c[1]}) - 0.5f)));
+	maxY = std::min(height - 1, static_cast<int>(std::floor(std::max({a[1], b[1], c[1]}) - 0.5f)));
+
+	return minX <= maxX && minY <= maxY;
+}
+
+// Depth tested rasterization of a triangle, limited to the rows [rowBegin, rowEnd)
+static void rasterizeTriangle(const float *a, const float *b, const float *c, const uint32_t id, const int width, const int rowBegin, const int rowEnd,
+							  uint32_t *ids, float *depths)
+{
+	if (std::isnan(a[2]) || std::isnan(b[2]) || std::isnan(c[2]))
+	{
+		return;
+	}
+
+	// Pixel centers at +0.5
+	const int minY = std::max(rowBegin, static_cast<int>(std::ceil(std::min({a[1], b[1], c[1]}) - 0.5f)));
+	const int maxY = std::min(rowEnd - 1, static_cast<int>(std::floor(std::max({a[1], b[1], c[1]}) - 0.5f)));
+
+	if (minY > maxY)
+	{
+		return;
+	}
+
+	const int minX = std::max(0, static_cast<int>(std::ceil(std::min({a[0], b[0], c[0]}) - 0.5f)));
+	const int maxX = std::min(width - 1, static_cast<int>(std::floor(std::max({a[0], b[0], c[0]}) - 0.5f)));
+
+	if (minX > maxX)
+	{
+		return;
+	}
+
+	const float area = edgeFunction(a, b, c[0], c[1]);
+
+	if (std::abs(area) < FLT_EPSILON)
+	{
+		return;
+	}
+
+	const float inverseArea = 1.0f / area;
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		const float py = y + 0.5f;
+
+		for (int x = minX; x <= maxX; ++x)
+		{
+			const float px = x + 0.5f;
+
+			// Barycentric weights, both windings are accepted
+			const float wa = edgeFunction(b, c, px, py) * inverseArea;
+			const float wb = edgeFunction(c, a, px, py) * inverseArea;
+			const float wc = 1.0f - wa - wb;
+
+			if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+			{
+				continue;
+			}
+
+			const float depth = wa * a[2] + wb * b[2] + wc * c[2];
+			const size_t pixel = static_cast<size_t>(y) * width + x;
+
+			if (depth < depths[pixel])
+			{
+				depths[pixel] = depth;
+				ids[pixel] = id;
+			}
+		}
+	}
+}
+
+
+PickingBuffer::PickingBuffer()
+{
+	m_worldToDevice = vtkSmartPointer<vtkMatrix4x4>::New();
+	m_deviceToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+}
+
+bool PickingBuffer::update(vtkRenderer *renderer, const std::shared_ptr<const ModelRegistry::Snapshot_t> &models)
+{
+	Signature_t signature = this->computeSignature(renderer, models);
+
+	if (signature.width <= 0 || signature.height <= 0)
+	{
+		m_valid = false;
+		return false;
+	}
+
+	if (m_valid && isSameSignature(m_signature, signature))
+	{
+		return true;
+	}
+
+	m_signature = std::move(signature);
+
+	QElapsedTimer timer;
+	timer.start();
+
+	this->rasterize(renderer);
+
+	m_valid = true;
+	++m_buildsCount;
+
+	qDebug() << "PickingBuffer::update(): rebuilt" << m_signature.width << "x" << m_signature.height << "in" << timer.elapsed() << "ms";
+
+	return true;
+}
+
+bool PickingBuffer::pick(const int displayX, const int displayY, PickResult_t &result) const
+{
+	if (!m_valid || displayX < 0 || displayY < 0 || displayX >= m_signature.width || displayY >= m_signature.height)
+	{
+		return false;
+	}
+
+	const size_t pixel = static_cast<size_t>(displayY) * m_signature.width + displayX;
+	const uint32_t id = m_ids[pixel];
+
+	if (id == 0)
+	{
+		return false;
+	}
+
+	result.model = (*m_signature.models)[id - 1];
+
+	// Unproject the pixel center at the stored depth
+	double devicePosition[4];
+	devicePosition[0] = 2.0 * (displayX + 0.5) / m_signature.width - 1.0;
+	devicePosition[1] = 2.0 * (displayY + 0.5) / m_signature.height - 1.0;
+	devicePosition[2] = m_depths[pixel];
+	devicePosition[3] = 1.0;
+
+	double worldPosition[4];
+	m_deviceToWorld->MultiplyPoint(devicePosition, worldPosition);
+
+	result.worldPosition[0] = worldPosition[0] / worldPosition[3];
+	result.worldPosition[1] = worldPosition[1] / worldPosition[3];
+	result.worldPosition[2] = worldPosition[2] / worldPosition[3];
+
+	return true;
+}
+
+void PickingBuffer::invalidate()
+{
+	m_valid = false;
+}
+
+uint64_t PickingBuffer::getBuildsCount() const
+{
+	return m_buildsCount;
+}
+
+PickingBuffer::Signature_t PickingBuffer::computeSignature(vtkRenderer *renderer, const std::shared_ptr<const ModelRegistry::Snapshot_t> &models) const
+{
+	Signature_t signature;
+
+	const int *rendererSize = renderer->GetSize();
+	signature.width = rendererSize[0];
+	signature.height = rendererSize[1];
+
+	// Camera parameters that move the models on screen. The clipping range is left out: the depths
+	// are only compared between themselves and unprojected with the matrix of the same build.
+	vtkCamera *camera = renderer->GetActiveCamera();
+	vtkMatrix4x4 *viewMatrix = camera->GetViewTransformMatrix();
+	std::copy(&viewMatrix->Element[0][0], &viewMatrix->Element[0][0] + 16, signature.viewMatrix.begin());
+	signature.viewAngle = camera->GetViewAngle();
+	signature.parallelScale = camera->GetParallelScale();
+	signature.parallelProjection = camera->GetParallelProjection() != 0;
+	signature.aspect = renderer->GetTiledAspectRatio();
+
+	signature.models = models;
+	signature.modelsStates.reserve(models->size());
+
+	for (const std::shared_ptr<Model> &model : *models)
+	{
+		vtkActor *actor = model->getModelActor();
+
+		ModelState_t modelState;
+		modelState.actor = actor;
+		modelState.userMatrixTime = actor->GetUserMatrix() ? actor->GetUserMatrix()->GetMTime() : 0;
+		modelState.dataTime = actor->GetMapper() && actor->GetMapper()->GetInput() ? actor->GetMapper()->GetInput()->GetMTime() : 0;
+		modelState.visible = actor->GetVisibility() && actor->GetPickable();
+
+		signature.modelsStates.push_back(modelState);
+	}
+
+	return signature;
+}
+
+bool PickingBuffer::isSameSignature(const Signature_t &a, const Signature_t &b)
+{
+	if (a.width != b.width || a.height != b.height || a.viewMatrix != b.viewMatrix || a.viewAngle != b.viewAngle ||
+		a.parallelScale != b.parallelScale || a.parallelProjection != b.parallelProjection || a.aspect != b.aspect ||
+		a.models != b.models || a.modelsStates.size() != b.modelsStates.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < a.modelsStates.size(); ++i)
+	{
+		const ModelState_t &stateA = a.modelsStates[i];
+		const ModelState_t &stateB = b.modelsStates[i];
+
+		if (stateA.actor != stateB.actor || stateA.userMatrixTime != stateB.userMatrixTime || stateA.dataTime != stateB.dataTime || stateA.visible != stateB.visible)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void PickingBuffer::rasterize(vtkRenderer *renderer)
+{
+	const int width = m_signature.width;
+	const int height = m_signature.height;
+
+	m_ids.assign(static_cast<size_t>(width) * height, 0);
+	m_depths.assign(static_cast<size_t>(width) * height, FLT_MAX);
+
+	m_worldToDevice->DeepCopy(renderer->GetActiveCamera()->GetCompositeProjectionTransformMatrix(m_signature.aspect, -1.0, 1.0));
+	vtkMatrix4x4::Invert(m_worldToDevice, m_deviceToWorld);
+
+	// Project the points of every model once, shared by all the rasterization bands
+	std::vector<ProjectedModel_t> projectedModels;
+	projectedModels.reserve(m_signature.models->size());
+
+	vtkSmartPointer<vtkMatrix4x4> modelToDevice = vtkSmartPointer<vtkMatrix4x4>::New();
+
+	for (size_t i = 0; i < m_signature.models->size(); ++i)
+	{
+		if (!m_signature.modelsStates[i].visible)
+		{
+			continue;
+		}
+
+		vtkActor *actor = (*m_signature.models)[i]->getModelActor();
+		vtkPolyData *polyData = actor->GetMapper() ? vtkPolyData::SafeDownCast(actor->GetMapper()->GetInput()) : nullptr;
+
+		if (!polyData || !polyData->GetPoints() || polyData->GetNumberOfPolys() == 0)
+		{
+			continue;
+		}
+
+		vtkPoints *points = polyData->GetPoints();
+		const int dataType = points->GetDataType();
+
+		if (dataType != VTK_FLOAT && dataType != VTK_DOUBLE)
+		{
+			continue;
+		}
+
+		vtkMatrix4x4::Multiply4x4(m_worldToDevice, actor->GetMatrix(), modelToDevice);
+
+		ProjectedModel_t projectedModel;
+		projectedModel.vertices.resize(3 * static_cast<size_t>(points->GetNumberOfPoints()));
+		projectedModel.polys.reset(new LegacyCells(polyData->GetPolys()));
+		projectedModel.id = static_cast<uint32_t>(i + 1);
+
+		if (dataType == VTK_FLOAT)
+		{
+			projectPoints(static_cast<vtkFloatArray*>(points->GetData())->GetPointer(0), points->GetNumberOfPoints(), &modelToDevice->Element[0][0],
+						  width, height, projectedModel.vertices.data());
+		}
+		else
+		{
+			projectPoints(static_cast<vtkDoubleArray*>(points->GetData())->GetPointer(0), points->GetNumberOfPoints(), &modelToDevice->Element[0][0],
+						  width, height, projectedModel.vertices.data());
+		}
+
+		projectedModels.push_back(std::move(projectedModel));
+	}
+
+	// One band of rows per thread, every thread owns its rows so the depth test needs no synchronization
+	const size_t bandsCount = std::min<size_t>(Parallel::getThreadsCount(), static_cast<size_t>(height));
+
+	// Bin the triangles to the bands they cover first, so each band only walks its own triangles.
+	// The bins of every chunk of cells are kept in the models order, for the same depth ties as a single pass.
+	typedef struct
+	{
+		uint32_t model;
+		uint32_t corner;
+		int64_t cellOffset;
+	} TriangleRef_t;
+
+	typedef struct
+	{
+		uint32_t model;
+		int64_t cellBegin;
+		int64_t cellEnd;
+	} CellsChunk_t;
+
+	std::vector<CellsChunk_t> cellsChunks;
+
+	for (size_t i = 0; i < projectedModels.size(); ++i)
+	{
+		const LegacyCells &polys = *projectedModels[i].polys;
+		const int64_t cellsCount = polys.getCellsCount();
+		const int64_t connectivitySize = polys.getSize();
+
+		// Triangles only: the cells can be split in ranges without walking them
+		if (polys.isTrianglesOnly())
+		{
+			const size_t rangesCount = Parallel::getRangesCount(static_cast<size_t>(cellsCount));
+
+			for (size_t rangeIndex = 0; rangeIndex < rangesCount; ++rangeIndex)
+			{
+				cellsChunks.push_back({static_cast<uint32_t>(i), 4 * static_cast<int64_t>(cellsCount * rangeIndex / rangesCount),
+									   4 * static_cast<int64_t>(cellsCount * (rangeIndex + 1) / rangesCount)});
+			}
+		}
+		else
+		{
+			cellsChunks.push_back({static_cast<uint32_t>(i), 0, connectivitySize});
+		}
+	}
+
+	std::vector<std::vector<TriangleRef_t>> chunksBins(cellsChunks.size() * bandsCount);
+
+	Parallel::forEachChunk(cellsChunks.size(), [&](const size_t chunkIndex)
+	{
+		const CellsChunk_t &cellsChunk = cellsChunks[chunkIndex];
+		const ProjectedModel_t &projectedModel = projectedModels[cellsChunk.model];
+		const vtkIdType *connectivity = projectedModel.polys->getData();
+		const float *vertices = projectedModel.vertices.data();
+		std::vector<TriangleRef_t> *bins = &chunksBins[chunkIndex * bandsCount];
+
+		int64_t cellOffset = cellsChunk.cellBegin;
+
+		while (cellOffset < cellsChunk.cellEnd)
+		{
+			const vtkIdType *cell = connectivity + cellOffset;
+			const vtkIdType cellSize = cell[0];
+
+			// Polygons as triangle fans
+			for (vtkIdType corner = 2; corner < cellSize; ++corner)
+			{
+				int minY;
+				int maxY;
+
+				if (!computeTriangleRows(vertices + 3 * cell[1], vertices + 3 * cell[corner], vertices + 3 * cell[corner + 1], width, height, minY, maxY))
+				{
+					continue;
+				}
+
+				// Band of a row: the largest band whose first row is not after it
+				const size_t firstBand = (static_cast<size_t>(minY + 1) * bandsCount - 1) / height;
+				const size_t lastBand = (static_cast<size_t>(maxY + 1) * bandsCount - 1) / height;
+
+				for (size_t band = firstBand; band <= lastBand; ++band)
+				{
+					bins[band].push_back({cellsChunk.model, static_cast<uint32_t>(corner), cellOffset});
+				}
+			}
+
+			cellOffset += cellSize + 1;
+		}
+	});
+
+	uint32_t *ids = m_ids.data();
+	float *depths = m_depths.data();
+
+	Parallel::forEachChunk(bandsCount, [&](const size_t bandIndex)
+	{
+		const int rowBegin = static_cast<int>(height * bandIndex / bandsCount);
+		const int rowEnd = static_cast<int>(height * (bandIndex + 1) / bandsCount);
+
+		for (size_t chunkIndex = 0; chunkIndex < cellsChunks.size(); ++chunkIndex)
+		{
+			for (const TriangleRef_t &triangle : chunksBins[chunkIndex * bandsCount + bandIndex])
+			{
+				const ProjectedModel_t &projectedModel = projectedModels[triangle.model];
+				const vtkIdType *cell = projectedModel.polys->getData() + triangle.cellOffset;
+				const float *vertices = projectedModel.vertices.data();
+
+				rasterizeTriangle(vertices + 3 * cell[1], vertices + 3 * cell[triangle.corner], vertices + 3 * cell[triangle.corner + 1],
+								  projectedModel.id, width, rowBegin, rowEnd, ids, depths);
+			}
+		}
+	});
+}
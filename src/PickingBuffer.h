@@ -0,0 +1,82 @@
+#ifndef PICKINGBUFFER_H
+#define PICKINGBUFFER_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <vtkMatrix4x4.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+#include "ModelRegistry.h"
+
+
+class Model;
+
+// Model ID and depth buffer of the canvas, rasterized on the CPU so it does not depend on the
+// OpenGL implementation (software rendering included).
+// The buffer is rebuilt only when the camera, the viewport size or the scene changed since the
+// last build, a pick is then a single lookup and an unprojection.
+class PickingBuffer
+{
+public:
+	typedef struct
+	{
+		std::shared_ptr<Model> model;
+		double worldPosition[3];
+	} PickResult_t;
+
+	PickingBuffer();
+
+	// Rebuilds the buffer if it is out of date. Returns false if it can not be built (empty viewport).
+	bool update(vtkRenderer *renderer, const std::shared_ptr<const ModelRegistry::Snapshot_t> &models);
+
+	// Display coordinates, origin at the bottom left. Returns false if no model covers the pixel.
+	bool pick(const int displayX, const int displayY, PickResult_t &result) const;
+
+	void invalidate();
+	uint64_t getBuildsCount() const;
+
+private:
+	typedef struct
+	{
+		const void *actor{nullptr};
+		unsigned long userMatrixTime{0};
+		unsigned long dataTime{0};
+		bool visible{false};
+	} ModelState_t;
+
+	typedef struct
+	{
+		int width{0};
+		int height{0};
+		std::array<double, 16> viewMatrix;
+		double viewAngle{0.0};
+		double parallelScale{0.0};
+		bool parallelProjection{false};
+		double aspect{0.0};
+		std::shared_ptr<const ModelRegistry::Snapshot_t> models;
+		std::vector<ModelState_t> modelsStates;
+	} Signature_t;
+
+	Signature_t computeSignature(vtkRenderer *renderer, const std::shared_ptr<const ModelRegistry::Snapshot_t> &models) const;
+	static bool isSameSignature(const Signature_t &a, const Signature_t &b);
+
+	void rasterize(vtkRenderer *renderer);
+
+	Signature_t m_signature;
+	bool m_valid = false;
+	uint64_t m_buildsCount = 0;
+
+	// 0 means background, otherwise index + 1 of the model in the snapshot
+	std::vector<uint32_t> m_ids;
+	std::vector<float> m_depths;
+
+	// World to normalized device coordinates of the last build, and its inverse for the unprojection
+	vtkSmartPointer<vtkMatrix4x4> m_worldToDevice;
+	vtkSmartPointer<vtkMatrix4x4> m_deviceToWorld;
+};
+
+#endif // PICKINGBUFFER_H
@@ -1,84 +1,683 @@
 #include "ProcessingEngine.h"
 
+#include <algorithm>
 #include <thread>
 #include <memory>
+#include <unordered_set>
+
+#ifdef __linux
+#include <unistd.h>
+#endif
 
 #include <QDebug>
+#include <QFile>
 #include <QFileInfo>
 
 #include <vtkAlgorithmOutput.h>
+#include <vtkCellArray.h>
 #include <vtkOBJReader.h>
-#include <vtkPolyDataNormals.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
 #include <vtkProperty.h>
+#include <vtkQuadricClustering.h>
 #include <vtkSTLReader.h>
-#include <vtkTransform.h>
-#include <vtkTransformPolyDataFilter.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
 
+#include "BinarySTLReader.h"
+#include "FrameProfiler.h"
+#include "GeometryCompactor.h"
 #include "Model.h"
+#include "ModelGeometry.h"
+#include "NormalsGenerator.h"
+#include "OBJParallelReader.h"
+#include "Parallel.h"
+#include "VertexWelder.h"
+
+
+// Bumped whenever the preprocessing output changes, so the cached meshes of older versions are not used
+static const int PREPROCESSING_PIPELINE_VERSION = 4;
+
+// Clustering grid of the proxy drawn for an evicted geometry without levels of detail
+static const int EVICTED_PROXY_DIVISIONS = 64;
+
+
+static void addGeometryMemoryUsage(ProcessingEngine::MemoryUsage_t &memoryUsage, const ModelGeometry::MemoryReport_t &memoryReport)
+{
+	memoryUsage.pointsBytes += memoryReport.geometry.pointsBytes;
+	memoryUsage.connectivityBytes += memoryReport.geometry.polysBytes;
+	memoryUsage.normalsBytes += memoryReport.geometry.pointNormalsBytes + memoryReport.octahedralNormalsBytes;
+	memoryUsage.otherBytes += memoryReport.geometry.cellDataBytes + memoryReport.lodsBytes + memoryReport.bvhBytes;
+	memoryUsage.totalBytes += memoryReport.totalBytes;
+	memoryUsage.gpuBytes += memoryReport.gpuBytes;
+}
+
+static void addIntermediatesMemoryUsage(ProcessingEngine::MemoryUsage_t &memoryUsage, const int64_t intermediatesBytes)
+{
+	memoryUsage.intermediatesBytes += intermediatesBytes;
+	memoryUsage.totalBytes += intermediatesBytes;
+}
+
+static int64_t getProcessResidentBytes()
+{
+#ifdef __linux
+	// Second field: resident pages
+	QFile statmFile("/proc/self/statm");
+
+	if (statmFile.open(QIODevice::ReadOnly))
+	{
+		const QList<QByteArray> fields = statmFile.readAll().split(' ');
+
+		if (fields.size() > 1)
+		{
+			return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+		}
+	}
+#endif
+
+	return 0;
+}
 
 
 ProcessingEngine::ProcessingEngine()
 {
+	const QColor defaultModelColor{"#0277bd"};
+	const QColor selectedModelColor{"#03a9f4"};
+
+	m_defaultModelProperty = vtkSmartPointer<vtkProperty>::New();
+	m_selectedModelProperty = vtkSmartPointer<vtkProperty>::New();
+
+	for (const vtkSmartPointer<vtkProperty> &modelProperty : {m_defaultModelProperty, m_selectedModelProperty})
+	{
+		modelProperty->SetInterpolationToFlat();
+		modelProperty->SetAmbient(0.1);
+		modelProperty->SetDiffuse(0.7);
+		modelProperty->SetSpecular(0.3);
+	}
+
+	m_defaultModelProperty->SetColor(defaultModelColor.redF(), defaultModelColor.greenF(), defaultModelColor.blueF());
+	m_selectedModelProperty->SetColor(selectedModelColor.redF(), selectedModelColor.greenF(), selectedModelColor.blueF());
 }
 
 
-const std::shared_ptr<Model> &ProcessingEngine::addModel(const QUrl &modelFilePath)
+std::shared_ptr<Model> ProcessingEngine::addModel(const QUrl &modelFilePath)
 {
 	qDebug() << "ProcessingEngine::addModelData()";
 
+	FRAME_PROFILER_SCOPE("ProcessingEngine::addModel");
+
+	QString modelKey;
+	std::shared_ptr<Model> model = this->addCachedModel(modelFilePath, &modelKey);
+
+	if (model)
+	{
+		return model;
+	}
+
+	return this->createModel(this->readModelData(modelFilePath), modelFilePath, modelKey);
+}
+
+std::shared_ptr<Model> ProcessingEngine::addCachedModel(const QUrl &modelFilePath, QString *computedModelKey)
+{
+	FRAME_PROFILER_SCOPE("ProcessingEngine::addCachedModel");
+
+	const QString modelKey = this->computeModelKey(modelFilePath);
+
+	if (computedModelKey)
+	{
+		*computedModelKey = modelKey;
+	}
+
+	if (modelKey.isEmpty())
+	{
+		return nullptr;
+	}
+
+	// Same contents already loaded: one more instance of its geometry, nothing is read
+	std::shared_ptr<ModelGeometry> geometry = this->findGeometry(modelKey);
+
+	if (geometry)
+	{
+		qDebug() << "ProcessingEngine::addCachedModel(): new instance of" << modelFilePath;
+
+		std::shared_ptr<Model> model = this->createInstance(geometry);
+		this->logMemoryUsage(model);
+
+		return model;
+	}
+
+	// Returns nullptr if the model was not preprocessed before, or if its file changed since
+	vtkSmartPointer<vtkPolyData> preprocessedData = m_meshCache.load(modelKey);
+
+	if (!preprocessedData)
+	{
+		return nullptr;
+	}
+
+	qDebug() << "ProcessingEngine::addCachedModel(): cache hit for" << modelFilePath;
+
+	std::shared_ptr<Model> model = this->createInstance(this->createGeometry(preprocessedData, modelKey, modelFilePath));
+	this->logMemoryUsage(model);
+
+	return model;
+}
+
+vtkSmartPointer<vtkPolyData> ProcessingEngine::readModelData(const QUrl &modelFilePath, const ReadProgress_t &readProgress) const
+{
+	FRAME_PROFILER_SCOPE("ProcessingEngine::readModelData");
+
 	QString modelFilePathExtension = QFileInfo(modelFilePath.toString()).suffix().toLower();
 
-    vtkSmartPointer<vtkOBJReader> objReader = vtkSmartPointer<vtkOBJReader>::New();
-    vtkSmartPointer<vtkSTLReader> stlReader = vtkSmartPointer<vtkSTLReader>::New();
-    vtkSmartPointer<vtkPolyData> inputData;
+	vtkSmartPointer<vtkPolyData> inputData;
 
 	if (modelFilePathExtension == "obj")
 	{
-		// Read OBJ file
-		objReader->SetFileName(modelFilePath.toString().toStdString().c_str());
-		objReader->Update();
-		inputData = objReader->GetOutput();
+		// Read OBJ file, parsed in parallel chunks
+		inputData = OBJParallelReader::read(modelFilePath.toString(), readProgress);
+
+		if (!inputData)
+		{
+			vtkSmartPointer<vtkOBJReader> objReader = vtkSmartPointer<vtkOBJReader>::New();
+			objReader->SetFileName(modelFilePath.toString().toStdString().c_str());
+			objReader->Update();
+
+			// Detached from the reader, so the reader and its buffers are released
+			inputData = vtkSmartPointer<vtkPolyData>::New();
+			inputData->ShallowCopy(objReader->GetOutput());
+		}
 	}
 	else
 	{
-		// Read STL file
-		stlReader->SetFileName(modelFilePath.toString().toStdString().c_str());
-		stlReader->Update();
-		inputData = stlReader->GetOutput();
+		// Read binary STL file through the memory mapped fast path
+		inputData = BinarySTLReader::read(modelFilePath.toString(), readProgress);
+
+		if (!inputData)
+		{
+			// Read ASCII STL file
+			vtkSmartPointer<vtkSTLReader> stlReader = vtkSmartPointer<vtkSTLReader>::New();
+			stlReader->SetFileName(modelFilePath.toString().toStdString().c_str());
+			stlReader->Update();
+
+			inputData = vtkSmartPointer<vtkPolyData>::New();
+			inputData->ShallowCopy(stlReader->GetOutput());
+		}
+	}
+
+	if (readProgress)
+	{
+		readProgress(QFileInfo(modelFilePath.toString()).size());
 	}
 
+	return inputData;
+}
+
+std::shared_ptr<Model> ProcessingEngine::createModel(const vtkSmartPointer<vtkPolyData> modelData, const QUrl &modelFilePath, const QString &computedModelKey,
+													 const PreprocessProgress_t &preprocessProgress)
+{
 	// Preprocess the polydata
-	vtkSmartPointer<vtkPolyData> preprocessedPolydata = preprocessPolydata(inputData);
+	vtkSmartPointer<vtkPolyData> preprocessedPolydata = preprocessPolydata(modelData);
+
+	// Rough shares of the preprocessing time: welding, then compacting and creating the model.
+	// The mesh cache entry is written once the model is displayed, see storeGeometryInCache().
+	if (preprocessProgress)
+	{
+		preprocessProgress(0.7);
+	}
 
-	// Create Model instance and insert it into the vector
-	std::shared_ptr<Model> model = std::make_shared<Model>(preprocessedPolydata);
+	// Already computed by addCachedModel() on a cache miss
+	const QString modelKey = (!computedModelKey.isEmpty() || modelFilePath.isEmpty()) ? computedModelKey : this->computeModelKey(modelFilePath);
 
-	m_models.push_back(model);
+	std::shared_ptr<Model> model = this->createInstance(this->createGeometry(preprocessedPolydata, modelKey, modelFilePath));
+	this->logMemoryUsage(model);
 
-	return m_models.back();
+	if (preprocessProgress)
+	{
+		preprocessProgress(1.0);
+	}
+
+	return model;
+}
+
+std::shared_ptr<ModelGeometry> ProcessingEngine::createGeometry(const vtkSmartPointer<vtkPolyData> preprocessedPolydata, const QString &modelKey, const QUrl &modelFilePath)
+{
+	this->compactGeometry(preprocessedPolydata);
+
+	std::shared_ptr<ModelGeometry> geometry = std::make_shared<ModelGeometry>(preprocessedPolydata, modelKey, modelFilePath);
+
+	// Computed in place before other loaders can find it, a shared geometry then follows the
+	// interpolation through its instances, see isPointNormalsOutdated()
+	if (m_pointNormalsRequired)
+	{
+		geometry->computePointNormals();
+	}
+
+	if (!modelKey.isEmpty())
+	{
+		std::lock_guard<std::mutex> lock(m_geometriesMutex);
+		m_geometries[modelKey] = geometry;
+	}
+
+	return geometry;
+}
+
+void ProcessingEngine::compactGeometry(const vtkSmartPointer<vtkPolyData> preprocessedPolydata) const
+{
+	if (!m_compactGeometry)
+	{
+		return;
+	}
+
+	FRAME_PROFILER_SCOPE("ProcessingEngine::compactGeometry");
+
+	const GeometryCompactor::GeometryBytes_t bytesBefore = GeometryCompactor::getGeometryBytes(preprocessedPolydata);
+	const GeometryCompactor::GeometryBytes_t bytesAfter = GeometryCompactor::compact(preprocessedPolydata);
+
+	qDebug() << "ProcessingEngine::compactGeometry(): geometry" << bytesBefore.totalBytes << "->" << bytesAfter.totalBytes << "bytes,"
+			 << "points" << bytesBefore.pointsBytes << "->" << bytesAfter.pointsBytes << "polygons" << bytesBefore.polysBytes << "->" << bytesAfter.polysBytes
+			 << "cell data" << bytesBefore.cellDataBytes << "->" << bytesAfter.cellDataBytes
+			 << "connectivity ids of" << GeometryCompactor::getConnectivityIdBytes(preprocessedPolydata) << "bytes";
+}
+
+std::shared_ptr<ModelGeometry> ProcessingEngine::findGeometry(const QString &modelKey)
+{
+	std::lock_guard<std::mutex> lock(m_geometriesMutex);
+
+	auto it = m_geometries.find(modelKey);
+
+	if (it == m_geometries.end())
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<ModelGeometry> geometry = it.value().lock();
+
+	// Every instance was removed since
+	if (!geometry)
+	{
+		m_geometries.erase(it);
+	}
+
+	return geometry;
+}
+
+std::shared_ptr<Model> ProcessingEngine::createInstance(const std::shared_ptr<ModelGeometry> geometry)
+{
+	// Not in the registry yet: inserted by insertModel() once its actor is added
+	return std::make_shared<Model>(geometry, m_defaultModelProperty, m_selectedModelProperty);
+}
+
+void ProcessingEngine::insertModel(const std::shared_ptr<Model> &model)
+{
+	// Loaders and the renderer insert concurrently, the registry handles the locking
+	model->setRegistryHandle(m_models.insert(model));
+}
+
+std::shared_ptr<Model> ProcessingEngine::duplicateModel(const std::shared_ptr<Model> &model)
+{
+	std::shared_ptr<Model> duplicatedModel = this->createInstance(model->getGeometry());
+	duplicatedModel->setDefaultProperty(model->getDefaultProperty());
+
+	// Next to the original along X, with a tenth of its width as gap
+	double bounds[6];
+	model->getGeometry()->getBounds(bounds);
+
+	duplicatedModel->translateToPosition(model->getPositionX() + 1.1 * (bounds[1] - bounds[0]), model->getPositionY());
+
+	return duplicatedModel;
+}
+
+void ProcessingEngine::setModelColor(const std::shared_ptr<Model> &model, const QColor &modelColor)
+{
+	vtkSmartPointer<vtkProperty> &colorModelProperty = m_colorModelProperties[modelColor.rgb()];
+
+	// Same render state as the default property, only the color differs
+	if (!colorModelProperty)
+	{
+		colorModelProperty = vtkSmartPointer<vtkProperty>::New();
+		colorModelProperty->DeepCopy(m_defaultModelProperty);
+		colorModelProperty->SetColor(modelColor.redF(), modelColor.greenF(), modelColor.blueF());
+	}
+
+	model->setDefaultProperty(colorModelProperty);
+}
+
+bool ProcessingEngine::storeGeometryInCache(const std::shared_ptr<ModelGeometry> &geometry)
+{
+	FRAME_PROFILER_SCOPE("ProcessingEngine::storeGeometryInCache");
+
+	const QString &modelKey = geometry->getKey();
+
+	if (modelKey.isEmpty() || !m_meshCache.isEnabled())
+	{
+		return false;
+	}
+
+	// Loaded from the cache, or stored by another instance or an earlier eviction
+	if (m_meshCache.contains(modelKey))
+	{
+		return true;
+	}
+
+	const vtkSmartPointer<vtkPolyData> modelData = geometry->getData();
+
+	// Geometry only: the renderer thread adds and releases the point normals meanwhile
+	vtkSmartPointer<vtkPolyData> storedData = vtkSmartPointer<vtkPolyData>::New();
+	storedData->SetPoints(modelData->GetPoints());
+	storedData->SetPolys(modelData->GetPolys());
+
+	return m_meshCache.store(modelKey, storedData);
+}
+
+vtkSmartPointer<vtkPolyData> ProcessingEngine::prepareGeometryEviction(const std::shared_ptr<ModelGeometry> &geometry)
+{
+	FRAME_PROFILER_SCOPE("ProcessingEngine::prepareGeometryEviction");
+
+	const QString &modelKey = geometry->getKey();
+
+	// The mesh cache is the only place the full mesh is restored from quickly
+	if (modelKey.isEmpty() || !m_meshCache.isEnabled())
+	{
+		return nullptr;
+	}
+
+	const vtkSmartPointer<vtkPolyData> modelData = geometry->getData();
+
+	if (!this->storeGeometryInCache(geometry))
+	{
+		return nullptr;
+	}
+
+	// The coarsest level of detail is already resident, with its normals if the interpolation needs them
+	if (geometry->getLodsCount() > 1)
+	{
+		return geometry->getLodData(geometry->getLodsCount() - 1);
+	}
+
+	vtkSmartPointer<vtkPolyData> proxyData = ProcessingEngine::createDecimatedProxy(modelData, EVICTED_PROXY_DIVISIONS);
+
+	if (m_pointNormalsRequired)
+	{
+		NormalsGenerator::computePointNormals(proxyData);
+	}
+
+	return proxyData;
+}
+
+vtkSmartPointer<vtkPolyData> ProcessingEngine::loadEvictedGeometry(const std::shared_ptr<ModelGeometry> &geometry)
+{
+	FRAME_PROFILER_SCOPE("ProcessingEngine::loadEvictedGeometry");
+
+	vtkSmartPointer<vtkPolyData> modelData = m_meshCache.load(geometry->getKey());
+
+	if (!modelData)
+	{
+		// Dropped from the mesh cache meanwhile: read and preprocessed again, if the file did not change
+		const QUrl &modelFilePath = geometry->getFilePath();
+
+		if (modelFilePath.isEmpty() || this->computeModelKey(modelFilePath) != geometry->getKey())
+		{
+			return nullptr;
+		}
+
+		modelData = this->readModelData(modelFilePath);
+
+		if (!modelData || modelData->GetNumberOfPoints() == 0)
+		{
+			return nullptr;
+		}
+
+		modelData = this->preprocessPolydata(modelData);
+	}
+
+	this->compactGeometry(modelData);
+
+	// Not shared yet, so the renderer thread has nothing left to compute
+	if (m_pointNormalsRequired)
+	{
+		NormalsGenerator::computePointNormals(modelData);
+		GeometryCompactor::quantizePointNormals(modelData);
+	}
+
+	return modelData;
+}
+
+bool ProcessingEngine::setGeometryData(const std::shared_ptr<ModelGeometry> &geometry, const vtkSmartPointer<vtkPolyData> data, const bool resident)
+{
+	geometry->setData(data, resident ? ModelGeometry::Residency_t::Resident : ModelGeometry::Residency_t::Evicted);
+
+	// The world-space copies of the instances would keep the previous mesh alive
+	const std::shared_ptr<const ModelRegistry::Snapshot_t> models = m_models.getSnapshot();
+
+	for (const std::shared_ptr<Model> &model : *models)
+	{
+		if (model->getGeometry() == geometry)
+		{
+			model->releaseTransformedModelData();
+		}
+	}
+
+	// The interpolation may have changed while the mesh was prepared
+	return this->isPointNormalsOutdated(geometry);
+}
+
+vtkSmartPointer<vtkPolyData> ProcessingEngine::createPointsProxy(const vtkSmartPointer<vtkPolyData> modelData, const vtkIdType maximumPoints)
+{
+	vtkPoints *points = modelData->GetPoints();
+
+	if (!points || points->GetNumberOfPoints() == 0 || maximumPoints <= 0)
+	{
+		return nullptr;
+	}
+
+	const vtkIdType stride = std::max<vtkIdType>(points->GetNumberOfPoints() / maximumPoints, 1);
+	const vtkIdType sampledPointsCount = (points->GetNumberOfPoints() + stride - 1) / stride;
+
+	vtkSmartPointer<vtkPoints> sampledPoints = vtkSmartPointer<vtkPoints>::New();
+	sampledPoints->SetDataType(points->GetDataType());
+	sampledPoints->SetNumberOfPoints(sampledPointsCount);
+
+	vtkSmartPointer<vtkCellArray> vertices = vtkSmartPointer<vtkCellArray>::New();
+	vtkIdType *verticesPointer = vertices->WritePointer(sampledPointsCount, 2 * sampledPointsCount);
+
+	for (vtkIdType i = 0; i < sampledPointsCount; ++i)
+	{
+		sampledPoints->SetPoint(i, points->GetPoint(i * stride));
+
+		verticesPointer[2 * i] = 1;
+		verticesPointer[2 * i + 1] = i;
+	}
+
+	vtkSmartPointer<vtkPolyData> proxyData = vtkSmartPointer<vtkPolyData>::New();
+	proxyData->SetPoints(sampledPoints);
+	proxyData->SetVerts(vertices);
+
+	return proxyData;
+}
+
+vtkSmartPointer<vtkPolyData> ProcessingEngine::createDecimatedProxy(const vtkSmartPointer<vtkPolyData> modelData, const int divisions)
+{
+	// Vertex clustering is linear in the input size and works on raw triangle soups, unlike the quadric decimation
+	vtkSmartPointer<vtkQuadricClustering> clustering = vtkSmartPointer<vtkQuadricClustering>::New();
+	clustering->SetInputData(modelData);
+	clustering->SetNumberOfDivisions(divisions, divisions, divisions);
+	clustering->AutoAdjustNumberOfDivisionsOn();
+	clustering->Update();
+
+	// Detached from the filter, its quadrics are released with it
+	vtkSmartPointer<vtkPolyData> proxyData = vtkSmartPointer<vtkPolyData>::New();
+	proxyData->ShallowCopy(clustering->GetOutput());
+
+	return proxyData;
+}
+
+bool ProcessingEngine::removeModel(const std::shared_ptr<Model> &model)
+{
+	return m_models.remove(model->getRegistryHandle());
 }
 
 vtkSmartPointer<vtkPolyData> ProcessingEngine::preprocessPolydata(const vtkSmartPointer<vtkPolyData> inputData) const
 {
-	// Center the polygon
-	double center[3];
-	inputData->GetCenter(center);
+	FRAME_PROFILER_SCOPE("ProcessingEngine::preprocessPolydata");
+
+	// Weld the duplicated vertices of triangle soups, so the geometry is indexed and the point normals are smooth
+	VertexWelder::WeldStats_t weldStats;
+	{
+		FRAME_PROFILER_SCOPE("ProcessingEngine::preprocessPolydata::weld");
+		weldStats = VertexWelder::weld(inputData, m_weldingTolerance);
+	}
+
+	qDebug() << "ProcessingEngine::preprocessPolydata(): welding" << weldStats.pointsBefore << "->" << weldStats.pointsAfter << "points,"
+			 << weldStats.bytesBefore << "->" << weldStats.bytesAfter << "bytes";
+
+	// The model matrix centers the polygon, the points are only shifted when asked to
+	if (m_recenterPoints)
+	{
+		FRAME_PROFILER_SCOPE("ProcessingEngine::preprocessPolydata::recenter");
+
+		double center[3];
+		inputData->GetCenter(center);
+
+		const double offset[3] = {-center[0], -center[1], -center[2]};
+		ProcessingEngine::shiftPoints(inputData, offset);
+	}
+
+	// No normals here: the flat interpolation does not need them, they are computed when the Gouraud one is enabled
+	return inputData;
+}
+
+void ProcessingEngine::shiftPoints(const vtkSmartPointer<vtkPolyData> polyData, const double offset[3])
+{
+	vtkPoints *points = polyData->GetPoints();
+
+	if (!points)
+	{
+		return;
+	}
+
+	const vtkIdType pointsCount = points->GetNumberOfPoints();
+
+	Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		if (points->GetDataType() == VTK_FLOAT)
+		{
+			float *coordinates = static_cast<vtkFloatArray*>(points->GetData())->GetPointer(0);
+
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+			{
+				coordinates[3 * i] += static_cast<float>(offset[0]);
+				coordinates[3 * i + 1] += static_cast<float>(offset[1]);
+				coordinates[3 * i + 2] += static_cast<float>(offset[2]);
+			}
+		}
+		else if (points->GetDataType() == VTK_DOUBLE)
+		{
+			double *coordinates = static_cast<vtkDoubleArray*>(points->GetData())->GetPointer(0);
+
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+			{
+				coordinates[3 * i] += offset[0];
+				coordinates[3 * i + 1] += offset[1];
+				coordinates[3 * i + 2] += offset[2];
+			}
+		}
+		else
+		{
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+			{
+				double point[3];
+				points->GetPoint(i, point);
+				points->SetPoint(i, point[0] + offset[0], point[1] + offset[1], point[2] + offset[2]);
+			}
+		}
+	});
+
+	points->Modified();
+}
+
+MeshCache &ProcessingEngine::getMeshCache()
+{
+	return m_meshCache;
+}
+
+
+ProcessingEngine::MemoryUsage_t ProcessingEngine::getModelMemoryUsage(const std::shared_ptr<Model> &model) const
+{
+	MemoryUsage_t memoryUsage;
+
+	addGeometryMemoryUsage(memoryUsage, model->getGeometry()->getMemoryReport());
+	addIntermediatesMemoryUsage(memoryUsage, model->getTransformedModelDataBytes());
+
+	return memoryUsage;
+}
+
+ProcessingEngine::MemoryReport_t ProcessingEngine::getMemoryReport() const
+{
+	MemoryReport_t memoryReport;
+
+	const std::shared_ptr<const ModelRegistry::Snapshot_t> models = m_models.getSnapshot();
+	std::unordered_set<const ModelGeometry*> countedGeometries;
+
+	for (const std::shared_ptr<Model> &model : *models)
+	{
+		const std::shared_ptr<ModelGeometry> &geometry = model->getGeometry();
+
+		if (countedGeometries.insert(geometry.get()).second)
+		{
+			const ModelGeometry::MemoryReport_t geometryMemoryReport = geometry->getMemoryReport();
+
+			addGeometryMemoryUsage(memoryReport.models, geometryMemoryReport);
+			memoryReport.geometriesEvictableBytes[geometry.get()] = geometryMemoryReport.totalBytes - geometryMemoryReport.lodsBytes;
+		}
+
+		addIntermediatesMemoryUsage(memoryReport.models, model->getTransformedModelDataBytes());
+	}
+
+	memoryReport.modelsCount = models->size();
+	memoryReport.geometriesCount = countedGeometries.size();
+	memoryReport.processBytes = getProcessResidentBytes();
+	memoryReport.budgetBytes = m_memoryBudget;
+	memoryReport.overBudget = std::max(memoryReport.processBytes, memoryReport.models.totalBytes) > memoryReport.budgetBytes;
+
+	return memoryReport;
+}
+
+void ProcessingEngine::logMemoryUsage(const std::shared_ptr<Model> &model) const
+{
+	const MemoryUsage_t modelMemoryUsage = this->getModelMemoryUsage(model);
+	const MemoryReport_t memoryReport = this->getMemoryReport();
 
-	vtkSmartPointer<vtkTransform> translation = vtkSmartPointer<vtkTransform>::New();
-	translation->Translate(-center[0], -center[1], -center[2]);
+	qDebug() << "ProcessingEngine::logMemoryUsage(): model" << modelMemoryUsage.totalBytes << "bytes -"
+			 << "points" << modelMemoryUsage.pointsBytes << "connectivity" << modelMemoryUsage.connectivityBytes
+			 << "normals" << modelMemoryUsage.normalsBytes << "intermediates" << modelMemoryUsage.intermediatesBytes
+			 << "other" << modelMemoryUsage.otherBytes << "gpu" << modelMemoryUsage.gpuBytes;
 
-	vtkSmartPointer<vtkTransformPolyDataFilter> transformFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-	transformFilter->SetInputData(inputData);
-	transformFilter->SetTransform(translation);
-	transformFilter->Update();
+	qDebug() << "ProcessingEngine::logMemoryUsage():" << memoryReport.modelsCount << "models," << memoryReport.geometriesCount << "geometries,"
+			 << memoryReport.models.totalBytes << "bytes, gpu" << memoryReport.models.gpuBytes << "bytes, process" << memoryReport.processBytes
+			 << "bytes, budget" << memoryReport.budgetBytes << "bytes";
 
-	// Normals - For the Gouraud interpolation to work
-	vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
-	normals->SetInputData(transformFilter->GetOutput());
-	normals->ComputePointNormalsOn();
-	normals->Update();
+	if (memoryReport.overBudget)
+	{
+		qWarning() << "ProcessingEngine::logMemoryUsage(): memory budget exceeded," << std::max(memoryReport.processBytes, memoryReport.models.totalBytes)
+				   << "of" << memoryReport.budgetBytes << "bytes used";
+	}
+}
+
+void ProcessingEngine::setMemoryBudget(const int64_t memoryBudget)
+{
+	m_memoryBudget = memoryBudget;
+}
 
-	return normals->GetOutput();
+int64_t ProcessingEngine::getMemoryBudget() const
+{
+	return m_memoryBudget;
+}
+
+QString ProcessingEngine::computeModelKey(const QUrl &modelFilePath) const
+{
+	// Everything the preprocessing output depends on, besides the file itself
+	const QString pipelineTag = QString("pipeline:%1;welding:%2;recenter:%3").arg(PREPROCESSING_PIPELINE_VERSION).arg(this->getWeldingTolerance(), 0, 'g', 17).arg(m_recenterPoints ? 1 : 0);
+
+	return m_meshCache.computeKey(modelFilePath.toString(), pipelineTag);
 }
 
 void ProcessingEngine::placeModel(Model &model) const
@@ -88,55 +687,104 @@ void ProcessingEngine::placeModel(Model &model) const
 	model.translateToPosition(0, 0);
 }
 
+void ProcessingEngine::setWeldingTolerance(const double weldingTolerance)
+{
+	m_weldingTolerance = weldingTolerance;
+}
+
+double ProcessingEngine::getWeldingTolerance() const
+{
+	return m_weldingTolerance;
+}
+
+void ProcessingEngine::setCompactGeometry(const bool compactGeometry)
+{
+	m_compactGeometry = compactGeometry;
+}
+
+bool ProcessingEngine::getCompactGeometry() const
+{
+	return m_compactGeometry;
+}
+
+void ProcessingEngine::setRecenterPoints(const bool recenterPoints)
+{
+	m_recenterPoints = recenterPoints;
+}
+
+bool ProcessingEngine::getRecenterPoints() const
+{
+	return m_recenterPoints;
+}
+
 void ProcessingEngine::setModelsRepresentation(const int modelsRepresentationOption) const
 {
-	for (const std::shared_ptr<Model>& model : m_models)
+	this->forEachModelProperty([modelsRepresentationOption](const vtkSmartPointer<vtkProperty> &modelProperty)
 	{
-		model->getModelActor()->GetProperty()->SetRepresentation(modelsRepresentationOption);
-	}
+		modelProperty->SetRepresentation(modelsRepresentationOption);
+	});
 }
 
 void ProcessingEngine::setModelsOpacity(const double modelsOpacity) const
 {
-	for (const std::shared_ptr<Model>& model : m_models)
+	this->forEachModelProperty([modelsOpacity](const vtkSmartPointer<vtkProperty> &modelProperty)
 	{
-		model->getModelActor()->GetProperty()->SetOpacity(modelsOpacity);
-	}
+		modelProperty->SetOpacity(modelsOpacity);
+	});
 }
 
 void ProcessingEngine::setModelsGouraudInterpolation(const bool enableGouraudInterpolation) const
 {
-	for (const std::shared_ptr<Model>& model : m_models)
+	// The models without point normals yet are shaded with their face normals until their command is executed
+	this->forEachModelProperty([enableGouraudInterpolation](const vtkSmartPointer<vtkProperty> &modelProperty)
 	{
 		if (enableGouraudInterpolation)
 		{
-			model->getModelActor()->GetProperty()->SetInterpolationToGouraud();
+			modelProperty->SetInterpolationToGouraud();
 		}
 		else
 		{
-			model->getModelActor()->GetProperty()->SetInterpolationToFlat();
+			modelProperty->SetInterpolationToFlat();
 		}
-	}
+	});
+}
+
+void ProcessingEngine::setSelectedModelColor(const QColor &selectedModelColor) const
+{
+	m_selectedModelProperty->SetColor(selectedModelColor.redF(), selectedModelColor.greenF(), selectedModelColor.blueF());
 }
 
-void ProcessingEngine::updateModelsColor() const
+void ProcessingEngine::setPointNormalsRequired(const bool pointNormalsRequired)
 {
-	for (const std::shared_ptr<Model>& model : m_models)
+	m_pointNormalsRequired = pointNormalsRequired;
+}
+
+bool ProcessingEngine::getPointNormalsRequired() const
+{
+	return m_pointNormalsRequired;
+}
+
+bool ProcessingEngine::isPointNormalsOutdated(const std::shared_ptr<ModelGeometry> &geometry) const
+{
+	if (m_pointNormalsRequired)
 	{
-		model->updateModelColor();
+		return !geometry->hasPointNormals();
 	}
+
+	// Flat interpolation: only the octahedral normals stay resident. The proxy of an evicted geometry keeps its normals.
+	const ModelGeometry::Residency_t residency = geometry->getResidency();
+
+	return m_compactGeometry && residency != ModelGeometry::Residency_t::Evicted && residency != ModelGeometry::Residency_t::Restoring
+		   && geometry->hasPointNormals();
 }
 
 std::shared_ptr<Model> ProcessingEngine::getModelFromActor(const vtkSmartPointer<vtkActor> modelActor) const
 {
-	for (const std::shared_ptr<Model> &model : m_models)
-	{
-		if (model->getModelActor() == modelActor)
-		{
-			return model;
-		}
-	}
+	// Returns nullptr if the actor does not belong to any model
+	return m_models.getFromActor(modelActor.GetPointer());
+}
 
-	// Raise exception instead
-	return nullptr;
+std::shared_ptr<const ModelRegistry::Snapshot_t> ProcessingEngine::getModels() const
+{
+	return m_models.getSnapshot();
 }
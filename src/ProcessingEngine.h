@@ -2,40 +2,199 @@
 #define PROCESSINGENGINE_H
 
 #include <array>
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <unordered_map>
 #include <vector>
 #include <mutex>
 #include <memory>
 
+#include <QColor>
+#include <QHash>
+#include <QString>
 #include <QUrl>
 
 #include <vtkActor.h>
 #include <vtkPolyData.h>
+#include <vtkProperty.h>
 #include <vtkSmartPointer.h>
 
+#include "MeshCache.h"
+#include "ModelRegistry.h"
+
 
 class Model;
+class ModelGeometry;
 
 class ProcessingEngine
 {
 	public:
 		ProcessingEngine();
 
-		const std::shared_ptr<Model>& addModel(const QUrl &modelFilePath);
+		typedef std::function<void(const qint64 bytesRead)> ReadProgress_t;
+
+		// Fraction of the preprocessing done, from 0 to 1
+		typedef std::function<void(const double progress)> PreprocessProgress_t;
+
+		// Host bytes by kind, plus the estimated GPU copies
+		typedef struct
+		{
+			int64_t pointsBytes{0};
+			int64_t connectivityBytes{0};
+			int64_t normalsBytes{0};
+			int64_t intermediatesBytes{0};
+			int64_t otherBytes{0};
+			int64_t totalBytes{0};
+			int64_t gpuBytes{0};
+		} MemoryUsage_t;
+
+		typedef struct
+		{
+			// Every geometry counted once, whatever its instances count
+			MemoryUsage_t models;
+			size_t modelsCount{0};
+			size_t geometriesCount{0};
+
+			// Resident set of the whole process, zero where it can not be read
+			int64_t processBytes{0};
+			int64_t budgetBytes{0};
+			bool overBudget{false};
+
+			// Bytes released by evicting each geometry: its full mesh, the levels of detail stay resident
+			std::unordered_map<const ModelGeometry*, int64_t> geometriesEvictableBytes;
+		} MemoryReport_t;
+
+		// Read and preprocess the model, in one go.
+		// The models are created out of the registry, see insertModel().
+		std::shared_ptr<Model> addModel(const QUrl &modelFilePath);
+
+		// The same stages, for loaders that preview the model in between.
+		// Files already loaded or in the mesh cache are added by addCachedModel(), nullptr otherwise.
+		// The content key of the file is returned in modelKey, so that createModel() does not hash the file again.
+		std::shared_ptr<Model> addCachedModel(const QUrl &modelFilePath, QString *modelKey = nullptr);
+		vtkSmartPointer<vtkPolyData> readModelData(const QUrl &modelFilePath, const ReadProgress_t &readProgress = nullptr) const;
+		std::shared_ptr<Model> createModel(const vtkSmartPointer<vtkPolyData> modelData, const QUrl &modelFilePath = QUrl(), const QString &modelKey = QString(),
+										   const PreprocessProgress_t &preprocessProgress = nullptr);
+
+		// Quick previews of the raw model data: a sampled points cloud and a clustered mesh
+		static vtkSmartPointer<vtkPolyData> createPointsProxy(const vtkSmartPointer<vtkPolyData> modelData, const vtkIdType maximumPoints);
+		static vtkSmartPointer<vtkPolyData> createDecimatedProxy(const vtkSmartPointer<vtkPolyData> modelData, const int divisions);
+		bool removeModel(const std::shared_ptr<Model> &model);
+
+		// Makes the model visible to the registry readers (picking, memory report, residency, normals updates).
+		// Renderer thread, once the model is placed and its actor is added.
+		void insertModel(const std::shared_ptr<Model> &model);
+
+		// New instance of the model geometry, placed next to it, to insert like the loaded models. Renderer thread.
+		std::shared_ptr<Model> duplicateModel(const std::shared_ptr<Model> &model);
+
+		// Color of a single model, the models of the same color share their property. Renderer thread.
+		void setModelColor(const std::shared_ptr<Model> &model, const QColor &modelColor);
+
+		// Loader threads, once the model is displayed (see MeshCacheWriter) and before an eviction. True if the
+		// full mesh of the geometry is in the mesh cache.
+		bool storeGeometryInCache(const std::shared_ptr<ModelGeometry> &geometry);
+
+		// Residency of the models geometry, driven by the ResidencyManager.
+		// Loader threads: the proxy to draw once the full mesh is safe in the mesh cache, and the full mesh back.
+		// Both return nullptr on failure, the geometry is then left as it is.
+		vtkSmartPointer<vtkPolyData> prepareGeometryEviction(const std::shared_ptr<ModelGeometry> &geometry);
+		vtkSmartPointer<vtkPolyData> loadEvictedGeometry(const std::shared_ptr<ModelGeometry> &geometry);
+		// Renderer thread: swaps the mesh drawn by all the instances of the geometry.
+		// Returns true if its point normals no longer match the interpolation, see isPointNormalsOutdated().
+		bool setGeometryData(const std::shared_ptr<ModelGeometry> &geometry, const vtkSmartPointer<vtkPolyData> data, const bool resident);
 
 		void placeModel(Model &model) const;
 
+		void setWeldingTolerance(const double weldingTolerance);
+		double getWeldingTolerance() const;
+
+		// On by default: the models geometry is compacted when registered, see GeometryCompactor
+		void setCompactGeometry(const bool compactGeometry);
+		bool getCompactGeometry() const;
+
+		// Off by default: the models are centered through their matrix, the points keep their file coordinates
+		void setRecenterPoints(const bool recenterPoints);
+		bool getRecenterPoints() const;
+
 		void setModelsRepresentation(const int modelsRepresentationOption) const;
 		void setModelsOpacity(const double modelsOpacity) const;
+		// Render state only: the point normals are added and released by CommandGeometryNormals
 		void setModelsGouraudInterpolation(const bool enableGouraudInterpolation) const;
-		void updateModelsColor() const;
+		void setSelectedModelColor(const QColor &selectedModelColor) const;
+
+		// Set with the Gouraud interpolation, before the commands updating the point normals are started.
+		// The geometries loaded meanwhile get their normals in the loader threads.
+		void setPointNormalsRequired(const bool pointNormalsRequired);
+		bool getPointNormalsRequired() const;
+		// True if a CommandGeometryNormals is needed to match the interpolation
+		bool isPointNormalsOutdated(const std::shared_ptr<ModelGeometry> &geometry) const;
 
 		std::shared_ptr<Model> getModelFromActor(const vtkSmartPointer<vtkActor> modelActor) const;
+		std::shared_ptr<const ModelRegistry::Snapshot_t> getModels() const;
 
-	private:
 		vtkSmartPointer<vtkPolyData> preprocessPolydata(const vtkSmartPointer<vtkPolyData> inputData) const;
 
-		std::vector<std::shared_ptr<Model>> m_models;
+		// Adds the offset to every point, in place and in parallel
+		static void shiftPoints(const vtkSmartPointer<vtkPolyData> polyData, const double offset[3]);
+
+		MeshCache &getMeshCache();
+
+		// The geometry of a model is shared with its other instances, and counted in full for each of them
+		MemoryUsage_t getModelMemoryUsage(const std::shared_ptr<Model> &model) const;
+		MemoryReport_t getMemoryReport() const;
+
+		// Compared to the process resident set, or to the models total where it is not available
+		void setMemoryBudget(const int64_t memoryBudget);
+		int64_t getMemoryBudget() const;
+
+	private:
+		QString computeModelKey(const QUrl &modelFilePath) const;
+		std::shared_ptr<ModelGeometry> createGeometry(const vtkSmartPointer<vtkPolyData> preprocessedPolydata, const QString &modelKey, const QUrl &modelFilePath);
+		void compactGeometry(const vtkSmartPointer<vtkPolyData> preprocessedPolydata) const;
+		std::shared_ptr<ModelGeometry> findGeometry(const QString &modelKey);
+		std::shared_ptr<Model> createInstance(const std::shared_ptr<ModelGeometry> geometry);
+		void logMemoryUsage(const std::shared_ptr<Model> &model) const;
+
+		template <typename Function>
+		void forEachModelProperty(Function function) const
+		{
+			function(m_defaultModelProperty);
+			function(m_selectedModelProperty);
+
+			for (const vtkSmartPointer<vtkProperty> &colorModelProperty : m_colorModelProperties)
+			{
+				function(colorModelProperty);
+			}
+		}
+
+		MeshCache m_meshCache;
+
+		// Geometries of the loaded files by content key, a file loaded again becomes an instance of its geometry
+		QHash<QString, std::weak_ptr<ModelGeometry>> m_geometries;
+		std::mutex m_geometriesMutex;
+
+		ModelRegistry m_models;
+
+		// Vertices closer than this are merged when loading, zero disables the welding
+		std::atomic<double> m_weldingTolerance{1.0e-5};
+
+		std::atomic<bool> m_recenterPoints{false};
+
+		std::atomic<bool> m_compactGeometry{true};
+
+		std::atomic<int64_t> m_memoryBudget{8LL << 30};
+
+		// Set while the Gouraud interpolation is enabled: the loaded geometries get their point normals,
+		// the others through CommandGeometryNormals
+		std::atomic<bool> m_pointNormalsRequired{false};
+
+		// One property per state class, shared by all the models: changing the render state costs the same for any number of models
+		vtkSmartPointer<vtkProperty> m_defaultModelProperty;
+		vtkSmartPointer<vtkProperty> m_selectedModelProperty;
+		// Renderer thread only, like every access to the properties: created by CommandModelColor, iterated when the render state is applied
+		QHash<QRgb, vtkSmartPointer<vtkProperty>> m_colorModelProperties;
 };
 
 #endif // PROCESSINGENGINE_H
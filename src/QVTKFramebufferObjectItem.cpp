@@ -1,6 +1,21 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QThread>
+
+#include "CommandGeometryNormals.h"
 #include "CommandModel.h"
 #include "CommandModelAdd.h"
+#include "CommandModelColor.h"
+#include "CommandModelDuplicate.h"
+#include "MeshCacheWriter.h"
 #include "Model.h"
+#include "ModelBVHBuilder.h"
+#include "ModelGeometry.h"
+#include "ModelLodGenerator.h"
 #include "ProcessingEngine.h"
 #include "QVTKFramebufferObjectItem.h"
 #include "QVTKFramebufferObjectRenderer.h"
@@ -8,14 +23,27 @@
 
 QVTKFramebufferObjectItem::QVTKFramebufferObjectItem()
 {
-	m_lastMouseLeftButton = std::make_shared<QMouseEvent>(QEvent::None, QPointF(0,0), Qt::NoButton, Qt::NoButton, Qt::NoModifier);
-	m_lastMouseButton = std::make_shared<QMouseEvent>(QEvent::None, QPointF(0,0), Qt::NoButton, Qt::NoButton, Qt::NoModifier);
-	m_lastMouseMove = std::make_shared<QMouseEvent>(QEvent::None, QPointF(0,0), Qt::NoButton, Qt::NoButton, Qt::NoModifier);
-	m_lastMouseWheel = std::make_shared<QWheelEvent>(QPointF(0,0), 0, Qt::NoButton, Qt::NoModifier, Qt::Vertical);
-
 	this->setMirrorVertically(true); // QtQuick and OpenGL have opposite Y-Axis directions
 
+	connect(&m_frameScheduler, &FrameScheduler::updateRequested, this, &QVTKFramebufferObjectItem::update);
+
 	setAcceptedMouseButtons(Qt::RightButton);
+
+	m_modelsLoaderPool.setMaxThreadCount(std::max(QThread::idealThreadCount(), 1));
+}
+
+QVTKFramebufferObjectItem::~QVTKFramebufferObjectItem()
+{
+	// Drop the loads not started yet and wait for the running ones
+	m_modelsLoaderPool.clear();
+	m_modelsLoaderPool.waitForDone();
+
+	// Loaded or not, these commands never reached the commands queue
+	qDeleteAll(m_modelsLoading);
+	m_modelsLoading.clear();
+
+	qDeleteAll(m_geometriesNormalsUpdating);
+	m_geometriesNormalsUpdating.clear();
 }
 
 
@@ -45,6 +73,14 @@ bool QVTKFramebufferObjectItem::isInitialized() const
 void QVTKFramebufferObjectItem::setProcessingEngine(const std::shared_ptr<ProcessingEngine> processingEngine)
 {
 	m_processingEngine = std::shared_ptr<ProcessingEngine>(processingEngine);
+	m_processingEngine->setPointNormalsRequired(m_gouraudInterpolation);
+
+	m_residencyManager.reset(new ResidencyManager(m_processingEngine, &m_commandsQueue, &m_modelsLoaderPool));
+	connect(m_residencyManager.get(), &ResidencyManager::commandReady, this, [this]()
+	{
+		m_frameScheduler.requestFrame(FrameScheduler::Scene);
+	});
+	connect(m_residencyManager.get(), &ResidencyManager::geometryNormalsOutdated, this, &QVTKFramebufferObjectItem::updateGeometriesNormals);
 }
 
 
@@ -68,32 +104,102 @@ double QVTKFramebufferObjectItem::getSelectedModelPositionY() const
 
 void QVTKFramebufferObjectItem::selectModel(const int screenX, const int screenY)
 {
-	m_lastMouseLeftButton = std::make_shared<QMouseEvent>(QEvent::None, QPointF(screenX, screenY), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
-	m_lastMouseLeftButton->ignore();
+	this->pushInputEvent(InputEventRing::Type_t::Select, QPoint(screenX, screenY), Qt::LeftButton, Qt::NoModifier, 0, 0);
 
-	update();
+	m_frameScheduler.requestFrame(FrameScheduler::Selection);
 }
 
 void QVTKFramebufferObjectItem::resetModelSelection()
 {
-	m_lastMouseLeftButton = std::make_shared<QMouseEvent>(QEvent::None, QPointF(-1, -1), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
-	m_lastMouseLeftButton->ignore();
+	this->pushInputEvent(InputEventRing::Type_t::Select, QPoint(-1, -1), Qt::LeftButton, Qt::NoModifier, 0, 0);
 
-	update();
+	m_frameScheduler.requestFrame(FrameScheduler::Selection);
 }
 
 void QVTKFramebufferObjectItem::addModelFromFile(const QUrl &modelPath)
 {
 	qDebug() << "QVTKFramebufferObjectItem::addModelFromFile";
 
-	CommandModelAdd *command = new CommandModelAdd(m_vtkFboRenderer, m_processingEngine, modelPath);
+	this->addModelsFromFiles(QList<QUrl>() << modelPath);
+}
 
-	connect(command, &CommandModelAdd::ready, this, &QVTKFramebufferObjectItem::update);
-	connect(command, &CommandModelAdd::done, this, &QVTKFramebufferObjectItem::addModelFromFileDone);
+void QVTKFramebufferObjectItem::addModelsFromFiles(const QList<QUrl> &modelsPaths)
+{
+	qDebug() << "QVTKFramebufferObjectItem::addModelsFromFiles:" << modelsPaths.size() << "models";
 
-	command->start();
+	// Largest files first, so the small ones fill the gaps at the end and the total time stays close to the I/O bound
+	std::vector<std::pair<qint64, QUrl>> modelsFiles;
+	modelsFiles.reserve(modelsPaths.size());
 
-	this->addCommand(command);
+	for (const QUrl &modelPath : modelsPaths)
+	{
+		modelsFiles.emplace_back(QFileInfo(modelPath.toString()).size(), modelPath);
+	}
+
+	std::stable_sort(modelsFiles.begin(), modelsFiles.end(), [](const std::pair<qint64, QUrl> &a, const std::pair<qint64, QUrl> &b)
+	{
+		return a.first > b.first;
+	});
+
+	for (const std::pair<qint64, QUrl> &modelFile : modelsFiles)
+	{
+		const QUrl modelPath = modelFile.second;
+		CommandModelAdd *command = new CommandModelAdd(m_vtkFboRenderer, m_processingEngine, &m_commandsQueue, modelPath);
+
+		// Loading progress, reported from the loader and the render threads
+		const quint64 loadId = command->getLoadId();
+
+		connect(command, &CommandModelAdd::progress, this, [this, loadId](const qint64 bytesRead, const qint64 bytesTotal)
+		{
+			emit addModelFromFileProgress(loadId, bytesRead, bytesTotal);
+		});
+		connect(command, &CommandModelAdd::preprocessingProgress, this, [this, loadId](const double progress)
+		{
+			emit addModelFromFilePreprocessingProgress(loadId, progress);
+		});
+		connect(command, &CommandModelAdd::stageChanged, this, [this, loadId](const int stage)
+		{
+			emit addModelFromFileStageChanged(loadId, stage);
+		});
+
+		// The previews are already in the commands queue
+		connect(command, &CommandModelAdd::previewReady, this, [this]()
+		{
+			m_frameScheduler.requestFrame(FrameScheduler::Scene);
+		});
+
+		// Queued connection: the command is pushed from the GUI thread once the loader is done with it
+		connect(command, &CommandModelAdd::ready, this, [this, command]()
+		{
+			// Picking index and levels of detail after every pending load, the model is displayed meanwhile
+			if (command->getModel())
+			{
+				m_modelsLoaderPool.start(new ModelBVHBuilder(command->getModel()->getGeometry()), -1);
+				m_modelsLoaderPool.start(new ModelLodGenerator(m_processingEngine, command->getModel()->getGeometry()), -1);
+			}
+
+			this->addModelLoadedCommand(command);
+		});
+		connect(command, &CommandModelAdd::done, this, &QVTKFramebufferObjectItem::addModelFromFileDone);
+		// Queued from execute() before the renderer hands the command back for deletion: the model is displayed
+		connect(command, &CommandModelAdd::done, this, [this, command]()
+		{
+			m_modelsLoaderPool.start(new MeshCacheWriter(m_processingEngine, command->getModel()->getGeometry()), -1);
+		});
+		connect(command, &CommandModelAdd::failed, this, &QVTKFramebufferObjectItem::addModelFromFileError);
+		connect(command, &CommandModelAdd::normalsOutdated, this, &QVTKFramebufferObjectItem::updateGeometriesNormals);
+
+		m_modelsLoading.insert(command);
+
+		// The pool runs the higher priorities first, which also keeps the largest-first order between batches
+		int priority = 0;
+		for (qint64 size = modelFile.first; size > 0; size >>= 1)
+		{
+			++priority;
+		}
+
+		m_modelsLoaderPool.start(command, priority);
+	}
 }
 
 void QVTKFramebufferObjectItem::translateModel(CommandModelTranslate::TranslateParams_t & translateData, const bool inTransition)
@@ -109,17 +215,131 @@ void QVTKFramebufferObjectItem::translateModel(CommandModelTranslate::TranslateP
 		}
 	}
 
+	// The last translation of a drag is not in transition
+	this->setInteracting(inTransition);
+
 	this->addCommand(new CommandModelTranslate(m_vtkFboRenderer, translateData, inTransition));
 }
 
+void QVTKFramebufferObjectItem::duplicateSelectedModel()
+{
+	std::shared_ptr<Model> selectedModel = m_vtkFboRenderer->getSelectedModel();
+
+	if (selectedModel == nullptr)
+	{
+		return;
+	}
+
+	this->addCommand(new CommandModelDuplicate(m_vtkFboRenderer, m_processingEngine, selectedModel));
+}
+
+void QVTKFramebufferObjectItem::colorSelectedModel(const QColor &modelColor)
+{
+	std::shared_ptr<Model> selectedModel = m_vtkFboRenderer->getSelectedModel();
+
+	if (selectedModel == nullptr)
+	{
+		return;
+	}
+
+	this->addCommand(new CommandModelColor(m_processingEngine, selectedModel, modelColor));
+}
+
 
 void QVTKFramebufferObjectItem::addCommand(CommandModel *command)
 {
-	m_commandsQueueMutex.lock();
+	// The queue takes ownership of the command
 	m_commandsQueue.push(command);
-	m_commandsQueueMutex.unlock();
 
-	update();
+	m_frameScheduler.requestFrame(FrameScheduler::Scene);
+}
+
+void QVTKFramebufferObjectItem::addModelLoadedCommand(CommandModelAdd *command)
+{
+	m_modelsLoading.remove(command);
+
+	this->addCommand(command);
+}
+
+void QVTKFramebufferObjectItem::updateGeometriesNormals()
+{
+	if (!m_processingEngine)
+	{
+		return;
+	}
+
+	const CommandGeometryNormals::Operation_t operation = m_processingEngine->getPointNormalsRequired() ? CommandGeometryNormals::Compute : CommandGeometryNormals::Release;
+
+	// One command per shared geometry, and none for the geometries already being updated the same way
+	QSet<const ModelGeometry*> geometries;
+
+	for (const CommandGeometryNormals *command : m_geometriesNormalsUpdating)
+	{
+		if (command->getOperation() == operation)
+		{
+			geometries.insert(command->getGeometry().get());
+		}
+	}
+
+	const std::shared_ptr<const ModelRegistry::Snapshot_t> models = m_processingEngine->getModels();
+
+	for (const std::shared_ptr<Model> &model : *models)
+	{
+		const std::shared_ptr<ModelGeometry> &geometry = model->getGeometry();
+
+		if (geometries.contains(geometry.get()) || !m_processingEngine->isPointNormalsOutdated(geometry))
+		{
+			continue;
+		}
+
+		geometries.insert(geometry.get());
+
+		CommandGeometryNormals *command = new CommandGeometryNormals(m_processingEngine, geometry, operation);
+
+		// Queued connection: the command is pushed from the GUI thread once the normals are prepared
+		connect(command, &CommandGeometryNormals::ready, this, [this, command]()
+		{
+			m_geometriesNormalsUpdating.remove(command);
+
+			if (!command->isPrepared())
+			{
+				delete command;
+				return;
+			}
+
+			this->addCommand(command);
+		});
+
+		m_geometriesNormalsUpdating.insert(command);
+
+		// After the pending loads, before the levels of detail
+		m_modelsLoaderPool.start(command, 0);
+	}
+}
+
+void QVTKFramebufferObjectItem::setInteracting(const bool interacting)
+{
+	if (m_interacting != interacting)
+	{
+		m_interacting = interacting;
+
+		// Coarser levels of detail from the press, back to the full resolution meshes on the release
+		m_frameScheduler.requestFrame(FrameScheduler::Scene);
+	}
+}
+
+void QVTKFramebufferObjectItem::pushInputEvent(const InputEventRing::Type_t type, const QPoint &position, const Qt::MouseButtons buttons, const Qt::KeyboardModifiers modifiers, const int delta, const ulong timestamp)
+{
+	InputEventRing::InputEvent_t inputEvent;
+	inputEvent.type = type;
+	inputEvent.x = position.x();
+	inputEvent.y = position.y();
+	inputEvent.buttons = static_cast<uint32_t>(buttons);
+	inputEvent.modifiers = static_cast<uint32_t>(modifiers);
+	inputEvent.delta = delta;
+	inputEvent.timestamp = timestamp;
+
+	m_inputEvents.push(inputEvent);
 }
 
 
@@ -127,68 +347,56 @@ void QVTKFramebufferObjectItem::addCommand(CommandModel *command)
 
 void QVTKFramebufferObjectItem::wheelEvent(QWheelEvent *e)
 {
-	m_lastMouseWheel = std::make_shared<QWheelEvent>(*e);
-	m_lastMouseWheel->ignore();
+	this->pushInputEvent(InputEventRing::Type_t::Wheel, e->pos(), e->buttons(), e->modifiers(), e->angleDelta().y(), e->timestamp());
 	e->accept();
-	update();
+	m_frameScheduler.requestFrame(FrameScheduler::Camera);
 }
 
 void QVTKFramebufferObjectItem::mousePressEvent(QMouseEvent *e)
 {
 	if (e->buttons() & Qt::RightButton)
 	{
-		m_lastMouseButton = std::make_shared<QMouseEvent>(*e);
-		m_lastMouseButton->ignore();
+		this->setInteracting(true);
+
+		this->pushInputEvent(InputEventRing::Type_t::MousePress, e->pos(), e->buttons(), e->modifiers(), 0, e->timestamp());
 		e->accept();
-		update();
+		m_frameScheduler.requestFrame(FrameScheduler::Camera);
 	}
 }
 
 void QVTKFramebufferObjectItem::mouseReleaseEvent(QMouseEvent *e)
 {
-	m_lastMouseButton = std::make_shared<QMouseEvent>(*e);
-	m_lastMouseButton->ignore();
+	if (!(e->buttons() & Qt::RightButton))
+	{
+		this->setInteracting(false);
+	}
+
+	this->pushInputEvent(InputEventRing::Type_t::MouseRelease, e->pos(), e->buttons(), e->modifiers(), 0, e->timestamp());
 	e->accept();
-	update();
+	m_frameScheduler.requestFrame(FrameScheduler::Camera);
 }
 
 void QVTKFramebufferObjectItem::mouseMoveEvent(QMouseEvent *e)
 {
 	if (e->buttons() & Qt::RightButton)
 	{
-		*m_lastMouseMove = *e;
-		m_lastMouseMove->ignore();
+		this->pushInputEvent(InputEventRing::Type_t::MouseMove, e->pos(), e->buttons(), e->modifiers(), 0, e->timestamp());
 		e->accept();
-		update();
+		m_frameScheduler.requestFrame(FrameScheduler::Camera);
 	}
 }
 
 
-QMouseEvent *QVTKFramebufferObjectItem::getLastMouseLeftButton()
-{
-	return m_lastMouseLeftButton.get();
-}
-
-QMouseEvent *QVTKFramebufferObjectItem::getLastMouseButton()
-{
-	return m_lastMouseButton.get();
-}
-
-QMouseEvent *QVTKFramebufferObjectItem::getLastMoveEvent()
-{
-	return m_lastMouseMove.get();
-}
-
-QWheelEvent *QVTKFramebufferObjectItem::getLastWheelEvent()
+InputEventRing &QVTKFramebufferObjectItem::getInputEvents()
 {
-	return m_lastMouseWheel.get();
+	return m_inputEvents;
 }
 
 
 void QVTKFramebufferObjectItem::resetCamera()
 {
 	m_vtkFboRenderer->resetCamera();
-	update();
+	m_frameScheduler.requestFrame(FrameScheduler::Camera);
 }
 
 int QVTKFramebufferObjectItem::getModelsRepresentation() const
@@ -226,7 +434,7 @@ void QVTKFramebufferObjectItem::setModelsRepresentation(const int representation
 	if (m_modelsRepresentationOption != representationOption)
 	{
 		m_modelsRepresentationOption = representationOption;
-		update();
+		m_frameScheduler.requestFrame(FrameScheduler::Style);
 	}
 }
 
@@ -235,7 +443,7 @@ void QVTKFramebufferObjectItem::setModelsOpacity(const double opacity)
 	if (m_modelsOpacity != opacity)
 	{
 		m_modelsOpacity = opacity;
-		update();
+		m_frameScheduler.requestFrame(FrameScheduler::Style);
 	}
 }
 
@@ -244,7 +452,15 @@ void QVTKFramebufferObjectItem::setGouraudInterpolation(const bool gouraudInterp
 	if (m_gouraudInterpolation != gouraudInterpolation)
 	{
 		m_gouraudInterpolation = gouraudInterpolation;
-		update();
+
+		// The render state switches in the next frame, the point normals follow geometry by geometry
+		if (m_processingEngine)
+		{
+			m_processingEngine->setPointNormalsRequired(m_gouraudInterpolation);
+			this->updateGeometriesNormals();
+		}
+
+		m_frameScheduler.requestFrame(FrameScheduler::Style);
 	}
 }
 
@@ -253,7 +469,7 @@ void QVTKFramebufferObjectItem::setModelColorR(const int colorR)
 	if (m_modelColorR != colorR)
 	{
 		m_modelColorR = colorR;
-		update();
+		m_frameScheduler.requestFrame(FrameScheduler::Style);
 	}
 }
 
@@ -262,7 +478,7 @@ void QVTKFramebufferObjectItem::setModelColorG(const int colorG)
 	if (m_modelColorG != colorG)
 	{
 		m_modelColorG = colorG;
-		update();
+		m_frameScheduler.requestFrame(FrameScheduler::Style);
 	}
 }
 
@@ -271,32 +487,56 @@ void QVTKFramebufferObjectItem::setModelColorB(const int colorB)
 	if (m_modelColorB != colorB)
 	{
 		m_modelColorB = colorB;
-		update();
+		m_frameScheduler.requestFrame(FrameScheduler::Style);
 	}
 }
 
-CommandModel *QVTKFramebufferObjectItem::getCommandsQueueFront() const
+CommandQueue &QVTKFramebufferObjectItem::getCommandsQueue()
+{
+	return m_commandsQueue;
+}
+
+ResidencyManager *QVTKFramebufferObjectItem::getResidencyManager()
 {
-	return m_commandsQueue.front();
+	return m_residencyManager.get();
 }
 
-void QVTKFramebufferObjectItem::commandsQueuePop()
+FrameScheduler &QVTKFramebufferObjectItem::getFrameScheduler()
 {
-	m_commandsQueue.pop();
+	return m_frameScheduler;
 }
 
-bool QVTKFramebufferObjectItem::isCommandsQueueEmpty() const
+bool QVTKFramebufferObjectItem::isInteracting() const
 {
-	return m_commandsQueue.empty();
+	return m_interacting;
 }
 
-void QVTKFramebufferObjectItem::lockCommandsQueueMutex()
+int64_t QVTKFramebufferObjectItem::getLodTrianglesBudget() const
 {
-	m_commandsQueueMutex.lock();
+	return m_lodTrianglesBudget;
 }
 
-void QVTKFramebufferObjectItem::unlockCommandsQueueMutex()
+void QVTKFramebufferObjectItem::setLodTrianglesBudget(const int64_t trianglesBudget)
 {
-	m_commandsQueueMutex.unlock();
+	if (m_lodTrianglesBudget != trianglesBudget)
+	{
+		m_lodTrianglesBudget = trianglesBudget;
+		m_frameScheduler.requestFrame(FrameScheduler::Scene);
+	}
 }
 
+int QVTKFramebufferObjectItem::getPickingMode() const
+{
+	return m_pickingMode;
+}
+
+void QVTKFramebufferObjectItem::setPickingMode(const int pickingMode)
+{
+	if (m_pickingMode != pickingMode)
+	{
+		m_pickingMode = pickingMode;
+
+		// The framebuffer does not change, the frame lets the renderer prepare the new mode
+		m_frameScheduler.requestFrame(FrameScheduler::None);
+	}
+}
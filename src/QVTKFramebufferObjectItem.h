@@ -1,16 +1,26 @@
 #ifndef QVTKFRAMEBUFFEROBJECTITEM_H
 #define QVTKFRAMEBUFFEROBJECTITEM_H
 
+#include <cstdint>
 #include <memory>
-#include <queue>
-#include <mutex>
 
+#include <QColor>
+#include <QList>
+#include <QSet>
+#include <QThreadPool>
+#include <QUrl>
 #include <QtQuick/QQuickFramebufferObject>
 
 #include "CommandModelTranslate.h"
+#include "CommandQueue.h"
+#include "FrameScheduler.h"
+#include "InputEventRing.h"
+#include "ResidencyManager.h"
 
 
+class CommandGeometryNormals;
 class CommandModel;
+class CommandModelAdd;
 class Model;
 class ProcessingEngine;
 class QVTKFramebufferObjectRenderer;
@@ -21,6 +31,7 @@ class QVTKFramebufferObjectItem : public QQuickFramebufferObject
 
 public:
 	QVTKFramebufferObjectItem();
+	~QVTKFramebufferObjectItem();
 
 	Renderer *createRenderer() const Q_DECL_OVERRIDE;
 	void setVtkFboRenderer(QVTKFramebufferObjectRenderer*);
@@ -36,8 +47,11 @@ public:
 	void selectModel(const int screenX, const int screenY);
 	void resetModelSelection();
 	void addModelFromFile(const QUrl &modelPath);
+	void addModelsFromFiles(const QList<QUrl> &modelsPaths);
 
 	void translateModel(CommandModelTranslate::TranslateParams_t &translateData, const bool inTransition);
+	void duplicateSelectedModel();
+	void colorSelectedModel(const QColor &modelColor);
 
 	// Camera related functions
 	void wheelEvent(QWheelEvent *e) override;
@@ -45,10 +59,8 @@ public:
 	void mouseReleaseEvent(QMouseEvent *e) override;
 	void mouseMoveEvent(QMouseEvent *e) override;
 
-	QMouseEvent *getLastMouseLeftButton();
-	QMouseEvent *getLastMouseButton();
-	QMouseEvent *getLastMoveEvent();
-	QWheelEvent *getLastWheelEvent();
+	// Drained by the renderer in render()
+	InputEventRing &getInputEvents();
 
 	void resetCamera();
 
@@ -66,11 +78,22 @@ public:
 	void setModelColorG(const int colorG);
 	void setModelColorB(const int colorB);
 
-	CommandModel* getCommandsQueueFront() const;
-	void commandsQueuePop();
-	bool isCommandsQueueEmpty() const;
-	void lockCommandsQueueMutex();
-	void unlockCommandsQueueMutex();
+	CommandQueue &getCommandsQueue();
+
+	// Null until the processing engine is set
+	ResidencyManager *getResidencyManager();
+
+	// Every redraw of the item goes through it
+	FrameScheduler &getFrameScheduler();
+
+	// True from the press to the release of a camera or model drag
+	bool isInteracting() const;
+	int64_t getLodTrianglesBudget() const;
+	void setLodTrianglesBudget(const int64_t trianglesBudget);
+
+	// QVTKFramebufferObjectRenderer::PickingMode_t, the ID buffer by default
+	int getPickingMode() const;
+	void setPickingMode(const int pickingMode);
 
 signals:
 	void rendererInitialized();
@@ -80,21 +103,41 @@ signals:
 	void selectedModelPositionYChanged();
 
 	void addModelFromFileDone();
+	// The file was read without any triangle, no model was added
 	void addModelFromFileError(QString error);
+	// Identified by the load ID, see CommandModelAdd::getLoadId()
+	void addModelFromFileProgress(const quint64 loadId, const qint64 bytesRead, const qint64 bytesTotal);
+	void addModelFromFilePreprocessingProgress(const quint64 loadId, const double progress);
+	void addModelFromFileStageChanged(const quint64 loadId, const int stage);
 
 private:
 	void addCommand(CommandModel* command);
+	void addModelLoadedCommand(CommandModelAdd* command);
+	void updateGeometriesNormals();
+	void setInteracting(const bool interacting);
+	void pushInputEvent(const InputEventRing::Type_t type, const QPoint &position, const Qt::MouseButtons buttons, const Qt::KeyboardModifiers modifiers, const int delta, const ulong timestamp);
 
 	QVTKFramebufferObjectRenderer *m_vtkFboRenderer = nullptr;
 	std::shared_ptr<ProcessingEngine> m_processingEngine;
 
-	std::queue<CommandModel*> m_commandsQueue;
-	std::mutex m_commandsQueueMutex;
+	CommandQueue m_commandsQueue;
+	FrameScheduler m_frameScheduler;
+
+	// Fixed number of loader threads, sized to the hardware
+	QThreadPool m_modelsLoaderPool;
+	QSet<CommandModelAdd*> m_modelsLoading;
+	QSet<CommandGeometryNormals*> m_geometriesNormalsUpdating;
+
+	// Evicts the geometries over the memory budget, checked with the memory report of the overlay
+	std::unique_ptr<ResidencyManager> m_residencyManager;
+
+	// Coarse levels of detail are drawn during the interactions, up to the triangles budget
+	bool m_interacting = false;
+	int64_t m_lodTrianglesBudget = 2000000;
+
+	int m_pickingMode = 0;
 
-	std::shared_ptr<QMouseEvent> m_lastMouseLeftButton;
-	std::shared_ptr<QMouseEvent> m_lastMouseButton;
-	std::shared_ptr<QMouseEvent> m_lastMouseMove;
-	std::shared_ptr<QWheelEvent> m_lastMouseWheel;
+	InputEventRing m_inputEvents;
 
 	int m_modelsRepresentationOption = 2;
 	double m_modelsOpacity = 1.0;
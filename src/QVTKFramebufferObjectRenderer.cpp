@@ -1,15 +1,17 @@
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include <queue>
 
 #include <QQuickWindow>
 
 #include <vtkAxesActor.h>
-#include <vtkBoundedPlanePointPlacer.h>
 #include <vtkCamera.h>
 #include <vtkCaptionActor2D.h>
 #include <vtkCellArray.h>
+#include <vtkInteractorStyle.h>
 #include <vtkInteractorStyleTrackballCamera.h>
 #include <vtkLight.h>
-#include <vtkPlane.h>
 #include <vtkPolyDataMapper.h>
 #include <vtkPolyLine.h>
 #include <vtkSTLReader.h>
@@ -17,10 +19,18 @@
 #include <vtkTextProperty.h>
 
 #include "CommandModel.h"
+#include "FrameProfiler.h"
+#include "FrameScheduler.h"
 #include "Model.h"
+#include "ModelGeometry.h"
 #include "ProcessingEngine.h"
 #include "QVTKFramebufferObjectItem.h"
 #include "QVTKFramebufferObjectRenderer.h"
+#include "ResidencyManager.h"
+
+
+// Angle delta of one wheel notch, in eighths of a degree
+static const double WHEEL_DELTA_PER_STEP = 120.0;
 
 QVTKFramebufferObjectRenderer::QVTKFramebufferObjectRenderer()
 {
@@ -58,6 +68,8 @@ void QVTKFramebufferObjectRenderer::setProcessingEngine(const std::shared_ptr<Pr
 
 void QVTKFramebufferObjectRenderer::synchronize(QQuickFramebufferObject *item)
 {
+	FRAME_PROFILER_SCOPE("Renderer::synchronize");
+
 	// For the first synchronize
 	if (!m_vtkFboItem)
 	{
@@ -76,149 +88,369 @@ void QVTKFramebufferObjectRenderer::synchronize(QQuickFramebufferObject *item)
 	if (m_vtkFboItem->width() != rendererSize[0] || m_vtkFboItem->height() != rendererSize[1])
 	{
 		m_vtkRenderWindow->SetSize(m_vtkFboItem->width(), m_vtkFboItem->height());
+		m_vtkFboItem->getFrameScheduler().addFrameChanges(FrameScheduler::Viewport);
+	}
+
+	// Hints only: the frame is rendered for the changes observed here and in render()
+	m_vtkFboItem->getFrameScheduler().takeDirtyReasons();
+
+	// The GUI thread is blocked: the events deferred while the ring was full are drained in this frame
+	m_vtkFboItem->getInputEvents().flushDeferred();
+
+	// Get extra data
+	if (this->synchronizeModelsRenderState())
+	{
+		m_vtkFboItem->getFrameScheduler().addFrameChanges(FrameScheduler::Style);
+	}
+
+	m_interacting = m_vtkFboItem->isInteracting();
+	m_lodTrianglesBudget = m_vtkFboItem->getLodTrianglesBudget();
+
+	const PickingMode_t pickingMode = static_cast<PickingMode_t>(m_vtkFboItem->getPickingMode());
+	if (m_pickingMode != pickingMode)
+	{
+		this->setPickingMode(pickingMode);
 	}
+}
 
-	// Copy mouse events
-	if (!m_vtkFboItem->getLastMouseLeftButton()->isAccepted())
+bool QVTKFramebufferObjectRenderer::synchronizeModelsRenderState()
+{
+	FRAME_PROFILER_SCOPE("Renderer::synchronize::modelsRenderState");
+
+	if (!m_processingEngine)
 	{
-		m_mouseLeftButton = std::make_shared<QMouseEvent>(*m_vtkFboItem->getLastMouseLeftButton());
-		m_vtkFboItem->getLastMouseLeftButton()->accept();
+		return false;
 	}
 
-	if (!m_vtkFboItem->getLastMouseButton()->isAccepted())
+	// Push only what changed since the last applied state, the models share their properties so each change is O(1)
+	const int modelsRepresentationOption = m_vtkFboItem->getModelsRepresentation();
+	const double modelsOpacity = m_vtkFboItem->getModelsOpacity();
+	const bool modelsGouraudInterpolation = m_vtkFboItem->getGourauInterpolation();
+	const QColor selectedModelColor(m_vtkFboItem->getModelColorR(), m_vtkFboItem->getModelColorG(), m_vtkFboItem->getModelColorB());
+
+	bool renderStateChanged = false;
+
+	if (!m_modelsRenderStateApplied || m_modelsRepresentationOption != modelsRepresentationOption)
 	{
-		m_mouseEvent = std::make_shared<QMouseEvent>(*m_vtkFboItem->getLastMouseButton());
-		m_vtkFboItem->getLastMouseButton()->accept();
+		renderStateChanged = true;
+		m_modelsRepresentationOption = modelsRepresentationOption;
+		m_processingEngine->setModelsRepresentation(m_modelsRepresentationOption);
 	}
 
-	if (!m_vtkFboItem->getLastMoveEvent()->isAccepted())
+	if (!m_modelsRenderStateApplied || m_modelsOpacity != modelsOpacity)
 	{
-		m_moveEvent = std::make_shared<QMouseEvent>(*m_vtkFboItem->getLastMoveEvent());
-		m_vtkFboItem->getLastMoveEvent()->accept();
+		renderStateChanged = true;
+		m_modelsOpacity = modelsOpacity;
+		m_processingEngine->setModelsOpacity(m_modelsOpacity);
 	}
 
-	if (!m_vtkFboItem->getLastWheelEvent()->isAccepted())
+	if (!m_modelsRenderStateApplied || m_modelsGouraudInterpolation != modelsGouraudInterpolation)
 	{
-		m_wheelEvent = std::make_shared<QWheelEvent>(*m_vtkFboItem->getLastWheelEvent());
-		m_vtkFboItem->getLastWheelEvent()->accept();
+		renderStateChanged = true;
+		m_modelsGouraudInterpolation = modelsGouraudInterpolation;
+		m_processingEngine->setModelsGouraudInterpolation(m_modelsGouraudInterpolation);
 	}
 
-	// Get extra data
-	m_modelsRepresentationOption = m_vtkFboItem->getModelsRepresentation();
-	m_modelsOpacity = m_vtkFboItem->getModelsOpacity();
-	m_modelsGouraudInterpolation = m_vtkFboItem->getGourauInterpolation();
-	Model::setSelectedModelColor(QColor(m_vtkFboItem->getModelColorR(), m_vtkFboItem->getModelColorG(), m_vtkFboItem->getModelColorB()));
+	if (!m_modelsRenderStateApplied || m_selectedModelColor != selectedModelColor)
+	{
+		renderStateChanged = true;
+		m_selectedModelColor = selectedModelColor;
+		m_processingEngine->setSelectedModelColor(m_selectedModelColor);
+	}
+
+	m_modelsRenderStateApplied = true;
+
+	return renderStateChanged;
 }
 
 void QVTKFramebufferObjectRenderer::render()
 {
+	FRAME_PROFILER_THREAD_NAME("Render");
+	FRAME_PROFILER_SCOPE("Renderer::render");
+
 	m_vtkRenderWindow->PushState();
 	this->openGLInitState();
 	m_vtkRenderWindow->Start();
 
+	FrameScheduler &frameScheduler = m_vtkFboItem->getFrameScheduler();
+
 	if (m_firstRender)
 	{
 		this->initScene();
 		m_firstRender = false;
+		frameScheduler.addFrameChanges(FrameScheduler::All);
 	}
 
 	// Process camera related commands
+	{
+		FRAME_PROFILER_SCOPE("Renderer::render::events");
+		this->processInputEvents();
+
+		// More events were deferred than the ring holds, the rest in the next frame
+		if (m_vtkFboItem->getInputEvents().hasDeferredEvents())
+		{
+			this->update();
+		}
+	}
+
+	// The camera does not move anymore in this frame, cache its projection for the picking and the commands
+	m_screenProjection.update(m_renderer);
+
+	// Process model related commands
 
-	// Process mouse event
-	if (m_mouseEvent && !m_mouseEvent->isAccepted())
+	// Select model
 	{
-		m_vtkRenderWindowInteractor->SetEventInformationFlipY(m_mouseEvent->x(), m_mouseEvent->y(),
-															  (m_mouseEvent->modifiers() & Qt::ControlModifier) > 0 ? 1 : 0,
-															  (m_mouseEvent->modifiers() & Qt::ShiftModifier) > 0 ? 1 : 0, 0,
-															  m_mouseEvent->type() == QEvent::MouseButtonDblClick ? 1 : 0);
+		FRAME_PROFILER_SCOPE("Renderer::render::selectModel");
 
-		if (m_mouseEvent->type() == QEvent::MouseButtonPress)
+		if (m_selectionPending)
 		{
-			m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::LeftButtonPressEvent, m_mouseEvent.get());
+			if (this->selectModel(m_selectionX, m_selectionY))
+			{
+				frameScheduler.addFrameChanges(FrameScheduler::Selection);
+			}
+
+			m_selectionPending = false;
 		}
-		else if (m_mouseEvent->type() == QEvent::MouseButtonRelease)
+	}
+
+	// Model transformations
+	{
+		FRAME_PROFILER_SCOPE("Renderer::render::commands");
+
+		std::unique_ptr<CommandModel> command;
+		while ((command = m_vtkFboItem->getCommandsQueue().popReady()))
 		{
-			m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::LeftButtonReleaseEvent, m_mouseEvent.get());
+			command->execute();
+			frameScheduler.addFrameChanges(FrameScheduler::Scene);
+
+			// The loader and residency commands live in the GUI thread, their signals may still be queued there
+			if (QObject *commandObject = dynamic_cast<QObject*>(command.get()))
+			{
+				command.release();
+				commandObject->deleteLater();
+			}
 		}
 
-		m_mouseEvent->accept();
+		m_commandsMergedLastFrame = m_vtkFboItem->getCommandsQueue().takeMergedCount();
+		if (m_commandsMergedLastFrame > 0)
+		{
+			CommandQueue::Stats_t commandsQueueStats = m_vtkFboItem->getCommandsQueue().getStats();
+
+			qDebug() << "QVTKFramebufferObjectRenderer::render(): merged" << m_commandsMergedLastFrame << "translate commands -"
+					 << "queue depth:" << commandsQueueStats.depth << "max depth:" << commandsQueueStats.maxDepth
+					 << "average wait:" << commandsQueueStats.averageWaitMs << "ms max wait:" << commandsQueueStats.maxWaitMs << "ms";
+		}
 	}
 
-	// Process move event
-	if (m_moveEvent && !m_moveEvent->isAccepted())
+	// Levels of detail for this frame
 	{
-		if (m_moveEvent->type() == QEvent::MouseMove && m_moveEvent->buttons() & Qt::RightButton)
-		{
-			m_vtkRenderWindowInteractor->SetEventInformationFlipY(m_moveEvent->x(), m_moveEvent->y(),
-																  (m_moveEvent->modifiers() & Qt::ControlModifier) > 0 ? 1 : 0,
-																  (m_moveEvent->modifiers() & Qt::ShiftModifier) > 0 ? 1 : 0, 0,
-																  m_moveEvent->type() == QEvent::MouseButtonDblClick ? 1 : 0);
+		FRAME_PROFILER_SCOPE("Renderer::render::modelsLod");
 
-			m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::MouseMoveEvent, m_moveEvent.get());
+		if (this->updateModelsLod())
+		{
+			frameScheduler.addFrameChanges(FrameScheduler::Scene);
 		}
+	}
+
+	// Reset the view-up vector. This improves the interaction of the camera with the plate.
+	m_renderer->GetActiveCamera()->SetViewUp(0.0, 0.0, 1.0);
 
-		m_moveEvent->accept();
+	// Moved by the input events, or outside of them by resetCamera(). A press without drag does not move it.
+	frameScheduler.checkCameraChange(m_renderer->GetActiveCamera()->GetMTime());
+
+	// Render, unless the framebuffer already holds this frame
+	const bool frameRendered = frameScheduler.getFrameChanges() != FrameScheduler::None;
+
+	if (frameRendered)
+	{
+		FRAME_PROFILER_SCOPE("Renderer::render::vtkRender");
+		m_vtkRenderWindow->Render();
 	}
 
-	// Process wheel event
-	if (m_wheelEvent && !m_wheelEvent->isAccepted())
+	frameScheduler.frameDone(frameRendered, m_renderer->GetActiveCamera()->GetMTime());
+
+	// The ID buffer follows the view once it settles, so a click is only a lookup
+	if (m_pickingMode == PickingMode_t::IdBuffer && m_processingEngine)
 	{
-		if (m_wheelEvent->delta() > 0)
+		if (frameRendered)
 		{
-			m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::MouseWheelForwardEvent, m_wheelEvent.get());
+			// One more frame to find out if the view still moves
+			m_pickingBufferOutdated = true;
+			this->update();
 		}
-		else if (m_wheelEvent->delta() < 0)
+		else if (m_pickingBufferOutdated && !m_interacting)
 		{
-			m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::MouseWheelBackwardEvent, m_wheelEvent.get());
+			FRAME_PROFILER_SCOPE("Renderer::render::pickingBuffer");
+			m_pickingBuffer.update(m_renderer, m_processingEngine->getModels());
+			m_pickingBufferOutdated = false;
 		}
+	}
 
-		m_wheelEvent->accept();
+	m_vtkRenderWindow->PopState();
+
+	m_vtkFboItem->window()->resetOpenGLState();
+}
+
+void QVTKFramebufferObjectRenderer::processInputEvents()
+{
+	InputEventRing &inputEvents = m_vtkFboItem->getInputEvents();
+	InputEventRing::InputEvent_t inputEvent;
+
+	// The moves of a drag are merged into the latest one, the style rotates by the distance to the previous event position
+	InputEventRing::InputEvent_t moveEvent;
+	bool movePending = false;
+	int32_t wheelDelta = 0;
+
+	while (inputEvents.pop(inputEvent))
+	{
+		switch (inputEvent.type)
+		{
+			case InputEventRing::Type_t::MousePress:
+			case InputEventRing::Type_t::MouseRelease:
+				if (movePending)
+				{
+					this->processMouseEvent(moveEvent);
+					movePending = false;
+				}
+
+				this->processMouseEvent(inputEvent);
+				break;
+
+			case InputEventRing::Type_t::MouseMove:
+				moveEvent = inputEvent;
+				movePending = true;
+				break;
+
+			case InputEventRing::Type_t::Wheel:
+				wheelDelta += inputEvent.delta;
+				break;
+
+			case InputEventRing::Type_t::Select:
+				// Resolved once the camera is updated, the last click wins
+				m_selectionX = static_cast<int16_t>(inputEvent.x);
+				m_selectionY = static_cast<int16_t>(inputEvent.y);
+				m_selectionPending = true;
+				break;
+		}
 	}
 
-	// Process model related commands
+	if (movePending)
+	{
+		this->processMouseEvent(moveEvent);
+	}
 
-	// Select model
+	if (wheelDelta != 0)
+	{
+		// One dolly for all the ticks of the frame: the zoom factor is exponential in the motion factor
+		vtkInteractorStyle *style = vtkInteractorStyle::SafeDownCast(m_vtkRenderWindowInteractor->GetInteractorStyle());
+		const double mouseWheelMotionFactor = style->GetMouseWheelMotionFactor();
 
-	if (m_mouseLeftButton && !m_mouseLeftButton->isAccepted())
+		style->SetMouseWheelMotionFactor(mouseWheelMotionFactor * std::abs(wheelDelta) / WHEEL_DELTA_PER_STEP);
+		m_vtkRenderWindowInteractor->InvokeEvent(wheelDelta > 0 ? vtkCommand::MouseWheelForwardEvent : vtkCommand::MouseWheelBackwardEvent, nullptr);
+		style->SetMouseWheelMotionFactor(mouseWheelMotionFactor);
+	}
+}
+
+void QVTKFramebufferObjectRenderer::processMouseEvent(const InputEventRing::InputEvent_t &inputEvent)
+{
+	const Qt::KeyboardModifiers modifiers(inputEvent.modifiers);
+
+	if (inputEvent.type == InputEventRing::Type_t::MouseMove && !(inputEvent.buttons & Qt::RightButton))
 	{
-		this->selectModel(m_mouseLeftButton->x(), m_mouseLeftButton->y());
-		m_mouseLeftButton->accept();
+		return;
 	}
 
-	// Model transformations
+	m_vtkRenderWindowInteractor->SetEventInformationFlipY(inputEvent.x, inputEvent.y,
+														  (modifiers & Qt::ControlModifier) ? 1 : 0,
+														  (modifiers & Qt::ShiftModifier) ? 1 : 0);
 
-	CommandModel *command;
-	while (!m_vtkFboItem->isCommandsQueueEmpty())
+	if (inputEvent.type == InputEventRing::Type_t::MousePress)
+	{
+		m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::LeftButtonPressEvent, nullptr);
+	}
+	else if (inputEvent.type == InputEventRing::Type_t::MouseRelease)
+	{
+		m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::LeftButtonReleaseEvent, nullptr);
+	}
+	else
 	{
-		m_vtkFboItem->lockCommandsQueueMutex();
+		m_vtkRenderWindowInteractor->InvokeEvent(vtkCommand::MouseMoveEvent, nullptr);
+	}
+}
 
-		command = m_vtkFboItem->getCommandsQueueFront();
-		if (!command->isReady())
-		{
-			m_vtkFboItem->unlockCommandsQueueMutex();
-			break;
-		}
-		m_vtkFboItem->commandsQueuePop();
+bool QVTKFramebufferObjectRenderer::updateModelsLod()
+{
+	if (!m_processingEngine)
+	{
+		return false;
+	}
 
-		m_vtkFboItem->unlockCommandsQueueMutex();
+	std::shared_ptr<const ModelRegistry::Snapshot_t> models = m_processingEngine->getModels();
+	const vtkMTimeType cameraMTime = m_renderer->GetActiveCamera()->GetMTime();
 
-		command->execute();
+	// Only the interaction, the budget and the models decide the levels. While interacting, the camera moves
+	// also pick up the levels generated meanwhile.
+	if (m_lodsApplied && m_lodsInteracting == m_interacting && m_lodsTrianglesBudget == m_lodTrianglesBudget &&
+		m_lodsModels.lock() == models && (!m_interacting || m_lodsCameraMTime == cameraMTime))
+	{
+		return false;
 	}
 
-	// Reset the view-up vector. This improves the interaction of the camera with the plate.
-	m_renderer->GetActiveCamera()->SetViewUp(0.0, 0.0, 1.0);
+	m_lodsApplied = true;
+	m_lodsInteracting = m_interacting;
+	m_lodsTrianglesBudget = m_lodTrianglesBudget;
+	m_lodsModels = models;
+	m_lodsCameraMTime = cameraMTime;
 
-	// Extra actions
-	m_processingEngine->setModelsRepresentation(m_modelsRepresentationOption);
-	m_processingEngine->setModelsOpacity(m_modelsOpacity);
-	m_processingEngine->setModelsGouraudInterpolation(m_modelsGouraudInterpolation);
-	m_processingEngine->updateModelsColor();
+	// Full resolution when idle
+	std::vector<size_t> lodLevels(models->size(), 0);
 
-	// Render
-	m_vtkRenderWindow->Render();
-	m_vtkRenderWindow->PopState();
+	if (m_interacting)
+	{
+		// Coarsen the model drawing the most triangles until the scene fits in the budget
+		int64_t trianglesCount = 0;
+		for (const std::shared_ptr<Model> &model : *models)
+		{
+			trianglesCount += model->getLodTrianglesCount(0);
+		}
 
-	m_vtkFboItem->window()->resetOpenGLState();
+		while (trianglesCount > m_lodTrianglesBudget)
+		{
+			size_t coarsenedModel = models->size();
+			vtkIdType coarsenedModelTriangles = 0;
+
+			for (size_t i = 0; i < models->size(); ++i)
+			{
+				const vtkIdType modelTriangles = (*models)[i]->getLodTrianglesCount(lodLevels[i]);
+
+				if (lodLevels[i] + 1 < (*models)[i]->getLodsCount() && modelTriangles > coarsenedModelTriangles)
+				{
+					coarsenedModel = i;
+					coarsenedModelTriangles = modelTriangles;
+				}
+			}
+
+			// Every model is at its coarsest level
+			if (coarsenedModel == models->size())
+			{
+				break;
+			}
+
+			++lodLevels[coarsenedModel];
+			trianglesCount -= coarsenedModelTriangles - (*models)[coarsenedModel]->getLodTrianglesCount(lodLevels[coarsenedModel]);
+		}
+	}
+
+	bool lodLevelsChanged = false;
+
+	for (size_t i = 0; i < models->size(); ++i)
+	{
+		const size_t lodLevel = (*models)[i]->getLodLevel();
+		(*models)[i]->setLodLevel(lodLevels[i]);
+		lodLevelsChanged |= (*models)[i]->getLodLevel() != lodLevel;
+	}
+
+	return lodLevelsChanged;
 }
 
 void QVTKFramebufferObjectRenderer::openGLInitState()
@@ -249,6 +481,12 @@ QOpenGLFramebufferObject *QVTKFramebufferObjectRenderer::createFramebufferObject
 	m_vtkRenderWindow->SetOffScreenRendering(true);
 	m_vtkRenderWindow->Modified();
 
+	// The new framebuffer is empty. Before the first synchronize(), the first render() draws everything anyway.
+	if (m_vtkFboItem)
+	{
+		m_vtkFboItem->getFrameScheduler().addFrameChanges(FrameScheduler::Viewport);
+	}
+
 	return framebufferObject.release();
 }
 
@@ -344,6 +582,12 @@ void QVTKFramebufferObjectRenderer::updatePlatform()
 		m_platformModel->SetCenter(0.0, 0.0, -m_platformThickness / 2);
 	}
 
+	if (m_vtkFboItem && m_vtkFboItem->getResidencyManager())
+	{
+		const double plateBounds[4] = {-m_platformWidth / 2.0, m_platformWidth / 2.0, -m_platformDepth / 2.0, m_platformDepth / 2.0};
+		m_vtkFboItem->getResidencyManager()->setPlateBounds(plateBounds);
+	}
+
 	// Platform Grid
 	vtkSmartPointer<vtkPoints> gridPoints = vtkSmartPointer<vtkPoints>::New();
 	vtkSmartPointer<vtkCellArray> gridCells = vtkSmartPointer<vtkCellArray>::New();
@@ -385,25 +629,41 @@ void QVTKFramebufferObjectRenderer::addModelActor(const std::shared_ptr<Model> m
 	qDebug() << "QVTKFramebufferObjectRenderer::addModelActor(): Model added " << model.get();
 }
 
-void QVTKFramebufferObjectRenderer::selectModel(const int16_t x, const int16_t y)
+void QVTKFramebufferObjectRenderer::setPreviewActor(const uint64_t previewId, const vtkSmartPointer<vtkActor> previewActor)
 {
-	qDebug() << "QVTKFramebufferObjectRenderer::selectModel()";
+	this->removePreviewActor(previewId);
 
-	// Compensate the y-axis flip for the picking
-	m_picker->Pick(x, m_renderer->GetSize()[1] - y, 0, m_renderer);
+	m_previewActors[previewId] = previewActor;
+	m_renderer->AddActor(previewActor);
+}
 
-	// Get pick position
+void QVTKFramebufferObjectRenderer::removePreviewActor(const uint64_t previewId)
+{
+	std::unordered_map<uint64_t, vtkSmartPointer<vtkActor>>::iterator previewActor = m_previewActors.find(previewId);
+
+	if (previewActor != m_previewActors.end())
+	{
+		m_renderer->RemoveActor(previewActor->second);
+		m_previewActors.erase(previewActor);
+	}
+}
+
+bool QVTKFramebufferObjectRenderer::selectModel(const int16_t x, const int16_t y)
+{
+	qDebug() << "QVTKFramebufferObjectRenderer::selectModel()";
+
+	// Get picked actor and pick position
 	double clickPosition[3];
-	m_picker->GetPickPosition(clickPosition);
+	vtkActor *pickedActor = this->pickModelActor(x, y, clickPosition);
 	m_clickPositionZ = clickPosition[2];
 
-	if (m_selectedActor == m_picker->GetActor())
+	if (m_selectedActor == pickedActor)
 	{
 		if (m_selectedModel)
 		{
 			m_selectedModel->setMouseDeltaXY(clickPosition[0] - m_selectedModel->getPositionX(), clickPosition[1] - m_selectedModel->getPositionY());
 		}
-		return;
+		return false;
 	}
 
 	// Disconnect signals
@@ -413,7 +673,7 @@ void QVTKFramebufferObjectRenderer::selectModel(const int16_t x, const int16_t y
 	}
 
 	// Pick the new actor
-	m_selectedActor = m_picker->GetActor();
+	m_selectedActor = pickedActor;
 
 	m_selectedModel = this->getSelectedModelNoLock();
 
@@ -423,6 +683,12 @@ void QVTKFramebufferObjectRenderer::selectModel(const int16_t x, const int16_t y
 
 		m_selectedModel->setSelected(true);
 
+		// An evicted geometry draws its proxy until it is back
+		if (!m_selectedModel->getGeometry()->isResident() && m_vtkFboItem->getResidencyManager())
+		{
+			m_vtkFboItem->getResidencyManager()->requestRestore(m_selectedModel->getGeometry());
+		}
+
 		// Connect signals
 		connect(m_selectedModel.get(), &Model::positionXChanged, this, &QVTKFramebufferObjectRenderer::setSelectedModelPositionX);
 		connect(m_selectedModel.get(), &Model::positionYChanged, this, &QVTKFramebufferObjectRenderer::setSelectedModelPositionY);
@@ -441,6 +707,80 @@ void QVTKFramebufferObjectRenderer::selectModel(const int16_t x, const int16_t y
 	}
 
 	qDebug() << "QVTKFramebufferObjectRenderer::selectModel() end";
+
+	return true;
+}
+
+vtkActor *QVTKFramebufferObjectRenderer::pickModelActor(const int16_t x, const int16_t y, double clickPosition[])
+{
+	// Compensate the y-axis flip for the picking
+	const int16_t displayY = m_renderer->GetSize()[1] - y;
+
+	if (m_pickingMode == PickingMode_t::Bvh && m_processingEngine)
+	{
+		double rayOrigin[3];
+		double rayDirection[3];
+		m_screenProjection.computeRay(x, y, rayOrigin, rayDirection);
+
+		std::shared_ptr<const ModelRegistry::Snapshot_t> models = m_processingEngine->getModels();
+		std::shared_ptr<Model> closestModel;
+		double closestT = std::numeric_limits<double>::max();
+		bool bvhsReady = true;
+
+		for (const std::shared_ptr<Model> &model : *models)
+		{
+			const vtkSmartPointer<vtkActor> &modelActor = model->getModelActor();
+
+			// The registry may hold models not added to this renderer
+			if (!modelActor->GetVisibility() || !modelActor->GetPickable() || !modelActor->IsConsumer(m_renderer))
+			{
+				continue;
+			}
+
+			// Still building on the loader pool, a closer hit could be missed
+			if (!model->getGeometry()->getBVH())
+			{
+				bvhsReady = false;
+				break;
+			}
+
+			double t;
+			double hitPosition[3];
+
+			if (model->intersectRay(rayOrigin, rayDirection, t, hitPosition) && t < closestT)
+			{
+				closestT = t;
+				closestModel = model;
+				std::copy(hitPosition, hitPosition + 3, clickPosition);
+			}
+		}
+
+		if (bvhsReady && closestModel)
+		{
+			return closestModel->getModelActor();
+		}
+
+		// Missed or not indexed yet, the cell picker has the last word
+	}
+
+	if (m_pickingMode == PickingMode_t::IdBuffer && m_processingEngine && m_pickingBuffer.update(m_renderer, m_processingEngine->getModels()))
+	{
+		PickingBuffer::PickResult_t pickResult;
+
+		if (m_pickingBuffer.pick(x, displayY, pickResult))
+		{
+			std::copy(pickResult.worldPosition, pickResult.worldPosition + 3, clickPosition);
+			return pickResult.model->getModelActor();
+		}
+
+		std::fill(clickPosition, clickPosition + 3, 0.0);
+		return nullptr;
+	}
+
+	m_picker->Pick(x, displayY, 0, m_renderer);
+	m_picker->GetPickPosition(clickPosition);
+
+	return m_picker->GetActor();
 }
 
 void QVTKFramebufferObjectRenderer::clearSelectedModel()
@@ -509,53 +849,26 @@ double QVTKFramebufferObjectRenderer::getSelectedModelPositionY() const
 	return m_selectedModelPositionY;
 }
 
-const bool QVTKFramebufferObjectRenderer::screenToWorld(const int16_t screenX, const int16_t screenY, double worldPos[])
+uint32_t QVTKFramebufferObjectRenderer::getCommandsMergedLastFrame() const
 {
-	//Create bounding planes for projection plane
-	vtkSmartPointer<vtkPlane> boundingPlanes[4];
-
-	boundingPlanes[0] = vtkSmartPointer<vtkPlane>::New();
-	boundingPlanes[0]->SetOrigin(0.0, 1000.0, 0.0);
-	boundingPlanes[0]->SetNormal(0.0, -1.0, 0.0);
-
-	boundingPlanes[1] = vtkSmartPointer<vtkPlane>::New();
-	boundingPlanes[1]->SetOrigin(0.0, -1000.0, 0.0);
-	boundingPlanes[1]->SetNormal(0.0, 1.0, 0.0);
-
-	boundingPlanes[2] = vtkSmartPointer<vtkPlane>::New();
-	boundingPlanes[2]->SetOrigin(1000.0, 0.0, 0.0);
-	boundingPlanes[2]->SetNormal(-1.0, 0.0, 0.0);
-
-	boundingPlanes[3] = vtkSmartPointer<vtkPlane>::New();
-	boundingPlanes[3]->SetOrigin(-1000.0, 0.0, 0.0);
-	boundingPlanes[3]->SetNormal(1.0, 0.0, 0.0);
-
-	// Create projection plane parallel platform and Z coordinate from clicked position in model
-	vtkSmartPointer<vtkPlane> plane = vtkSmartPointer<vtkPlane>::New();
-	plane->SetOrigin(0.0, 0.0, m_clickPositionZ);
-	plane->SetNormal(0.0, 0.0, 1.0);
-
-	// Set projection and bounding planes to placer
-	vtkSmartPointer<vtkBoundedPlanePointPlacer> placer = vtkSmartPointer<vtkBoundedPlanePointPlacer>::New();
-	placer->SetObliquePlane(plane);
-	placer->SetProjectionNormalToOblique();
-
-	placer->AddBoundingPlane(boundingPlanes[0].Get());
-	placer->AddBoundingPlane(boundingPlanes[1].Get());
-	placer->AddBoundingPlane(boundingPlanes[2].Get());
-	placer->AddBoundingPlane(boundingPlanes[3].Get());
-
-	double screenPos[2];
-	double worldOrient[9];
+	return m_commandsMergedLastFrame;
+}
 
-	screenPos[0] = screenX;
-	// Compensate the y-axis flip for the picking
-	screenPos[1] = m_renderer->GetSize()[1] - screenY;
+void QVTKFramebufferObjectRenderer::setPickingMode(const PickingMode_t pickingMode)
+{
+	m_pickingMode = pickingMode;
+	m_pickingBuffer.invalidate();
+	m_pickingBufferOutdated = true;
+}
 
-	int16_t withinBounds;
-	withinBounds = placer->ComputeWorldPosition(m_renderer, screenPos, worldPos, worldOrient);
+QVTKFramebufferObjectRenderer::PickingMode_t QVTKFramebufferObjectRenderer::getPickingMode() const
+{
+	return m_pickingMode;
+}
 
-	return withinBounds;
+const bool QVTKFramebufferObjectRenderer::screenToWorld(const int16_t screenX, const int16_t screenY, double worldPos[])
+{
+	return m_screenProjection.screenToWorld(screenX, screenY, m_clickPositionZ, worldPos);
 }
 
 void QVTKFramebufferObjectRenderer::resetCamera()
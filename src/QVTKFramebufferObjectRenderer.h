@@ -2,6 +2,7 @@
 #define QVTKFRAMEBUFFEROBJECTRENDERER_H
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <mutex>
 
@@ -9,6 +10,7 @@
 #include <QOpenGLFunctions>
 #include <QQuickFramebufferObject>
 #include <QUndoStack>
+#include <QColor>
 #include <QDir>
 
 #include <vtkActor.h>
@@ -22,15 +24,28 @@
 #include <vtkRenderer.h>
 #include <vtkSmartPointer.h>
 
+#include "InputEventRing.h"
+#include "ModelsRenderer.h"
+#include "PickingBuffer.h"
+#include "ScreenProjection.h"
+
 class Model;
 class QVTKFramebufferObjectItem;
 class ProcessingEngine;
 
-class QVTKFramebufferObjectRenderer : public QObject, public QQuickFramebufferObject::Renderer, protected QOpenGLFunctions
+class QVTKFramebufferObjectRenderer : public QObject, public QQuickFramebufferObject::Renderer, public ModelsRenderer, protected QOpenGLFunctions
 {
 	Q_OBJECT
 
 public:
+	// In the order of the picking modes of the QML
+	enum class PickingMode_t
+	{
+		IdBuffer,
+		Bvh,
+		CellPicker
+	};
+
 	QVTKFramebufferObjectRenderer();
 
 	void setProcessingEngine(const std::shared_ptr<ProcessingEngine> processingEngine);
@@ -40,7 +55,7 @@ public:
 	virtual void openGLInitState();
 	QOpenGLFramebufferObject *createFramebufferObject(const QSize &size);
 
-	void addModelActor(const std::shared_ptr<Model> model);
+	void addModelActor(const std::shared_ptr<Model> model) override;
 
 	std::shared_ptr<Model> getSelectedModel() const;
 	bool isModelSelected() const;
@@ -51,8 +66,16 @@ public:
 	double getSelectedModelPositionX() const;
 	double getSelectedModelPositionY() const;
 
+	uint32_t getCommandsMergedLastFrame() const;
+
+	void setPickingMode(const PickingMode_t pickingMode);
+	PickingMode_t getPickingMode() const;
+
 	void resetCamera();
-	const bool screenToWorld(const int16_t screenX, const int16_t screenY, double worldPos[]);
+	const bool screenToWorld(const int16_t screenX, const int16_t screenY, double worldPos[]) override;
+
+	void setPreviewActor(const uint64_t previewId, const vtkSmartPointer<vtkActor> previewActor) override;
+	void removePreviewActor(const uint64_t previewId) override;
 
 signals:
 	void isModelSelectedChanged();
@@ -62,10 +85,18 @@ signals:
 
 private:
 	void initScene();
+	// True if the render state changed
+	bool synchronizeModelsRenderState();
+	void processInputEvents();
+	void processMouseEvent(const InputEventRing::InputEvent_t &inputEvent);
+	// True if a model changed of level of detail
+	bool updateModelsLod();
 	void generatePlatform();
 	void updatePlatform();
 
-	void selectModel(const int16_t x, const int16_t y);
+	// True if the selected model changed
+	bool selectModel(const int16_t x, const int16_t y);
+	vtkActor *pickModelActor(const int16_t x, const int16_t y, double clickPosition[]);
 	void clearSelectedModel();
 	void setIsModelSelected(const bool isModelSelected);
 
@@ -78,8 +109,17 @@ private:
 	vtkSmartPointer<vtkRenderer> m_renderer;
 	vtkSmartPointer<vtkGenericRenderWindowInteractor> m_vtkRenderWindowInteractor;
 
+	// Clicks are resolved in the ID buffer, or for the exact hit cell against the models BVH. The cell picker
+	// remains as fallback.
+	PickingMode_t m_pickingMode = PickingMode_t::IdBuffer;
+	PickingBuffer m_pickingBuffer;
+	// Rebuilt in the first frame without changes, once the camera and the models stopped moving
+	bool m_pickingBufferOutdated = true;
 	vtkSmartPointer<vtkCellPicker> m_picker;
 
+	// Camera projection of the current frame
+	ScreenProjection m_screenProjection;
+
 	std::shared_ptr<Model> m_selectedModel = nullptr;
 	vtkSmartPointer<vtkActor> m_selectedActor = nullptr;
 	bool m_isModelSelected = false;
@@ -87,10 +127,10 @@ private:
 	double m_selectedModelPositionX = 0.0;
 	double m_selectedModelPositionY = 0.0;
 
-	std::shared_ptr<QMouseEvent> m_mouseLeftButton = nullptr;
-	std::shared_ptr<QMouseEvent> m_mouseEvent = nullptr;
-	std::shared_ptr<QMouseEvent> m_moveEvent = nullptr;
-	std::shared_ptr<QWheelEvent> m_wheelEvent = nullptr;
+	// Click to resolve after the camera events of the frame
+	bool m_selectionPending = false;
+	int16_t m_selectionX = 0;
+	int16_t m_selectionY = 0;
 
 	vtkSmartPointer<vtkCubeSource> m_platformModel;
 	vtkSmartPointer<vtkPolyData> m_platformGrid;
@@ -110,11 +150,29 @@ private:
 
 	double m_clickPositionZ = 0.0;
 
+	// Previews of the models being loaded
+	std::unordered_map<uint64_t, vtkSmartPointer<vtkActor>> m_previewActors;
+
 	bool m_firstRender = true;
 
+	uint32_t m_commandsMergedLastFrame = 0;
+
+	bool m_interacting = false;
+	int64_t m_lodTrianglesBudget = 0;
+
+	// State of the last levels of detail update, they are chosen again only when it changes
+	bool m_lodsApplied = false;
+	bool m_lodsInteracting = false;
+	int64_t m_lodsTrianglesBudget = 0;
+	std::weak_ptr<const ModelRegistry::Snapshot_t> m_lodsModels;
+	vtkMTimeType m_lodsCameraMTime = 0;
+
+	// Last render state applied to the models
+	bool m_modelsRenderStateApplied = false;
 	int m_modelsRepresentationOption = 0;
 	double m_modelsOpacity = 1.0;
 	bool m_modelsGouraudInterpolation = false;
+	QColor m_selectedModelColor;
 };
 
 #endif // QVTKFRAMEBUFFEROBJECTRENDERER_H
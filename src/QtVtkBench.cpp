@@ -0,0 +1,766 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <QColor>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QUrl>
+
+#include <vtkCamera.h>
+#include <vtkCellPicker.h>
+#include <vtkCommand.h>
+#include <vtkGenericRenderWindowInteractor.h>
+#include <vtkInteractorStyleTrackballCamera.h>
+#include <vtkMath.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkSmartPointer.h>
+
+#include "BinarySTLReader.h"
+#include "CommandGeometryNormals.h"
+#include "CommandModelTranslate.h"
+#include "FrameProfiler.h"
+#include "FrameScheduler.h"
+#include "Model.h"
+#include "ModelGeometry.h"
+#include "ModelsRenderer.h"
+#include "NormalsGenerator.h"
+#include "ProcessingEngine.h"
+#include "ScreenProjection.h"
+
+
+// Headless stand-in of QVTKFramebufferObjectRenderer: same screen to world path, in an offscreen window.
+// The window is rendered once before the picking is timed, so the picks see the same state as in the application.
+class BenchRenderer : public ModelsRenderer
+{
+public:
+	BenchRenderer(const int width, const int height)
+	{
+		m_renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
+		m_renderWindow->SetOffScreenRendering(1);
+		m_renderWindow->SetSize(width, height);
+
+		m_renderer = vtkSmartPointer<vtkRenderer>::New();
+		m_renderWindow->AddRenderer(m_renderer);
+
+		m_renderer->GetActiveCamera()->SetPosition(0.0, -400.0, 300.0);
+		m_renderer->GetActiveCamera()->SetFocalPoint(0.0, 0.0, 0.0);
+		m_renderer->GetActiveCamera()->SetViewUp(0.0, 0.0, 1.0);
+
+		// Same interaction as the application renderer, which renders itself
+		m_interactor = vtkSmartPointer<vtkGenericRenderWindowInteractor>::New();
+		m_interactor->EnableRenderOff();
+		m_renderWindow->SetInteractor(m_interactor);
+
+		vtkSmartPointer<vtkInteractorStyleTrackballCamera> style = vtkSmartPointer<vtkInteractorStyleTrackballCamera>::New();
+		style->SetDefaultRenderer(m_renderer);
+		style->SetMotionFactor(10.0);
+		m_interactor->SetInteractorStyle(style);
+
+		m_screenProjection.update(m_renderer);
+	}
+
+	void addModelActor(const std::shared_ptr<Model> model) override
+	{
+		m_renderer->AddActor(model->getModelActor());
+		m_renderer->ResetCameraClippingRange();
+
+		m_screenProjection.update(m_renderer);
+	}
+
+	const bool screenToWorld(const int16_t screenX, const int16_t screenY, double worldPos[]) override
+	{
+		return m_screenProjection.screenToWorld(screenX, screenY, 0.0, worldPos);
+	}
+
+	void setPreviewActor(const uint64_t previewId, const vtkSmartPointer<vtkActor> previewActor) override
+	{
+		this->removePreviewActor(previewId);
+
+		m_previewActors[previewId] = previewActor;
+		m_renderer->AddActor(previewActor);
+	}
+
+	void removePreviewActor(const uint64_t previewId) override
+	{
+		if (m_previewActors.count(previewId))
+		{
+			m_renderer->RemoveActor(m_previewActors[previewId]);
+			m_previewActors.erase(previewId);
+		}
+	}
+
+	void render()
+	{
+		m_renderWindow->Render();
+
+		m_screenProjection.update(m_renderer);
+	}
+
+	vtkRenderer *getRenderer() const
+	{
+		return m_renderer;
+	}
+
+	vtkRenderWindowInteractor *getInteractor() const
+	{
+		return m_interactor;
+	}
+
+	const ScreenProjection &getScreenProjection() const
+	{
+		return m_screenProjection;
+	}
+
+private:
+	vtkSmartPointer<vtkRenderWindow> m_renderWindow;
+	vtkSmartPointer<vtkRenderer> m_renderer;
+	vtkSmartPointer<vtkGenericRenderWindowInteractor> m_interactor;
+	ScreenProjection m_screenProjection;
+	std::map<uint64_t, vtkSmartPointer<vtkActor>> m_previewActors;
+};
+
+
+static const double PI = vtkMath::Pi();
+
+// Writes a binary STL triangle soup of a UV sphere with at least the given number of triangles
+static bool writeSphereSTL(const QString &filePath, const int64_t trianglesTarget, const double radius, int64_t &trianglesCount)
+{
+	const int64_t rings = std::max<int64_t>(2, static_cast<int64_t>(std::ceil(std::sqrt(trianglesTarget / 4.0))));
+	const int64_t segments = 2 * rings;
+
+	trianglesCount = 2 * rings * segments;
+
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	const int64_t headerSize = 80 + sizeof(uint32_t);
+	const int64_t triangleSize = 50;
+
+	if (!file.resize(headerSize + trianglesCount * triangleSize))
+	{
+		return false;
+	}
+
+	uchar *data = file.map(0, file.size());
+
+	if (!data)
+	{
+		return false;
+	}
+
+	std::memset(data, 0, 80);
+	const uint32_t trianglesCount32 = static_cast<uint32_t>(trianglesCount);
+	std::memcpy(data + 80, &trianglesCount32, sizeof(uint32_t));
+
+	auto vertex = [&](const int64_t ring, const int64_t segment, float *out)
+	{
+		const double theta = PI * ring / rings;
+		const double phi = 2.0 * PI * segment / segments;
+
+		out[0] = static_cast<float>(radius * std::sin(theta) * std::cos(phi));
+		out[1] = static_cast<float>(radius * std::sin(theta) * std::sin(phi));
+		out[2] = static_cast<float>(radius * std::cos(theta));
+	};
+
+	uchar *triangle = data + headerSize;
+
+	for (int64_t ring = 0; ring < rings; ++ring)
+	{
+		for (int64_t segment = 0; segment < segments; ++segment)
+		{
+			float corners[4][3];
+			vertex(ring, segment, corners[0]);
+			vertex(ring + 1, segment, corners[1]);
+			vertex(ring + 1, segment + 1, corners[2]);
+			vertex(ring, segment + 1, corners[3]);
+
+			const int quads[2][3] = {{0, 1, 2}, {0, 2, 3}};
+
+			for (const auto &quad : quads)
+			{
+				float facet[12] = {0.0f, 0.0f, 0.0f};
+
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					std::memcpy(&facet[3 + 3 * corner], corners[quad[corner]], 3 * sizeof(float));
+				}
+
+				std::memcpy(triangle, facet, sizeof(facet));
+				std::memset(triangle + sizeof(facet), 0, sizeof(uint16_t));
+				triangle += triangleSize;
+			}
+		}
+	}
+
+	file.unmap(data);
+	file.close();
+
+	return true;
+}
+
+static double elapsedMs(const QElapsedTimer &timer)
+{
+	return timer.nsecsElapsed() / 1.0e6;
+}
+
+// State shared by the timing sections of one mesh
+typedef struct
+{
+	std::shared_ptr<ProcessingEngine> processingEngine;
+	std::shared_ptr<Model> model;
+	std::vector<std::shared_ptr<Model>> instances;
+	BenchRenderer *benchRenderer;
+	int iterations;
+} BenchContext_t;
+
+// Read, welding and normals, on their own
+static bool benchPreprocessing(const QString &filePath, ProcessingEngine &processingEngine, QJsonObject &result)
+{
+	QElapsedTimer timer;
+
+	timer.start();
+	vtkSmartPointer<vtkPolyData> inputData = BinarySTLReader::read(filePath);
+	result["load_ms"] = elapsedMs(timer);
+
+	if (!inputData)
+	{
+		result["error"] = QString("Could not read %1").arg(filePath);
+		return false;
+	}
+
+	result["points_loaded"] = static_cast<double>(inputData->GetNumberOfPoints());
+
+	timer.start();
+	vtkSmartPointer<vtkPolyData> preprocessedData = processingEngine.preprocessPolydata(inputData);
+	result["preprocess_ms"] = elapsedMs(timer);
+	result["points_preprocessed"] = static_cast<double>(preprocessedData->GetNumberOfPoints());
+
+	// Point normals, computed when the Gouraud interpolation is enabled
+	timer.start();
+	NormalsGenerator::computePointNormals(preprocessedData);
+	result["normals_ms"] = elapsedMs(timer);
+
+	return true;
+}
+
+// Complete load through the engine, as the loader threads do, then the same file again from the mesh cache
+static std::shared_ptr<Model> benchAddModel(const QString &filePath, ProcessingEngine &processingEngine, QJsonObject &result)
+{
+	QElapsedTimer timer;
+
+	timer.start();
+	std::shared_ptr<Model> model = processingEngine.addModel(QUrl(filePath));
+	result["add_model_ms"] = elapsedMs(timer);
+
+	// Written by the loader pool once the model is displayed
+	timer.start();
+	processingEngine.storeGeometryInCache(model->getGeometry());
+	result["mesh_cache_store_ms"] = elapsedMs(timer);
+
+	timer.start();
+	std::shared_ptr<Model> cachedModel = processingEngine.addCachedModel(QUrl(filePath));
+	result["add_model_cached_ms"] = cachedModel ? elapsedMs(timer) : -1.0;
+	result["mesh_cache_bytes"] = static_cast<double>(processingEngine.getMeshCache().getSize());
+
+	// Never inserted in the registry, only its geometry is shared
+	return model;
+}
+
+// Through the same command the GUI pushes on every mouse move
+static void benchTranslate(BenchContext_t &context, QJsonObject &result)
+{
+	QElapsedTimer timer;
+
+	timer.start();
+	for (int i = 0; i < context.iterations; ++i)
+	{
+		CommandModelTranslate::TranslateParams_t translateParams;
+		translateParams.model = context.model;
+		translateParams.screenX = 640 + (i % 100);
+		translateParams.screenY = 360 + (i % 50);
+
+		std::unique_ptr<CommandModelTranslate> command(new CommandModelTranslate(context.benchRenderer, translateParams, true));
+		command->execute();
+	}
+	result["translate_us"] = 1000.0 * elapsedMs(timer) / context.iterations;
+}
+
+// One position at a time, then the coalesced drag positions
+static void benchScreenToWorld(BenchContext_t &context, QJsonObject &result)
+{
+	QElapsedTimer timer;
+	const int iterations = context.iterations;
+
+	double worldPos[3];
+	timer.start();
+	for (int i = 0; i < iterations; ++i)
+	{
+		context.benchRenderer->screenToWorld(320 + (i % 640), 180 + (i % 360), worldPos);
+	}
+	result["screen_to_world_us"] = 1000.0 * elapsedMs(timer) / iterations;
+
+	std::vector<int16_t> screenPositions(2 * iterations);
+	std::vector<double> worldPositions(3 * iterations);
+	for (int i = 0; i < iterations; ++i)
+	{
+		screenPositions[2 * i] = 320 + (i % 640);
+		screenPositions[2 * i + 1] = 180 + (i % 360);
+	}
+
+	timer.start();
+	context.benchRenderer->getScreenProjection().screenToWorld(screenPositions.data(), iterations, 0.0, worldPositions.data());
+	result["screen_to_world_batch_us"] = 1000.0 * elapsedMs(timer) / iterations;
+}
+
+// The model is back at the plate center and the picks aim at it
+static void benchPicking(BenchContext_t &context, QJsonObject &result)
+{
+	QElapsedTimer timer;
+	const std::shared_ptr<Model> &model = context.model;
+
+	context.processingEngine->placeModel(*model);
+
+	// Not timed: with --render the first render uploads the model, and in any case the screen projection follows the camera
+	context.benchRenderer->render();
+
+	vtkSmartPointer<vtkCellPicker> picker = vtkSmartPointer<vtkCellPicker>::New();
+	picker->SetTolerance(0.0);
+
+	const int pickIterations = std::max(1, context.iterations / 10);
+	int hits = 0;
+
+	timer.start();
+	for (int i = 0; i < pickIterations; ++i)
+	{
+		if (picker->Pick(620 + (i % 40), 340 + (i % 40), 0.0, context.benchRenderer->getRenderer()))
+		{
+			++hits;
+		}
+	}
+	result["pick_ms"] = elapsedMs(timer) / pickIterations;
+	result["pick_hits"] = hits;
+
+	// Through the model BVH, built on the loader pool by the application
+	timer.start();
+	model->getGeometry()->buildBVH();
+	result["bvh_build_ms"] = elapsedMs(timer);
+
+	double rayOrigin[3];
+	double rayDirection[3];
+	double hitT;
+	double hitPosition[3];
+	int bvhHits = 0;
+
+	timer.start();
+	for (int i = 0; i < context.iterations; ++i)
+	{
+		context.benchRenderer->getScreenProjection().computeRay(620 + (i % 40), 720 - (340 + (i % 40)), rayOrigin, rayDirection);
+
+		if (model->intersectRay(rayOrigin, rayDirection, hitT, hitPosition))
+		{
+			++bvhHits;
+		}
+	}
+	result["pick_bvh_us"] = 1000.0 * elapsedMs(timer) / context.iterations;
+	result["pick_bvh_hits"] = bvhHits;
+}
+
+// Render on demand, decided as the application renderer does: every event requests a frame, only the observed
+// changes render it. The idle updates and the clicks without drag are skipped, every drag move is rendered.
+static void benchFrameScheduler(BenchContext_t &context, QJsonObject &result)
+{
+	FrameScheduler frameScheduler;
+	frameScheduler.setMaximumFrameRate(0);
+
+	BenchRenderer *benchRenderer = context.benchRenderer;
+	vtkCamera *camera = benchRenderer->getRenderer()->GetActiveCamera();
+	vtkRenderWindowInteractor *interactor = benchRenderer->getInteractor();
+
+	const auto runFrame = [&frameScheduler, benchRenderer, camera](const uint32_t requestedReasons, const std::function<void()> &inputEvents)
+	{
+		frameScheduler.requestFrame(requestedReasons);
+		frameScheduler.takeDirtyReasons();
+
+		inputEvents();
+
+		camera->SetViewUp(0.0, 0.0, 1.0);
+		frameScheduler.checkCameraChange(camera->GetMTime());
+
+		const bool rendered = frameScheduler.getFrameChanges() != FrameScheduler::None;
+
+		if (rendered)
+		{
+			benchRenderer->render();
+		}
+
+		frameScheduler.frameDone(rendered, camera->GetMTime());
+	};
+
+	const auto mouseEvent = [interactor](const unsigned long event, const int x, const int y)
+	{
+		return [interactor, event, x, y]()
+		{
+			interactor->SetEventInformationFlipY(x, y, 0, 0);
+			interactor->InvokeEvent(event, nullptr);
+		};
+	};
+
+	const int framesCount = std::min(context.iterations, 100);
+
+	frameScheduler.addFrameChanges(FrameScheduler::All);
+	runFrame(FrameScheduler::All, []() {});
+
+	FrameScheduler::Stats_t frameStats = frameScheduler.getStats();
+
+	for (int i = 0; i < framesCount; ++i)
+	{
+		runFrame(FrameScheduler::Scene, []() {});
+	}
+	result["frames_idle_skipped"] = static_cast<double>(frameScheduler.getStats().skippedFramesCount - frameStats.skippedFramesCount) / framesCount;
+
+	frameStats = frameScheduler.getStats();
+
+	for (int i = 0; i < framesCount; ++i)
+	{
+		runFrame(FrameScheduler::Camera, mouseEvent(vtkCommand::LeftButtonPressEvent, 640, 360));
+		runFrame(FrameScheduler::Camera, mouseEvent(vtkCommand::LeftButtonReleaseEvent, 640, 360));
+	}
+	result["frames_click_skipped"] = static_cast<double>(frameScheduler.getStats().skippedFramesCount - frameStats.skippedFramesCount) / (2 * framesCount);
+
+	frameStats = frameScheduler.getStats();
+
+	runFrame(FrameScheduler::Camera, mouseEvent(vtkCommand::LeftButtonPressEvent, 640, 360));
+	for (int i = 0; i < framesCount; ++i)
+	{
+		runFrame(FrameScheduler::Camera, mouseEvent(vtkCommand::MouseMoveEvent, 640 + 2 * (i + 1), 360));
+	}
+	runFrame(FrameScheduler::Camera, mouseEvent(vtkCommand::LeftButtonReleaseEvent, 640 + 2 * framesCount, 360));
+	result["frames_drag_rendered"] = static_cast<double>(frameScheduler.getStats().renderedFramesCount - frameStats.renderedFramesCount) / framesCount;
+}
+
+// Per frame render state application
+static void benchRenderState(BenchContext_t &context, QJsonObject &result)
+{
+	QElapsedTimer timer;
+
+	timer.start();
+	for (int i = 0; i < context.iterations; ++i)
+	{
+		context.processingEngine->setModelsRepresentation(i % 3);
+		context.processingEngine->setModelsOpacity(0.5 + 0.5 * (i % 2));
+		context.processingEngine->setSelectedModelColor(QColor::fromHsv(i % 360, 255, 255));
+	}
+	result["state_apply_us"] = 1000.0 * elapsedMs(timer) / context.iterations;
+}
+
+// Gouraud interpolation: normals computed, released to the octahedral encoding, then decoded.
+// Prepared as in a loader thread, only the swap is left to the renderer thread.
+static void benchGouraudInterpolation(BenchContext_t &context, QJsonObject &result)
+{
+	QElapsedTimer timer;
+	const std::shared_ptr<ProcessingEngine> &processingEngine = context.processingEngine;
+	const std::shared_ptr<Model> &model = context.model;
+
+	double normalsSwapMs = 0.0;
+	const auto switchInterpolation = [&processingEngine, &model, &normalsSwapMs](const bool gouraudInterpolation)
+	{
+		processingEngine->setPointNormalsRequired(gouraudInterpolation);
+
+		if (processingEngine->isPointNormalsOutdated(model->getGeometry()))
+		{
+			CommandGeometryNormals command(processingEngine, model->getGeometry(), gouraudInterpolation ? CommandGeometryNormals::Compute : CommandGeometryNormals::Release);
+			command.run();
+
+			QElapsedTimer swapTimer;
+			swapTimer.start();
+			command.execute();
+			normalsSwapMs = std::max(normalsSwapMs, elapsedMs(swapTimer));
+		}
+
+		processingEngine->setModelsGouraudInterpolation(gouraudInterpolation);
+	};
+
+	timer.start();
+	switchInterpolation(true);
+	result["gouraud_first_enable_ms"] = elapsedMs(timer);
+
+	const ModelGeometry::MemoryReport_t gouraudMemoryReport = model->getGeometry()->getMemoryReport();
+
+	timer.start();
+	switchInterpolation(false);
+	result["gouraud_disable_ms"] = elapsedMs(timer);
+
+	timer.start();
+	switchInterpolation(true);
+	result["gouraud_enable_ms"] = elapsedMs(timer);
+
+	// Decoded: the octahedral normals are dropped, only the 16-bit drawn normals are resident
+	const ModelGeometry::MemoryReport_t decodedMemoryReport = model->getGeometry()->getMemoryReport();
+	result["model_decoded_normals_bytes"] = static_cast<double>(decodedMemoryReport.geometry.pointNormalsBytes + decodedMemoryReport.octahedralNormalsBytes);
+
+	switchInterpolation(false);
+	result["gouraud_swap_max_ms"] = normalsSwapMs;
+
+	// Resident bytes of the model, levels of detail excluded (not generated here)
+	const ModelGeometry::MemoryReport_t memoryReport = model->getGeometry()->getMemoryReport();
+	result["model_points_bytes"] = static_cast<double>(memoryReport.geometry.pointsBytes);
+	result["model_polys_bytes"] = static_cast<double>(memoryReport.geometry.polysBytes);
+	result["model_normals_bytes"] = static_cast<double>(gouraudMemoryReport.geometry.pointNormalsBytes);
+	result["model_octahedral_normals_bytes"] = static_cast<double>(memoryReport.octahedralNormalsBytes);
+	result["model_bvh_bytes"] = static_cast<double>(memoryReport.bvhBytes);
+	result["model_total_bytes"] = static_cast<double>(memoryReport.totalBytes);
+}
+
+// Instances sharing the geometry: the resident bytes do not depend on their count.
+// Then per-instance colors, as executed by CommandModelColor: the instances of the same color share their property.
+static void benchInstances(BenchContext_t &context, QJsonObject &result)
+{
+	static const int instancesCount = 50;
+	static const int colorsCount = 5;
+
+	QElapsedTimer timer;
+	const std::shared_ptr<ProcessingEngine> &processingEngine = context.processingEngine;
+	std::vector<std::shared_ptr<Model>> &instances = context.instances;
+
+	timer.start();
+	for (int i = 0; i < instancesCount; ++i)
+	{
+		instances.push_back(processingEngine->duplicateModel(instances.empty() ? context.model : instances.back()));
+		context.benchRenderer->addModelActor(instances.back());
+		processingEngine->insertModel(instances.back());
+	}
+	result["duplicate_us"] = 1000.0 * elapsedMs(timer) / instancesCount;
+	result["instances_total_bytes"] = static_cast<double>(context.model->getGeometry()->getMemoryReport().totalBytes);
+
+	timer.start();
+	for (int i = 0; i < instancesCount; ++i)
+	{
+		processingEngine->setModelColor(instances[i], QColor::fromHsv((i % colorsCount) * 360 / colorsCount, 255, 255));
+	}
+	result["color_us"] = 1000.0 * elapsedMs(timer) / instancesCount;
+
+	// Render state application with the color properties: one change per color, not per instance
+	timer.start();
+	for (int i = 0; i < context.iterations; ++i)
+	{
+		processingEngine->setModelsRepresentation(i % 3);
+		processingEngine->setModelsOpacity(0.5 + 0.5 * (i % 2));
+	}
+	result["state_apply_colored_us"] = 1000.0 * elapsedMs(timer) / context.iterations;
+}
+
+// Process-wide accounting, as polled by the memory overlay
+static void benchMemoryReport(BenchContext_t &context, QJsonObject &result)
+{
+	QElapsedTimer timer;
+	ProcessingEngine::MemoryReport_t processMemoryReport;
+
+	timer.start();
+	for (int i = 0; i < context.iterations; ++i)
+	{
+		processMemoryReport = context.processingEngine->getMemoryReport();
+	}
+	result["memory_report_us"] = 1000.0 * elapsedMs(timer) / context.iterations;
+	result["models_memory_bytes"] = static_cast<double>(processMemoryReport.models.totalBytes);
+	result["models_gpu_bytes"] = static_cast<double>(processMemoryReport.models.gpuBytes);
+	result["process_resident_bytes"] = static_cast<double>(processMemoryReport.processBytes);
+}
+
+// Residency round trip, as the residency commands do: evicted to a proxy, then restored from the mesh cache
+static void benchResidency(BenchContext_t &context, QJsonObject &result)
+{
+	QElapsedTimer timer;
+	const std::shared_ptr<ProcessingEngine> &processingEngine = context.processingEngine;
+	const std::shared_ptr<ModelGeometry> &geometry = context.model->getGeometry();
+
+	if (!geometry->changeResidency(ModelGeometry::Residency_t::Resident, ModelGeometry::Residency_t::Evicting))
+	{
+		return;
+	}
+
+	timer.start();
+	vtkSmartPointer<vtkPolyData> proxyData = processingEngine->prepareGeometryEviction(geometry);
+
+	if (proxyData)
+	{
+		processingEngine->setGeometryData(geometry, proxyData, false);
+	}
+	result["evict_ms"] = proxyData ? elapsedMs(timer) : -1.0;
+	result["evicted_total_bytes"] = static_cast<double>(geometry->getMemoryReport().totalBytes);
+
+	if (proxyData && geometry->changeResidency(ModelGeometry::Residency_t::Evicted, ModelGeometry::Residency_t::Restoring))
+	{
+		timer.start();
+		vtkSmartPointer<vtkPolyData> restoredData = processingEngine->loadEvictedGeometry(geometry);
+
+		if (restoredData)
+		{
+			processingEngine->setGeometryData(geometry, restoredData, true);
+		}
+		result["restore_ms"] = restoredData ? elapsedMs(timer) : -1.0;
+	}
+}
+
+static QJsonObject runBenchmark(const QString &filePath, const QString &meshCacheDirectory, const int64_t trianglesCount, const int iterations,
+								const bool renderEnabled)
+{
+	QJsonObject result;
+	result["triangles"] = static_cast<double>(trianglesCount);
+	result["file_bytes"] = static_cast<double>(QFile(filePath).size());
+
+	std::shared_ptr<ProcessingEngine> processingEngine = std::make_shared<ProcessingEngine>();
+	processingEngine->getMeshCache().setDirectory(meshCacheDirectory);
+
+	if (!benchPreprocessing(filePath, *processingEngine, result))
+	{
+		return result;
+	}
+
+	BenchRenderer benchRenderer(1280, 720, renderEnabled);
+
+	BenchContext_t context;
+	context.processingEngine = processingEngine;
+	context.model = benchAddModel(filePath, *processingEngine, result);
+	context.benchRenderer = &benchRenderer;
+	context.iterations = iterations;
+
+	processingEngine->placeModel(*context.model);
+	benchRenderer.addModelActor(context.model);
+	processingEngine->insertModel(context.model);
+
+	benchTranslate(context, result);
+	benchScreenToWorld(context, result);
+	benchPicking(context, result);
+	benchFrameScheduler(context, result);
+	benchRenderState(context, result);
+	benchGouraudInterpolation(context, result);
+	benchInstances(context, result);
+	benchMemoryReport(context, result);
+	benchResidency(context, result);
+
+	for (const std::shared_ptr<Model> &instance : context.instances)
+	{
+		processingEngine->removeModel(instance);
+	}
+
+	processingEngine->removeModel(context.model);
+
+	return result;
+}
+
+
+int main(int argc, char **argv)
+{
+#ifdef __linux
+	putenv((char *)"LC_NUMERIC=C");
+#endif //LINUX
+
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("qtvtk_bench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Times the QtVtk model pipeline against synthetic meshes, results as JSON");
+	parser.addHelpOption();
+
+	QCommandLineOption outputOption(QStringList() << "o" << "output", "Write the JSON results to <file> instead of stdout.", "file");
+	QCommandLineOption maxTrianglesOption("max-triangles", "Largest synthetic mesh, in triangles (default 10000000).", "count", "10000000");
+	QCommandLineOption iterationsOption("iterations", "Iterations of the per-frame measurements (default 1000).", "count", "1000");
+	QCommandLineOption traceOption("trace", "Write the Chrome trace of the loader stages to <file> (builds with QTVTK_FRAME_PROFILER).", "file");
+	QCommandLineOption renderOption("render", "Render the offscreen window (needs a display and OpenGL with VTK 8).");
+	parser.addOption(outputOption);
+	parser.addOption(maxTrianglesOption);
+	parser.addOption(iterationsOption);
+	parser.addOption(traceOption);
+	parser.addOption(renderOption);
+	parser.process(app);
+
+	const int64_t maxTriangles = parser.value(maxTrianglesOption).toLongLong();
+	const int iterations = std::max(1, parser.value(iterationsOption).toInt());
+	const bool renderEnabled = parser.isSet(renderOption);
+
+	QTemporaryDir temporaryDir;
+
+	if (!temporaryDir.isValid())
+	{
+		qCritical() << "qtvtk_bench: could not create a temporary directory";
+		return 1;
+	}
+
+	QJsonArray results;
+
+	for (int64_t trianglesTarget = 10000; trianglesTarget <= maxTriangles; trianglesTarget *= 10)
+	{
+		const QString filePath = temporaryDir.filePath(QString("sphere_%1.stl").arg(trianglesTarget));
+		int64_t trianglesCount = 0;
+
+		if (!writeSphereSTL(filePath, trianglesTarget, 50.0, trianglesCount))
+		{
+			qCritical() << "qtvtk_bench: could not write" << filePath;
+			return 1;
+		}
+
+		qDebug() << "qtvtk_bench:" << trianglesCount << "triangles";
+
+		results.append(runBenchmark(filePath, temporaryDir.filePath("mesh_cache"), trianglesCount, iterations, renderEnabled));
+
+		QFile::remove(filePath);
+	}
+
+	QJsonObject report;
+	report["benchmark"] = QString("qtvtk_bench");
+	report["threads"] = QThread::idealThreadCount();
+	report["iterations"] = iterations;
+	report["render"] = renderEnabled;
+	report["results"] = results;
+
+	const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+	if (parser.isSet(outputOption))
+	{
+		QFile outputFile(parser.value(outputOption));
+
+		if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		{
+			qCritical() << "qtvtk_bench: could not write" << outputFile.fileName();
+			return 1;
+		}
+
+		outputFile.write(json);
+	}
+	else
+	{
+		QFile standardOutput;
+		standardOutput.open(stdout, QIODevice::WriteOnly);
+		standardOutput.write(json);
+	}
+
+	if (parser.isSet(traceOption))
+	{
+#ifdef QTVTK_FRAME_PROFILER
+		FRAME_PROFILER_WRITE_TRACE(parser.value(traceOption));
+#else
+		qWarning() << "qtvtk_bench: frame profiler not built, no trace written";
+#endif
+	}
+
+	return 0;
+}
@@ -0,0 +1,587 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdList.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkProperty.h>
+#include <vtkShortArray.h>
+#include <vtkSmartPointer.h>
+
+#include "CommandModelTranslate.h"
+#include "CommandQueue.h"
+#include "FixedBlockPool.h"
+#include "GeometryCompactor.h"
+#include "InputEventRing.h"
+#include "MeshCache.h"
+#include "Model.h"
+#include "OBJParallelReader.h"
+#include "VertexWelder.h"
+
+
+// Headless checks of the core classes, one CTest test per function: qtvtk_tests <name>, or every test without argument
+
+static int failuresCount = 0;
+
+#define QTVTK_CHECK(condition) checkCondition((condition), #condition, __FILE__, __LINE__)
+
+static bool checkCondition(const bool condition, const char *expression, const char *file, const int line)
+{
+	if (!condition)
+	{
+		qCritical().nospace() << file << ":" << line << ": check failed: " << expression;
+		++failuresCount;
+	}
+
+	return condition;
+}
+
+
+// Triangle soup, three points per triangle
+static vtkSmartPointer<vtkPolyData> createTriangleSoup(const std::vector<float> &coordinates)
+{
+	const vtkIdType pointsCount = static_cast<vtkIdType>(coordinates.size() / 3);
+
+	vtkSmartPointer<vtkFloatArray> pointsData = vtkSmartPointer<vtkFloatArray>::New();
+	pointsData->SetNumberOfComponents(3);
+	pointsData->SetNumberOfTuples(pointsCount);
+	std::memcpy(pointsData->GetPointer(0), coordinates.data(), coordinates.size() * sizeof(float));
+
+	vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+	points->SetData(pointsData);
+
+	vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+
+	for (vtkIdType i = 0; i + 2 < pointsCount; i += 3)
+	{
+		const vtkIdType triangle[3] = {i, i + 1, i + 2};
+		polys->InsertNextCell(3, triangle);
+	}
+
+	vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+	polyData->SetPoints(points);
+	polyData->SetPolys(polys);
+
+	return polyData;
+}
+
+static vtkSmartPointer<vtkProperty> createProperty()
+{
+	return vtkSmartPointer<vtkProperty>::New();
+}
+
+
+static void testCommandQueueMerging()
+{
+	const std::vector<float> triangle = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+	std::shared_ptr<Model> modelA = std::make_shared<Model>(createTriangleSoup(triangle), createProperty(), createProperty());
+	std::shared_ptr<Model> modelB = std::make_shared<Model>(createTriangleSoup(triangle), createProperty(), createProperty());
+
+	const auto createTranslate = [](const std::shared_ptr<Model> &model, const bool inTransition)
+	{
+		CommandModelTranslate::TranslateParams_t translateParams;
+		translateParams.model = model;
+
+		return new CommandModelTranslate(nullptr, translateParams, inTransition);
+	};
+
+	CommandQueue commandsQueue(16);
+
+	// Only the consecutive in-transition moves of the same model merge, into the latest one
+	CommandModel *lastMoveA = nullptr;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		lastMoveA = createTranslate(modelA, true);
+		commandsQueue.push(lastMoveA);
+	}
+
+	commandsQueue.push(createTranslate(modelB, true));
+	commandsQueue.push(createTranslate(modelA, false));
+
+	std::unique_ptr<CommandModel> command = commandsQueue.popReady();
+	QTVTK_CHECK(command.get() == lastMoveA);
+	QTVTK_CHECK(commandsQueue.takeMergedCount() == 2);
+
+	command = commandsQueue.popReady();
+	const CommandModelTranslate *moveB = dynamic_cast<const CommandModelTranslate*>(command.get());
+	QTVTK_CHECK(moveB && moveB->getModel() == modelB && moveB->isInTransition());
+
+	command = commandsQueue.popReady();
+	const CommandModelTranslate *releaseA = dynamic_cast<const CommandModelTranslate*>(command.get());
+	QTVTK_CHECK(releaseA && releaseA->getModel() == modelA && !releaseA->isInTransition());
+
+	QTVTK_CHECK(!commandsQueue.popReady());
+	QTVTK_CHECK(commandsQueue.isEmpty());
+
+	// A full ring spills into the overflow list, nothing is lost nor reordered
+	CommandQueue smallQueue(2);
+	std::vector<CommandModel*> pushedCommands;
+
+	for (int i = 0; i < 6; ++i)
+	{
+		pushedCommands.push_back(createTranslate(i % 2 ? modelA : modelB, false));
+		smallQueue.push(pushedCommands.back());
+	}
+
+	QTVTK_CHECK(smallQueue.getStats().overflowed > 0);
+
+	for (CommandModel *pushedCommand : pushedCommands)
+	{
+		command = smallQueue.popReady();
+		QTVTK_CHECK(command.get() == pushedCommand);
+	}
+
+	QTVTK_CHECK(!smallQueue.popReady());
+}
+
+static void testFixedBlockPool()
+{
+	FixedBlockPool<32, 4> pool;
+	std::vector<void*> blocks;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		blocks.push_back(pool.allocate());
+		QTVTK_CHECK(pool.owns(blocks.back()));
+	}
+
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		for (size_t j = i + 1; j < blocks.size(); ++j)
+		{
+			QTVTK_CHECK(blocks[i] != blocks[j]);
+		}
+	}
+
+	// Exhausted: from the global heap
+	void *heapBlock = pool.allocate();
+	QTVTK_CHECK(heapBlock != nullptr && !pool.owns(heapBlock));
+	pool.release(heapBlock);
+
+	// A released block is the next one allocated
+	pool.release(blocks[2]);
+	QTVTK_CHECK(pool.allocate() == blocks[2]);
+
+	for (void *block : blocks)
+	{
+		pool.release(block);
+	}
+}
+
+static void testInputEventRing()
+{
+	const auto createEvent = [](const InputEventRing::Type_t type, const int32_t x, const int32_t delta)
+	{
+		InputEventRing::InputEvent_t inputEvent;
+		std::memset(&inputEvent, 0, sizeof(inputEvent));
+		inputEvent.type = type;
+		inputEvent.x = x;
+		inputEvent.delta = delta;
+
+		return inputEvent;
+	};
+
+	InputEventRing inputEvents(4);
+	InputEventRing::InputEvent_t inputEvent;
+
+	// In order, while there is room
+	inputEvents.push(createEvent(InputEventRing::Type_t::MousePress, 1, 0));
+	inputEvents.push(createEvent(InputEventRing::Type_t::MouseMove, 2, 0));
+	inputEvents.push(createEvent(InputEventRing::Type_t::MouseRelease, 3, 0));
+
+	for (int32_t x = 1; x <= 3; ++x)
+	{
+		QTVTK_CHECK(inputEvents.pop(inputEvent) && inputEvent.x == x);
+	}
+
+	QTVTK_CHECK(!inputEvents.pop(inputEvent));
+
+	// Full ring: the moves and the wheel ticks are merged, the presses and releases are deferred in order
+	for (int32_t x = 0; x < 4; ++x)
+	{
+		inputEvents.push(createEvent(InputEventRing::Type_t::MouseMove, x, 0));
+	}
+
+	inputEvents.push(createEvent(InputEventRing::Type_t::MousePress, 10, 0));
+	inputEvents.push(createEvent(InputEventRing::Type_t::MouseMove, 11, 0));
+	inputEvents.push(createEvent(InputEventRing::Type_t::MouseMove, 12, 0));
+	inputEvents.push(createEvent(InputEventRing::Type_t::Wheel, 13, 120));
+	inputEvents.push(createEvent(InputEventRing::Type_t::Wheel, 13, 240));
+	inputEvents.push(createEvent(InputEventRing::Type_t::MouseRelease, 14, 0));
+
+	QTVTK_CHECK(inputEvents.hasDeferredEvents());
+	QTVTK_CHECK(inputEvents.getStats().merged == 2);
+
+	std::vector<InputEventRing::InputEvent_t> poppedEvents;
+
+	// The renderer drains the ring, the deferred events move in as it makes room
+	for (;;)
+	{
+		if (!inputEvents.pop(inputEvent))
+		{
+			if (!inputEvents.hasDeferredEvents())
+			{
+				break;
+			}
+
+			inputEvents.flushDeferred();
+			continue;
+		}
+
+		poppedEvents.push_back(inputEvent);
+		inputEvents.flushDeferred();
+	}
+
+	QTVTK_CHECK(poppedEvents.size() == 8);
+
+	if (poppedEvents.size() == 8)
+	{
+		for (int32_t x = 0; x < 4; ++x)
+		{
+			QTVTK_CHECK(poppedEvents[x].type == InputEventRing::Type_t::MouseMove && poppedEvents[x].x == x);
+		}
+
+		QTVTK_CHECK(poppedEvents[4].type == InputEventRing::Type_t::MousePress);
+		QTVTK_CHECK(poppedEvents[5].type == InputEventRing::Type_t::MouseMove && poppedEvents[5].x == 12);
+		QTVTK_CHECK(poppedEvents[6].type == InputEventRing::Type_t::Wheel && poppedEvents[6].delta == 360);
+		QTVTK_CHECK(poppedEvents[7].type == InputEventRing::Type_t::MouseRelease);
+	}
+
+	const InputEventRing::Stats_t stats = inputEvents.getStats();
+	QTVTK_CHECK(stats.pushed == 13 && stats.popped == 11);
+}
+
+static void testOBJParallelReader()
+{
+	QTemporaryDir temporaryDir;
+	QTVTK_CHECK(temporaryDir.isValid());
+
+	const QString filePath = temporaryDir.filePath("quad.obj");
+	QFile file(filePath);
+
+	if (!QTVTK_CHECK(file.open(QIODevice::WriteOnly)))
+	{
+		return;
+	}
+
+	file.write("# Unit quad, two triangles\n"
+			   "v 0 0 0\n"
+			   "v 1 0 0\n"
+			   "v 0 1 0\n"
+			   "v 1 1 0.5\n"
+			   "vn 0 0 1\n"
+			   "vn 0 0 1\n"
+			   "vn 0 0 1\n"
+			   "vn 0 0 1\n"
+			   "f 1//1 2//2 3//3\n"
+			   "f -3//-3 -1//-1 -2//-2\n");
+	file.close();
+
+	vtkSmartPointer<vtkPolyData> polyData = OBJParallelReader::read(filePath);
+
+	if (!QTVTK_CHECK(polyData))
+	{
+		return;
+	}
+
+	QTVTK_CHECK(polyData->GetNumberOfPoints() == 4);
+	QTVTK_CHECK(polyData->GetNumberOfPolys() == 2);
+
+	double point[3];
+	polyData->GetPoint(3, point);
+	QTVTK_CHECK(point[0] == 1.0 && point[1] == 1.0 && point[2] == 0.5);
+
+	// The relative indices resolve to the last three vertices
+	vtkSmartPointer<vtkIdList> pointIds = vtkSmartPointer<vtkIdList>::New();
+	polyData->GetPolys()->InitTraversal();
+	polyData->GetPolys()->GetNextCell(pointIds);
+	polyData->GetPolys()->GetNextCell(pointIds);
+	QTVTK_CHECK(pointIds->GetNumberOfIds() == 3 && pointIds->GetId(0) == 1 && pointIds->GetId(1) == 3 && pointIds->GetId(2) == 2);
+
+	vtkDataArray *normals = polyData->GetPointData()->GetNormals();
+	QTVTK_CHECK(normals && normals->GetNumberOfTuples() == 4);
+
+	// Preview samples parse the vertex lines only, the same vertex is not sampled twice
+	vtkSmartPointer<vtkPolyData> sampleData = OBJParallelReader::readSample(filePath, 1);
+	QTVTK_CHECK(sampleData && sampleData->GetNumberOfPoints() == 1 && sampleData->GetNumberOfVerts() == 1);
+
+	sampleData = OBJParallelReader::readSample(filePath, 64);
+	QTVTK_CHECK(sampleData && sampleData->GetNumberOfPoints() >= 2 && sampleData->GetNumberOfPoints() <= 4);
+
+	// Also the vertex lines of ASCII STL files
+	const QString stlFilePath = temporaryDir.filePath("triangle.stl");
+	QFile stlFile(stlFilePath);
+
+	if (!QTVTK_CHECK(stlFile.open(QIODevice::WriteOnly)))
+	{
+		return;
+	}
+
+	stlFile.write("solid triangle\n"
+				  " facet normal 0 0 1\n"
+				  "  outer loop\n"
+				  "   vertex 2 0 0\n"
+				  "   vertex 3 0 0\n"
+				  "   vertex 2 1 0\n"
+				  "  endloop\n"
+				  " endfacet\n"
+				  "endsolid triangle\n");
+	stlFile.close();
+
+	sampleData = OBJParallelReader::readSample(stlFilePath, 1, "vertex");
+
+	if (QTVTK_CHECK(sampleData && sampleData->GetNumberOfPoints() == 1))
+	{
+		sampleData->GetPoint(0, point);
+		QTVTK_CHECK(point[0] == 2.0 && point[1] == 0.0 && point[2] == 0.0);
+	}
+
+	QTVTK_CHECK(!OBJParallelReader::readSample(stlFilePath, 1));
+}
+
+static void testVertexWelder()
+{
+	// Two triangles sharing an edge, two others sharing points on both sides of a grid cell boundary,
+	// and a triangle thinner than the tolerance
+	vtkSmartPointer<vtkPolyData> polyData = createTriangleSoup({
+		0, 0, 0,  1, 0, 0,  0, 1, 0,
+		1, 0, 0,  0, 1, 0,  1, 1, 0,
+		0.99999f, 5, 0,  2, 5, 0,  2, 6, 0,
+		1.00001f, 5, 0,  2, 6, 0,  1, 6, 0,
+		3, 3, 3,  3.0002f, 3, 3,  4, 4, 4
+	});
+
+	// Point data follows the welded points
+	vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+	normals->SetNumberOfComponents(3);
+	normals->SetNumberOfTuples(polyData->GetNumberOfPoints());
+	for (vtkIdType i = 0; i < polyData->GetNumberOfPoints(); ++i)
+	{
+		normals->SetTuple3(i, 0.0, 0.0, 1.0);
+	}
+	polyData->GetPointData()->SetNormals(normals);
+
+	const VertexWelder::WeldStats_t stats = VertexWelder::weld(polyData, 1.0e-3);
+
+	QTVTK_CHECK(stats.pointsBefore == 15);
+	QTVTK_CHECK(stats.pointsAfter == 10);
+	QTVTK_CHECK(polyData->GetNumberOfPoints() == 10);
+	QTVTK_CHECK(stats.collapsedPolysRemoved == 1);
+	QTVTK_CHECK(polyData->GetNumberOfPolys() == 4);
+	QTVTK_CHECK(polyData->GetPointData()->GetNormals() && polyData->GetPointData()->GetNormals()->GetNumberOfTuples() == 10);
+
+	// Non-finite points are left as they are
+	vtkSmartPointer<vtkPolyData> nanPolyData = createTriangleSoup({NAN, 0, 0,  1, 0, 0,  0, 1, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0});
+	const VertexWelder::WeldStats_t nanStats = VertexWelder::weld(nanPolyData, 1.0e-3);
+	QTVTK_CHECK(nanStats.pointsAfter == 4);
+}
+
+static void testOctahedralNormals()
+{
+	const std::vector<float> expectedNormals = {
+		0, 0, 1,  0, 0, -1,  1, 0, 0,  0, -1, 0,
+		0.577350f, 0.577350f, 0.577350f,  -0.267261f, 0.534522f, -0.801784f,  0.6f, -0.8f, 0
+	};
+
+	vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+	normals->SetNumberOfComponents(3);
+	normals->SetNumberOfTuples(expectedNormals.size() / 3);
+	std::memcpy(normals->GetPointer(0), expectedNormals.data(), expectedNormals.size() * sizeof(float));
+
+	vtkSmartPointer<vtkShortArray> octNormals = GeometryCompactor::encodeNormals(normals);
+
+	if (!QTVTK_CHECK(octNormals && octNormals->GetNumberOfComponents() == 2))
+	{
+		return;
+	}
+
+	vtkSmartPointer<vtkFloatArray> decodedNormals = GeometryCompactor::decodeNormals(octNormals);
+	QTVTK_CHECK(decodedNormals->GetNumberOfTuples() == normals->GetNumberOfTuples());
+
+	for (vtkIdType i = 0; i < decodedNormals->GetNumberOfTuples(); ++i)
+	{
+		double expected[3];
+		double decoded[3];
+		normals->GetTuple(i, expected);
+		decodedNormals->GetTuple(i, decoded);
+
+		const double dot = expected[0] * decoded[0] + expected[1] * decoded[1] + expected[2] * decoded[2];
+		QTVTK_CHECK(dot > 0.9999);
+	}
+
+	// Zero normals of degenerate faces decode to zero, not to +Z
+	const float zeroNormal[3] = {0, 0, 0};
+	normals->SetNumberOfTuples(1);
+	normals->SetTypedTuple(0, zeroNormal);
+
+	decodedNormals = GeometryCompactor::decodeNormals(GeometryCompactor::encodeNormals(normals));
+
+	double decoded[3];
+	decodedNormals->GetTuple(0, decoded);
+	QTVTK_CHECK(decoded[0] == 0.0 && decoded[1] == 0.0 && decoded[2] == 0.0);
+
+	// Drawn normals: same directions, zero stays zero
+	const float normal[3] = {0.6f, -0.8f, 0};
+	normals->SetNumberOfTuples(2);
+	normals->SetTypedTuple(0, normal);
+	normals->SetTypedTuple(1, zeroNormal);
+
+	vtkSmartPointer<vtkShortArray> quantizedNormals = GeometryCompactor::quantizeNormals(normals);
+
+	if (QTVTK_CHECK(quantizedNormals->GetNumberOfComponents() == 3 && quantizedNormals->GetNumberOfTuples() == 2))
+	{
+		QTVTK_CHECK(quantizedNormals->GetValue(0) == 19660 && quantizedNormals->GetValue(1) == -26214 && quantizedNormals->GetValue(2) == 0);
+		QTVTK_CHECK(quantizedNormals->GetValue(3) == 0 && quantizedNormals->GetValue(4) == 0 && quantizedNormals->GetValue(5) == 0);
+	}
+}
+
+static void testMeshCache()
+{
+	QTemporaryDir temporaryDir;
+	QTVTK_CHECK(temporaryDir.isValid());
+
+	MeshCache meshCache;
+	meshCache.setDirectory(temporaryDir.path());
+
+	vtkSmartPointer<vtkPolyData> polyData = createTriangleSoup({0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 0, 0,  1, 1, 0,  0, 1, 0});
+
+	QTVTK_CHECK(!meshCache.load("missing"));
+	QTVTK_CHECK(meshCache.store("mesh", polyData));
+	QTVTK_CHECK(meshCache.contains("mesh"));
+	QTVTK_CHECK(meshCache.getSize() > 0);
+
+	vtkSmartPointer<vtkPolyData> loadedData = meshCache.load("mesh");
+
+	if (!QTVTK_CHECK(loadedData))
+	{
+		return;
+	}
+
+	QTVTK_CHECK(loadedData->GetNumberOfPoints() == polyData->GetNumberOfPoints());
+	QTVTK_CHECK(loadedData->GetNumberOfPolys() == polyData->GetNumberOfPolys());
+
+	for (vtkIdType i = 0; i < polyData->GetNumberOfPoints(); ++i)
+	{
+		double point[3];
+		double loadedPoint[3];
+		polyData->GetPoint(i, point);
+		loadedData->GetPoint(i, loadedPoint);
+		QTVTK_CHECK(point[0] == loadedPoint[0] && point[1] == loadedPoint[1] && point[2] == loadedPoint[2]);
+	}
+
+	QFile entryFile;
+
+	for (const QString &entryName : QDir(temporaryDir.path()).entryList(QDir::Files))
+	{
+		if (entryName.endsWith(".mesh"))
+		{
+			entryFile.setFileName(QDir(temporaryDir.path()).filePath(entryName));
+		}
+	}
+
+	if (!QTVTK_CHECK(entryFile.exists()) || !entryFile.open(QIODevice::ReadWrite))
+	{
+		return;
+	}
+
+	const QByteArray entry = entryFile.readAll();
+
+	// Header fields: pointsOffset at 48, connectivityOffset at 56
+	uint64_t connectivityOffset;
+	std::memcpy(&connectivityOffset, entry.constData() + 56, sizeof(uint64_t));
+
+	const auto loadCorrupted = [&](const qint64 position, const void *value, const size_t size)
+	{
+		QByteArray corruptedEntry = entry;
+		std::memcpy(corruptedEntry.data() + position, value, size);
+
+		entryFile.seek(0);
+		entryFile.write(corruptedEntry);
+		entryFile.flush();
+
+		return meshCache.load("mesh");
+	};
+
+	// A point id past the points is rejected
+	const int64_t pointId = 1000;
+	QTVTK_CHECK(!loadCorrupted(static_cast<qint64>(connectivityOffset + sizeof(int64_t)), &pointId, sizeof(int64_t)));
+
+	// So is an offset wrapping around past the end of the file
+	const uint64_t pointsOffset = UINT64_MAX - 7;
+	QTVTK_CHECK(!loadCorrupted(48, &pointsOffset, sizeof(uint64_t)));
+
+	// Intact again
+	QTVTK_CHECK(loadCorrupted(0, entry.constData(), 0));
+
+	// A truncated entry is rejected, never read past its end
+	{
+		entryFile.resize(entryFile.size() / 2);
+		entryFile.close();
+
+		QTVTK_CHECK(!meshCache.load("mesh"));
+	}
+
+	meshCache.clear();
+	QTVTK_CHECK(!meshCache.contains("mesh"));
+}
+
+
+int main(int argc, char **argv)
+{
+#ifdef __linux
+	putenv((char *)"LC_NUMERIC=C");
+#endif //LINUX
+
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("qtvtk_tests");
+
+	const std::vector<std::pair<QString, std::function<void()>>> tests = {
+		{"command_queue_merging", testCommandQueueMerging},
+		{"fixed_block_pool", testFixedBlockPool},
+		{"input_event_ring", testInputEventRing},
+		{"obj_parallel_reader", testOBJParallelReader},
+		{"vertex_welder", testVertexWelder},
+		{"octahedral_normals", testOctahedralNormals},
+		{"mesh_cache", testMeshCache}
+	};
+
+	const QStringList testsNames = app.arguments().mid(1);
+	int testsRun = 0;
+
+	for (const std::pair<QString, std::function<void()>> &test : tests)
+	{
+		if (!testsNames.isEmpty() && !testsNames.contains(test.first))
+		{
+			continue;
+		}
+
+		const int failuresBefore = failuresCount;
+		test.second();
+		++testsRun;
+
+		qInfo().noquote() << (failuresCount == failuresBefore ? "PASS" : "FAIL") << test.first;
+	}
+
+	if (testsRun == 0)
+	{
+		qCritical() << "qtvtk_tests: no test named" << testsNames;
+		return 1;
+	}
+
+	return (failuresCount == 0) ? 0 : 1;
+}
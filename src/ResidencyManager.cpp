@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include <QDebug>
+
+#include "CommandGeometryResidency.h"
+#include "CommandQueue.h"
+#include "Model.h"
+#include "ModelGeometry.h"
+#include "ProcessingEngine.h"
+#include "ResidencyManager.h"
+
+
+static const int64_t BUDGET_CHECK_INTERVAL = 5000;
+
+ResidencyManager::ResidencyManager(std::shared_ptr<ProcessingEngine> processingEngine, CommandQueue *commandsQueue, QThreadPool *loaderPool)
+	: m_processingEngine{processingEngine}
+	, m_commandsQueue{commandsQueue}
+	, m_loaderPool{loaderPool}
+{
+	m_residencyPool.setMaxThreadCount(1);
+}
+
+ResidencyManager::~ResidencyManager()
+{
+	m_residencyPool.waitForDone();
+}
+
+
+void ResidencyManager::setEnabled(const bool enabled)
+{
+	m_enabled = enabled;
+}
+
+bool ResidencyManager::isEnabled() const
+{
+	return m_enabled;
+}
+
+void ResidencyManager::setIdleTime(const int64_t idleTime)
+{
+	m_idleTime = idleTime;
+}
+
+int64_t ResidencyManager::getIdleTime() const
+{
+	return m_idleTime;
+}
+
+void ResidencyManager::setPlateBounds(const double plateBounds[4])
+{
+	std::lock_guard<std::mutex> lock(m_plateBoundsMutex);
+	std::copy(plateBounds, plateBounds + 4, m_plateBounds);
+}
+
+
+void ResidencyManager::enforceBudget(const ProcessingEngine::MemoryReport_t &memoryReport)
+{
+	if (!m_enabled || (m_budgetCheckTimer.isValid() && m_budgetCheckTimer.elapsed() < BUDGET_CHECK_INTERVAL))
+	{
+		return;
+	}
+
+	m_budgetCheckTimer.start();
+
+	int64_t excessBytes = std::max(memoryReport.processBytes, memoryReport.models.totalBytes) - memoryReport.budgetBytes;
+
+	if (excessBytes <= 0)
+	{
+		return;
+	}
+
+	typedef struct
+	{
+		std::shared_ptr<ModelGeometry> geometry;
+		bool offPlate;
+		int64_t lastAccessTime;
+		int64_t evictableBytes;
+	} Candidate_t;
+
+	// A geometry is off the plate if all its instances are
+	std::vector<Candidate_t> candidates;
+	std::unordered_map<const ModelGeometry*, size_t> candidatesIndices;
+
+	const std::shared_ptr<const ModelRegistry::Snapshot_t> models = m_processingEngine->getModels();
+
+	for (const std::shared_ptr<Model> &model : *models)
+	{
+		const std::shared_ptr<ModelGeometry> &geometry = model->getGeometry();
+		const bool offPlate = this->isModelOffPlate(model);
+
+		auto candidateIndex = candidatesIndices.find(geometry.get());
+
+		if (candidateIndex == candidatesIndices.end())
+		{
+			// Loaded after the report, nothing to evict yet
+			auto evictableBytes = memoryReport.geometriesEvictableBytes.find(geometry.get());
+
+			if (evictableBytes == memoryReport.geometriesEvictableBytes.end())
+			{
+				continue;
+			}
+
+			candidatesIndices[geometry.get()] = candidates.size();
+			candidates.push_back({geometry, offPlate, geometry->getLastAccessTime(), evictableBytes->second});
+		}
+		else
+		{
+			candidates[candidateIndex->second].offPlate &= offPlate;
+		}
+	}
+
+	const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	const int64_t idleTime = m_idleTime;
+
+	candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [now, idleTime](const Candidate_t &candidate)
+	{
+		return !candidate.geometry->isResident() || candidate.geometry->getKey().isEmpty()
+			   || (!candidate.offPlate && now - candidate.lastAccessTime < idleTime);
+	}), candidates.end());
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate_t &a, const Candidate_t &b)
+	{
+		return a.offPlate != b.offPlate ? a.offPlate : a.lastAccessTime < b.lastAccessTime;
+	});
+
+	int evictionsCount = 0;
+
+	for (const Candidate_t &candidate : candidates)
+	{
+		if (excessBytes <= 0)
+		{
+			break;
+		}
+
+		if (!candidate.geometry->changeResidency(ModelGeometry::Residency_t::Resident, ModelGeometry::Residency_t::Evicting))
+		{
+			continue;
+		}
+
+		excessBytes -= candidate.evictableBytes;
+
+		this->startCommand(new CommandGeometryResidency(m_processingEngine, candidate.geometry, CommandGeometryResidency::Evict, nullptr), 0);
+		++evictionsCount;
+	}
+
+	qDebug() << "ResidencyManager::enforceBudget():" << memoryReport.budgetBytes << "bytes budget exceeded, evicting" << evictionsCount
+			 << "of" << candidates.size() << "candidate geometries";
+}
+
+void ResidencyManager::requestRestore(const std::shared_ptr<ModelGeometry> &geometry)
+{
+	if (!geometry->changeResidency(ModelGeometry::Residency_t::Evicted, ModelGeometry::Residency_t::Restoring))
+	{
+		return;
+	}
+
+	// Ahead of the pending evictions, a model is waiting for it
+	this->startCommand(new CommandGeometryResidency(m_processingEngine, geometry, CommandGeometryResidency::Restore, m_loaderPool), 1);
+}
+
+
+void ResidencyManager::startCommand(CommandGeometryResidency *command, const int priority)
+{
+	// Queued connection: the command is pushed from the GUI thread once it is prepared
+	connect(command, &CommandGeometryResidency::ready, this, [this, command]()
+	{
+		if (!command->isPrepared())
+		{
+			delete command;
+			return;
+		}
+
+		m_commandsQueue->push(command);
+
+		emit commandReady();
+	});
+
+	// Emitted from the renderer thread
+	connect(command, &CommandGeometryResidency::normalsOutdated, this, &ResidencyManager::geometryNormalsOutdated, Qt::QueuedConnection);
+
+	m_residencyPool.start(command, priority);
+}
+
+bool ResidencyManager::isModelOffPlate(const std::shared_ptr<Model> &model) const
+{
+	double bounds[6];
+	model->getGeometry()->getBounds(bounds);
+
+	// The model matrix centers the mesh on its position
+	const double halfWidth = (bounds[1] - bounds[0]) / 2.0;
+	const double halfDepth = (bounds[3] - bounds[2]) / 2.0;
+	const double positionX = model->getPositionX();
+	const double positionY = model->getPositionY();
+
+	std::lock_guard<std::mutex> lock(m_plateBoundsMutex);
+
+	return positionX + halfWidth < m_plateBounds[0] || positionX - halfWidth > m_plateBounds[1]
+		   || positionY + halfDepth < m_plateBounds[2] || positionY - halfDepth > m_plateBounds[3];
+}
@@ -0,0 +1,76 @@
+#ifndef RESIDENCYMANAGER_H
+#define RESIDENCYMANAGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QThreadPool>
+
+#include "ProcessingEngine.h"
+
+
+class CommandGeometryResidency;
+class CommandQueue;
+class Model;
+class ModelGeometry;
+
+// Keeps the models within the memory budget of the ProcessingEngine. Over budget, the full mesh of the
+// geometries off the plate or not used for a while is evicted to the mesh cache, off-plate and least
+// recently used first: their instances draw a coarse proxy meanwhile, with the same bounds.
+// An evicted geometry is restored in the background once one of its instances is selected.
+class ResidencyManager : public QObject
+{
+	Q_OBJECT
+
+public:
+	// The picking index and the levels of detail of the restored geometries are built in the loader threads
+	ResidencyManager(std::shared_ptr<ProcessingEngine> processingEngine, CommandQueue *commandsQueue, QThreadPool *loaderPool);
+	~ResidencyManager();
+
+	void setEnabled(const bool enabled);
+	bool isEnabled() const;
+
+	// Milliseconds without selection, move nor duplication before a geometry on the plate can be evicted
+	void setIdleTime(const int64_t idleTime);
+	int64_t getIdleTime() const;
+
+	// World XY rectangle of the plate: xMin, xMax, yMin, yMax
+	void setPlateBounds(const double plateBounds[4]);
+
+	// Starts the evictions needed to fit in the budget, from the memory report polled for the overlay.
+	// GUI thread, at most once per check interval: the evictions started in between are not in the report yet.
+	void enforceBudget(const ProcessingEngine::MemoryReport_t &memoryReport);
+
+	// Any thread, does nothing if the geometry is resident or already being restored
+	void requestRestore(const std::shared_ptr<ModelGeometry> &geometry);
+
+signals:
+	// A command was pushed to the commands queue
+	void commandReady();
+	// A mesh was swapped after the interpolation changed, its point normals must be updated
+	void geometryNormalsOutdated();
+
+private:
+	void startCommand(CommandGeometryResidency *command, const int priority);
+	bool isModelOffPlate(const std::shared_ptr<Model> &model) const;
+
+	std::shared_ptr<ProcessingEngine> m_processingEngine;
+	CommandQueue *m_commandsQueue;
+	QThreadPool *m_loaderPool;
+	QElapsedTimer m_budgetCheckTimer;
+
+	// One thread: the evictions and restorations are disk bound, and must not delay the loads
+	QThreadPool m_residencyPool;
+
+	std::atomic<bool> m_enabled{true};
+	std::atomic<int64_t> m_idleTime{120000};
+
+	double m_plateBounds[4] = {-100.0, 100.0, -100.0, 100.0};
+	mutable std::mutex m_plateBoundsMutex;
+};
+
+#endif // RESIDENCYMANAGER_H
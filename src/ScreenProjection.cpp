@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cmath>
+
+#include <vtkCamera.h>
+#include <vtkMatrix4x4.h>
+
+#include "ScreenProjection.h"
+
+
+// Plate bounds of the projected positions
+static const double BOUND_MIN_X = -1000.0;
+static const double BOUND_MAX_X = 1000.0;
+static const double BOUND_MIN_Y = -1000.0;
+static const double BOUND_MAX_Y = 1000.0;
+
+ScreenProjection::ScreenProjection()
+{
+	vtkMatrix4x4::Identity(m_deviceToWorld);
+}
+
+void ScreenProjection::update(vtkRenderer *renderer)
+{
+	m_width = renderer->GetSize()[0];
+	m_height = renderer->GetSize()[1];
+
+	// Same matrix as vtkRenderer::DisplayToWorld(), without the per-call copy and inversion
+	vtkMatrix4x4 *worldToDevice = renderer->GetActiveCamera()->GetCompositeProjectionTransformMatrix(renderer->GetTiledAspectRatio(), -1.0, 1.0);
+	vtkMatrix4x4::Invert(*worldToDevice->Element, m_deviceToWorld);
+}
+
+bool ScreenProjection::screenToWorld(const int16_t screenX, const int16_t screenY, const double planeZ, double worldPos[]) const
+{
+	double origin[3];
+	double direction[3];
+
+	this->computeRay(screenX, screenY, origin, direction);
+
+	return this->projectOnPlane(origin, direction, planeZ, worldPos);
+}
+
+size_t ScreenProjection::screenToWorld(const int16_t *screenPositions, const size_t count, const double planeZ, double *worldPositions, bool *withinBounds) const
+{
+	size_t withinBoundsCount = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const bool positionWithinBounds = this->screenToWorld(screenPositions[2 * i], screenPositions[2 * i + 1], planeZ, worldPositions + 3 * i);
+
+		if (withinBounds)
+		{
+			withinBounds[i] = positionWithinBounds;
+		}
+
+		withinBoundsCount += positionWithinBounds ? 1 : 0;
+	}
+
+	return withinBoundsCount;
+}
+
+void ScreenProjection::computeRay(const int16_t screenX, const int16_t screenY, double origin[3], double direction[3]) const
+{
+	// Compensate the y-axis flip
+	const double deviceX = m_width > 0 ? 2.0 * screenX / m_width - 1.0 : 0.0;
+	const double deviceY = m_height > 0 ? 2.0 * (m_height - screenY) / m_height - 1.0 : 0.0;
+
+	const double nearDevicePoint[4] = {deviceX, deviceY, -1.0, 1.0};
+	const double farDevicePoint[4] = {deviceX, deviceY, 1.0, 1.0};
+
+	double nearPoint[4];
+	double farPoint[4];
+	vtkMatrix4x4::MultiplyPoint(m_deviceToWorld, nearDevicePoint, nearPoint);
+	vtkMatrix4x4::MultiplyPoint(m_deviceToWorld, farDevicePoint, farPoint);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		origin[i] = nearPoint[i] / nearPoint[3];
+		direction[i] = farPoint[i] / farPoint[3] - origin[i];
+	}
+}
+
+bool ScreenProjection::projectOnPlane(const double origin[3], const double direction[3], const double planeZ, double worldPos[]) const
+{
+	// Ray parallel to the plane
+	if (std::abs(direction[2]) < 1.0e-12)
+	{
+		return false;
+	}
+
+	const double t = (planeZ - origin[2]) / direction[2];
+
+	worldPos[0] = origin[0] + t * direction[0];
+	worldPos[1] = origin[1] + t * direction[1];
+	worldPos[2] = planeZ;
+
+	return worldPos[0] >= BOUND_MIN_X && worldPos[0] <= BOUND_MAX_X && worldPos[1] >= BOUND_MIN_Y && worldPos[1] <= BOUND_MAX_Y;
+}
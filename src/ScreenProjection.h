@@ -0,0 +1,40 @@
+#ifndef SCREENPROJECTION_H
+#define SCREENPROJECTION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vtkRenderer.h>
+
+
+// Screen to world conversions of the canvas, independent of the Qt Quick renderer.
+// The inverse view-projection matrix is cached by update(), once per frame after the camera moved,
+// the conversions are then analytic and do not allocate.
+class ScreenProjection
+{
+public:
+	ScreenProjection();
+
+	void update(vtkRenderer *renderer);
+
+	// Projects the screen position (Qt coordinates, Y axis downwards) on the horizontal plane Z = planeZ.
+	// Returns false if the position falls outside the plate bounds or the view is parallel to the plane.
+	bool screenToWorld(const int16_t screenX, const int16_t screenY, const double planeZ, double worldPos[]) const;
+
+	// Batch version for count (x, y) screen positions, worldPositions receives count (x, y, z) positions.
+	// Returns the number of positions within bounds, withinBounds optionally receives every result.
+	size_t screenToWorld(const int16_t *screenPositions, const size_t count, const double planeZ, double *worldPositions, bool *withinBounds = nullptr) const;
+
+	// World space ray through the screen position, from the near to the far clipping plane (direction not normalized)
+	void computeRay(const int16_t screenX, const int16_t screenY, double origin[3], double direction[3]) const;
+
+private:
+	bool projectOnPlane(const double origin[3], const double direction[3], const double planeZ, double worldPos[]) const;
+
+	// Normalized device to world coordinates
+	double m_deviceToWorld[16];
+	int m_width = 0;
+	int m_height = 0;
+};
+
+#endif // SCREENPROJECTION_H
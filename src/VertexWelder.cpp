@@ -0,0 +1,564 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <QDebug>
+
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+
+#include "LegacyCells.h"
+#include "Parallel.h"
+#include "VertexWelder.h"
+
+
+typedef struct
+{
+	int64_t x;
+	int64_t y;
+	int64_t z;
+} GridCell_t;
+
+// Far enough from the int64_t limits for the neighbouring cells too
+static const double MAXIMUM_GRID_CELL = 4.0e18;
+
+// False for the non-finite points and the points too far for the grid, they are not welded
+template <typename T>
+static inline bool getGridCell(const T *point, const double inverseEpsilon, GridCell_t &cell)
+{
+	const double x = std::floor(point[0] * inverseEpsilon);
+	const double y = std::floor(point[1] * inverseEpsilon);
+	const double z = std::floor(point[2] * inverseEpsilon);
+
+	// Also false for NaN
+	if (!(std::fabs(x) < MAXIMUM_GRID_CELL && std::fabs(y) < MAXIMUM_GRID_CELL && std::fabs(z) < MAXIMUM_GRID_CELL))
+	{
+		return false;
+	}
+
+	cell.x = static_cast<int64_t>(x);
+	cell.y = static_cast<int64_t>(y);
+	cell.z = static_cast<int64_t>(z);
+	return true;
+}
+
+static inline bool isSameGridCell(const GridCell_t &a, const GridCell_t &b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static inline uint64_t hashGridCell(const GridCell_t &cell)
+{
+	uint64_t hash = static_cast<uint64_t>(cell.x) * 73856093ULL ^ static_cast<uint64_t>(cell.y) * 19349663ULL ^ static_cast<uint64_t>(cell.z) * 83492791ULL;
+
+	// Final mix (MurmurHash3)
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+// Lowest index point of the grid cell, -1 if the cell is empty
+template <typename T>
+static inline int64_t findCellLeader(const std::atomic<int64_t> *table, const uint64_t tableMask, const T *coordinates, const double inverseEpsilon,
+									 const GridCell_t &cell)
+{
+	uint64_t slot = hashGridCell(cell) & tableMask;
+
+	for (;;)
+	{
+		const int64_t slotPoint = table[slot].load(std::memory_order_relaxed);
+
+		if (slotPoint < 0)
+		{
+			return -1;
+		}
+
+		// Only the points of the grid are in the table
+		GridCell_t slotCell;
+		getGridCell(coordinates + 3 * slotPoint, inverseEpsilon, slotCell);
+
+		if (isSameGridCell(slotCell, cell))
+		{
+			return slotPoint;
+		}
+
+		slot = (slot + 1) & tableMask;
+	}
+}
+
+
+VertexWelder::WeldStats_t VertexWelder::weld(const vtkSmartPointer<vtkPolyData> polyData, const double epsilon)
+{
+	WeldStats_t stats;
+
+	vtkPoints *points = polyData->GetPoints();
+
+	if (!points || epsilon <= 0.0)
+	{
+		return stats;
+	}
+
+	const int64_t pointsCount = points->GetNumberOfPoints();
+	const int dataType = points->GetDataType();
+
+	stats.pointsBefore = pointsCount;
+	stats.pointsAfter = pointsCount;
+	stats.bytesBefore = static_cast<int64_t>(polyData->GetActualMemorySize()) * 1024;
+	stats.bytesAfter = stats.bytesBefore;
+
+	if (pointsCount == 0 || (dataType != VTK_FLOAT && dataType != VTK_DOUBLE))
+	{
+		return stats;
+	}
+
+	// Representative of every point: the leader of its grid cell, or a lower index leader closer than epsilon
+	std::unique_ptr<int64_t[]> representatives(new int64_t[pointsCount]);
+	int64_t uniquePointsCount;
+
+	if (dataType == VTK_FLOAT)
+	{
+		uniquePointsCount = computeRepresentatives(static_cast<vtkFloatArray*>(points->GetData())->GetPointer(0), pointsCount, epsilon, representatives.get());
+	}
+	else
+	{
+		uniquePointsCount = computeRepresentatives(static_cast<vtkDoubleArray*>(points->GetData())->GetPointer(0), pointsCount, epsilon, representatives.get());
+	}
+
+	if (uniquePointsCount == pointsCount)
+	{
+		// Already indexed, nothing to weld
+		return stats;
+	}
+
+	// New indices of the representatives: per range counts then prefix sum
+	const size_t rangesCount = Parallel::getRangesCount(pointsCount);
+	std::vector<int64_t> rangesOffsets(rangesCount + 1, 0);
+
+	Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t rangeIndex)
+	{
+		int64_t rangeUniquePointsCount = 0;
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			rangeUniquePointsCount += (representatives[i] == static_cast<int64_t>(i)) ? 1 : 0;
+		}
+		rangesOffsets[rangeIndex + 1] = rangeUniquePointsCount;
+	});
+
+	for (size_t i = 0; i < rangesCount; ++i)
+	{
+		rangesOffsets[i + 1] += rangesOffsets[i];
+	}
+
+	std::unique_ptr<int64_t[]> newIndices(new int64_t[pointsCount]);
+
+	vtkSmartPointer<vtkFloatArray> weldedPointsData = vtkSmartPointer<vtkFloatArray>::New();
+	weldedPointsData->SetNumberOfComponents(3);
+	weldedPointsData->SetNumberOfTuples(uniquePointsCount);
+	float *weldedPointsPointer = weldedPointsData->GetPointer(0);
+
+	vtkDataArray *pointsData = points->GetData();
+	const float *floatPointsPointer = (dataType == VTK_FLOAT) ? static_cast<vtkFloatArray*>(pointsData)->GetPointer(0) : nullptr;
+	const double *doublePointsPointer = (dataType == VTK_DOUBLE) ? static_cast<vtkDoubleArray*>(pointsData)->GetPointer(0) : nullptr;
+
+	Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t rangeIndex)
+	{
+		int64_t newIndex = rangesOffsets[rangeIndex];
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			if (representatives[i] == static_cast<int64_t>(i))
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					weldedPointsPointer[3 * newIndex + c] = floatPointsPointer ? floatPointsPointer[3 * i + c] : static_cast<float>(doublePointsPointer[3 * i + c]);
+				}
+				newIndices[i] = newIndex++;
+			}
+		}
+	});
+
+	Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			if (representatives[i] != static_cast<int64_t>(i))
+			{
+				newIndices[i] = newIndices[representatives[i]];
+			}
+		}
+	});
+
+	// Point attributes (the OBJ normals) of the representatives, in their new order
+	vtkPointData *pointData = polyData->GetPointData();
+
+	if (pointData->GetNumberOfArrays() > 0)
+	{
+		vtkSmartPointer<vtkPointData> weldedPointData = vtkSmartPointer<vtkPointData>::New();
+		weldedPointData->CopyAllocate(pointData, uniquePointsCount);
+
+		for (int64_t i = 0; i < pointsCount; ++i)
+		{
+			if (representatives[i] == i)
+			{
+				weldedPointData->CopyData(pointData, i, newIndices[i]);
+			}
+		}
+
+		pointData->ShallowCopy(weldedPointData);
+	}
+
+	representatives.reset();
+
+	// Remap the connectivity in place, every cell array indexes the same points
+	remapCellArray(polyData->GetVerts(), newIndices.get());
+	remapCellArray(polyData->GetLines(), newIndices.get());
+	remapCellArray(polyData->GetPolys(), newIndices.get());
+	remapCellArray(polyData->GetStrips(), newIndices.get());
+
+	vtkSmartPointer<vtkPoints> weldedPoints = vtkSmartPointer<vtkPoints>::New();
+	weldedPoints->SetData(weldedPointsData);
+	polyData->SetPoints(weldedPoints);
+
+	// Polygons thinner than the tolerance now reference the same point more than once
+	stats.collapsedPolysRemoved = removeCollapsedPolys(polyData);
+	polyData->Modified();
+
+	stats.pointsAfter = uniquePointsCount;
+	stats.bytesAfter = static_cast<int64_t>(polyData->GetActualMemorySize()) * 1024;
+
+	return stats;
+}
+
+void VertexWelder::remapCellArray(vtkCellArray *cells, const int64_t *newIndices)
+{
+	if (!cells || cells->GetNumberOfCells() == 0)
+	{
+		return;
+	}
+
+	LegacyCells legacyCells(cells);
+	vtkIdType *connectivity = legacyCells.getData();
+	const int64_t cellsCount = legacyCells.getCellsCount();
+	const int64_t connectivitySize = legacyCells.getSize();
+
+	// Triangles only, the cell layout is known and the cells can be remapped in parallel
+	const bool trianglesOnly = legacyCells.isTrianglesOnly();
+
+	if (trianglesOnly)
+	{
+		Parallel::forEachRange(cellsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+		{
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+			{
+				vtkIdType *cell = connectivity + 4 * i;
+				cell[1] = newIndices[cell[1]];
+				cell[2] = newIndices[cell[2]];
+				cell[3] = newIndices[cell[3]];
+			}
+		});
+	}
+	else
+	{
+		for (int64_t i = 0; i < connectivitySize; i += connectivity[i] + 1)
+		{
+			for (vtkIdType j = 1; j <= connectivity[i]; ++j)
+			{
+				connectivity[i + j] = newIndices[connectivity[i + j]];
+			}
+		}
+	}
+
+	legacyCells.commit();
+}
+
+int64_t VertexWelder::removeCollapsedPolys(vtkPolyData *polyData)
+{
+	vtkCellArray *polys = polyData->GetPolys();
+
+	if (!polys || polys->GetNumberOfCells() == 0)
+	{
+		return 0;
+	}
+
+	const LegacyCells legacyPolys(polys);
+	const vtkIdType *connectivity = legacyPolys.getData();
+	const int64_t cellsCount = legacyPolys.getCellsCount();
+	const int64_t connectivitySize = legacyPolys.getSize();
+	const bool trianglesOnly = legacyPolys.isTrianglesOnly();
+
+	// Kept polygons: at least three distinct points
+	std::unique_ptr<uint8_t[]> keptCells(new uint8_t[cellsCount]);
+	int64_t keptCellsCount = 0;
+
+	const size_t rangesCount = Parallel::getRangesCount(cellsCount);
+	std::vector<int64_t> rangesOffsets(rangesCount + 1, 0);
+
+	if (trianglesOnly)
+	{
+		Parallel::forEachRange(cellsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t rangeIndex)
+		{
+			int64_t rangeKeptCellsCount = 0;
+
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+			{
+				const vtkIdType *cell = connectivity + 4 * i;
+				keptCells[i] = (cell[1] != cell[2] && cell[2] != cell[3] && cell[1] != cell[3]) ? 1 : 0;
+				rangeKeptCellsCount += keptCells[i];
+			}
+
+			rangesOffsets[rangeIndex + 1] = rangeKeptCellsCount;
+		});
+
+		for (size_t i = 0; i < rangesCount; ++i)
+		{
+			rangesOffsets[i + 1] += rangesOffsets[i];
+		}
+
+		keptCellsCount = rangesOffsets[rangesCount];
+	}
+	else
+	{
+		int64_t cellIndex = 0;
+
+		for (int64_t i = 0; i < connectivitySize; i += connectivity[i] + 1, ++cellIndex)
+		{
+			const vtkIdType *cellPoints = connectivity + i + 1;
+			vtkIdType distinctPointsCount = 0;
+
+			for (vtkIdType j = 0; j < connectivity[i] && distinctPointsCount < 3; ++j)
+			{
+				distinctPointsCount += (std::find(cellPoints, cellPoints + j, cellPoints[j]) == cellPoints + j) ? 1 : 0;
+			}
+
+			keptCells[cellIndex] = (distinctPointsCount >= 3) ? 1 : 0;
+			keptCellsCount += keptCells[cellIndex];
+		}
+	}
+
+	if (keptCellsCount == cellsCount)
+	{
+		return 0;
+	}
+
+	vtkSmartPointer<vtkIdTypeArray> keptConnectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+
+	if (trianglesOnly)
+	{
+		keptConnectivity->SetNumberOfValues(4 * keptCellsCount);
+		vtkIdType *keptConnectivityPointer = keptConnectivity->GetPointer(0);
+
+		Parallel::forEachRange(cellsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t rangeIndex)
+		{
+			vtkIdType *keptCell = keptConnectivityPointer + 4 * rangesOffsets[rangeIndex];
+
+			for (size_t i = rangeBegin; i < rangeEnd; ++i)
+			{
+				if (keptCells[i])
+				{
+					std::copy(connectivity + 4 * i, connectivity + 4 * i + 4, keptCell);
+					keptCell += 4;
+				}
+			}
+		});
+	}
+	else
+	{
+		keptConnectivity->SetNumberOfValues(connectivitySize);
+		vtkIdType *keptConnectivityPointer = keptConnectivity->GetPointer(0);
+		int64_t keptConnectivitySize = 0;
+		int64_t cellIndex = 0;
+
+		for (int64_t i = 0; i < connectivitySize; i += connectivity[i] + 1, ++cellIndex)
+		{
+			if (keptCells[cellIndex])
+			{
+				std::copy(connectivity + i, connectivity + i + connectivity[i] + 1, keptConnectivityPointer + keptConnectivitySize);
+				keptConnectivitySize += connectivity[i] + 1;
+			}
+		}
+
+		keptConnectivity->SetNumberOfValues(keptConnectivitySize);
+		keptConnectivity->Squeeze();
+	}
+
+	// The cell data follows the cells: vertices, lines, polygons then strips
+	vtkCellData *cellData = polyData->GetCellData();
+
+	if (cellData->GetNumberOfArrays() > 0)
+	{
+		const vtkIdType cellsTotal = polyData->GetNumberOfCells();
+		const vtkIdType polysOffset = polyData->GetNumberOfVerts() + polyData->GetNumberOfLines();
+
+		vtkSmartPointer<vtkCellData> keptCellData = vtkSmartPointer<vtkCellData>::New();
+		keptCellData->CopyAllocate(cellData, cellsTotal - (cellsCount - keptCellsCount));
+
+		vtkIdType keptCellId = 0;
+
+		for (vtkIdType cellId = 0; cellId < cellsTotal; ++cellId)
+		{
+			if (cellId < polysOffset || cellId >= polysOffset + cellsCount || keptCells[cellId - polysOffset])
+			{
+				keptCellData->CopyData(cellData, cellId, keptCellId++);
+			}
+		}
+
+		cellData->ShallowCopy(keptCellData);
+	}
+
+	LegacyCells::setCells(polys, keptCellsCount, keptConnectivity);
+
+	// Cell links built before no longer match
+	polyData->DeleteCells();
+
+	return cellsCount - keptCellsCount;
+}
+
+template <typename T>
+int64_t VertexWelder::computeRepresentatives(const T *coordinates, const int64_t pointsCount, const double epsilon, int64_t *representatives)
+{
+	const double inverseEpsilon = 1.0 / epsilon;
+
+	// Open addressing table with a load factor below 0.5, each slot holds the index of a representative point
+	uint64_t tableSize = 2;
+	while (tableSize < 2 * static_cast<uint64_t>(pointsCount))
+	{
+		tableSize <<= 1;
+	}
+	const uint64_t tableMask = tableSize - 1;
+
+	std::unique_ptr<std::atomic<int64_t>[]> table(new std::atomic<int64_t>[tableSize]);
+
+	Parallel::forEachRange(tableSize, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			table[i].store(-1, std::memory_order_relaxed);
+		}
+	});
+
+	// Insert one point per grid cell, the slot then keeps the lowest index of the cell whatever the threads order,
+	// so that the same mesh always welds to the same points
+	Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			GridCell_t cell;
+
+			if (!getGridCell(coordinates + 3 * i, inverseEpsilon, cell))
+			{
+				continue;
+			}
+
+			uint64_t slot = hashGridCell(cell) & tableMask;
+
+			for (;;)
+			{
+				int64_t slotPoint = table[slot].load(std::memory_order_acquire);
+
+				if (slotPoint < 0)
+				{
+					if (table[slot].compare_exchange_strong(slotPoint, static_cast<int64_t>(i), std::memory_order_acq_rel))
+					{
+						break;
+					}
+					// Another thread took the slot, slotPoint now holds its point
+				}
+
+				GridCell_t slotCell;
+				getGridCell(coordinates + 3 * slotPoint, inverseEpsilon, slotCell);
+
+				if (isSameGridCell(slotCell, cell))
+				{
+					while (static_cast<int64_t>(i) < slotPoint
+						   && !table[slot].compare_exchange_weak(slotPoint, static_cast<int64_t>(i), std::memory_order_acq_rel))
+					{
+					}
+					break;
+				}
+
+				slot = (slot + 1) & tableMask;
+			}
+		}
+	});
+
+	// The table is final. Every point follows the leader of its cell, and every leader the lowest index leader
+	// of the neighbouring cells closer than epsilon: the coincident points split by a cell boundary weld too.
+	const double squaredEpsilon = epsilon * epsilon;
+
+	Parallel::forEachRange(pointsCount, [&](const size_t rangeBegin, const size_t rangeEnd, const size_t)
+	{
+		for (size_t i = rangeBegin; i < rangeEnd; ++i)
+		{
+			GridCell_t cell;
+
+			if (!getGridCell(coordinates + 3 * i, inverseEpsilon, cell))
+			{
+				representatives[i] = static_cast<int64_t>(i);
+				continue;
+			}
+
+			int64_t representative = findCellLeader(table.get(), tableMask, coordinates, inverseEpsilon, cell);
+
+			if (representative == static_cast<int64_t>(i))
+			{
+				const T *point = coordinates + 3 * i;
+
+				for (int64_t dx = -1; dx <= 1; ++dx)
+				{
+					for (int64_t dy = -1; dy <= 1; ++dy)
+					{
+						for (int64_t dz = -1; dz <= 1; ++dz)
+						{
+							const GridCell_t neighbourCell = {cell.x + dx, cell.y + dy, cell.z + dz};
+							const int64_t neighbourLeader = (dx || dy || dz) ? findCellLeader(table.get(), tableMask, coordinates, inverseEpsilon, neighbourCell) : -1;
+
+							if (neighbourLeader < 0 || neighbourLeader >= representative)
+							{
+								continue;
+							}
+
+							const T *neighbourPoint = coordinates + 3 * neighbourLeader;
+							const double squaredDistance = (static_cast<double>(point[0]) - neighbourPoint[0]) * (static_cast<double>(point[0]) - neighbourPoint[0])
+														   + (static_cast<double>(point[1]) - neighbourPoint[1]) * (static_cast<double>(point[1]) - neighbourPoint[1])
+														   + (static_cast<double>(point[2]) - neighbourPoint[2]) * (static_cast<double>(point[2]) - neighbourPoint[2]);
+
+							if (squaredDistance <= squaredEpsilon)
+							{
+								representative = neighbourLeader;
+							}
+						}
+					}
+				}
+			}
+
+			representatives[i] = representative;
+		}
+	});
+
+	// Every representative has a lower index: in index order, each one is final when its followers read it
+	int64_t uniquePointsCount = 0;
+
+	for (int64_t i = 0; i < pointsCount; ++i)
+	{
+		if (representatives[i] == i)
+		{
+			++uniquePointsCount;
+		}
+		else
+		{
+			representatives[i] = representatives[representatives[i]];
+		}
+	}
+
+	return uniquePointsCount;
+}
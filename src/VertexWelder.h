@@ -0,0 +1,39 @@
+#ifndef VERTEXWELDER_H
+#define VERTEXWELDER_H
+
+#include <cstdint>
+
+#include <vtkCellArray.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+
+// Merges the coincident vertices of triangle soups (STL) into indexed geometry.
+// Points are snapped to a grid of cells of size epsilon and inserted concurrently into a lock-free
+// spatial hash, the lowest index point of a cell leads it. The leaders closer than epsilon across
+// neighbouring cells are merged too, so coincident points on both sides of a cell boundary weld.
+// The polydata is modified in place: compacted points, point data of the kept points, remapped connectivity
+// of every cell array, and no polygon collapsed by the welding. Non-finite points are left unwelded.
+class VertexWelder
+{
+public:
+	typedef struct
+	{
+		int64_t pointsBefore{0};
+		int64_t pointsAfter{0};
+		int64_t bytesBefore{0};
+		int64_t bytesAfter{0};
+		int64_t collapsedPolysRemoved{0};
+	} WeldStats_t;
+
+	static WeldStats_t weld(const vtkSmartPointer<vtkPolyData> polyData, const double epsilon);
+
+private:
+	static void remapCellArray(vtkCellArray *cells, const int64_t *newIndices);
+	static int64_t removeCollapsedPolys(vtkPolyData *polyData);
+
+	template <typename T>
+	static int64_t computeRepresentatives(const T *coordinates, const int64_t pointsCount, const double epsilon, int64_t *representatives);
+};
+
+#endif // VERTEXWELDER_H